@@ -1,27 +1,23 @@
 -- read input stream line by line
 
 local uv = require "lluv"
-local ut = require "lluv.utils"
 
 local host, port = "127.0.0.1", 5555
 
-local buffer = ut.Buffer.new("\r\n")
-
-local function read_data(cli, err, data)
-  if err then return cli:close() end
-
-  buffer:append(data)
-  while true do
-    local line = buffer:next_line()
-    if not line then break end
-    print(line)
+local function read_line(cli, err, line)
+  if err then
+    -- `line` contains data after last line terminator
+    if line then print(line) end
+    return cli:close()
   end
+
+  print(line)
 end
 
 uv.tcp():connect(host, port, function(cli, err)
   if err then return cli:close() end
 
-  cli:start_read(read_data)
+  cli:start_read_framed({mode = "line"}, read_line)
 end)
 
 uv.run(debug.traceback)
@@ -13,9 +13,11 @@
 #include "lluv_timer.h"
 #include "lluv_error.h"
 #include "lluv_idle.h"
+#include "lluv_async.h"
 #include "lluv_loop.h"
 #include "lluv_fs.h"
 #include "lluv_fbuf.h"
+#include "lluv_sockaddr.h"
 #include "lluv_handle.h"
 #include "lluv_stream.h"
 #include "lluv_tcp.h"
@@ -31,6 +33,10 @@
 #include "lluv_process.h"
 #include "lluv_misc.h"
 #include "lluv_dns.h"
+#include "lluv_worker.h"
+#include "lluv_work.h"
+#include "lluv_vmpool.h"
+#include "lluv_appender.h"
 
 #define LLUV_COPYRIGHT     "Copyright (C) 2014-2019 Alexey Melnichuk"
 #define LLUV_MODULE_NAME   "lluv"
@@ -95,7 +101,9 @@ static int luaopen_lluv_impl(lua_State *L, int safe){
   LLUV_PUSH_UPVALUES(L); lluv_stream_initlib   (L, NUPVALUES, safe);
   LLUV_PUSH_UPVALUES(L); lluv_timer_initlib    (L, NUPVALUES, safe);
   LLUV_PUSH_UPVALUES(L); lluv_fbuf_initlib     (L, NUPVALUES, safe);
+  LLUV_PUSH_UPVALUES(L); lluv_sockaddr_initlib (L, NUPVALUES, safe);
   LLUV_PUSH_UPVALUES(L); lluv_idle_initlib     (L, NUPVALUES, safe);
+  LLUV_PUSH_UPVALUES(L); lluv_async_initlib    (L, NUPVALUES, safe);
   LLUV_PUSH_UPVALUES(L); lluv_tcp_initlib      (L, NUPVALUES, safe);
   LLUV_PUSH_UPVALUES(L); lluv_pipe_initlib     (L, NUPVALUES, safe);
   LLUV_PUSH_UPVALUES(L); lluv_tty_initlib      (L, NUPVALUES, safe);
@@ -109,6 +117,10 @@ static int luaopen_lluv_impl(lua_State *L, int safe){
   LLUV_PUSH_UPVALUES(L); lluv_process_initlib  (L, NUPVALUES, safe);
   LLUV_PUSH_UPVALUES(L); lluv_misc_initlib     (L, NUPVALUES, safe);
   LLUV_PUSH_UPVALUES(L); lluv_dns_initlib      (L, NUPVALUES, safe);
+  LLUV_PUSH_UPVALUES(L); lluv_worker_initlib   (L, NUPVALUES, safe);
+  LLUV_PUSH_UPVALUES(L); lluv_work_initlib     (L, NUPVALUES, safe);
+  LLUV_PUSH_UPVALUES(L); lluv_vmpool_initlib   (L, NUPVALUES, safe);
+  LLUV_PUSH_UPVALUES(L); lluv_appender_initlib (L, NUPVALUES, safe);
 
   lua_remove(L, -2); /* registry */
   lua_remove(L, -2); /* handles  */
@@ -0,0 +1,195 @@
+/******************************************************************************
+* Author: Alexey Melnichuk <alexeymelnichuck@gmail.com>
+*
+* Copyright (C) 2014-2019 Alexey Melnichuk <alexeymelnichuck@gmail.com>
+*
+* Licensed according to the included 'LICENSE' document
+*
+* This file is part of lua-lluv library.
+******************************************************************************/
+
+#include "lluv.h"
+#include "lluv_utils.h"
+#include "lluv_addrcache.h"
+#include <string.h>
+
+LLUV_INTERNAL void lluv_addrcache_init(lluv_addrcache_t *cache){
+  memset(cache->entries, 0, sizeof(cache->entries));
+  cache->ref    = LUA_NOREF;
+  cache->tick   = 0;
+  cache->hits   = 0;
+  cache->misses = 0;
+  cache->evicts = 0;
+}
+
+LLUV_INTERNAL void lluv_addrcache_close(lua_State *L, lluv_addrcache_t *cache){
+  luaL_unref(L, LLUV_LUA_REGISTRY, cache->ref);
+  cache->ref = LUA_NOREF;
+  memset(cache->entries, 0, sizeof(cache->entries));
+}
+
+static unsigned int lluv_addrcache_hash(const unsigned char *addr, size_t len){
+  unsigned int h = 2166136261u; /* FNV-1a */
+  size_t i;
+  for(i = 0; i < len; ++i){
+    h = (h ^ addr[i]) * 16777619u;
+  }
+  return h ^ (h >> 16);
+}
+
+static void lluv_addrcache_push_host(lua_State *L, lluv_addrcache_t *cache,
+  const struct sockaddr *sa, const void *addr, size_t len
+){
+  char buf[INET6_ADDRSTRLEN + 1];
+  lluv_addrcache_entry_t *set, *e, *victim;
+  int i, slot;
+
+  set = &cache->entries[
+    (lluv_addrcache_hash((const unsigned char*)addr, len) & (LLUV_ADDRCACHE_SETS - 1)) * LLUV_ADDRCACHE_WAYS
+  ];
+
+  cache->tick += 1;
+
+  if(cache->ref == LUA_NOREF){
+    lua_createtable(L, LLUV_ADDRCACHE_SIZE, 0);
+    cache->ref = luaL_ref(L, LLUV_LUA_REGISTRY);
+  }
+  lua_rawgeti(L, LLUV_LUA_REGISTRY, cache->ref);
+
+  victim = set;
+  for(i = 0; i < LLUV_ADDRCACHE_WAYS; ++i){
+    e = &set[i];
+
+    if((e->len == len) && (memcmp(e->addr, addr, len) == 0)){
+      lua_rawgeti(L, -1, (int)(e - cache->entries) + 1);
+      if(lua_isstring(L, -1)){
+        e->tick = cache->tick;
+        cache->hits += 1;
+        lua_remove(L, -2);
+        return;
+      }
+      lua_pop(L, 1);
+      victim = e;
+      break;
+    }
+
+    /* prefer empty entries and then least recently used one */
+    if(victim->len == 0) continue;
+    if((e->len == 0) || ((cache->tick - e->tick) > (cache->tick - victim->tick))){
+      victim = e;
+    }
+  }
+
+  cache->misses += 1;
+  if(victim->len && ((victim->len != len) || memcmp(victim->addr, addr, len))){
+    cache->evicts += 1;
+  }
+
+  if(len == 4) uv_ip4_name((const struct sockaddr_in*)sa, buf, sizeof(buf));
+  else uv_ip6_name((const struct sockaddr_in6*)sa, buf, sizeof(buf));
+
+  victim->len  = (unsigned char)len;
+  victim->tick = cache->tick;
+  memcpy(victim->addr, addr, len);
+
+  slot = (int)(victim - cache->entries) + 1;
+  lua_pushstring(L, buf);
+  lua_pushvalue(L, -1);
+  lua_rawseti(L, -3, slot);
+  lua_remove(L, -2);
+}
+
+LLUV_INTERNAL int lluv_addrcache_push_addr(lua_State *L, lluv_addrcache_t *cache, const struct sockaddr *sa){
+  switch (sa->sa_family){
+    case AF_INET:{
+      const struct sockaddr_in *sin = (const struct sockaddr_in*)sa;
+      lluv_addrcache_push_host(L, cache, sa, &sin->sin_addr, 4);
+      lua_pushinteger(L, ntohs(sin->sin_port));
+      return 2;
+    }
+
+    case AF_INET6:{
+      const struct sockaddr_in6 *sin6 = (const struct sockaddr_in6*)sa;
+      lluv_addrcache_push_host(L, cache, sa, &sin6->sin6_addr, 16);
+      lua_pushinteger(L, ntohs(sin6->sin6_port));
+      lutil_pushint64(L, ntohl(sin6->sin6_flowinfo));
+      lutil_pushint64(L, sin6->sin6_scope_id);
+      return 4;
+    }
+  }
+
+  return 0;
+}
+
+LLUV_INTERNAL void lluv_addrcache_push_stats(lua_State *L, lluv_addrcache_t *cache){
+#define SET_FIELD_INT(F,V)  lutil_pushint64(L, (int64_t)cache->V); lua_setfield(L, -2, F)
+
+  int i, n = 0;
+
+  for(i = 0; i < LLUV_ADDRCACHE_SIZE; ++i){
+    if(cache->entries[i].len) ++n;
+  }
+
+  lua_newtable(L);
+  SET_FIELD_INT( "hits"  , hits   );
+  SET_FIELD_INT( "misses", misses );
+  SET_FIELD_INT( "evicts", evicts );
+
+  lutil_pushint64(L, n);                   lua_setfield(L, -2, "size");
+  lutil_pushint64(L, LLUV_ADDRCACHE_SIZE); lua_setfield(L, -2, "capacity");
+
+#undef SET_FIELD_INT
+}
+
+/* Key contains only address, port and scope so it does not depend
+** on flowinfo and garbage in padding fields.
+*/
+LLUV_INTERNAL int lluv_push_peer_key(lua_State *L, const struct sockaddr *sa){
+  switch (sa->sa_family){
+    case AF_INET:{
+      struct sockaddr_in key;
+      memset(&key, 0, sizeof(key));
+      key.sin_family = AF_INET;
+      key.sin_port   = ((const struct sockaddr_in*)sa)->sin_port;
+      key.sin_addr   = ((const struct sockaddr_in*)sa)->sin_addr;
+      lua_pushlstring(L, (const char*)&key, sizeof(key));
+      return 1;
+    }
+
+    case AF_INET6:{
+      struct sockaddr_in6 key;
+      memset(&key, 0, sizeof(key));
+      key.sin6_family   = AF_INET6;
+      key.sin6_port     = ((const struct sockaddr_in6*)sa)->sin6_port;
+      key.sin6_addr     = ((const struct sockaddr_in6*)sa)->sin6_addr;
+      key.sin6_scope_id = ((const struct sockaddr_in6*)sa)->sin6_scope_id;
+      lua_pushlstring(L, (const char*)&key, sizeof(key));
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+LLUV_INTERNAL int lluv_to_peer_key(lua_State *L, int idx, struct sockaddr_storage *sa){
+  size_t len; const char *key;
+
+  if(lua_type(L, idx) != LUA_TSTRING) return UV_EINVAL;
+
+  key = lua_tolstring(L, idx, &len);
+
+  if((len != sizeof(struct sockaddr_in)) && (len != sizeof(struct sockaddr_in6)))
+    return UV_EINVAL;
+
+  memset(sa, 0, sizeof(*sa));
+  memcpy(sa, key, len);
+
+  if(len == sizeof(struct sockaddr_in)){
+    if(((struct sockaddr*)sa)->sa_family != AF_INET) return UV_EINVAL;
+  }
+  else{
+    if(((struct sockaddr*)sa)->sa_family != AF_INET6) return UV_EINVAL;
+  }
+
+  return 0;
+}
@@ -0,0 +1,69 @@
+/******************************************************************************
+* Author: Alexey Melnichuk <alexeymelnichuck@gmail.com>
+*
+* Copyright (C) 2014-2019 Alexey Melnichuk <alexeymelnichuck@gmail.com>
+*
+* Licensed according to the included 'LICENSE' document
+*
+* This file is part of lua-lluv library.
+******************************************************************************/
+
+#ifndef _LLUV_ADDRCACHE_H_
+#define _LLUV_ADDRCACHE_H_
+
+#include "lluv.h"
+#include "lluv_utils.h"
+
+/* Cache of formatted host names for ip addresses.
+** Set associative cache with LRU replacement inside each set.
+** Host strings are kept in Lua table so pushing cached name is
+** just table lookup without formatting and string interning.
+*/
+
+/* number of sets (must be power of 2) */
+#ifndef LLUV_ADDRCACHE_SETS
+#  define LLUV_ADDRCACHE_SETS 64
+#endif
+
+/* number of entries in each set */
+#ifndef LLUV_ADDRCACHE_WAYS
+#  define LLUV_ADDRCACHE_WAYS 4
+#endif
+
+#define LLUV_ADDRCACHE_SIZE (LLUV_ADDRCACHE_SETS * LLUV_ADDRCACHE_WAYS)
+
+typedef struct lluv_addrcache_entry_tag{
+  unsigned char len;       /* 0 - empty, 4 - ipv4, 16 - ipv6 */
+  unsigned char addr[16];
+  unsigned int  tick;      /* last access */
+}lluv_addrcache_entry_t;
+
+typedef struct lluv_addrcache_tag{
+  lluv_addrcache_entry_t entries[LLUV_ADDRCACHE_SIZE];
+  int          ref;        /* reference to table with host strings */
+  unsigned int tick;
+
+  /* statistics */
+  size_t hits;
+  size_t misses;
+  size_t evicts;
+}lluv_addrcache_t;
+
+LLUV_INTERNAL void lluv_addrcache_init(lluv_addrcache_t *cache);
+
+LLUV_INTERNAL void lluv_addrcache_close(lua_State *L, lluv_addrcache_t *cache);
+
+/* same as lluv_push_addr but use cache for host name */
+LLUV_INTERNAL int lluv_addrcache_push_addr(lua_State *L, lluv_addrcache_t *cache, const struct sockaddr *sa);
+
+LLUV_INTERNAL void lluv_addrcache_push_stats(lua_State *L, lluv_addrcache_t *cache);
+
+/* Peer key is opaque string which encode address and port.
+** It can be used as table key and passed back to `send` without
+** address parsing.
+*/
+LLUV_INTERNAL int lluv_push_peer_key(lua_State *L, const struct sockaddr *sa);
+
+LLUV_INTERNAL int lluv_to_peer_key(lua_State *L, int idx, struct sockaddr_storage *sa);
+
+#endif
@@ -0,0 +1,919 @@
+/******************************************************************************
+* Author: Alexey Melnichuk <alexeymelnichuck@gmail.com>
+*
+* Copyright (C) 2014-2019 Alexey Melnichuk <alexeymelnichuck@gmail.com>
+*
+* Licensed according to the included 'LICENSE' document
+*
+* This file is part of lua-lluv library.
+******************************************************************************/
+
+#include "lluv.h"
+#include "lluv_appender.h"
+#include "lluv_loop.h"
+#include "lluv_error.h"
+#include "lluv_fbuf.h"
+#include <assert.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <string.h>
+
+#define LLUV_APPENDER_NAME LLUV_PREFIX" Appender"
+static const char *LLUV_APPENDER = LLUV_APPENDER_NAME;
+
+/* Append only writer with group commit.
+**
+** Records are copied to native chunks of filling batch. Batch is written
+** with one vectored request and then synced. Only one batch is in flight
+** so records which arrive meanwhile go to next batch and one sync covers
+** all of them. Record callbacks are called after covering sync is done.
+**
+** Requests are started only from libuv callbacks (timer or fs) so Lua
+** callbacks are never called from inside `write`.
+**
+** Size of filling batch is limited by `max_pending` so `write` fails with
+** ENOBUFS if disk can not keep up with writer.
+*/
+
+#ifndef LLUV_APPENDER_CHUNK
+#  define LLUV_APPENDER_CHUNK (64 * 1024)
+#endif
+
+#ifndef LLUV_APPENDER_MAX_BATCH
+#  define LLUV_APPENDER_MAX_BATCH (1024 * 1024)
+#endif
+
+#ifndef LLUV_APPENDER_MAX_PENDING
+#  define LLUV_APPENDER_MAX_PENDING (16 * 1024 * 1024)
+#endif
+
+/* ms */
+#ifndef LLUV_APPENDER_INTERVAL
+#  define LLUV_APPENDER_INTERVAL 10
+#endif
+
+#define LLUV_APPENDER_SYNC_NONE 0
+#define LLUV_APPENDER_SYNC_DATA 1
+#define LLUV_APPENDER_SYNC_FULL 2
+
+typedef struct lluv_appender_chunk_tag lluv_appender_chunk_t;
+
+struct lluv_appender_chunk_tag{
+  lluv_appender_chunk_t *next;
+  size_t                 size;
+  size_t                 capacity;
+  char                   data[1];
+};
+
+typedef struct lluv_appender_batch_tag{
+  lluv_appender_chunk_t *head;
+  lluv_appender_chunk_t *tail;
+  size_t                 nchunks;
+  size_t                 bytes;
+  size_t                 records;
+  int                   *cbs;      /* record and flush callbacks */
+  size_t                 ncbs;
+  size_t                 cbs_cap;
+}lluv_appender_batch_t;
+
+typedef struct lluv_appender_tag{
+  uv_timer_t            timer;     /* internal handle (data is NULL). Have to be first */
+  uv_fs_t               req;       /* write, sync or close request */
+  lluv_loop_t          *loop;
+  lluv_flags_t          flags;
+  uv_file               fd;
+  int                   sync;      /* LLUV_APPENDER_SYNC_XXX */
+  size_t                max_batch;
+  size_t                max_pending;
+  uint64_t              interval;
+  int                   self;      /* reference to userdata while there pending work */
+  int                   loop_ref;  /* keep loop alive while appender is open */
+  int                   on_batch;
+  int                   close_cb;
+  int                   error;     /* first write/sync error. All next records fail with it */
+  int                   in_flight;
+  int                   ready;     /* flush requested while batch was in flight */
+  int                   closing;
+  int                   detached;  /* userdata collected while request active */
+  int                   timer_closed;
+  uv_buf_t             *bufs;
+  size_t                written;
+  lluv_appender_batch_t fill;
+  lluv_appender_batch_t flight;
+  uint64_t              nbatches;
+  uint64_t              nrecords;
+  uint64_t              nbytes;
+  uint64_t              nsyncs;
+}lluv_appender_t;
+
+//{ Batch
+
+static void lluv_appender_batch_init(lluv_appender_batch_t *b){
+  memset(b, 0, sizeof(*b));
+}
+
+static int lluv_appender_batch_empty(const lluv_appender_batch_t *b){
+  return (b->bytes == 0) && (b->ncbs == 0);
+}
+
+static void lluv_appender_batch_free(lua_State *L, lluv_appender_batch_t *b){
+  lluv_appender_chunk_t *chunk = b->head;
+  size_t i;
+
+  while(chunk){
+    lluv_appender_chunk_t *next = chunk->next;
+    lluv_free(L, chunk);
+    chunk = next;
+  }
+
+  for(i = 0; i < b->ncbs; ++i){
+    luaL_unref(L, LLUV_LUA_REGISTRY, b->cbs[i]);
+  }
+  lluv_free(L, b->cbs);
+
+  lluv_appender_batch_init(b);
+}
+
+static lluv_appender_chunk_t *lluv_appender_chunk_new(lua_State *L, size_t capacity){
+  lluv_appender_chunk_t *chunk = (lluv_appender_chunk_t*)lluv_alloc(L,
+    offsetof(lluv_appender_chunk_t, data) + capacity
+  );
+
+  if(chunk){
+    chunk->next     = NULL;
+    chunk->size     = 0;
+    chunk->capacity = capacity;
+  }
+
+  return chunk;
+}
+
+/* copy whole record or nothing */
+static int lluv_appender_batch_append(lua_State *L, lluv_appender_batch_t *b, const char *data, size_t len){
+  lluv_appender_chunk_t *tail = b->tail, *chunk = NULL;
+  size_t n = tail ? (tail->capacity - tail->size) : 0;
+
+  if(n > len) n = len;
+
+  if(len > n){
+    chunk = lluv_appender_chunk_new(L, (len - n > LLUV_APPENDER_CHUNK) ? (len - n) : LLUV_APPENDER_CHUNK);
+    if(!chunk) return UV_ENOMEM;
+  }
+
+  if(n){
+    memcpy(tail->data + tail->size, data, n);
+    tail->size += n;
+  }
+
+  if(chunk){
+    memcpy(chunk->data, data + n, len - n);
+    chunk->size = len - n;
+    if(tail) tail->next = chunk; else b->head = chunk;
+    b->tail     = chunk;
+    b->nchunks += 1;
+  }
+
+  b->bytes += len;
+  return 0;
+}
+
+static int lluv_appender_batch_reserve_cb(lua_State *L, lluv_appender_batch_t *b){
+  int *cbs;
+  size_t cap;
+
+  if(b->ncbs < b->cbs_cap) return 0;
+
+  cap = b->cbs_cap ? b->cbs_cap * 2 : 16;
+  cbs = (int*)lluv_alloc(L, sizeof(int) * cap);
+  if(!cbs) return UV_ENOMEM;
+
+  if(b->ncbs) memcpy(cbs, b->cbs, sizeof(int) * b->ncbs);
+  lluv_free(L, b->cbs);
+
+  b->cbs     = cbs;
+  b->cbs_cap = cap;
+  return 0;
+}
+
+/* reference function at idx. Slot have to be reserved */
+static void lluv_appender_batch_add_cb(lua_State *L, lluv_appender_batch_t *b, int idx){
+  assert(b->ncbs < b->cbs_cap);
+  lua_pushvalue(L, idx);
+  b->cbs[b->ncbs++] = luaL_ref(L, LLUV_LUA_REGISTRY);
+}
+
+//}
+
+static void lluv_appender_start(lluv_appender_t *a);
+
+static void lluv_appender_start_close(lluv_appender_t *a);
+
+static void lluv_appender_write_next(lluv_appender_t *a);
+
+static void lluv_appender_on_timer_close(uv_handle_t *h){
+  lluv_appender_t *a = (lluv_appender_t*)h;
+  lluv_free(NULL, a);
+}
+
+/* write batch with blocking requests */
+static int lluv_appender_write_sync(lluv_appender_t *a, lluv_appender_batch_t *b){
+  lluv_appender_chunk_t *chunk;
+  uv_fs_t req;
+  int err = 0;
+
+  for(chunk = b->head; chunk; chunk = chunk->next){
+    size_t pos = 0;
+    while(pos < chunk->size){
+      uv_buf_t ubuf = lluv_buf_init(chunk->data + pos, chunk->size - pos);
+      err = uv_fs_write(NULL, &req, a->fd, &ubuf, 1, -1, NULL);
+      uv_fs_req_cleanup(&req);
+      if(err <= 0) return err < 0 ? err : UV_EIO;
+      pos += (size_t)err;
+    }
+  }
+
+  switch(a->sync){
+    case LLUV_APPENDER_SYNC_DATA:
+      err = uv_fs_fdatasync(NULL, &req, a->fd, NULL);
+      break;
+    case LLUV_APPENDER_SYNC_FULL:
+      err = uv_fs_fsync(NULL, &req, a->fd, NULL);
+      break;
+    default:
+      return 0;
+  }
+  uv_fs_req_cleanup(&req);
+
+  return err;
+}
+
+/* write not started records and close file */
+static void lluv_appender_close_sync(lluv_appender_t *a){
+  uv_fs_t req;
+
+  if(a->fd < 0) return;
+
+  if(!a->error) lluv_appender_write_sync(a, &a->fill);
+
+  uv_fs_close(NULL, &req, a->fd, NULL);
+  uv_fs_req_cleanup(&req);
+  a->fd = -1;
+}
+
+/* Detached object does not touch Lua state. It is freed when both
+** request is done and timer is closed.
+*/
+static void lluv_appender_detached_free(lluv_appender_t *a){
+  if(a->in_flight || !a->timer_closed) return;
+
+  lluv_appender_close_sync(a);
+
+  lluv_appender_batch_free(NULL, &a->fill);
+  lluv_appender_batch_free(NULL, &a->flight);
+  lluv_free(NULL, a->bufs);
+  lluv_free(NULL, a);
+}
+
+static void lluv_appender_on_detached_timer_close(uv_handle_t *h){
+  lluv_appender_t *a = (lluv_appender_t*)h;
+  a->timer_closed = 1;
+  lluv_appender_detached_free(a);
+}
+
+/* release all Lua references but keep memory used by active request */
+static void lluv_appender_detach(lua_State *L, lluv_appender_t *a){
+  size_t i;
+
+  for(i = 0; i < a->fill.ncbs; ++i)
+    luaL_unref(L, LLUV_LUA_REGISTRY, a->fill.cbs[i]);
+  a->fill.ncbs = 0;
+
+  for(i = 0; i < a->flight.ncbs; ++i)
+    luaL_unref(L, LLUV_LUA_REGISTRY, a->flight.cbs[i]);
+  a->flight.ncbs = 0;
+
+  luaL_unref(L, LLUV_LUA_REGISTRY, a->self);
+  luaL_unref(L, LLUV_LUA_REGISTRY, a->loop_ref);
+  luaL_unref(L, LLUV_LUA_REGISTRY, a->on_batch);
+  luaL_unref(L, LLUV_LUA_REGISTRY, a->close_cb);
+  a->self = a->loop_ref = a->on_batch = a->close_cb = LUA_NOREF;
+
+  a->detached = 1;
+
+  if(IS_(a->loop, OPEN)){
+    uv_timer_stop(&a->timer);
+    uv_close((uv_handle_t*)&a->timer, lluv_appender_on_detached_timer_close);
+  }
+  else a->timer_closed = 1;
+}
+
+static void lluv_appender_lock(lua_State *L, lluv_appender_t *a, int idx){
+  if(a->self != LUA_NOREF) return;
+  lua_pushvalue(L, idx);
+  a->self = luaL_ref(L, LLUV_LUA_REGISTRY);
+}
+
+/* release reference if there no pending work */
+static void lluv_appender_unlock(lua_State *L, lluv_appender_t *a){
+  if(a->in_flight || a->closing || !lluv_appender_batch_empty(&a->fill)) return;
+  luaL_unref(L, LLUV_LUA_REGISTRY, a->self);
+  a->self = LUA_NOREF;
+}
+
+/* detach from userdata at idx (or from locked one) and free all resources */
+static void lluv_appender_release(lua_State *L, lluv_appender_t *a, int idx){
+  if(idx) lua_pushvalue(L, idx);
+  else lua_rawgeti(L, LLUV_LUA_REGISTRY, a->self);
+  if(lua_isuserdata(L, -1)) *(lluv_appender_t **)lua_touserdata(L, -1) = NULL;
+  lua_pop(L, 1);
+
+  lluv_appender_batch_free(L, &a->fill);
+  lluv_appender_batch_free(L, &a->flight);
+  lluv_free(L, a->bufs);
+  a->bufs = NULL;
+
+  luaL_unref(L, LLUV_LUA_REGISTRY, a->self);
+  luaL_unref(L, LLUV_LUA_REGISTRY, a->loop_ref);
+  luaL_unref(L, LLUV_LUA_REGISTRY, a->on_batch);
+  luaL_unref(L, LLUV_LUA_REGISTRY, a->close_cb);
+  a->self = a->loop_ref = a->on_batch = a->close_cb = LUA_NOREF;
+
+  if(IS_(a->loop, OPEN))
+    uv_close((uv_handle_t*)&a->timer, lluv_appender_on_timer_close);
+  else
+    lluv_appender_on_timer_close((uv_handle_t*)&a->timer);
+}
+
+static void lluv_appender_push_error(lua_State *L, int err){
+  if(err < 0) lluv_error_create(L, LLUV_ERR_UV, (uv_errno_t)err, NULL);
+  else lua_pushnil(L);
+}
+
+/* After error in callback loop going to stop and raise it
+** so rest of callbacks are deferred.
+*/
+static int lluv_appender_call(lua_State *L, lluv_loop_t *loop, int narg, int failed){
+  if(failed){
+    lluv_loop_defer_call(L, loop, narg);
+    return 1;
+  }
+
+  if(lluv_loop_call(L, loop, narg, UV_UNKNOWN_HANDLE, LLUV_CB_FS)) return 1;
+
+  lluv_loop_defer_proceed(L, loop);
+  return 0;
+}
+
+static void lluv_appender_complete(lluv_appender_t *a, int err, int fatal){
+  lluv_loop_t *loop;
+  lua_State *L;
+  lluv_appender_batch_t batch = a->flight;
+  int failed = 0;
+  size_t i;
+
+  if((err < 0) && fatal && !a->error) a->error = err;
+
+  if(a->detached){
+    a->in_flight = 0;
+    lluv_appender_detached_free(a);
+    return;
+  }
+
+  loop = a->loop;
+  L    = loop->L;
+
+  LLUV_CHECK_LOOP_CB_INVARIANT(L);
+
+  lluv_appender_batch_init(&a->flight);
+  lluv_free(L, a->bufs);
+  a->bufs = NULL;
+
+  a->nbatches += 1;
+  a->nrecords += batch.records;
+  if(err >= 0) a->nbytes += batch.bytes;
+
+  /* callbacks may write or flush again. Object is locked until
+  ** unlock below so it is safe to call Lua.
+  */
+  a->in_flight = 0;
+
+  if(a->on_batch != LUA_NOREF){
+    lua_rawgeti(L, LLUV_LUA_REGISTRY, a->on_batch);
+    lua_rawgeti(L, LLUV_LUA_REGISTRY, a->self);
+    lluv_appender_push_error(L, err);
+    lutil_pushint64(L, batch.records);
+    lutil_pushint64(L, batch.bytes);
+    failed = lluv_appender_call(L, loop, 4, failed);
+  }
+
+  for(i = 0; i < batch.ncbs; ++i){
+    lua_rawgeti(L, LLUV_LUA_REGISTRY, batch.cbs[i]);
+    luaL_unref(L, LLUV_LUA_REGISTRY, batch.cbs[i]);
+    lua_rawgeti(L, LLUV_LUA_REGISTRY, a->self);
+    lluv_appender_push_error(L, err);
+    failed = lluv_appender_call(L, loop, 2, failed);
+  }
+  batch.ncbs = 0;
+  lluv_appender_batch_free(L, &batch);
+
+  if(!lluv_appender_batch_empty(&a->fill)){
+    /* otherwise timer still active */
+    if(a->ready || a->closing || a->error || (a->fill.bytes >= a->max_batch))
+      lluv_appender_start(a);
+    return;
+  }
+
+  if(a->closing){
+    lluv_appender_start_close(a);
+    return;
+  }
+
+  lluv_appender_unlock(L, a);
+
+  LLUV_CHECK_LOOP_CB_INVARIANT(L);
+}
+
+static void lluv_appender_on_sync(uv_fs_t *arg){
+  lluv_appender_t *a = (lluv_appender_t*)arg->data;
+  int err = (int)arg->result;
+
+  uv_fs_req_cleanup(arg);
+
+  if(err >= 0) a->nsyncs += 1;
+
+  lluv_appender_complete(a, err < 0 ? err : 0, 1);
+}
+
+static void lluv_appender_on_written(lluv_appender_t *a){
+  int err;
+
+  switch(a->sync){
+    case LLUV_APPENDER_SYNC_DATA:
+      err = uv_fs_fdatasync(a->loop->handle, &a->req, a->fd, lluv_appender_on_sync);
+      break;
+    case LLUV_APPENDER_SYNC_FULL:
+      err = uv_fs_fsync(a->loop->handle, &a->req, a->fd, lluv_appender_on_sync);
+      break;
+    default:
+      lluv_appender_complete(a, 0, 0);
+      return;
+  }
+
+  if(err < 0) lluv_appender_complete(a, err, 1);
+}
+
+static void lluv_appender_on_write(uv_fs_t *arg){
+  lluv_appender_t *a = (lluv_appender_t*)arg->data;
+  int64_t result = (int64_t)arg->result;
+
+  uv_fs_req_cleanup(arg);
+
+  if(result <= 0){
+    lluv_appender_complete(a, result < 0 ? (int)result : UV_EIO, 1);
+    return;
+  }
+
+  a->written += (size_t)result;
+  lluv_appender_write_next(a);
+}
+
+/* write rest of batch. Usually whole batch written by one request */
+static void lluv_appender_write_next(lluv_appender_t *a){
+  lluv_appender_chunk_t *chunk;
+  size_t n = 0, skip = a->written;
+  int err;
+
+  if(a->written >= a->flight.bytes){
+    lluv_appender_on_written(a);
+    return;
+  }
+
+  for(chunk = a->flight.head; chunk; chunk = chunk->next){
+    if(skip >= chunk->size){
+      skip -= chunk->size;
+      continue;
+    }
+    a->bufs[n++] = lluv_buf_init(chunk->data + skip, chunk->size - skip);
+    skip = 0;
+  }
+
+  err = uv_fs_write(a->loop->handle, &a->req, a->fd, a->bufs, (unsigned int)n, -1, lluv_appender_on_write);
+  if(err < 0) lluv_appender_complete(a, err, 1);
+}
+
+static void lluv_appender_start(lluv_appender_t *a){
+  lua_State *L = a->loop->L;
+
+  uv_timer_stop(&a->timer);
+
+  a->ready     = 0;
+  a->in_flight = 1;
+  a->written   = 0;
+  a->flight    = a->fill;
+  lluv_appender_batch_init(&a->fill);
+
+  if(a->error){
+    lluv_appender_complete(a, a->error, 0);
+    return;
+  }
+
+  a->bufs = (uv_buf_t*)lluv_alloc(L, sizeof(uv_buf_t) * (a->flight.nchunks ? a->flight.nchunks : 1));
+  if(!a->bufs){
+    /* nothing written so file is still consistent */
+    lluv_appender_complete(a, UV_ENOMEM, 0);
+    return;
+  }
+
+  lluv_appender_write_next(a);
+}
+
+static void lluv_appender_closed(lluv_appender_t *a, int err){
+  lluv_loop_t *loop;
+  lua_State *L;
+  int has_cb = (a->close_cb != LUA_NOREF);
+
+  a->fd        = -1;
+  a->in_flight = 0;
+  a->closing   = 0;
+
+  if(a->detached){
+    lluv_appender_detached_free(a);
+    return;
+  }
+
+  loop = a->loop;
+  L    = loop->L;
+
+  LLUV_CHECK_LOOP_CB_INVARIANT(L);
+
+  if(has_cb){
+    lua_rawgeti(L, LLUV_LUA_REGISTRY, a->close_cb);
+    lua_rawgeti(L, LLUV_LUA_REGISTRY, a->self);
+    lluv_appender_push_error(L, err);
+  }
+
+  lluv_appender_release(L, a, 0);
+
+  if(has_cb){
+    LLUV_LOOP_CALL_CB(L, loop, 2, LLUV_CB_FS);
+  }
+
+  LLUV_CHECK_LOOP_CB_INVARIANT(L);
+}
+
+static void lluv_appender_on_close(uv_fs_t *arg){
+  lluv_appender_t *a = (lluv_appender_t*)arg->data;
+  int err = (int)arg->result;
+
+  uv_fs_req_cleanup(arg);
+
+  lluv_appender_closed(a, err < 0 ? err : 0);
+}
+
+static void lluv_appender_start_close(lluv_appender_t *a){
+  int err;
+
+  uv_timer_stop(&a->timer);
+
+  a->in_flight = 1;
+  err = uv_fs_close(a->loop->handle, &a->req, a->fd, lluv_appender_on_close);
+  if(err < 0) lluv_appender_closed(a, err);
+}
+
+static void lluv_appender_on_timer(uv_timer_t *arg){
+  lluv_appender_t *a = (lluv_appender_t*)arg;
+
+  if(a->in_flight){
+    a->ready = 1;
+    return;
+  }
+
+  if(!lluv_appender_batch_empty(&a->fill)){
+    lluv_appender_start(a);
+    return;
+  }
+
+  if(a->closing){
+    lluv_appender_start_close(a);
+    return;
+  }
+
+  lluv_appender_unlock(a->loop->L, a);
+}
+
+static lluv_appender_t *lluv_check_appender(lua_State *L, int idx){
+  lluv_appender_t **a = (lluv_appender_t **)lutil_checkudatap(L, idx, LLUV_APPENDER);
+  luaL_argcheck (L, a != NULL, idx, LLUV_APPENDER_NAME" expected");
+  luaL_argcheck (L, (*a != NULL) && IS_((*a), OPEN), idx, LLUV_APPENDER_NAME" closed");
+  return *a;
+}
+
+static int lluv_appender_to_s(lua_State *L){
+  lluv_appender_t **a = (lluv_appender_t **)lutil_checkudatap(L, 1, LLUV_APPENDER);
+  luaL_argcheck (L, a != NULL, 1, LLUV_APPENDER_NAME" expected");
+  lua_pushfstring(L, LLUV_APPENDER_NAME" (%p)", *a);
+  return 1;
+}
+
+static int lluv_appender_loop(lua_State *L){
+  lluv_appender_t *a = lluv_check_appender(L, 1);
+  lua_rawgeti(L, LLUV_LUA_REGISTRY, a->loop_ref);
+  return 1;
+}
+
+// write(data, [cb])
+static int lluv_appender_write(lua_State *L){
+  lluv_appender_t *a = lluv_check_appender(L, 1);
+  lluv_fixed_buffer_t *buffer = lluv_opt_fbuf(L, 2);
+  int was_empty, err;
+  const char *data;
+  size_t len;
+
+  if(buffer){
+    data = buffer->data;
+    len  = buffer->capacity;
+  }
+  else data = luaL_checklstring(L, 2, &len);
+
+  if(!lua_isnoneornil(L, 3)) lluv_check_callable(L, 3);
+  lua_settop(L, 3);
+
+  if(a->error){
+    return lluv_fail(L, a->flags, LLUV_ERR_UV, a->error, NULL);
+  }
+
+  /* caller should wait for flush before write more */
+  if(a->fill.bytes && (a->fill.bytes + len > a->max_pending)){
+    return lluv_fail(L, a->flags, LLUV_ERR_UV, UV_ENOBUFS, NULL);
+  }
+
+  was_empty = lluv_appender_batch_empty(&a->fill);
+
+  if(!lua_isnil(L, 3)){
+    err = lluv_appender_batch_reserve_cb(L, &a->fill);
+    if(err < 0) return lluv_fail(L, a->flags, LLUV_ERR_UV, err, NULL);
+  }
+
+  err = lluv_appender_batch_append(L, &a->fill, data, len);
+  if(err < 0) return lluv_fail(L, a->flags, LLUV_ERR_UV, err, NULL);
+
+  if(!lua_isnil(L, 3)) lluv_appender_batch_add_cb(L, &a->fill, 3);
+
+  a->fill.records += 1;
+
+  lluv_appender_lock(L, a, 1);
+
+  if(a->fill.bytes >= a->max_batch)
+    uv_timer_start(&a->timer, lluv_appender_on_timer, 0, 0);
+  else if(was_empty)
+    uv_timer_start(&a->timer, lluv_appender_on_timer, a->interval, 0);
+
+  lutil_pushint64(L, a->fill.bytes);
+  return 1;
+}
+
+// flush([cb])
+static int lluv_appender_flush(lua_State *L){
+  lluv_appender_t *a = lluv_check_appender(L, 1);
+  lluv_appender_batch_t *batch = NULL;
+  int err;
+
+  if(!lua_isnoneornil(L, 2)) lluv_check_callable(L, 2);
+  lua_settop(L, 2);
+
+  if(a->error){
+    return lluv_fail(L, a->flags, LLUV_ERR_UV, a->error, NULL);
+  }
+
+  if(!lluv_appender_batch_empty(&a->fill)){
+    batch = &a->fill;
+    uv_timer_start(&a->timer, lluv_appender_on_timer, 0, 0);
+  }
+  else if(a->in_flight){
+    batch = &a->flight;
+  }
+
+  if(!lua_isnil(L, 2)){
+    if(batch){
+      err = lluv_appender_batch_reserve_cb(L, batch);
+      if(err < 0) return lluv_fail(L, a->flags, LLUV_ERR_UV, err, NULL);
+      lluv_appender_batch_add_cb(L, batch, 2);
+    }
+    else{
+      /* all records already done */
+      lua_pushvalue(L, 2);
+      lua_pushvalue(L, 1);
+      lua_pushnil(L);
+      lluv_loop_defer_call(L, a->loop, 2);
+    }
+  }
+
+  lua_pushboolean(L, 1);
+  return 1;
+}
+
+// close([cb]) flushes pending records and closes file
+static int lluv_appender_close(lua_State *L){
+  lluv_appender_t **pa = (lluv_appender_t **)lutil_checkudatap(L, 1, LLUV_APPENDER);
+  lluv_appender_t *a;
+
+  luaL_argcheck (L, pa != NULL, 1, LLUV_APPENDER_NAME" expected");
+
+  a = *pa;
+  if(!a || !IS_(a, OPEN)) return 0;
+
+  if(!lua_isnoneornil(L, 2)){
+    lluv_check_callable(L, 2);
+    lua_settop(L, 2);
+    a->close_cb = luaL_ref(L, LLUV_LUA_REGISTRY);
+  }
+
+  UNSET_(a, OPEN);
+  a->closing = 1;
+  lluv_appender_lock(L, a, 1);
+
+  if(!a->in_flight)
+    uv_timer_start(&a->timer, lluv_appender_on_timer, 0, 0);
+
+  return 0;
+}
+
+/* Object referenced while there pending work so it can be collected
+** with pending records only when Lua state is closing. Not started
+** records are written synchronously. If request is active it still uses
+** object so it is detached and its callback writes rest of records.
+** Callbacks of records are not called.
+*/
+static int lluv_appender_gc(lua_State *L){
+  lluv_appender_t **pa = (lluv_appender_t **)lutil_checkudatap(L, 1, LLUV_APPENDER);
+  lluv_appender_t *a = pa ? *pa : NULL;
+
+  if(!a) return 0;
+
+  *pa = NULL;
+
+  if(a->in_flight){
+    lluv_appender_detach(L, a);
+    return 0;
+  }
+
+  lluv_appender_close_sync(a);
+
+  lluv_appender_release(L, a, 1);
+
+  return 0;
+}
+
+static int lluv_appender_stats(lua_State *L){
+  lluv_appender_t *a = lluv_check_appender(L, 1);
+
+  lua_newtable(L);
+  lutil_pushint64(L, (int64_t)a->nbatches); lua_setfield(L, -2, "batches");
+  lutil_pushint64(L, (int64_t)a->nrecords); lua_setfield(L, -2, "records");
+  lutil_pushint64(L, (int64_t)a->nbytes  ); lua_setfield(L, -2, "bytes"  );
+  lutil_pushint64(L, (int64_t)a->nsyncs  ); lua_setfield(L, -2, "syncs"  );
+  lutil_pushint64(L, (int64_t)a->fill.bytes); lua_setfield(L, -2, "pending");
+
+  return 1;
+}
+
+static const struct luaL_Reg lluv_appender_methods[] = {
+  { "loop",       lluv_appender_loop    },
+  { "write",      lluv_appender_write   },
+  { "flush",      lluv_appender_flush   },
+  { "close",      lluv_appender_close   },
+  { "stats",      lluv_appender_stats   },
+  { "__gc",       lluv_appender_gc      },
+  { "__tostring", lluv_appender_to_s    },
+
+  {NULL,NULL}
+};
+
+// fs_appender([loop,] path, [{max_batch_bytes=, flush_interval_ms=, sync=, on_batch=}])
+LLUV_IMPL_SAFE(lluv_fs_appender){
+  static const lluv_uv_const_t SYNC[] = {
+    { LLUV_APPENDER_SYNC_NONE, "none" },
+    { LLUV_APPENDER_SYNC_DATA, "data" },
+    { LLUV_APPENDER_SYNC_FULL, "full" },
+
+    { 0, NULL }
+  };
+
+  lluv_loop_t *loop     = lluv_opt_loop(L, 1, LLUV_FLAG_OPEN);
+  int first             = loop ? 2 : 1, opt = first + 1;
+  const char *path      = luaL_checkstring(L, first);
+  lua_Integer max_batch = LLUV_APPENDER_MAX_BATCH;
+  lua_Integer max_pending = LLUV_APPENDER_MAX_PENDING;
+  lua_Integer interval  = LLUV_APPENDER_INTERVAL;
+  int sync              = LLUV_APPENDER_SYNC_NONE;
+  lluv_flags_t flags;
+  lluv_appender_t *a, **pa;
+  uv_fs_t req;
+  int err;
+
+  if(!loop) loop = lluv_default_loop(L);
+
+  flags = safe_flag | INHERITE_FLAGS(loop);
+
+  lua_settop(L, opt);
+  if(!lua_isnil(L, opt)){
+    luaL_checktype(L, opt, LUA_TTABLE);
+
+    lua_getfield(L, opt, "max_batch_bytes");
+    max_batch = luaL_optinteger(L, -1, max_batch);
+    luaL_argcheck(L, max_batch > 0, opt, "invalid max_batch_bytes value");
+
+    lua_getfield(L, opt, "max_pending_bytes");
+    max_pending = luaL_optinteger(L, -1, max_pending);
+    luaL_argcheck(L, max_pending > 0, opt, "invalid max_pending_bytes value");
+    lua_pop(L, 1);
+
+    lua_getfield(L, opt, "flush_interval_ms");
+    interval = luaL_optinteger(L, -1, interval);
+    luaL_argcheck(L, interval >= 0, opt, "invalid flush_interval_ms value");
+
+    lua_getfield(L, opt, "sync");
+    sync = (int)lluv_opt_named_const(L, -1, sync, SYNC);
+
+    lua_getfield(L, opt, "on_batch");
+    if(!lua_isnil(L, -1)) lluv_check_callable(L, -1);
+  }
+  else lua_settop(L, opt + 4);
+
+  err = uv_fs_open(loop->handle, &req, path, O_WRONLY | O_CREAT | O_APPEND, 0666, NULL);
+  uv_fs_req_cleanup(&req);
+  if(err < 0){
+    return lluv_fail(L, flags, LLUV_ERR_UV, err, path);
+  }
+
+  a = lluv_alloc_t(L, lluv_appender_t);
+  if(a) err = uv_timer_init(loop->handle, &a->timer);
+  else err = UV_ENOMEM;
+
+  if(err < 0){
+    uv_fs_close(NULL, &req, (uv_file)req.result, NULL);
+    uv_fs_req_cleanup(&req);
+    lluv_free_t(L, lluv_appender_t, a);
+    return lluv_fail(L, flags, LLUV_ERR_UV, err, NULL);
+  }
+
+  a->timer.data = NULL;
+  a->req.data   = a;
+  a->loop       = loop;
+  a->flags      = flags | LLUV_FLAG_OPEN;
+  a->fd         = (uv_file)req.result;
+  a->sync       = sync;
+  a->max_batch  = (size_t)max_batch;
+  a->max_pending = (size_t)max_pending;
+  a->interval   = (uint64_t)interval;
+  a->self       = a->loop_ref = a->on_batch = a->close_cb = LUA_NOREF;
+  a->error      = 0;
+  a->in_flight  = a->ready = a->closing = 0;
+  a->detached   = a->timer_closed = 0;
+  a->bufs       = NULL;
+  a->written    = 0;
+  a->nbatches   = a->nrecords = a->nbytes = a->nsyncs = 0;
+  lluv_appender_batch_init(&a->fill);
+  lluv_appender_batch_init(&a->flight);
+
+  pa = lutil_newudatap(L, lluv_appender_t*, LLUV_APPENDER);
+  *pa = a;
+
+  lluv_loop_pushself(L, loop);
+  a->loop_ref = luaL_ref(L, LLUV_LUA_REGISTRY);
+
+  if(!lua_isnil(L, opt + 4)){
+    lua_pushvalue(L, opt + 4);
+    a->on_batch = luaL_ref(L, LLUV_LUA_REGISTRY);
+  }
+
+  return 1;
+}
+
+#define LLUV_FUNCTIONS(F)                       \
+  {"fs_appender", lluv_fs_appender_##F},        \
+
+static const struct luaL_Reg lluv_functions[][2] = {
+  {
+    LLUV_FUNCTIONS(unsafe)
+
+    {NULL,NULL}
+  },
+  {
+    LLUV_FUNCTIONS(safe)
+
+    {NULL,NULL}
+  },
+};
+
+LLUV_INTERNAL void lluv_appender_initlib(lua_State *L, int nup, int safe){
+  assert((safe == 0) || (safe == 1));
+
+  lutil_pushnvalues(L, nup);
+
+  if(!lutil_createmetap(L, LLUV_APPENDER, lluv_appender_methods, nup))
+    lua_pop(L, nup);
+  lua_pop(L, 1);
+
+  luaL_setfuncs(L, lluv_functions[safe], nup);
+}
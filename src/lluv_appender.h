@@ -0,0 +1,19 @@
+/******************************************************************************
+* Author: Alexey Melnichuk <alexeymelnichuck@gmail.com>
+*
+* Copyright (C) 2014-2019 Alexey Melnichuk <alexeymelnichuck@gmail.com>
+*
+* Licensed according to the included 'LICENSE' document
+*
+* This file is part of lua-lluv library.
+******************************************************************************/
+
+#ifndef _LLUV_APPENDER_H_
+#define _LLUV_APPENDER_H_
+
+#include "lluv.h"
+#include "lluv_utils.h"
+
+LLUV_INTERNAL void lluv_appender_initlib(lua_State *L, int nup, int safe);
+
+#endif
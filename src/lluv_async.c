@@ -0,0 +1,406 @@
+/******************************************************************************
+* Author: Alexey Melnichuk <alexeymelnichuck@gmail.com>
+*
+* Copyright (C) 2014-2019 Alexey Melnichuk <alexeymelnichuck@gmail.com>
+*
+* Licensed according to the included 'LICENSE' document
+*
+* This file is part of lua-lluv library.
+******************************************************************************/
+
+#include "lluv.h"
+#include "lluv_handle.h"
+#include "lluv_async.h"
+#include "lluv_loop.h"
+#include "lluv_error.h"
+#include "lluv_serial.h"
+#include <assert.h>
+#include <stddef.h>
+
+#define LLUV_ASYNC_NAME LLUV_PREFIX" Async"
+static const char *LLUV_ASYNC = LLUV_ASYNC_NAME;
+
+/* Payloads are pushed to stack by any number of threads.
+** Loop thread takes whole stack with one atomic exchange, reverses it
+** and delivers payloads in send order. Consumer never pops single nodes
+** so there no ABA problem.
+**
+** Stack and uv_async_t pointer live in shared block which can outlive
+** handle. Block is referenced by handle and by each pointer returned by
+** `ptr`. Producers push and wakeup loop under mutex and get EPIPE after
+** handle closed.
+*/
+
+#define LLUV_ASYNC_MAGIC 0x4C415359 /* LASY */
+
+#if defined(_MSC_VER)
+#  define lluv_atomic_cas_ptr(P, O, N) (InterlockedCompareExchangePointer((PVOID volatile*)(P), (N), (O)) == (O))
+#  define lluv_atomic_xchg_ptr(P, N)   InterlockedExchangePointer((PVOID volatile*)(P), (N))
+#else
+#  define lluv_atomic_cas_ptr(P, O, N) __sync_bool_compare_and_swap((P), (O), (N))
+#  define lluv_atomic_xchg_ptr(P, N)   __sync_lock_test_and_set((P), (N))
+#endif
+
+typedef struct lluv_async_node_tag lluv_async_node_t;
+
+struct lluv_async_node_tag{
+  lluv_async_node_t *next;
+  size_t             size;
+  char               data[1];
+};
+
+#define LLUV_ASYNC_NODE_HEADER offsetof(lluv_async_node_t, data)
+
+typedef struct lluv_async_shared_tag{
+  unsigned int                magic;
+  uv_mutex_t                  mutex;
+  int                         refs;    /* handle and pointers returned by `ptr` */
+  int                         closed;  /* handle closed. protected by mutex */
+  lluv_async_node_t *volatile head;    /* written by producers */
+  uv_async_t                 *async;
+}lluv_async_shared_t;
+
+typedef struct lluv_async_ext_tag{
+  lluv_handle_ext_t    base;
+  lluv_async_node_t   *pending; /* taken but not delivered yet (loop thread only) */
+  lluv_async_shared_t *shared;
+}lluv_async_ext_t;
+
+static void lluv_async_free_nodes(lluv_async_node_t *node){
+  while(node){
+    lluv_async_node_t *next = node->next;
+    lluv_free(NULL, node);
+    node = next;
+  }
+}
+
+static lluv_async_shared_t *lluv_async_shared_new(uv_async_t *async){
+  lluv_async_shared_t *shared = lluv_alloc_t(NULL, lluv_async_shared_t);
+  if(!shared) return NULL;
+
+  if(uv_mutex_init(&shared->mutex) < 0){
+    lluv_free_t(NULL, lluv_async_shared_t, shared);
+    return NULL;
+  }
+
+  shared->magic  = LLUV_ASYNC_MAGIC;
+  shared->refs   = 1;
+  shared->closed = 0;
+  shared->head   = NULL;
+  shared->async  = async;
+
+  return shared;
+}
+
+static void lluv_async_shared_ref(lluv_async_shared_t *shared){
+  uv_mutex_lock(&shared->mutex);
+  shared->refs += 1;
+  uv_mutex_unlock(&shared->mutex);
+}
+
+/* can be called from any thread */
+static void lluv_async_shared_unref(lluv_async_shared_t *shared){
+  int refs;
+
+  uv_mutex_lock(&shared->mutex);
+  refs = --shared->refs;
+  uv_mutex_unlock(&shared->mutex);
+
+  if(refs) return;
+
+  shared->magic = 0;
+  uv_mutex_destroy(&shared->mutex);
+  lluv_free_t(NULL, lluv_async_shared_t, shared);
+}
+
+/* called by loop thread when handle is going to close */
+static void lluv_async_shared_close(lluv_async_shared_t *shared){
+  uv_mutex_lock(&shared->mutex);
+  shared->closed = 1;
+  shared->async  = NULL;
+  uv_mutex_unlock(&shared->mutex);
+
+  lluv_async_free_nodes((lluv_async_node_t*)lluv_atomic_xchg_ptr(&shared->head, NULL));
+}
+
+static void lluv_async_ext_close(lua_State *L, lluv_handle_t *handle, lluv_handle_ext_t *arg){
+  lluv_async_ext_t *ext = (lluv_async_ext_t*)arg;
+  UNUSED_ARG(L); UNUSED_ARG(handle);
+  lluv_async_shared_close(ext->shared);
+}
+
+static void lluv_async_ext_free(lua_State *L, lluv_handle_t *handle, lluv_handle_ext_t *arg){
+  lluv_async_ext_t *ext = (lluv_async_ext_t*)arg;
+  UNUSED_ARG(handle);
+  lluv_async_free_nodes(ext->pending);
+  lluv_async_shared_close(ext->shared);
+  lluv_async_shared_unref(ext->shared);
+  lluv_free_t(L, lluv_async_ext_t, ext);
+}
+
+/* can be called from any thread. node released if handle closed */
+static int lluv_async_push(lluv_async_shared_t *shared, lluv_async_node_t *node){
+  uv_mutex_lock(&shared->mutex);
+
+  if(shared->closed){
+    uv_mutex_unlock(&shared->mutex);
+    lluv_async_free_nodes(node);
+    return UV_EPIPE;
+  }
+
+  if(node){
+    do{
+      node->next = shared->head;
+    }while(!lluv_atomic_cas_ptr(&shared->head, node->next, node));
+  }
+
+  uv_async_send(shared->async);
+
+  uv_mutex_unlock(&shared->mutex);
+
+  return 0;
+}
+
+/* serialize values to node. node is NULL if there no values */
+static int lluv_async_pack(lua_State *L, int first, lluv_async_node_t **pnode){
+  lluv_sbuf_t buf;
+  int err;
+
+  *pnode = NULL;
+  if(first > lua_gettop(L)) return 0;
+
+  lluv_sbuf_init(&buf);
+  err = lluv_sbuf_reserve(&buf, LLUV_ASYNC_NODE_HEADER);
+  if(!err) err = lluv_serialize(L, first, lua_gettop(L), &buf);
+  if(err < 0){
+    lluv_sbuf_free(&buf);
+    return err;
+  }
+
+  *pnode = (lluv_async_node_t*)buf.data;
+  (*pnode)->next = NULL;
+  (*pnode)->size = buf.size - LLUV_ASYNC_NODE_HEADER;
+
+  return 0;
+}
+
+LLUV_INTERNAL int lluv_async_index(lua_State *L){
+  return lluv__index(L, LLUV_ASYNC, lluv_handle_index);
+}
+
+static lluv_handle_t* lluv_check_async(lua_State *L, int idx, lluv_flags_t flags){
+  lluv_handle_t *handle = lluv_check_handle(L, idx, flags);
+  luaL_argcheck (L, LLUV_H(handle, uv_handle_t)->type == UV_ASYNC, idx, LLUV_ASYNC_NAME" expected");
+
+  return handle;
+}
+
+static void lluv_on_async(uv_async_t *arg){
+  lluv_handle_t *handle = lluv_handle_byptr((uv_handle_t*)arg);
+  lluv_async_ext_t *ext = (lluv_async_ext_t*)handle->ext;
+  lluv_loop_t *loop = lluv_loop_by_handle(&handle->handle);
+  lua_State *L = LLUV_HCALLBACK_L(handle);
+  lluv_async_node_t *node, *list = NULL, **tail;
+
+  LLUV_CHECK_LOOP_CB_INVARIANT(L);
+
+  /* take all and restore send order */
+  node = (lluv_async_node_t*)lluv_atomic_xchg_ptr(&ext->shared->head, NULL);
+  while(node){
+    lluv_async_node_t *next = node->next;
+    node->next = list;
+    list = node;
+    node = next;
+  }
+
+  tail = &ext->pending;
+  while(*tail) tail = &(*tail)->next;
+  *tail = list;
+
+  if(!ext->pending){
+    /* wakeup without payload */
+    lua_rawgeti(L, LLUV_LUA_REGISTRY, LLUV_START_CB(handle));
+    lluv_handle_pushself(L, handle);
+    LLUV_HANDLE_CALL_CB(L, handle, 1);
+    LLUV_CHECK_LOOP_CB_INVARIANT(L);
+    return;
+  }
+
+  while(ext->pending){
+    int n, err;
+
+    node = ext->pending;
+    ext->pending = node->next;
+
+    lua_rawgeti(L, LLUV_LUA_REGISTRY, LLUV_START_CB(handle));
+    lluv_handle_pushself(L, handle);
+    n = lluv_deserialize(L, node->data, node->size);
+    lluv_free(L, node);
+
+    if(n < 0){
+      lua_pop(L, 2);
+      continue;
+    }
+
+    err = lluv_loop_call(L, loop, n + 1, UV_ASYNC, LLUV_CB_MESSAGE);
+    if(!err) lluv_loop_defer_proceed(L, loop);
+
+    /* handle closed from callback. ext already released */
+    if(!IS_(handle, OPEN) || uv_is_closing(LLUV_H(handle, uv_handle_t))) break;
+
+    if(err){
+      /* deliver rest on next iteration */
+      if(ext->pending) uv_async_send(arg);
+      break;
+    }
+  }
+
+  LLUV_CHECK_LOOP_CB_INVARIANT(L);
+}
+
+// async([loop,] cb)
+LLUV_IMPL_SAFE(lluv_async_create){
+  lluv_loop_t      *loop   = lluv_opt_loop(L, 1, LLUV_FLAG_OPEN);
+  int               cb     = loop ? 2 : 1;
+  lluv_async_ext_t *ext;
+  lluv_handle_t    *handle;
+  int err;
+
+  lluv_check_callable(L, cb);
+
+  if(!loop) loop = lluv_default_loop(L);
+
+  ext = lluv_alloc_t(L, lluv_async_ext_t);
+  if(!ext) return lluv_fail(L, safe_flag | loop->flags, LLUV_ERR_UV, UV_ENOMEM, NULL);
+
+  handle = lluv_handle_create(L, UV_ASYNC, safe_flag | INHERITE_FLAGS(loop));
+
+  ext->shared = lluv_async_shared_new(LLUV_H(handle, uv_async_t));
+  if(!ext->shared){
+    lluv_free_t(L, lluv_async_ext_t, ext);
+    lluv_handle_cleanup(L, handle, -1);
+    return lluv_fail(L, safe_flag | loop->flags, LLUV_ERR_UV, UV_ENOMEM, NULL);
+  }
+
+  err = uv_async_init(loop->handle, LLUV_H(handle, uv_async_t), lluv_on_async);
+  if(err < 0){
+    lluv_async_shared_unref(ext->shared);
+    lluv_free_t(L, lluv_async_ext_t, ext);
+    lluv_handle_cleanup(L, handle, -1);
+    return lluv_fail(L, safe_flag | loop->flags, LLUV_ERR_UV, (uv_errno_t)err, NULL);
+  }
+
+  ext->base.free  = lluv_async_ext_free;
+  ext->base.close = lluv_async_ext_close;
+  ext->pending    = NULL;
+  handle->ext     = &ext->base;
+
+  lua_pushvalue(L, cb);
+  LLUV_START_CB(handle) = luaL_ref(L, LLUV_LUA_REGISTRY);
+
+  /* async handle is always active */
+  lluv_handle_lock(L, handle, LLUV_LOCK_START);
+
+  return 1;
+}
+
+static int lluv_async_send_impl(lua_State *L, lluv_flags_t flags, lluv_async_shared_t *shared, int first){
+  lluv_async_node_t *node;
+  int err = lluv_async_pack(L, first, &node);
+
+  if(err < 0)
+    return lluv_fail(L, flags, LLUV_ERR_UV, err, "can not serialize value");
+
+  err = lluv_async_push(shared, node);
+  if(err < 0)
+    return lluv_fail(L, flags, LLUV_ERR_UV, err, NULL);
+
+  return 0;
+}
+
+// send(...)
+static int lluv_async_send(lua_State *L){
+  lluv_handle_t *handle = lluv_check_async(L, 1, LLUV_FLAG_OPEN);
+  int ret = lluv_async_send_impl(L, handle->flags, ((lluv_async_ext_t*)handle->ext)->shared, 2);
+  if(ret) return ret;
+
+  lua_settop(L, 1);
+  return 1;
+}
+
+/* Pointer can be passed to other Lua state (e.g. to worker) and used with
+** `uv.async_send`. Each pointer holds reference to shared block
+** and have to be released with `uv.async_release`.
+*/
+static int lluv_async_ptr(lua_State *L){
+  lluv_handle_t *handle = lluv_check_async(L, 1, LLUV_FLAG_OPEN);
+  lluv_async_ext_t *ext = (lluv_async_ext_t*)handle->ext;
+
+  lluv_async_shared_ref(ext->shared);
+  lua_pushlightuserdata(L, ext->shared);
+  return 1;
+}
+
+static lluv_async_shared_t *lluv_check_async_ptr(lua_State *L, int idx){
+  lluv_async_shared_t *shared;
+
+  luaL_checktype(L, idx, LUA_TLIGHTUSERDATA);
+  shared = (lluv_async_shared_t*)lua_touserdata(L, idx);
+  luaL_argcheck(L, (shared != NULL) && (shared->magic == LLUV_ASYNC_MAGIC),
+    idx, LLUV_ASYNC_NAME" pointer expected");
+
+  return shared;
+}
+
+// async_send(ptr, ...)
+LLUV_IMPL_SAFE(lluv_async_send_ptr){
+  lluv_async_shared_t *shared = lluv_check_async_ptr(L, 1);
+  int ret = lluv_async_send_impl(L, safe_flag, shared, 2);
+  if(ret) return ret;
+
+  lua_pushboolean(L, 1);
+  return 1;
+}
+
+// async_release(ptr)
+static int lluv_async_release_ptr(lua_State *L){
+  lluv_async_shared_t *shared = lluv_check_async_ptr(L, 1);
+  lluv_async_shared_unref(shared);
+  return 0;
+}
+
+static const struct luaL_Reg lluv_async_methods[] = {
+  { "send",       lluv_async_send      },
+  { "ptr",        lluv_async_ptr       },
+
+  {NULL,NULL}
+};
+
+#define LLUV_FUNCTIONS(F)                        \
+  {"async",      lluv_async_create_##F},         \
+  {"async_send", lluv_async_send_ptr_##F},       \
+  {"async_release", lluv_async_release_ptr},     \
+
+static const struct luaL_Reg lluv_functions[][4] = {
+  {
+    LLUV_FUNCTIONS(unsafe)
+
+    {NULL,NULL}
+  },
+  {
+    LLUV_FUNCTIONS(safe)
+
+    {NULL,NULL}
+  },
+};
+
+LLUV_INTERNAL void lluv_async_initlib(lua_State *L, int nup, int safe){
+  assert((safe == 0) || (safe == 1));
+
+  lutil_pushnvalues(L, nup);
+  if(!lutil_createmetap(L, LLUV_ASYNC, lluv_async_methods, nup))
+    lua_pop(L, nup);
+  lua_pop(L, 1);
+
+  luaL_setfuncs(L, lluv_functions[safe], nup);
+}
@@ -0,0 +1,18 @@
+/******************************************************************************
+* Author: Alexey Melnichuk <alexeymelnichuck@gmail.com>
+*
+* Copyright (C) 2014-2019 Alexey Melnichuk <alexeymelnichuck@gmail.com>
+*
+* Licensed according to the included 'LICENSE' document
+*
+* This file is part of lua-lluv library.
+******************************************************************************/
+
+#ifndef _LLUV_ASYNC_H_
+#define _LLUV_ASYNC_H_
+
+LLUV_INTERNAL void lluv_async_initlib(lua_State *L, int nup, int safe);
+
+LLUV_INTERNAL int lluv_async_index(lua_State *L);
+
+#endif
@@ -0,0 +1,165 @@
+/******************************************************************************
+* Author: Alexey Melnichuk <alexeymelnichuck@gmail.com>
+*
+* Copyright (C) 2014-2019 Alexey Melnichuk <alexeymelnichuck@gmail.com>
+*
+* Licensed according to the included 'LICENSE' document
+*
+* This file is part of lua-lluv library.
+******************************************************************************/
+
+#include "lluv.h"
+#include "lluv_utils.h"
+#include "lluv_bufpool.h"
+#include <assert.h>
+
+/* Each block has header just before data.
+** Header is aligned so data has same alignment as malloc result.
+*/
+union lluv_bufpool_block_tag{
+  struct{
+    lluv_bufpool_block_t *next;
+    int                   cls; /* size class or -1 for oversized blocks */
+  }h;
+
+  double     align_d;
+  void      *align_p;
+  long long  align_ll;
+};
+
+#define LLUV_BUFPOOL_CLASS_SIZE(C) ((size_t)1 << (LLUV_BUFPOOL_MIN_SHIFT + (C)))
+
+#define LLUV_BUFPOOL_BLOCK(B) ((lluv_bufpool_block_t*)(B) - 1)
+
+#define LLUV_BUFPOOL_DATA(B) ((char*)((lluv_bufpool_block_t*)(B) + 1))
+
+static int lluv_bufpool_class(size_t size){
+  int cls = 0;
+  while(LLUV_BUFPOOL_CLASS_SIZE(cls) < size){
+    if(++cls == LLUV_BUFPOOL_CLASSES) return -1;
+  }
+  return cls;
+}
+
+LLUV_INTERNAL void lluv_bufpool_init(lluv_bufpool_t *pool){
+  int i;
+  for(i = 0; i < LLUV_BUFPOOL_CLASSES; ++i){
+    pool->free[i]  = NULL;
+    pool->nfree[i] = 0;
+  }
+
+  pool->allocs   = 0;
+  pool->hits     = 0;
+  pool->oversize = 0;
+  pool->trims    = 0;
+  pool->in_use   = 0;
+  pool->peak     = 0;
+  pool->cached   = 0;
+}
+
+LLUV_INTERNAL void lluv_bufpool_close(lua_State *L, lluv_bufpool_t *pool){
+  int i;
+  for(i = 0; i < LLUV_BUFPOOL_CLASSES; ++i){
+    while(pool->free[i]){
+      lluv_bufpool_block_t *block = pool->free[i];
+      pool->free[i] = block->h.next;
+      lluv_free(L, block);
+    }
+    pool->nfree[i] = 0;
+  }
+  pool->cached = 0;
+}
+
+LLUV_INTERNAL uv_buf_t lluv_bufpool_alloc(lua_State *L, lluv_bufpool_t *pool, size_t size){
+  lluv_bufpool_block_t *block;
+  int cls = lluv_bufpool_class(size);
+
+  pool->allocs += 1;
+
+  if(cls < 0){
+    pool->oversize += 1;
+    block = (lluv_bufpool_block_t*)lluv_alloc(L, sizeof(lluv_bufpool_block_t) + size);
+  }
+  else{
+    size = LLUV_BUFPOOL_CLASS_SIZE(cls);
+    block = pool->free[cls];
+    if(block){
+      pool->free[cls]   = block->h.next;
+      pool->nfree[cls] -= 1;
+      pool->cached     -= size;
+      pool->hits       += 1;
+    }
+    else{
+      block = (lluv_bufpool_block_t*)lluv_alloc(L, sizeof(lluv_bufpool_block_t) + size);
+    }
+  }
+
+  if(!block) return lluv_buf_init(NULL, 0);
+
+  block->h.next = NULL;
+  block->h.cls  = cls;
+
+  pool->in_use += 1;
+  if(pool->in_use > pool->peak) pool->peak = pool->in_use;
+
+  return lluv_buf_init(LLUV_BUFPOOL_DATA(block), size);
+}
+
+LLUV_INTERNAL void lluv_bufpool_free(lua_State *L, lluv_bufpool_t *pool, char *base){
+  lluv_bufpool_block_t *block;
+  int cls;
+
+  if(!base) return;
+
+  block = LLUV_BUFPOOL_BLOCK(base);
+  cls   = block->h.cls;
+
+  assert(pool->in_use > 0);
+  pool->in_use -= 1;
+
+  if(cls < 0){
+    lluv_free(L, block);
+    return;
+  }
+
+  assert(cls < LLUV_BUFPOOL_CLASSES);
+
+  if(pool->nfree[cls] >= LLUV_BUFPOOL_MAX_FREE){
+    pool->trims += 1;
+    lluv_free(L, block);
+    return;
+  }
+
+  block->h.next     = pool->free[cls];
+  pool->free[cls]   = block;
+  pool->nfree[cls] += 1;
+  pool->cached     += LLUV_BUFPOOL_CLASS_SIZE(cls);
+}
+
+LLUV_INTERNAL void lluv_bufpool_push_stats(lua_State *L, lluv_bufpool_t *pool){
+#define SET_FIELD_INT(F,V)  lutil_pushint64(L, (int64_t)pool->V); lua_setfield(L, -2, F)
+
+  int i;
+
+  lua_newtable(L);
+  SET_FIELD_INT( "allocs"  , allocs   );
+  SET_FIELD_INT( "hits"    , hits     );
+  SET_FIELD_INT( "oversize", oversize );
+  SET_FIELD_INT( "trims"   , trims    );
+  SET_FIELD_INT( "in_use"  , in_use   );
+  SET_FIELD_INT( "peak"    , peak     );
+  SET_FIELD_INT( "cached"  , cached   );
+
+  lutil_pushint64(L, (int64_t)(pool->allocs - pool->hits - pool->oversize));
+  lua_setfield(L, -2, "misses");
+
+  /* number of free blocks for each size class */
+  lua_newtable(L);
+  for(i = 0; i < LLUV_BUFPOOL_CLASSES; ++i){
+    lutil_pushint64(L, (int64_t)pool->nfree[i]);
+    lua_rawseti(L, -2, i + 1);
+  }
+  lua_setfield(L, -2, "free");
+
+#undef SET_FIELD_INT
+}
@@ -0,0 +1,60 @@
+/******************************************************************************
+* Author: Alexey Melnichuk <alexeymelnichuck@gmail.com>
+*
+* Copyright (C) 2014-2019 Alexey Melnichuk <alexeymelnichuck@gmail.com>
+*
+* Licensed according to the included 'LICENSE' document
+*
+* This file is part of lua-lluv library.
+******************************************************************************/
+
+#ifndef _LLUV_BUFPOOL_H_
+#define _LLUV_BUFPOOL_H_
+
+#include "lluv.h"
+#include "lluv_utils.h"
+
+/* smallest size class is 1 << LLUV_BUFPOOL_MIN_SHIFT (4 KiB) */
+#define LLUV_BUFPOOL_MIN_SHIFT 12
+
+/* largest size class is 1 << LLUV_BUFPOOL_MAX_SHIFT (256 KiB)
+** bigger requests bypass the pool
+*/
+#define LLUV_BUFPOOL_MAX_SHIFT 18
+
+#define LLUV_BUFPOOL_CLASSES (LLUV_BUFPOOL_MAX_SHIFT - LLUV_BUFPOOL_MIN_SHIFT + 1)
+
+/* high-water mark. Number of free blocks which pool keep for each class.
+** All blocks released above this limit returns to system allocator.
+*/
+#ifndef LLUV_BUFPOOL_MAX_FREE
+#  define LLUV_BUFPOOL_MAX_FREE 8
+#endif
+
+typedef union lluv_bufpool_block_tag lluv_bufpool_block_t;
+
+typedef struct lluv_bufpool_tag{
+  lluv_bufpool_block_t *free[LLUV_BUFPOOL_CLASSES];
+  unsigned int         nfree[LLUV_BUFPOOL_CLASSES];
+
+  /* statistics */
+  size_t allocs;     /* total number of allocations             */
+  size_t hits;       /* allocations served from free lists      */
+  size_t oversize;   /* allocations bigger than largest class   */
+  size_t trims;      /* blocks returned to system at high-water */
+  size_t in_use;     /* number of blocks currently allocated    */
+  size_t peak;       /* maximum value of `in_use`               */
+  size_t cached;     /* bytes kept in free lists                */
+}lluv_bufpool_t;
+
+LLUV_INTERNAL void lluv_bufpool_init(lluv_bufpool_t *pool);
+
+LLUV_INTERNAL void lluv_bufpool_close(lua_State *L, lluv_bufpool_t *pool);
+
+LLUV_INTERNAL uv_buf_t lluv_bufpool_alloc(lua_State *L, lluv_bufpool_t *pool, size_t size);
+
+LLUV_INTERNAL void lluv_bufpool_free(lua_State *L, lluv_bufpool_t *pool, char *base);
+
+LLUV_INTERNAL void lluv_bufpool_push_stats(lua_State *L, lluv_bufpool_t *pool);
+
+#endif
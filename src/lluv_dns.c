@@ -116,7 +116,7 @@ static void lluv_on_getnameinfo(uv_getnameinfo_t* arg, int status, const char* h
 
   lluv_req_free(L, req);
 
-  LLUV_LOOP_CALL_CB(L, loop, 4);
+  LLUV_LOOP_CALL_CB(L, loop, 4, LLUV_CB_DNS);
 
   LLUV_CHECK_LOOP_CB_INVARIANT(L);
 }
@@ -192,7 +192,7 @@ static void lluv_on_getaddrinfo(uv_getaddrinfo_t* arg, int status, struct addrin
   if(status < 0){
     uv_freeaddrinfo(res);
     lluv_error_create(L, LLUV_ERR_UV, (uv_errno_t)status, NULL);
-    LLUV_LOOP_CALL_CB(L, loop, 2);
+    LLUV_LOOP_CALL_CB(L, loop, 2, LLUV_CB_DNS);
     LLUV_CHECK_LOOP_CB_INVARIANT(L);
     return;
   }
@@ -202,7 +202,7 @@ static void lluv_on_getaddrinfo(uv_getaddrinfo_t* arg, int status, struct addrin
   lluv_push_addrinfo(L, res);
 
   uv_freeaddrinfo(res);
-  LLUV_LOOP_CALL_CB(L, loop, 3);
+  LLUV_LOOP_CALL_CB(L, loop, 3, LLUV_CB_DNS);
 
   LLUV_CHECK_LOOP_CB_INVARIANT(L);
 }
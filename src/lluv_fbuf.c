@@ -10,18 +10,30 @@
 
 #include "lluv_fbuf.h"
 #include "lluv_utils.h"
-
-//! @todo implement pack/unpack functions
+#include "lluv_error.h"
+#include <string.h>
+#include <assert.h>
 
 //{ Fixed buffer
 
 #define LLUV_FIXEDBUFFER_NAME LLUV_PREFIX" Fixed buffer"
 static const char *LLUV_FIXEDBUFFER = LLUV_FIXEDBUFFER_NAME;
 
+static lluv_fixed_buffer_t *lluv_fbuf_new_impl(lua_State *L, size_t size){
+  lluv_fixed_buffer_t *buffer = (lluv_fixed_buffer_t*)lutil_newudatap_impl(L, size, LLUV_FIXEDBUFFER);
+  buffer->capacity = 0;
+  buffer->data     = &buffer->storage[0];
+  buffer->pins     = 0;
+  buffer->root     = NULL;
+  buffer->parent   = LUA_NOREF;
+  buffer->flags    = 0;
+  return buffer;
+}
+
 LLUV_INTERNAL lluv_fixed_buffer_t *lluv_fbuf_alloc(lua_State *L, size_t n){
-  lluv_fixed_buffer_t *buffer = (lluv_fixed_buffer_t*)lutil_newudatap_impl(L, sizeof(lluv_fixed_buffer_t) + n - 1, LLUV_FIXEDBUFFER);
+  lluv_fixed_buffer_t *buffer = lluv_fbuf_new_impl(L, sizeof(lluv_fixed_buffer_t) + n - 1);
   buffer->capacity = n;
-  
+
   // this prevent GC so user shoul do this explicitly
   // but we remove ref in close method
   //
@@ -30,15 +42,90 @@ LLUV_INTERNAL lluv_fixed_buffer_t *lluv_fbuf_alloc(lua_State *L, size_t n){
   return buffer;
 }
 
+LLUV_INTERNAL void lluv_push_fbuf_copy(lua_State *L, const char *data, size_t n){
+  lluv_fixed_buffer_t *buffer;
+
+  lutil_getmetatablep(L, LLUV_FIXEDBUFFER);
+  if(!lua_istable(L, -1)){
+    lua_pop(L, 1);
+    lua_pushlstring(L, data, n);
+    return;
+  }
+  lua_pop(L, 1);
+
+  buffer = lluv_fbuf_alloc(L, n);
+  if(n) memcpy(buffer->data, data, n);
+}
+
+static lluv_fixed_buffer_t *lluv_fbuf_alloc_growable(lua_State *L, size_t n){
+  lluv_fixed_buffer_t *buffer = lluv_fbuf_new_impl(L, sizeof(lluv_fixed_buffer_t));
+  buffer->data = (char*)lluv_alloc(L, n ? n : 1);
+  if(!buffer->data){
+    lua_pushliteral(L, "not enough memory");
+    lua_error(L);
+  }
+  buffer->capacity = n;
+  SET(buffer, LLUV_FLAG_FBUF_GROWABLE);
+  return buffer;
+}
+
 LLUV_INTERNAL lluv_fixed_buffer_t *lluv_check_fbuf(lua_State *L, int i){
   lluv_fixed_buffer_t *buffer = (lluv_fixed_buffer_t *)lutil_checkudatap (L, i, LLUV_FIXEDBUFFER);
   luaL_argcheck (L, buffer != NULL, i, LLUV_FIXEDBUFFER_NAME" expected");
   return buffer;
 }
 
+LLUV_INTERNAL lluv_fixed_buffer_t *lluv_opt_fbuf(lua_State *L, int i){
+  if(!lutil_isudatap(L, i, LLUV_FIXEDBUFFER)) return NULL;
+  return (lluv_fixed_buffer_t *)lua_touserdata(L, i);
+}
+
+LLUV_INTERNAL void lluv_fbuf_pin(lluv_fixed_buffer_t *buffer){
+  if(buffer->root) buffer = buffer->root;
+  buffer->pins += 1;
+}
+
+LLUV_INTERNAL void lluv_fbuf_unpin(lluv_fixed_buffer_t *buffer){
+  if(buffer->root) buffer = buffer->root;
+  if(buffer->pins > 0) buffer->pins -= 1;
+}
+
+/* [offset, [length]] -> position inside buffer.
+ * default offset is 0 and default length is rest of buffer
+ */
+static void lluv_fbuf_opt_range(lua_State *L, lluv_fixed_buffer_t *buffer, int idx, size_t *offset, size_t *length){
+  int64_t off = lua_isnoneornil(L, idx) ? 0 : lutil_checkint64(L, idx);
+  int64_t len;
+
+  luaL_argcheck (L, (off >= 0) && ((uint64_t)off <= buffer->capacity), idx, LLUV_PREFIX" offset out of index");
+
+  if(lua_isnoneornil(L, idx + 1)){
+    len = buffer->capacity - off;
+  }
+  else{
+    len = lutil_checkint64(L, idx + 1);
+    luaL_argcheck (L, (len >= 0) && ((uint64_t)(off + len) <= buffer->capacity), idx + 1, LLUV_PREFIX" length out of index");
+  }
+
+  *offset = (size_t)off;
+  *length = (size_t)len;
+}
+
+static size_t lluv_fbuf_check_offset(lua_State *L, lluv_fixed_buffer_t *buffer, int idx, size_t size){
+  int64_t off = lutil_checkint64(L, idx);
+  luaL_argcheck (L, (off >= 0) && ((uint64_t)off + size <= buffer->capacity), idx, LLUV_PREFIX" offset out of index");
+  return (size_t)off;
+}
+
 static int lluv_fbuf_new(lua_State *L){
   int64_t len = lutil_checkint64(L, 1);
-  /*lluv_fixed_buffer_t *buffer = */lluv_fbuf_alloc(L, (size_t)len);
+  luaL_argcheck (L, len >= 0, 1, LLUV_PREFIX" invalid buffer size");
+
+  if(lua_toboolean(L, 2))
+    lluv_fbuf_alloc_growable(L, (size_t)len);
+  else
+    lluv_fbuf_alloc(L, (size_t)len);
+
   return 1;
 }
 
@@ -49,6 +136,28 @@ static int lluv_fbuf_close(lua_State *L){
   return 0;
 }
 
+static int lluv_fbuf__gc(lua_State *L){
+  lluv_fixed_buffer_t *buffer = lluv_check_fbuf(L, 1);
+
+  lluv_fbuf_close(L);
+
+  if(IS(buffer, LLUV_FLAG_FBUF_VIEW)){
+    lluv_fbuf_unpin(buffer);
+    buffer->root = NULL;
+    luaL_unref(L, LLUV_LUA_REGISTRY, buffer->parent);
+    buffer->parent = LUA_NOREF;
+  }
+  else if(IS(buffer, LLUV_FLAG_FBUF_GROWABLE)){
+    lluv_free(L, buffer->data);
+  }
+
+  buffer->data     = NULL;
+  buffer->capacity = 0;
+  buffer->flags    = 0;
+
+  return 0;
+}
+
 static int lluv_fbuf_to_s(lua_State *L){
   lluv_fixed_buffer_t *buffer = lluv_check_fbuf(L, 1);
   int64_t len = buffer->capacity;
@@ -90,17 +199,304 @@ static int lluv_fbuf_size(lua_State *L){
   return 1;
 }
 
+static int lluv_fbuf_growable(lua_State *L){
+  lluv_fixed_buffer_t *buffer = lluv_check_fbuf(L, 1);
+  lua_pushboolean(L, IS(buffer, LLUV_FLAG_FBUF_GROWABLE) ? 1 : 0);
+  return 1;
+}
+
+static int lluv_fbuf_resize(lua_State *L){
+  lluv_fixed_buffer_t *buffer = lluv_check_fbuf(L, 1);
+  int64_t len = lutil_checkint64(L, 2);
+  char *data;
+
+  luaL_argcheck (L, IS(buffer, LLUV_FLAG_FBUF_GROWABLE), 1, LLUV_PREFIX" growable buffer expected");
+  luaL_argcheck (L, len >= 0, 2, LLUV_PREFIX" invalid buffer size");
+
+  if(buffer->pins){
+    lluv_error_create(L, LLUV_ERR_UV, UV_EBUSY, NULL);
+    return lua_error(L);
+  }
+
+  data = (char*)lluv_alloc(L, len ? (size_t)len : 1);
+  if(!data){
+    lua_pushliteral(L, "not enough memory");
+    return lua_error(L);
+  }
+
+  memcpy(data, buffer->data, ((size_t)len < buffer->capacity) ? (size_t)len : buffer->capacity);
+  lluv_free(L, buffer->data);
+  buffer->data     = data;
+  buffer->capacity = (size_t)len;
+
+  lua_settop(L, 1);
+  return 1;
+}
+
+static int lluv_fbuf_slice(lua_State *L){
+  lluv_fixed_buffer_t *buffer = lluv_check_fbuf(L, 1);
+  lluv_fixed_buffer_t *root   = buffer->root ? buffer->root : buffer;
+  lluv_fixed_buffer_t *view;
+  size_t offset, length;
+
+  lluv_fbuf_opt_range(L, buffer, 2, &offset, &length);
+
+  view = lluv_fbuf_new_impl(L, sizeof(lluv_fixed_buffer_t));
+  view->capacity = length;
+  view->data     = buffer->data + offset;
+  view->root     = root;
+  SET(view, LLUV_FLAG_FBUF_VIEW);
+
+  /* keep root buffer alive while view exists */
+  if(root == buffer) lua_pushvalue(L, 1);
+  else lua_rawgeti(L, LLUV_LUA_REGISTRY, buffer->parent);
+  view->parent = luaL_ref(L, LLUV_LUA_REGISTRY);
+
+  lluv_fbuf_pin(view);
+
+  return 1;
+}
+
+static int lluv_fbuf_is_view(lua_State *L){
+  lluv_fixed_buffer_t *buffer = lluv_check_fbuf(L, 1);
+  lua_pushboolean(L, IS(buffer, LLUV_FLAG_FBUF_VIEW) ? 1 : 0);
+  return 1;
+}
+
+static const char *lluv_fbuf_memmem(const char *str, size_t len, const char *pat, size_t n){
+  const char *end;
+
+  if(n == 0) return str;
+  if(n > len) return NULL;
+
+  end = str + len - n + 1;
+  while(str < end){
+    str = (const char*)memchr(str, pat[0], end - str);
+    if(!str) return NULL;
+    if(0 == memcmp(str, pat, n)) return str;
+    ++str;
+  }
+
+  return NULL;
+}
+
+static int lluv_fbuf_find(lua_State *L){
+  lluv_fixed_buffer_t *buffer = lluv_check_fbuf(L, 1);
+  size_t n; const char *pat = luaL_checklstring(L, 2, &n);
+  size_t offset, length; const char *res;
+
+  lluv_fbuf_opt_range(L, buffer, 3, &offset, &length);
+
+  res = lluv_fbuf_memmem(buffer->data + offset, length, pat, n);
+  if(!res) return 0;
+
+  lutil_pushint64(L, res - buffer->data);
+  return 1;
+}
+
+static int lluv_fbuf_copy(lua_State *L){
+  // dst:copy(dst_offset, src_buffer|string, [src_offset, [length]])
+  lluv_fixed_buffer_t *buffer = lluv_check_fbuf(L, 1);
+  int64_t dst = lutil_checkint64(L, 2);
+  lluv_fixed_buffer_t *src = lluv_opt_fbuf(L, 3);
+  const char *data; size_t capacity;
+  int64_t off, len;
+
+  if(src){
+    data = src->data; capacity = src->capacity;
+  }
+  else{
+    data = luaL_checklstring(L, 3, &capacity);
+  }
+
+  off = lua_isnoneornil(L, 4) ? 0 : lutil_checkint64(L, 4);
+  luaL_argcheck (L, (off >= 0) && ((uint64_t)off <= capacity), 4, LLUV_PREFIX" offset out of index");
+
+  len = lua_isnoneornil(L, 5) ? (int64_t)(capacity - off) : lutil_checkint64(L, 5);
+  luaL_argcheck (L, (len >= 0) && ((uint64_t)(off + len) <= capacity), 5, LLUV_PREFIX" length out of index");
+
+  luaL_argcheck (L, (dst >= 0) && ((uint64_t)(dst + len) <= buffer->capacity), 2, LLUV_PREFIX" offset out of index");
+
+  memmove(buffer->data + dst, data + off, (size_t)len);
+
+  lua_settop(L, 1);
+  return 1;
+}
+
+static int lluv_fbuf_fill(lua_State *L){
+  // buffer:fill(byte|char, [offset, [length]])
+  lluv_fixed_buffer_t *buffer = lluv_check_fbuf(L, 1);
+  size_t offset, length;
+  int ch;
+
+  if(lua_type(L, 2) == LUA_TSTRING){
+    size_t n; const char *str = lua_tolstring(L, 2, &n);
+    luaL_argcheck (L, n == 1, 2, LLUV_PREFIX" single char expected");
+    ch = (unsigned char)str[0];
+  }
+  else{
+    ch = (int)(luaL_optinteger(L, 2, 0) & 0xFF);
+  }
+
+  lluv_fbuf_opt_range(L, buffer, 3, &offset, &length);
+
+  memset(buffer->data + offset, ch, length);
+
+  lua_settop(L, 1);
+  return 1;
+}
+
+//{ Typed access
+
+static uint64_t lluv_fbuf_load(const unsigned char *p, size_t size, int be){
+  uint64_t v = 0; size_t i;
+  if(be) for(i = 0; i < size; ++i) v = (v << 8) | p[i];
+  else   for(i = size; i > 0; --i) v = (v << 8) | p[i - 1];
+  return v;
+}
+
+static void lluv_fbuf_store(unsigned char *p, size_t size, int be, uint64_t v){
+  size_t i;
+  if(be) for(i = size; i > 0; --i){ p[i - 1] = (unsigned char)(v & 0xFF); v >>= 8; }
+  else   for(i = 0; i < size; ++i){ p[i]     = (unsigned char)(v & 0xFF); v >>= 8; }
+}
+
+static int lluv_fbuf_get_int(lua_State *L, size_t size, int sign, int be){
+  lluv_fixed_buffer_t *buffer = lluv_check_fbuf(L, 1);
+  size_t off = lluv_fbuf_check_offset(L, buffer, 2, size);
+  uint64_t v = lluv_fbuf_load((unsigned char*)buffer->data + off, size, be);
+
+  if(sign && (size < 8) && (v & ((uint64_t)1 << (size * 8 - 1)))){
+    v |= ~(((uint64_t)1 << (size * 8)) - 1);
+  }
+
+  lutil_pushint64(L, (int64_t)v);
+  return 1;
+}
+
+static int lluv_fbuf_set_int(lua_State *L, size_t size, int be){
+  lluv_fixed_buffer_t *buffer = lluv_check_fbuf(L, 1);
+  size_t off = lluv_fbuf_check_offset(L, buffer, 2, size);
+  int64_t  v = lutil_checkint64(L, 3);
+
+  lluv_fbuf_store((unsigned char*)buffer->data + off, size, be, (uint64_t)v);
+
+  lua_settop(L, 1);
+  return 1;
+}
+
+static int lluv_fbuf_get_float(lua_State *L, size_t size, int be){
+  lluv_fixed_buffer_t *buffer = lluv_check_fbuf(L, 1);
+  size_t off = lluv_fbuf_check_offset(L, buffer, 2, size);
+  uint64_t v = lluv_fbuf_load((unsigned char*)buffer->data + off, size, be);
+
+  if(size == 4){
+    uint32_t u = (uint32_t)v; float f;
+    memcpy(&f, &u, sizeof(f));
+    lua_pushnumber(L, f);
+  }
+  else{
+    double d;
+    memcpy(&d, &v, sizeof(d));
+    lua_pushnumber(L, d);
+  }
+
+  return 1;
+}
+
+static int lluv_fbuf_set_float(lua_State *L, size_t size, int be){
+  lluv_fixed_buffer_t *buffer = lluv_check_fbuf(L, 1);
+  size_t off = lluv_fbuf_check_offset(L, buffer, 2, size);
+  double     d = luaL_checknumber(L, 3);
+  uint64_t   v;
+
+  if(size == 4){
+    float f = (float)d; uint32_t u;
+    memcpy(&u, &f, sizeof(u));
+    v = u;
+  }
+  else{
+    memcpy(&v, &d, sizeof(v));
+  }
+
+  lluv_fbuf_store((unsigned char*)buffer->data + off, size, be, v);
+
+  lua_settop(L, 1);
+  return 1;
+}
+
+/* name, size, signed, big endian */
+#define LLUV_FBUF_INT_TYPES(XX) \
+  XX( u8,    1, 0, 0 )          \
+  XX( i8,    1, 1, 0 )          \
+  XX( u16le, 2, 0, 0 )          \
+  XX( u16be, 2, 0, 1 )          \
+  XX( i16le, 2, 1, 0 )          \
+  XX( i16be, 2, 1, 1 )          \
+  XX( u32le, 4, 0, 0 )          \
+  XX( u32be, 4, 0, 1 )          \
+  XX( i32le, 4, 1, 0 )          \
+  XX( i32be, 4, 1, 1 )          \
+  XX( i64le, 8, 1, 0 )          \
+  XX( i64be, 8, 1, 1 )          \
+
+/* name, size, big endian */
+#define LLUV_FBUF_FLOAT_TYPES(XX) \
+  XX( f32le, 4, 0 )               \
+  XX( f32be, 4, 1 )               \
+  XX( f64le, 8, 0 )               \
+  XX( f64be, 8, 1 )               \
+
+#define XX(N, S, I, E)                                                              \
+  static int lluv_fbuf_get_##N(lua_State *L){ return lluv_fbuf_get_int(L, S, I, E); } \
+  static int lluv_fbuf_set_##N(lua_State *L){ return lluv_fbuf_set_int(L, S, E);    } \
+
+LLUV_FBUF_INT_TYPES(XX)
+
+#undef XX
+
+#define XX(N, S, E)                                                                   \
+  static int lluv_fbuf_get_##N(lua_State *L){ return lluv_fbuf_get_float(L, S, E); }  \
+  static int lluv_fbuf_set_##N(lua_State *L){ return lluv_fbuf_set_float(L, S, E); }  \
+
+LLUV_FBUF_FLOAT_TYPES(XX)
+
+#undef XX
+
+//}
+
+#define LLUV_FBUF_INT_METHODS(N, S, I, E) \
+  { "get_" #N, lluv_fbuf_get_##N },       \
+  { "set_" #N, lluv_fbuf_set_##N },       \
+
+#define LLUV_FBUF_FLOAT_METHODS(N, S, E)  \
+  { "get_" #N, lluv_fbuf_get_##N },       \
+  { "set_" #N, lluv_fbuf_set_##N },       \
+
 static const struct luaL_Reg lluv_fbuf_methods[] = {
-  { "__gc",        lluv_fbuf_close          },
+  { "__gc",        lluv_fbuf__gc            },
   { "__tostring",  lluv_fbuf_to_s           },
   { "free",        lluv_fbuf_close          },
   { "to_s",        lluv_fbuf_to_s           },
   { "to_p",        lluv_fbuf_topointer      },
   { "size",        lluv_fbuf_size           },
+  { "growable",    lluv_fbuf_growable       },
+  { "resize",      lluv_fbuf_resize         },
+  { "slice",       lluv_fbuf_slice          },
+  { "is_view",     lluv_fbuf_is_view        },
+  { "find",        lluv_fbuf_find           },
+  { "copy",        lluv_fbuf_copy           },
+  { "fill",        lluv_fbuf_fill           },
+
+  LLUV_FBUF_INT_TYPES(LLUV_FBUF_INT_METHODS)
+  LLUV_FBUF_FLOAT_TYPES(LLUV_FBUF_FLOAT_METHODS)
 
   {NULL,NULL}
 };
 
+#undef LLUV_FBUF_INT_METHODS
+#undef LLUV_FBUF_FLOAT_METHODS
+
 //}
 
 static const struct luaL_Reg lluv_fbuf_functions[] = {
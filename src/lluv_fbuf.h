@@ -12,16 +12,37 @@
 #define _LLUV_FBUF_H_
 
 #include "lluv.h"
+#include "lluv_utils.h"
 
-typedef struct lluv_fixed_buffer_tag{
-  size_t  capacity;
-  char    data[1];
-}lluv_fixed_buffer_t;
+typedef struct lluv_fixed_buffer_tag lluv_fixed_buffer_t;
+
+struct lluv_fixed_buffer_tag{
+  size_t               capacity;
+  char                *data;     /* points to `storage`, heap memory or memory of root buffer */
+  size_t               pins;     /* number of views and readers which use memory */
+  lluv_fixed_buffer_t *root;     /* buffer which owns memory (for views) */
+  int                  parent;   /* reference to root buffer (for views) */
+  lluv_flags_t         flags;
+  char                 storage[1];
+};
+
+#define LLUV_FLAG_FBUF_VIEW     LLUV_FLAG_0
+#define LLUV_FLAG_FBUF_GROWABLE LLUV_FLAG_1
 
 LLUV_INTERNAL void lluv_fbuf_initlib(lua_State *L, int nup, int safe);
 
 LLUV_INTERNAL lluv_fixed_buffer_t *lluv_fbuf_alloc(lua_State *L, size_t n);
 
+/* push new buffer with copy of data or string if library is not loaded in this state */
+LLUV_INTERNAL void lluv_push_fbuf_copy(lua_State *L, const char *data, size_t n);
+
 LLUV_INTERNAL lluv_fixed_buffer_t *lluv_check_fbuf(lua_State *L, int i);
 
+LLUV_INTERNAL lluv_fixed_buffer_t *lluv_opt_fbuf(lua_State *L, int i);
+
+/* prevent resizing of the buffer memory while it in use */
+LLUV_INTERNAL void lluv_fbuf_pin(lluv_fixed_buffer_t *buffer);
+
+LLUV_INTERNAL void lluv_fbuf_unpin(lluv_fixed_buffer_t *buffer);
+
 #endif
@@ -19,10 +19,13 @@
 #include "lluv_fbuf.h"
 #include <assert.h>
 #include <fcntl.h>
+#include <string.h>
+#include <stddef.h>
 
 #ifndef _WIN32
 
 #include <unistd.h>
+#include <errno.h>
 
 #endif
 
@@ -36,6 +39,9 @@ typedef struct lluv_fs_request_tag{
   lua_State *L;
   int cb;
   int file_ref;
+  lluv_fixed_buffer_t  *fbuf;   /* pinned buffer */
+  lluv_fixed_buffer_t **fbufs;  /* pinned buffers of vector request (NULL for strings) */
+  size_t                nfbufs;
 }lluv_fs_request_t;
 
 #define LLUV_FCALLBACK_L(H) (lluv_loop_byptr(H->req.loop)->L)
@@ -45,10 +51,22 @@ static lluv_fs_request_t *lluv_fs_request_new(lua_State *L){
   req->L        = L;
   req->req.data = req;
   req->cb = req->file_ref = LUA_NOREF;
+  req->fbuf     = NULL;
+  req->fbufs    = NULL;
+  req->nfbufs   = 0;
   return req;
 }
 
 static void lluv_fs_request_free(lua_State *L, lluv_fs_request_t *req){
+  size_t i;
+
+  /* buffers can be resized again when request done */
+  if(req->fbuf) lluv_fbuf_unpin(req->fbuf);
+  for(i = 0; i < req->nfbufs; ++i){
+    if(req->fbufs[i]) lluv_fbuf_unpin(req->fbufs[i]);
+  }
+  lluv_free(L, req->fbufs);
+
   if(req->cb != LUA_NOREF)
     luaL_unref(L, LLUV_LUA_REGISTRY, req->cb);
   if(req->file_ref != LUA_NOREF)
@@ -62,6 +80,20 @@ static void lluv_fs_request_free(lua_State *L, lluv_fs_request_t *req){
 
 static int lluv_file_create(lua_State *L, lluv_loop_t  *loop, uv_file h, unsigned char flags);
 
+#if LLUV_UV_VER_GE(1,28,0)
+
+#define LLUV_FS_IS_OPEN_REQ(T) (((T) == UV_FS_OPEN) || ((T) == UV_FS_OPENDIR))
+
+static void lluv_dir_attach(lua_State *L, int idx, uv_dir_t *handle);
+
+static void lluv_dir_done(lua_State *L, int idx);
+
+#else
+
+#define LLUV_FS_IS_OPEN_REQ(T) ((T) == UV_FS_OPEN)
+
+#endif
+
 static int lluv_push_fs_result_object(lua_State* L, lluv_fs_request_t* lreq) {
   uv_fs_t *req = &lreq->req;
   lluv_loop_t *loop = lluv_loop_byptr(req->loop);
@@ -113,6 +145,26 @@ static int lluv_push_fs_result_object(lua_State* L, lluv_fs_request_t* lreq) {
       lua_rawgeti(L, LLUV_LUA_REGISTRY, lreq->file_ref);
       return 1;
 
+#if LLUV_UV_VER_GE(1,28,0)
+    case UV_FS_OPENDIR:
+      lua_rawgeti(L, LLUV_LUA_REGISTRY, lreq->file_ref);
+      if(req->result < 0){
+        lua_pop(L, 1);
+        lua_pushnil(L);
+      }
+      else lluv_dir_attach(L, -1, (uv_dir_t*)req->ptr);
+      return 1;
+
+    case UV_FS_READDIR:
+      lua_rawgeti(L, LLUV_LUA_REGISTRY, lreq->file_ref);
+      lluv_dir_done(L, -1);
+      return 1;
+
+    case UV_FS_CLOSEDIR:
+      lua_rawgeti(L, LLUV_LUA_REGISTRY, lreq->file_ref);
+      return 1;
+#endif
+
     default:
       fprintf(stderr, "UNKNOWN FS TYPE %d\n", req->fs_type);
       return 0;
@@ -218,6 +270,33 @@ static int lluv_push_fs_result(lua_State* L, lluv_fs_request_t* lreq) {
       return 1;
 #endif
 
+#if LLUV_UV_VER_GE(1,28,0)
+    case UV_FS_OPENDIR:
+      lua_pushstring(L, req->path);
+      return 1;
+
+    case UV_FS_CLOSEDIR:
+      lua_pushboolean(L, 1);
+      return 1;
+
+    case UV_FS_READDIR:{
+      uv_dir_t *dir = (uv_dir_t*)req->ptr;
+      int i, n = (int)req->result;
+      lua_createtable(L, n, 0);
+      lua_createtable(L, n, 0);
+      for(i = 0; i < n; ++i){
+        lua_pushstring (L, dir->dirents[i].name); lua_rawseti(L, -3, i + 1);
+#define XX(C,S) case S: lua_pushliteral(L, C); lua_rawseti(L, -2, i + 1); break;
+          switch(dir->dirents[i].type){
+            LLUV_DIRENT_MAP(XX)
+            default: lua_pushstring(L, "unknown"); lua_rawseti(L, -2, i + 1);
+          }
+#undef XX
+      }
+      return 2;
+    }
+#endif
+
     default:
       fprintf(stderr, "UNKNOWN FS TYPE %d\n", req->fs_type);
       return 0;
@@ -247,7 +326,7 @@ static void lluv_on_fs(uv_fs_t *arg){
   uv_fs_req_cleanup(&req->req);
   lluv_fs_request_free(L, req);
 
-  LLUV_LOOP_CALL_CB(L, loop, argc);
+  LLUV_LOOP_CALL_CB(L, loop, argc, LLUV_CB_FS);
 
   LLUV_CHECK_LOOP_CB_INVARIANT(L);
 }
@@ -308,9 +387,8 @@ static void lluv_on_fs(uv_fs_t *arg){
     argc = 2;                                                             \
   }                                                                       \
   else{                                                                   \
-    if(req->req.fs_type == UV_FS_OPEN){                                   \
-      lluv_file_create(L, loop, (uv_file)req->req.result, 0);             \
-      argc = 1;                                                           \
+    if(LLUV_FS_IS_OPEN_REQ(req->req.fs_type)){                            \
+      argc = lluv_push_fs_result_object(L, req);                          \
     }                                                                     \
     else argc = 0;                                                        \
     argc += lluv_push_fs_result(L, req);                                  \
@@ -645,6 +723,7 @@ typedef struct lluv_file_tag{
   uv_file      handle;
   lluv_flags_t flags;
   lluv_loop_t  *loop;
+  int          busy;   /* number of transfers which use descriptor */
 }lluv_file_t;
 
 static int lluv_file_create(lua_State *L, lluv_loop_t  *loop, uv_file h, unsigned char flags){
@@ -652,6 +731,7 @@ static int lluv_file_create(lua_State *L, lluv_loop_t  *loop, uv_file h, unsigne
   f->handle = h;
   f->loop   = loop;
   f->flags  = flags | LLUV_FLAG_OPEN; 
+  f->busy   = 0;
   return 1;
 }
 
@@ -683,6 +763,11 @@ static int lluv_file_close(lua_State *L){
   lluv_file_t *f = lluv_check_file(L, 1, 0);
   lluv_loop_t *loop = f->loop;
 
+  /* descriptor is used by sendfile or reader */
+  if(IS_(f, OPEN) && f->busy){
+    return lluv_fail(L, f->flags, LLUV_ERR_UV, UV_EBUSY, NULL);
+  }
+
   if(IS_(f, OPEN)){
     const char  *path = NULL;
     int          argc = 1;
@@ -697,6 +782,15 @@ static int lluv_file_close(lua_State *L){
   return 0;
 }
 
+/* transfers keep file referenced so it can be busy here only while
+** Lua state is closing. Descriptor still may be used by thread pool.
+*/
+static int lluv_file_gc(lua_State *L){
+  lluv_file_t *f = lluv_check_file(L, 1, 0);
+  if(f->busy) return 0;
+  return lluv_file_close(L);
+}
+
 static int lluv_file_loop(lua_State *L){
   lluv_file_t *f = lluv_check_file(L, 1, LLUV_FLAG_OPEN);
   lua_rawgetp(L, LLUV_LUA_REGISTRY, f->loop->handle);
@@ -800,13 +894,95 @@ static int lluv_file_utime(lua_State* L) {
   LLUV_POST_FILE();
 }
 
+/* array of fixed buffers. Strings allowed only for write */
+static void lluv_file_check_bufs(lua_State *L, int idx, uv_buf_t *buf, size_t n, int allow_str){
+  size_t i;
+
+  for(i = 0; i < n; ++i){
+    lluv_fixed_buffer_t *buffer;
+
+    lua_rawgeti(L, idx, i + 1);
+    buffer = lluv_opt_fbuf(L, -1);
+    if(buffer){
+      buf[i] = lluv_buf_init(buffer->data, buffer->capacity);
+    }
+    else if(allow_str && (lua_type(L, -1) == LUA_TSTRING)){
+      size_t len; const char *str = lua_tolstring(L, -1, &len);
+      buf[i] = lluv_buf_init((char*)str, len);
+    }
+    else{
+      luaL_argerror(L, idx, allow_str ? "array of strings or buffers expected" : "array of buffers expected");
+    }
+    lua_pop(L, 1);
+  }
+}
+
+static int lluv_file_pin_bufs(lua_State *L, int idx, lluv_fs_request_t *req, size_t n){
+  size_t i;
+
+  req->fbufs = (lluv_fixed_buffer_t**)lluv_alloc(L, sizeof(lluv_fixed_buffer_t*) * n);
+  if(!req->fbufs) return UV_ENOMEM;
+
+  for(i = 0; i < n; ++i){
+    lua_rawgeti(L, idx, i + 1);
+    req->fbufs[i] = lluv_opt_fbuf(L, -1);
+    if(req->fbufs[i]) lluv_fbuf_pin(req->fbufs[i]);
+    lua_pop(L, 1);
+  }
+  req->nfbufs = n;
+
+  return 0;
+}
+
+static int lluv_file_rw_vector(lua_State* L, int write) {
+  // read({buffer, ...}, [position,] [callback])
+  // write({buffer | string, ...}, [position,] [callback])
+
+  const char  *path     = NULL;
+  lluv_file_t *f        = lluv_check_file(L, 1, LLUV_FLAG_OPEN);
+  lluv_loop_t *loop     = f->loop;
+  size_t       n        = lua_rawlen(L, 2);
+  int64_t      position = 0; /* position in file default: 0*/
+  uv_buf_t    *buf;
+
+  int         argc = 2;
+
+  luaL_argcheck(L, n > 0, 2, "Empty array not supported");
+
+  if(lluv_arg_exists(L, 3)){      /* position        */
+    position = lutil_checkint64(L, ++argc);
+  }
+
+  buf = (uv_buf_t*)lluv_alloca(sizeof(uv_buf_t) * n);
+  if(!buf){
+    return lluv_fail(L, f->flags, LLUV_ERR_UV, UV_ENOMEM, NULL);
+  }
+
+  lluv_file_check_bufs(L, 2, buf, n, write);
+
+  LLUV_PRE_FILE();
+  {
+    /* libuv copies array of buffers to request */
+    err = lluv_file_pin_bufs(L, 2, req, n);
+    if(err >= 0){
+      lua_pushvalue(L, 2); /*array*/
+      lua_rawsetp(L, LLUV_LUA_REGISTRY, &req->req);
+      lua_pushvalue(L, 1);
+      req->file_ref = luaL_ref(L, LLUV_LUA_REGISTRY);
+      if(write) err = uv_fs_write(loop->handle, &req->req, f->handle, buf, (unsigned int)n, position, cb);
+      else      err = uv_fs_read (loop->handle, &req->req, f->handle, buf, (unsigned int)n, position, cb);
+    }
+  }
+  LLUV_POST_FILE();
+}
+
 static int lluv_file_readb(lua_State* L) {
   const char  *path = NULL;
   lluv_file_t *f    = lluv_check_file(L, 1, LLUV_FLAG_OPEN);
   lluv_loop_t *loop = f->loop;
 
   char *base; size_t capacity;
-  lluv_fixed_buffer_t *buffer;
+  lluv_fixed_buffer_t *buffer = NULL;
 
   int64_t   position = 0; /* position in file default: 0*/ 
   int64_t   offset   = 0; /* offset in buffer default: 0*/
@@ -846,6 +1022,11 @@ static int lluv_file_readb(lua_State* L) {
   {
     uv_buf_t ubuf = lluv_buf_init(&base[offset], length);
 
+    if(buffer){
+      lluv_fbuf_pin(buffer);
+      req->fbuf = buffer;
+    }
+
     lua_pushvalue(L, 2);
     lua_rawsetp(L, LLUV_LUA_REGISTRY, &req->req);
     lua_pushvalue(L, 1);
@@ -858,6 +1039,7 @@ static int lluv_file_readb(lua_State* L) {
 static int lluv_file_read(lua_State* L) {
   // if buffer_length provided then function allocate buffer with this size
   // read(buffer | buffer_length, [position, [ [offset,] [length,] ] ] [callback])
+  // read({buffer, ...}, [position,] [callback]) fills all buffers with one request
 
   if(lua_isnumber(L, 2)){
     int64_t len = lutil_checkint64(L, 2);
@@ -865,12 +1047,16 @@ static int lluv_file_read(lua_State* L) {
     lua_remove(L, 2); // replace length
     lua_insert(L, 2); // with buffer
   }
+  else if(lua_type(L, 2) == LUA_TTABLE){
+    return lluv_file_rw_vector(L, 0);
+  }
   return lluv_file_readb(L);
 }
 
 static int lluv_file_write(lua_State* L) {
   // if you provide string then function does not copy this string
   // write(buffer | string, [position, [ [offset,] [length,] ] ] [callback])
+  // write({buffer | string, ...}, [position,] [callback]) writes all items with one request
 
   const char  *path           = NULL;
   lluv_file_t *f              = lluv_check_file(L, 1, LLUV_FLAG_OPEN);
@@ -884,6 +1070,10 @@ static int lluv_file_write(lua_State* L) {
   
   int         argc = 2;
 
+  if(lua_type(L, 2) == LUA_TTABLE){
+    return lluv_file_rw_vector(L, 1);
+  }
+
   if(NULL == (str = lua_tolstring(L, 2, &capacity))){
     buffer   = lluv_check_fbuf(L, 2);
     capacity = buffer->capacity;
@@ -911,7 +1101,12 @@ static int lluv_file_write(lua_State* L) {
   LLUV_PRE_FILE();
   {
     uv_buf_t ubuf = lluv_buf_init((char*)&str[offset], length);
-    
+
+    if(buffer){
+      lluv_fbuf_pin(buffer);
+      req->fbuf = buffer;
+    }
+
     lua_pushvalue(L, 2); /*string or buffer*/
     lua_rawsetp(L, LLUV_LUA_REGISTRY, &req->req);
     lua_pushvalue(L, 1);
@@ -921,6 +1116,327 @@ static int lluv_file_write(lua_State* L) {
   LLUV_POST_FILE();
 }
 
+/* number of bytes passed to one uv_fs_sendfile call */
+#ifndef LLUV_SENDFILE_CHUNK
+#  define LLUV_SENDFILE_CHUNK (16 * 1024 * 1024)
+#endif
+
+/* delay before retry when output can not be polled (e.g. on Windows) */
+#ifndef LLUV_SENDFILE_RETRY_MS
+#  define LLUV_SENDFILE_RETRY_MS 1
+#endif
+
+/* Transfer loop. Sends file chunk by chunk until `remain` bytes
+** sent, EOF reached or error occurred. Non-blocking socket returns
+** EAGAIN when its send buffer is full so transfer waits until output
+** become writable.
+** Input file is pinned (can not be closed) during transfer. Output
+** descriptor is duplicated so closing stream does not release
+** descriptor used by thread pool and it can be polled independently
+** from stream itself.
+*/
+typedef struct lluv_sendfile_tag{
+  uv_fs_t        req;
+  union{
+    uv_handle_t  handle;
+    uv_poll_t    poll;
+    uv_timer_t   timer;
+  }wait;                   /* waits until output is writable */
+  uv_handle_type wait_type;/* UV_UNKNOWN_HANDLE if not initialized */
+  lluv_loop_t   *loop;
+  lluv_handle_t *stream;   /* NULL if output is raw descriptor */
+  lluv_file_t   *file;
+  uv_file        in;
+  uv_file        out;
+  int            own_out;  /* out is duplicated descriptor */
+  int64_t        offset;
+  int64_t        remain;   /* -1 - until EOF */
+  int64_t        sent;
+  int            cb;
+  int            file_ref;
+  int            out_ref;
+}lluv_sendfile_t;
+
+/* wait handle is internal (data is NULL) so loop does not treat it as Lua object */
+#define LLUV_SENDFILE_BY_WAIT(H) ((lluv_sendfile_t*)((char*)(H) - offsetof(lluv_sendfile_t, wait)))
+
+static void lluv_on_sendfile(uv_fs_t *arg);
+
+static void lluv_sendfile_release(lluv_sendfile_t *s){
+#ifndef _WIN32
+  if(s->own_out) close(s->out);
+#endif
+  lluv_free_t(s->loop->L, lluv_sendfile_t, s);
+}
+
+static void lluv_on_sendfile_closed(uv_handle_t *arg){
+  lluv_sendfile_release(LLUV_SENDFILE_BY_WAIT(arg));
+}
+
+static void lluv_sendfile_free(lua_State *L, lluv_sendfile_t *s){
+  if(s->file){
+    s->file->busy -= 1;
+    s->file = NULL;
+  }
+
+  luaL_unref(L, LLUV_LUA_REGISTRY, s->cb);
+  luaL_unref(L, LLUV_LUA_REGISTRY, s->file_ref);
+  luaL_unref(L, LLUV_LUA_REGISTRY, s->out_ref);
+  s->cb = s->file_ref = s->out_ref = LUA_NOREF;
+
+  /* poll have to be closed before descriptor */
+  if(s->wait_type != UV_UNKNOWN_HANDLE){
+    uv_close(&s->wait.handle, lluv_on_sendfile_closed);
+    return;
+  }
+
+  lluv_sendfile_release(s);
+}
+
+static size_t lluv_sendfile_chunk(lluv_sendfile_t *s){
+  if((s->remain >= 0) && (s->remain < LLUV_SENDFILE_CHUNK))
+    return (size_t)s->remain;
+  return LLUV_SENDFILE_CHUNK;
+}
+
+static void lluv_on_sendfile_timer(uv_timer_t *arg);
+
+static void lluv_on_sendfile_poll(uv_poll_t *arg, int status, int events);
+
+static int lluv_sendfile_wait(lluv_sendfile_t *s){
+  if(s->wait_type == UV_UNKNOWN_HANDLE){
+    int err = UV_ENOTSUP;
+#ifndef _WIN32
+    /* regular file or device can not be polled */
+    err = uv_poll_init(s->loop->handle, &s->wait.poll, s->out);
+    if(err >= 0) s->wait_type = UV_POLL;
+#endif
+    if(err < 0){
+      err = uv_timer_init(s->loop->handle, &s->wait.timer);
+      if(err < 0) return err;
+      s->wait_type = UV_TIMER;
+    }
+    s->wait.handle.data = NULL;
+  }
+
+  if(s->wait_type == UV_POLL)
+    return uv_poll_start(&s->wait.poll, UV_WRITABLE, lluv_on_sendfile_poll);
+
+  return uv_timer_start(&s->wait.timer, lluv_on_sendfile_timer, LLUV_SENDFILE_RETRY_MS, 0);
+}
+
+static int lluv_sendfile_next(lluv_sendfile_t *s){
+  if(s->stream){
+    int err;
+
+    if(!IS_(s->stream, OPEN)) return UV_ECANCELED;
+
+    /* corked and queued data has to be sent first */
+    err = lluv_stream_cork_sync(s->loop->L, s->stream);
+    if(err < 0) return err;
+
+    if(LLUV_H(s->stream, uv_stream_t)->write_queue_size)
+      return lluv_sendfile_wait(s);
+  }
+
+  return uv_fs_sendfile(s->loop->handle, &s->req, s->out, s->in,
+    s->offset, lluv_sendfile_chunk(s), lluv_on_sendfile
+  );
+}
+
+static void lluv_sendfile_done(lluv_sendfile_t *s, int err){
+  lluv_loop_t *loop = s->loop;
+  lua_State   *L    = loop->L;
+
+  LLUV_CHECK_LOOP_CB_INVARIANT(L);
+
+  lua_rawgeti(L, LLUV_LUA_REGISTRY, s->cb);
+  lua_rawgeti(L, LLUV_LUA_REGISTRY, s->file_ref);
+  if(err < 0) lluv_error_create(L, LLUV_ERR_UV, err, NULL);
+  else lua_pushnil(L);
+  lutil_pushint64(L, s->sent);
+
+  lluv_sendfile_free(L, s);
+
+  LLUV_LOOP_CALL_CB(L, loop, 3, LLUV_CB_FS);
+
+  LLUV_CHECK_LOOP_CB_INVARIANT(L);
+}
+
+static void lluv_on_sendfile_timer(uv_timer_t *arg){
+  lluv_sendfile_t *s = LLUV_SENDFILE_BY_WAIT(arg);
+  int err = lluv_sendfile_next(s);
+  if(err < 0) lluv_sendfile_done(s, err);
+}
+
+static void lluv_on_sendfile_poll(uv_poll_t *arg, int status, int events){
+  lluv_sendfile_t *s = LLUV_SENDFILE_BY_WAIT(arg);
+  int err = status;
+
+  UNUSED_ARG(events);
+
+  uv_poll_stop(arg);
+  if(err >= 0) err = lluv_sendfile_next(s);
+  if(err < 0) lluv_sendfile_done(s, err);
+}
+
+static void lluv_on_sendfile(uv_fs_t *arg){
+  lluv_sendfile_t *s = arg->data;
+  int64_t result = arg->result;
+  int err;
+
+  uv_fs_req_cleanup(arg);
+
+  if(result == UV_EAGAIN){
+    err = lluv_sendfile_wait(s);
+  }
+  else if(result < 0){
+    err = (int)result;
+  }
+  else{
+    s->sent   += result;
+    s->offset += result;
+    if(s->remain > 0) s->remain -= result;
+
+    if((result == 0) || (s->remain == 0)){
+      lluv_sendfile_done(s, 0);
+      return;
+    }
+
+    err = lluv_sendfile_next(s);
+  }
+
+  if(err < 0) lluv_sendfile_done(s, err);
+}
+
+static int lluv_file_sendfile_sync(lua_State* L, lluv_file_t *f, uv_file out, int64_t offset, int64_t remain){
+  int64_t sent = 0;
+
+  for(;;){
+    uv_fs_t req;
+    size_t len = ((remain >= 0) && (remain < LLUV_SENDFILE_CHUNK)) ? (size_t)remain : LLUV_SENDFILE_CHUNK;
+    int64_t result;
+
+    uv_fs_sendfile(f->loop->handle, &req, out, f->handle, offset, len, NULL);
+    result = req.result;
+    uv_fs_req_cleanup(&req);
+
+    if(result < 0){
+      /* non-blocking socket is full. report partial transfer */
+      if((result == UV_EAGAIN) && (sent > 0)) break;
+      return lluv_fail(L, f->flags, LLUV_ERR_UV, (int)result, NULL);
+    }
+
+    sent   += result;
+    offset += result;
+    if(remain > 0) remain -= result;
+
+    if((result == 0) || (remain == 0)) break;
+  }
+
+  lutil_pushint64(L, sent);
+  return 1;
+}
+
+static int lluv_file_sendfile(lua_State* L) {
+  // sendfile(stream | fd, [offset, [length,]] [callback])
+  // without length sends data until end of file
+
+  lluv_file_t   *f      = lluv_check_file(L, 1, LLUV_FLAG_OPEN);
+  lluv_loop_t   *loop   = f->loop;
+  lluv_handle_t *stream = NULL;
+  int64_t        offset = 0;
+  int64_t        length = -1;
+  uv_file        out;
+  int            argc   = 2;
+  lluv_sendfile_t *s;
+  int err;
+
+  if(lua_type(L, 2) == LUA_TNUMBER){
+    out = (uv_file)lutil_checkint64(L, 2);
+  }
+  else{
+    uv_os_fd_t fd;
+    stream = lluv_check_stream(L, 2, LLUV_FLAG_OPEN);
+#if defined(_WIN32)
+    (void)fd;
+    return lluv_fail(L, f->flags, LLUV_ERR_UV, UV_ENOTSUP, NULL);
+#else
+    err = uv_fileno(LLUV_H(stream, uv_handle_t), &fd);
+    if(err < 0) return lluv_fail(L, f->flags, LLUV_ERR_UV, err, NULL);
+    out = (uv_file)fd;
+#endif
+  }
+
+  if(lluv_arg_exists(L, argc + 1)){  /* offset */
+    if(!lua_isnil(L, ++argc)) offset = lutil_checkint64(L, argc);
+    luaL_argcheck(L, offset >= 0, argc, LLUV_PREFIX" offset out of index");
+  }
+  if(lluv_arg_exists(L, argc + 1)){  /* length */
+    if(!lua_isnil(L, ++argc)){
+      length = lutil_checkint64(L, argc);
+      luaL_argcheck(L, length >= 0, argc, LLUV_PREFIX" invalid length");
+    }
+  }
+
+  if(lua_gettop(L) <= argc){
+    return lluv_file_sendfile_sync(L, f, out, offset, length);
+  }
+
+  lluv_check_callable(L, argc + 1);
+  lua_settop(L, argc + 1);
+
+  s = lluv_alloc_t(L, lluv_sendfile_t);
+  if(!s) return lluv_fail(L, f->flags, LLUV_ERR_UV, UV_ENOMEM, NULL);
+
+  memset(s, 0, sizeof(*s));
+  s->cb = s->file_ref = s->out_ref = LUA_NOREF;
+  s->req.data  = s;
+  s->wait_type = UV_UNKNOWN_HANDLE;
+  s->loop      = loop;
+  s->stream    = stream;
+  s->file      = f;
+  s->in        = f->handle;
+  s->out       = out;
+  s->offset    = offset;
+  s->remain    = length;
+
+  f->busy += 1;
+
+#ifndef _WIN32
+  s->out = dup(out);
+  if(s->out < 0){
+    err = uv_translate_sys_error(errno);
+    s->out = out;
+  }
+  else{
+    s->own_out = 1;
+    err = lluv_sendfile_next(s);
+  }
+#else
+  err = lluv_sendfile_next(s);
+#endif
+  if(err < 0){
+    lluv_sendfile_free(L, s);
+    lua_pushvalue(L, 1);
+    lluv_error_create(L, LLUV_ERR_UV, err, NULL);
+    lutil_pushint64(L, 0);
+    lluv_loop_defer_call(L, loop, 3);
+    lua_pushboolean(L, 1);
+    return 1;
+  }
+
+  s->cb       = luaL_ref(L, LLUV_LUA_REGISTRY);
+  lua_pushvalue(L, 1);
+  s->file_ref = luaL_ref(L, LLUV_LUA_REGISTRY);
+  lua_pushvalue(L, 2);
+  s->out_ref  = luaL_ref(L, LLUV_LUA_REGISTRY);
+
+  lua_pushboolean(L, 1);
+  return 1;
+}
+
+
 static int lluv_file_fileno(lua_State *L){
   lluv_file_t *f = lluv_check_file(L, 1, LLUV_FLAG_OPEN);
   lutil_pushint64(L, f->handle);
@@ -967,6 +1483,556 @@ static int lluv_file_pipe(lua_State *L){
   return 1;
 }
 
+//{ Reader object
+
+/* Sequential reader with read-ahead.
+**
+** File is read into ring of `chunks` buffers. While Lua consumes
+** current chunk next ones are filled by background read requests.
+** Methods never wait. They return `false` if there no buffered data
+** so caller have to call `wait` and repeat.
+*/
+
+#define LLUV_READER_NAME LLUV_PREFIX" File Reader"
+static const char *LLUV_READER = LLUV_READER_NAME;
+
+#ifndef LLUV_READER_CHUNK
+#  define LLUV_READER_CHUNK (256 * 1024)
+#endif
+
+#ifndef LLUV_READER_CHUNKS
+#  define LLUV_READER_CHUNKS 2
+#endif
+
+#define LLUV_READER_MAX_EOL 8
+
+typedef struct lluv_reader_chunk_tag{
+  char   *data;
+  size_t  size;
+  size_t  pos;
+}lluv_reader_chunk_t;
+
+typedef struct lluv_reader_tag{
+  uv_fs_t              req;
+  lluv_loop_t         *loop;
+  lluv_flags_t         flags;
+  lluv_file_t         *file;      /* busy while request active. NULL if detached */
+  uv_file              fd;
+  int64_t              offset;    /* position of next read request */
+  lluv_reader_chunk_t *chunks;
+  size_t               nchunks;
+  size_t               chunk_size;
+  size_t               head;      /* chunk which consumed now */
+  size_t               nready;
+  int                  reading;
+  int                  detached;  /* userdata collected while request active */
+  int                  eof;
+  int                  error;
+  char                *acc;       /* data before head chunk (partial line) */
+  size_t               acc_size;
+  size_t               acc_cap;
+  size_t               scanned;   /* bytes of acc which do not start `eol` */
+  char                 eol[LLUV_READER_MAX_EOL];
+  size_t               eol_len;
+  int                  self;      /* reference to userdata while request active */
+  int                  file_ref;
+  int                  wait_cb;
+  int                  close_cb;
+}lluv_reader_t;
+
+static void lluv_reader_unref(lua_State *L, lluv_reader_t *r){
+  luaL_unref(L, LLUV_LUA_REGISTRY, r->self);
+  luaL_unref(L, LLUV_LUA_REGISTRY, r->file_ref);
+  luaL_unref(L, LLUV_LUA_REGISTRY, r->wait_cb);
+  luaL_unref(L, LLUV_LUA_REGISTRY, r->close_cb);
+  r->self = r->file_ref = r->wait_cb = r->close_cb = LUA_NOREF;
+}
+
+/* free memory only. Does not touch Lua state */
+static void lluv_reader_destroy(lluv_reader_t *r){
+  size_t i;
+
+  for(i = 0; i < r->nchunks; ++i){
+    lluv_free(NULL, r->chunks[i].data);
+  }
+  lluv_free(NULL, r->chunks);
+  lluv_free(NULL, r->acc);
+  lluv_free_t(NULL, lluv_reader_t, r);
+}
+
+static void lluv_reader_free(lua_State *L, lluv_reader_t *r){
+  lluv_reader_unref(L, r);
+  lluv_reader_destroy(r);
+}
+
+static void lluv_on_reader_read(uv_fs_t *arg);
+
+/* start read into next free chunk */
+static void lluv_reader_fill(lua_State *L, lluv_reader_t *r, int idx){
+  lluv_reader_chunk_t *chunk;
+  uv_buf_t ubuf;
+  int err;
+
+  if(r->reading || r->eof || r->error || !IS_(r, OPEN)) return;
+  if(r->nready == r->nchunks) return;
+
+  chunk = &r->chunks[(r->head + r->nready) % r->nchunks];
+  ubuf  = lluv_buf_init(chunk->data, r->chunk_size);
+
+  err = uv_fs_read(r->loop->handle, &r->req, r->fd, &ubuf, 1, r->offset, lluv_on_reader_read);
+  if(err < 0){
+    r->error = err;
+    return;
+  }
+
+  r->reading = 1;
+  r->file->busy += 1;
+  if(r->self == LUA_NOREF){
+    lua_pushvalue(L, idx);
+    r->self = luaL_ref(L, LLUV_LUA_REGISTRY);
+  }
+}
+
+static void lluv_reader_release_chunk(lua_State *L, lluv_reader_t *r, int idx){
+  r->head    = (r->head + 1) % r->nchunks;
+  r->nready -= 1;
+  lluv_reader_fill(L, r, idx);
+}
+
+static lluv_reader_chunk_t *lluv_reader_current(lluv_reader_t *r){
+  return r->nready ? &r->chunks[r->head] : NULL;
+}
+
+static int lluv_reader_acc_append(lua_State *L, lluv_reader_t *r, const char *data, size_t len){
+  if(r->acc_size + len > r->acc_cap){
+    size_t cap = r->acc_cap ? r->acc_cap : r->chunk_size;
+    char *acc;
+
+    while(cap < r->acc_size + len) cap *= 2;
+
+    acc = (char*)lluv_alloc(L, cap);
+    if(!acc) return UV_ENOMEM;
+
+    if(r->acc_size) memcpy(acc, r->acc, r->acc_size);
+    lluv_free(L, r->acc);
+    r->acc     = acc;
+    r->acc_cap = cap;
+  }
+
+  memcpy(r->acc + r->acc_size, data, len);
+  r->acc_size += len;
+  return 0;
+}
+
+static void lluv_reader_acc_consume(lluv_reader_t *r, size_t len){
+  r->acc_size -= len;
+  if(r->acc_size) memmove(r->acc, r->acc + len, r->acc_size);
+  r->scanned = 0;
+}
+
+static const char *lluv_reader_find(const char *s, size_t len, const char *eol, size_t eol_len){
+  const char *end = s + len;
+
+  while((size_t)(end - s) >= eol_len){
+    const char *p = memchr(s, eol[0], (end - s) - eol_len + 1);
+    if(!p) return NULL;
+    if(memcmp(p, eol, eol_len) == 0) return p;
+    s = p + 1;
+  }
+
+  return NULL;
+}
+
+/* result when there no buffered data: nil at EOF, nil, err or false */
+static int lluv_reader_no_data(lua_State *L, lluv_reader_t *r){
+  if(r->error) return lluv_fail(L, r->flags, LLUV_ERR_UV, r->error, NULL);
+
+  if(r->eof){
+    lua_pushnil(L);
+    return 1;
+  }
+
+  lluv_reader_fill(L, r, 1);
+  lua_pushboolean(L, 0);
+  return 1;
+}
+
+static lluv_reader_t *lluv_check_reader(lua_State *L, int i, lluv_flags_t flags){
+  lluv_reader_t **r = (lluv_reader_t **)lutil_checkudatap(L, i, LLUV_READER);
+  luaL_argcheck (L, r != NULL, i, LLUV_READER_NAME" expected");
+  luaL_argcheck (L, (*r != NULL) && FLAGS_IS_SET((*r)->flags, flags), i, LLUV_READER_NAME" closed");
+  return *r;
+}
+
+static int lluv_reader_to_s(lua_State *L){
+  lluv_reader_t **r = (lluv_reader_t **)lutil_checkudatap(L, 1, LLUV_READER);
+  luaL_argcheck (L, r != NULL, 1, LLUV_READER_NAME" expected");
+  lua_pushfstring(L, LLUV_READER_NAME" (%p)", *r);
+  return 1;
+}
+
+// read([n]) returns up to `n` buffered bytes
+static int lluv_reader_read(lua_State *L){
+  lluv_reader_t *r = lluv_check_reader(L, 1, LLUV_FLAG_OPEN);
+  lua_Number    n  = luaL_optnumber(L, 2, -1);
+  lluv_reader_chunk_t *chunk;
+  size_t len;
+
+  if(r->acc_size){
+    len = ((n >= 0) && (n < r->acc_size)) ? (size_t)n : r->acc_size;
+    lua_pushlstring(L, r->acc, len);
+    lluv_reader_acc_consume(r, len);
+    return 1;
+  }
+
+  chunk = lluv_reader_current(r);
+  if(!chunk) return lluv_reader_no_data(L, r);
+
+  len = chunk->size - chunk->pos;
+  if((n >= 0) && (n < len)) len = (size_t)n;
+
+  lua_pushlstring(L, chunk->data + chunk->pos, len);
+  chunk->pos += len;
+  if(chunk->pos == chunk->size) lluv_reader_release_chunk(L, r, 1);
+
+  return 1;
+}
+
+// read_line([keep_eol], [eol])
+static int lluv_reader_read_line(lua_State *L){
+  lluv_reader_t *r   = lluv_check_reader(L, 1, LLUV_FLAG_OPEN);
+  int keep           = lua_toboolean(L, 2);
+  size_t eol_len;
+  const char *eol    = luaL_optlstring(L, 3, "\n", &eol_len);
+
+  luaL_argcheck(L, (eol_len > 0) && (eol_len <= LLUV_READER_MAX_EOL), 3, "invalid eol");
+
+  if((eol_len != r->eol_len) || memcmp(eol, r->eol, eol_len)){
+    memcpy(r->eol, eol, eol_len);
+    r->eol_len = eol_len;
+    r->scanned = 0;
+  }
+
+  for(;;){
+    lluv_reader_chunk_t *chunk;
+    const char *p;
+
+    /* partial line from previous chunks */
+    if(r->acc_size > r->scanned){
+      p = lluv_reader_find(r->acc + r->scanned, r->acc_size - r->scanned, eol, eol_len);
+      if(p){
+        size_t len = (p - r->acc) + eol_len;
+        lua_pushlstring(L, r->acc, keep ? len : len - eol_len);
+        lluv_reader_acc_consume(r, len);
+        return 1;
+      }
+      r->scanned = (r->acc_size >= eol_len) ? (r->acc_size - eol_len + 1) : 0;
+    }
+
+    chunk = lluv_reader_current(r);
+    if(!chunk){
+      if(r->acc_size && (r->eof || r->error)){
+        /* last line without eol. error will be returned by next call */
+        lua_pushlstring(L, r->acc, r->acc_size);
+        lluv_reader_acc_consume(r, r->acc_size);
+        return 1;
+      }
+      return lluv_reader_no_data(L, r);
+    }
+
+    {
+      const char *s = chunk->data + chunk->pos;
+      size_t len = chunk->size - chunk->pos;
+      int err;
+
+      p = lluv_reader_find(s, len, eol, eol_len);
+      if(p) len = (p - s) + eol_len;
+
+      if(p && !r->acc_size){
+        lua_pushlstring(L, s, keep ? len : len - eol_len);
+        chunk->pos += len;
+        if(chunk->pos == chunk->size) lluv_reader_release_chunk(L, r, 1);
+        return 1;
+      }
+
+      /* Line started in previous chunk. Also eol can be split
+      ** between chunks so line checked again in acc.
+      */
+      err = lluv_reader_acc_append(L, r, s, len);
+      if(err < 0) return lluv_fail(L, r->flags, LLUV_ERR_UV, err, NULL);
+      chunk->pos += len;
+      if(chunk->pos == chunk->size) lluv_reader_release_chunk(L, r, 1);
+    }
+  }
+}
+
+// wait(cb) calls `cb(reader)` when there buffered data, EOF or error
+static int lluv_reader_wait(lua_State *L){
+  lluv_reader_t *r = lluv_check_reader(L, 1, LLUV_FLAG_OPEN);
+
+  lluv_check_callable(L, 2);
+  lua_settop(L, 2);
+
+  luaL_unref(L, LLUV_LUA_REGISTRY, r->wait_cb);
+  r->wait_cb = LUA_NOREF;
+
+  lluv_reader_fill(L, r, 1);
+
+  if(r->reading && !r->nready){
+    r->wait_cb = luaL_ref(L, LLUV_LUA_REGISTRY);
+  }
+  else{
+    lua_pushvalue(L, 1);
+    lluv_loop_defer_call(L, r->loop, 1);
+  }
+
+  lua_settop(L, 1);
+  return 1;
+}
+
+// tell() returns file position of next unread byte
+static int lluv_reader_tell(lua_State *L){
+  lluv_reader_t *r = lluv_check_reader(L, 1, LLUV_FLAG_OPEN);
+  int64_t pos = r->offset - (int64_t)r->acc_size;
+  size_t i;
+
+  for(i = 0; i < r->nready; ++i){
+    lluv_reader_chunk_t *chunk = &r->chunks[(r->head + i) % r->nchunks];
+    pos -= (int64_t)(chunk->size - chunk->pos);
+  }
+
+  lutil_pushint64(L, pos);
+  return 1;
+}
+
+/* Active request uses buffers so reader destroyed when it done */
+static int lluv_reader_close(lua_State *L){
+  lluv_reader_t **pr = (lluv_reader_t **)lutil_checkudatap(L, 1, LLUV_READER);
+  lluv_reader_t *r;
+
+  luaL_argcheck (L, pr != NULL, 1, LLUV_READER_NAME" expected");
+
+  r = *pr;
+  if(!r || !IS_(r, OPEN)) return 0;
+
+  if(!lua_isnoneornil(L, 2)) lluv_check_callable(L, 2);
+  lua_settop(L, 2);
+
+  UNSET_(r, OPEN);
+
+  if(r->reading){
+    if(!lua_isnil(L, 2)) r->close_cb = luaL_ref(L, LLUV_LUA_REGISTRY);
+    return 0;
+  }
+
+  *pr = NULL;
+
+  if(!lua_isnil(L, 2)){
+    lua_pushvalue(L, 1);
+    lluv_loop_defer_call(L, r->loop, 1);
+  }
+
+  lluv_reader_free(L, r);
+  return 0;
+}
+
+/* Object referenced while request active so it can be collected with
+** active request only when Lua state is closing. Request still uses
+** buffers so reader is detached and freed by its callback without
+** touching Lua. File stays busy so descriptor is not closed under request.
+*/
+static int lluv_reader_gc(lua_State *L){
+  lluv_reader_t **pr = (lluv_reader_t **)lutil_checkudatap(L, 1, LLUV_READER);
+  lluv_reader_t *r = pr ? *pr : NULL;
+
+  if(!r) return 0;
+
+  *pr = NULL;
+  UNSET_(r, OPEN);
+
+  if(!r->reading){
+    lluv_reader_free(L, r);
+    return 0;
+  }
+
+  lluv_reader_unref(L, r);
+  r->file     = NULL;
+  r->detached = 1;
+
+  return 0;
+}
+
+static void lluv_on_reader_read(uv_fs_t *arg){
+  lluv_reader_t *r  = (lluv_reader_t*)arg->data;
+  int64_t result    = arg->result;
+  lluv_loop_t *loop;
+  lua_State   *L;
+  int cb;
+
+  uv_fs_req_cleanup(arg);
+
+  r->reading = 0;
+
+  if(r->detached){
+    lluv_reader_destroy(r);
+    return;
+  }
+
+  loop = r->loop;
+  L    = loop->L;
+
+  LLUV_CHECK_LOOP_CB_INVARIANT(L);
+
+  r->file->busy -= 1;
+
+  lua_rawgeti(L, LLUV_LUA_REGISTRY, r->self);
+  luaL_unref(L, LLUV_LUA_REGISTRY, r->self);
+  r->self = LUA_NOREF;
+
+  if(!IS_(r, OPEN)){
+    cb = r->close_cb;
+    r->close_cb = LUA_NOREF;
+
+    *(lluv_reader_t **)lua_touserdata(L, -1) = NULL;
+    lluv_reader_free(L, r);
+
+    if(cb == LUA_NOREF){
+      lua_pop(L, 1);
+      return;
+    }
+
+    lua_rawgeti(L, LLUV_LUA_REGISTRY, cb);
+    luaL_unref(L, LLUV_LUA_REGISTRY, cb);
+    lua_insert(L, -2);
+    LLUV_LOOP_CALL_CB(L, loop, 1, LLUV_CB_FS);
+    LLUV_CHECK_LOOP_CB_INVARIANT(L);
+    return;
+  }
+
+  if(result < 0){
+    r->error = (int)result;
+  }
+  else if(result == 0){
+    r->eof = 1;
+  }
+  else{
+    lluv_reader_chunk_t *chunk = &r->chunks[(r->head + r->nready) % r->nchunks];
+    chunk->size = (size_t)result;
+    chunk->pos  = 0;
+    r->offset  += result;
+    r->nready  += 1;
+
+    /* prefetch next chunk while Lua process this one */
+    lluv_reader_fill(L, r, -1);
+  }
+
+  cb = r->wait_cb;
+  r->wait_cb = LUA_NOREF;
+
+  if(cb == LUA_NOREF){
+    lua_pop(L, 1);
+    return;
+  }
+
+  lua_rawgeti(L, LLUV_LUA_REGISTRY, cb);
+  luaL_unref(L, LLUV_LUA_REGISTRY, cb);
+  lua_insert(L, -2);
+  LLUV_LOOP_CALL_CB(L, loop, 1, LLUV_CB_FS);
+
+  LLUV_CHECK_LOOP_CB_INVARIANT(L);
+}
+
+static const struct luaL_Reg lluv_reader_methods[] = {
+  {"read",         lluv_reader_read      },
+  {"read_line",    lluv_reader_read_line },
+  {"wait",         lluv_reader_wait      },
+  {"tell",         lluv_reader_tell      },
+  {"close",        lluv_reader_close     },
+  {"__gc",         lluv_reader_gc        },
+  {"__tostring",   lluv_reader_to_s      },
+
+  {NULL,NULL}
+};
+
+static int lluv_file_reader(lua_State *L){
+  // reader([position], [{chunk_size=, chunks=}])
+
+  lluv_file_t   *f      = lluv_check_file(L, 1, LLUV_FLAG_OPEN);
+  int64_t        offset = 0;
+  lua_Integer    chunk_size = LLUV_READER_CHUNK;
+  lua_Integer    nchunks    = LLUV_READER_CHUNKS;
+  lluv_reader_t *r, **pr;
+  int opt = 2;
+  size_t i;
+
+  if(lua_type(L, 2) == LUA_TNUMBER){
+    offset = lutil_checkint64(L, 2);
+    luaL_argcheck(L, offset >= 0, 2, LLUV_PREFIX" offset out of index");
+    opt = 3;
+  }
+  else if(lua_isnil(L, 2) && !lua_isnoneornil(L, 3)){
+    opt = 3;
+  }
+
+  if(!lua_isnoneornil(L, opt)){
+    luaL_checktype(L, opt, LUA_TTABLE);
+
+    lua_getfield(L, opt, "chunk_size");
+    chunk_size = luaL_optinteger(L, -1, chunk_size);
+    luaL_argcheck(L, chunk_size > 0, opt, "invalid chunk_size value");
+    lua_pop(L, 1);
+
+    lua_getfield(L, opt, "chunks");
+    nchunks = luaL_optinteger(L, -1, nchunks);
+    luaL_argcheck(L, nchunks > 0, opt, "invalid chunks value");
+    lua_pop(L, 1);
+  }
+
+  r = lluv_alloc_t(L, lluv_reader_t);
+  if(!r) return lluv_fail(L, f->flags, LLUV_ERR_UV, UV_ENOMEM, NULL);
+
+  memset(r, 0, sizeof(*r));
+  r->self = r->file_ref = r->wait_cb = r->close_cb = LUA_NOREF;
+  r->req.data   = r;
+  r->loop       = f->loop;
+  r->file       = f;
+  r->flags      = f->flags | LLUV_FLAG_OPEN;
+  r->fd         = f->handle;
+  r->offset     = offset;
+  r->chunk_size = (size_t)chunk_size;
+  r->nchunks    = (size_t)nchunks;
+  r->eol[0]     = '\n';
+  r->eol_len    = 1;
+
+  r->chunks = (lluv_reader_chunk_t*)lluv_alloc(L, sizeof(lluv_reader_chunk_t) * r->nchunks);
+  if(r->chunks){
+    memset(r->chunks, 0, sizeof(lluv_reader_chunk_t) * r->nchunks);
+    for(i = 0; i < r->nchunks; ++i){
+      r->chunks[i].data = (char*)lluv_alloc(L, r->chunk_size);
+      if(!r->chunks[i].data) break;
+    }
+  }
+
+  if(!r->chunks || (i < r->nchunks)){
+    if(!r->chunks) r->nchunks = 0;
+    lluv_reader_free(L, r);
+    return lluv_fail(L, f->flags, LLUV_ERR_UV, UV_ENOMEM, NULL);
+  }
+
+  pr = lutil_newudatap(L, lluv_reader_t*, LLUV_READER);
+  *pr = r;
+
+  lua_pushvalue(L, 1);
+  r->file_ref = luaL_ref(L, LLUV_LUA_REGISTRY);
+
+  /* start read-ahead */
+  lluv_reader_fill(L, r, -1);
+
+  return 1;
+}
+
+//}
+
 static const struct luaL_Reg lluv_file_methods[] = {
   {"loop",         lluv_file_loop      },
   {"stat",         lluv_file_stat      },
@@ -982,7 +2048,9 @@ static const struct luaL_Reg lluv_file_methods[] = {
 
   {"read",         lluv_file_read      },
   {"write",        lluv_file_write     },
-  {"__gc",         lluv_file_close     },
+  {"sendfile",     lluv_file_sendfile  },
+  {"reader",       lluv_file_reader    },
+  {"__gc",         lluv_file_gc        },
   {"__tostring",   lluv_file_to_s      },
   
   {NULL,NULL}
@@ -990,6 +2058,183 @@ static const struct luaL_Reg lluv_file_methods[] = {
 
 //}
 
+#if LLUV_UV_VER_GE(1,28,0)
+
+//{ Dir object
+
+#define LLUV_DIR_NAME LLUV_PREFIX" Dir"
+static const char *LLUV_DIR = LLUV_DIR_NAME;
+
+/* default number of entries returned by one read */
+#ifndef LLUV_DIR_ENTRIES
+#  define LLUV_DIR_ENTRIES 64
+#endif
+
+/* readdir request is in progress */
+#define LLUV_FLAG_DIR_BUSY LLUV_FLAG_4
+
+typedef struct lluv_dir_tag{
+  uv_dir_t     *handle;
+  uv_dirent_t  *dirents;
+  size_t        nentries;
+  lluv_flags_t  flags;
+  lluv_loop_t  *loop;
+}lluv_dir_t;
+
+/* create not opened object. it owns buffer for entries */
+static lluv_dir_t *lluv_dir_create(lua_State *L, lluv_loop_t  *loop, size_t nentries){
+  lluv_dir_t *f = lutil_newudatap(L, lluv_dir_t, LLUV_DIR);
+  f->handle   = NULL;
+  f->loop     = loop;
+  f->flags    = 0;
+  f->nentries = 0;
+  f->dirents  = (uv_dirent_t*)lluv_alloc(L, nentries * sizeof(uv_dirent_t));
+  if(f->dirents) f->nentries = nentries;
+  return f;
+}
+
+static void lluv_dir_attach(lua_State *L, int idx, uv_dir_t *handle){
+  lluv_dir_t *f = (lluv_dir_t *)lutil_checkudatap (L, idx, LLUV_DIR);
+  assert(f);
+  f->handle           = handle;
+  f->handle->dirents  = f->dirents;
+  f->handle->nentries = f->nentries;
+  SET_(f, OPEN);
+}
+
+static void lluv_dir_done(lua_State *L, int idx){
+  lluv_dir_t *f = (lluv_dir_t *)lutil_checkudatap (L, idx, LLUV_DIR);
+  assert(f);
+  UNSET_(f, DIR_BUSY);
+}
+
+static void lluv_dir_free_entries(lua_State *L, lluv_dir_t *f){
+  if(f->dirents){
+    lluv_free(L, f->dirents);
+    f->dirents  = NULL;
+    f->nentries = 0;
+  }
+}
+
+static lluv_dir_t *lluv_check_dir(lua_State *L, int i, lluv_flags_t flags){
+  lluv_dir_t *f = (lluv_dir_t *)lutil_checkudatap (L, i, LLUV_DIR);
+  luaL_argcheck (L, f != NULL, i, LLUV_DIR_NAME" expected");
+
+  /* loop could be closed already */
+  if(!IS_(f->loop, OPEN)){
+    if(IS_(f, OPEN) && !IS_(f, DIR_BUSY)){
+      lluv_fs_request_t *req = lluv_fs_request_new(L);
+      UNSET_(f, OPEN);
+      uv_fs_closedir(NULL, &req->req, f->handle, NULL);
+      uv_fs_req_cleanup(&req->req);
+      lluv_fs_request_free(L, req);
+      f->handle = NULL;
+    }
+  }
+
+  luaL_argcheck (L, FLAGS_IS_SET(f->flags, flags), i, LLUV_DIR_NAME" closed");
+  return f;
+}
+
+static int lluv_dir_to_s(lua_State *L){
+  lluv_dir_t *f = lluv_check_dir(L, 1, 0);
+  lua_pushfstring(L, LLUV_DIR_NAME" (%p)", f);
+  return 1;
+}
+
+static int lluv_dir_loop(lua_State *L){
+  lluv_dir_t *f = lluv_check_dir(L, 1, LLUV_FLAG_OPEN);
+  lua_rawgetp(L, LLUV_LUA_REGISTRY, f->loop->handle);
+  return 1;
+}
+
+static int lluv_dir_read(lua_State *L){
+  const char  *path = NULL;
+  lluv_dir_t  *f    = lluv_check_dir(L, 1, LLUV_FLAG_OPEN);
+  lluv_loop_t *loop = f->loop;
+  int          argc = 1;
+
+  if(IS_(f, DIR_BUSY)){
+    return lluv_fail(L, f->flags, LLUV_ERR_UV, UV_EBUSY, NULL);
+  }
+
+  LLUV_PRE_FILE();
+  lua_pushvalue(L, 1);
+  req->file_ref = luaL_ref(L, LLUV_LUA_REGISTRY);
+  err = uv_fs_readdir(loop->handle, &req->req, f->handle, cb);
+  if((err >= 0) && cb) SET_(f, DIR_BUSY);
+  LLUV_POST_FILE();
+}
+
+static int lluv_dir_close(lua_State *L){
+  lluv_dir_t  *f    = lluv_check_dir(L, 1, 0);
+  lluv_loop_t *loop = f->loop;
+
+  if(IS_(f, DIR_BUSY)){
+    return lluv_fail(L, f->flags, LLUV_ERR_UV, UV_EBUSY, NULL);
+  }
+
+  /* closedir does not touch entries */
+  lluv_dir_free_entries(L, f);
+
+  if(IS_(f, OPEN)){
+    const char  *path   = NULL;
+    uv_dir_t    *handle = f->handle;
+    int          argc   = 1;
+    UNSET_(f, OPEN);
+    f->handle = NULL;
+
+    LLUV_PRE_FILE();
+    lua_pushvalue(L, 1);
+    req->file_ref = luaL_ref(L, LLUV_LUA_REGISTRY);
+    err = uv_fs_closedir(loop->handle, &req->req, handle, cb);
+    LLUV_POST_FILE();
+  }
+
+  return 0;
+}
+
+static const struct luaL_Reg lluv_dir_methods[] = {
+  {"loop",         lluv_dir_loop       },
+  {"read",         lluv_dir_read       },
+  {"close",        lluv_dir_close      },
+  {"__gc",         lluv_dir_close      },
+  {"__tostring",   lluv_dir_to_s       },
+
+  {NULL,NULL}
+};
+
+LLUV_IMPL_SAFE(lluv_fs_opendir) {
+  LLUV_CHECK_LOOP_FS()
+
+  const char *path    = luaL_checkstring(L, ++argc);
+  lua_Integer entries = LLUV_DIR_ENTRIES;
+
+  if(lluv_arg_exists(L, argc + 1)){
+    if(!lua_isnil(L, ++argc)){
+      luaL_checktype(L, argc, LUA_TTABLE);
+      lua_getfield(L, argc, "entries");
+      if(!lua_isnil(L, -1)) entries = luaL_checkinteger(L, -1);
+      lua_pop(L, 1);
+    }
+  }
+
+  luaL_argcheck(L, entries > 0, argc, LLUV_PREFIX" entries should be positive");
+
+  LLUV_PRE_FS();
+  {
+    lluv_dir_t *f = lluv_dir_create(L, loop, (size_t)entries);
+    req->file_ref = luaL_ref(L, LLUV_LUA_REGISTRY);
+    if(!f->dirents) err = UV_ENOMEM;
+    else err = uv_fs_opendir(loop->handle, &req->req, path, cb);
+  }
+  LLUV_POST_FS();
+}
+
+//}
+
+#endif
+
 enum {
   LLUV_FS_FUNCTIONS_DUMMY = 16,
   #if LLUV_UV_VER_GE(1,8,0)
@@ -998,6 +2243,9 @@ enum {
   #if LLUV_UV_VER_GE(1,14,0)
   LLUV_FS_FUNCTIONS_DUMMY_2,
   #endif
+  #if LLUV_UV_VER_GE(1,28,0)
+  LLUV_FS_FUNCTIONS_DUMMY_3,
+  #endif
   LLUV_FS_FUNCTIONS_COUNT
 };
 
@@ -1026,6 +2274,9 @@ enum {
 #define LLUV_FS_FUNCTIONS_1_14_0(F)         \
   { "fs_copyfile", lluv_fs_copyfile_##F },  \
 
+#define LLUV_FS_FUNCTIONS_1_28_0(F)         \
+  { "fs_opendir",  lluv_fs_opendir_##F  },  \
+
 static const struct luaL_Reg lluv_fs_functions[][LLUV_FS_FUNCTIONS_COUNT] = {
   {
     LLUV_FS_FUNCTIONS(unsafe)
@@ -1034,6 +2285,9 @@ static const struct luaL_Reg lluv_fs_functions[][LLUV_FS_FUNCTIONS_COUNT] = {
 #endif
 #if LLUV_UV_VER_GE(1,14,0)
     LLUV_FS_FUNCTIONS_1_14_0(unsafe)
+#endif
+#if LLUV_UV_VER_GE(1,28,0)
+    LLUV_FS_FUNCTIONS_1_28_0(unsafe)
 #endif
     {NULL,NULL}
   },
@@ -1044,6 +2298,9 @@ static const struct luaL_Reg lluv_fs_functions[][LLUV_FS_FUNCTIONS_COUNT] = {
 #endif
 #if LLUV_UV_VER_GE(1,14,0)
     LLUV_FS_FUNCTIONS_1_14_0(safe)
+#endif
+#if LLUV_UV_VER_GE(1,28,0)
+    LLUV_FS_FUNCTIONS_1_28_0(safe)
 #endif
     {NULL,NULL}
   },
@@ -1076,6 +2333,20 @@ LLUV_INTERNAL void lluv_fs_initlib(lua_State *L, int nup, int safe){
     lua_pop(L, nup);
   lua_pop(L, 1);
 
+  lutil_pushnvalues(L, nup);
+
+  if(!lutil_createmetap(L, LLUV_READER, lluv_reader_methods, nup))
+    lua_pop(L, nup);
+  lua_pop(L, 1);
+
+#if LLUV_UV_VER_GE(1,28,0)
+  lutil_pushnvalues(L, nup);
+
+  if(!lutil_createmetap(L, LLUV_DIR, lluv_dir_methods, nup))
+    lua_pop(L, nup);
+  lua_pop(L, 1);
+#endif
+
   luaL_setfuncs(L, lluv_fs_functions[safe], nup);
   lluv_register_constants(L, lluv_fs_constants);
 }
@@ -26,6 +26,7 @@
 #include "lluv_fs_event.h"
 #include "lluv_fs_poll.h"
 #include "lluv_process.h"
+#include "lluv_async.h"
 #include <assert.h>
 #include <string.h>
 
@@ -52,6 +53,7 @@ static int lluv_handle_dispatch(lua_State *L){
     case UV_FS_EVENT:   return lluv_fs_event_index(L);
     case UV_FS_POLL:    return lluv_fs_poll_index(L);
     case UV_PROCESS:    return lluv_process_index(L);
+    case UV_ASYNC:      return lluv_async_index(L);
   }
   assert(0 && "please provide index function for this handle type");
   return 0;
@@ -113,6 +115,7 @@ LLUV_INTERNAL lluv_handle_t* lluv_handle_create(lua_State *L, uv_handle_type typ
   handle->self = LUA_NOREF;
   handle->lock = 0;
   handle->lock_counter = 0;
+  handle->ext  = NULL;
 
   return handle;
 }
@@ -200,6 +203,12 @@ LLUV_INTERNAL void lluv_handle_cleanup(lua_State *L, lluv_handle_t *handle, int
     handle->callbacks[i] = LUA_NOREF;
   }
 
+  if(handle->ext){
+    lluv_handle_ext_t *ext = handle->ext;
+    handle->ext = NULL;
+    ext->free(L, handle, ext);
+  }
+
   luaL_unref(L, LLUV_LUA_REGISTRY, handle->self);
   handle->self = LUA_NOREF;
 
@@ -287,7 +296,7 @@ static void lluv_on_handle_close(uv_handle_t *arg){
 
     lua_pushvalue(L, -1); lua_insert(L, -3);
 
-    LLUV_LOOP_CALL_CB(L, loop, 1);
+    LLUV_LOOP_CALL_CB_EX(L, loop, 1, arg->type, LLUV_CB_CLOSE);
 
     /* cleanup LLUV_HANDLES_SET after callback */
     assert(lluv_check_handle(L, -1, 0));
@@ -319,6 +328,10 @@ static int lluv_handle_close(lua_State *L){
     LLUV_CLOSE_CB(handle) = luaL_ref(L, LLUV_LUA_REGISTRY);
   }
 
+  if(handle->ext && handle->ext->close){
+    handle->ext->close(L, handle, handle->ext);
+  }
+
   uv_close(LLUV_H(handle, uv_handle_t), lluv_on_handle_close);
 
   lua_settop(L, 1);
@@ -22,14 +22,25 @@
 #include "lluv.h"
 #include "lluv_utils.h"
 
+typedef struct lluv_handle_ext_tag lluv_handle_ext_t;
+
+/* Optional type specific data attached to handle (e.g. read into buffer state).
+ * Extension allocated on demand and released by `free` in lluv_handle_cleanup.
+ */
+struct lluv_handle_ext_tag{
+  void (*free)(lua_State *L, lluv_handle_t *handle, lluv_handle_ext_t *ext);
+  void (*close)(lua_State *L, lluv_handle_t *handle, lluv_handle_ext_t *ext); /* optional. called just before uv_close */
+};
+
 typedef struct lluv_handle_tag{
-  int          self;
-  lluv_flags_t lock;
-  int          lock_counter;
-  lua_State   *L;
-  lluv_flags_t flags;
-  int          callbacks[LLUV_MAX_HANDLE_CB];
-  uv_handle_t  handle;
+  int                self;
+  lluv_flags_t       lock;
+  int                lock_counter;
+  lua_State         *L;
+  lluv_flags_t       flags;
+  int                callbacks[LLUV_MAX_HANDLE_CB];
+  lluv_handle_ext_t *ext;
+  uv_handle_t        handle;
 } lluv_handle_t;
 
 //! @todo make debug verions with check cast with checking uv_handle_type
@@ -72,6 +83,7 @@ LLUV_INTERNAL void lluv_handle_unlock(lua_State *L, lluv_handle_t *handle, lluv_
 #define LLUV_LOCK_EXIT        LLUV_FLAG_1
 #define LLUV_LOCK_CONNECTION  LLUV_FLAG_2
 #define LLUV_LOCK_MANUAL      LLUV_FLAG_3
+#define LLUV_LOCK_CORK        LLUV_FLAG_4
 #define LLUV_LOCK_REQ         LLUV_FLAG_7 /* counter lock */
 
 #endif
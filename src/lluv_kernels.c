@@ -0,0 +1,554 @@
+/******************************************************************************
+* Author: Alexey Melnichuk <alexeymelnichuck@gmail.com>
+*
+* Copyright (C) 2014-2019 Alexey Melnichuk <alexeymelnichuck@gmail.com>
+*
+* Licensed according to the included 'LICENSE' document
+*
+* This file is part of lua-lluv library.
+******************************************************************************/
+
+/* Builtin kernels for `uv.queue_work`.
+** All kernels process input buffers as one continuous stream.
+*/
+
+#include "lluv.h"
+#include "lluv_utils.h"
+#include "lluv_work.h"
+#include <string.h>
+#include <stdlib.h>
+
+#ifdef LLUV_USE_ZLIB
+#  include <zlib.h>
+#endif
+
+static size_t lluv_kernel_total(const lluv_work_data_t *data){
+  size_t i, total = 0;
+  for(i = 0; i < data->nbufs; ++i) total += data->bufs[i].len;
+  return total;
+}
+
+static int lluv_kernel_result(lluv_work_data_t *data, size_t size){
+  data->result = (char*)malloc(size ? size : 1);
+  if(!data->result) return UV_ENOMEM;
+  data->result_len = size;
+  return 0;
+}
+
+static void lluv_put_be32(unsigned char *p, uint32_t v){
+  p[0] = (unsigned char)(v >> 24); p[1] = (unsigned char)(v >> 16);
+  p[2] = (unsigned char)(v >>  8); p[3] = (unsigned char)(v      );
+}
+
+static void lluv_put_be64(unsigned char *p, uint64_t v){
+  lluv_put_be32(p,     (uint32_t)(v >> 32));
+  lluv_put_be32(p + 4, (uint32_t)(v      ));
+}
+
+//{ SHA-256
+
+typedef struct lluv_sha256_tag{
+  uint32_t      state[8];
+  uint64_t      bitlen;
+  unsigned char data[64];
+  size_t        datalen;
+}lluv_sha256_t;
+
+static const uint32_t lluv_sha256_k[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+  0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+  0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+  0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+  0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+  0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define LLUV_ROTR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void lluv_sha256_transform(lluv_sha256_t *ctx, const unsigned char *data){
+  uint32_t a, b, c, d, e, f, g, h, t1, t2, m[64];
+  int i;
+
+  for(i = 0; i < 16; ++i){
+    m[i] = ((uint32_t)data[i * 4] << 24) | ((uint32_t)data[i * 4 + 1] << 16) |
+           ((uint32_t)data[i * 4 + 2] << 8) | ((uint32_t)data[i * 4 + 3]);
+  }
+  for(; i < 64; ++i){
+    uint32_t s0 = LLUV_ROTR32(m[i - 15], 7) ^ LLUV_ROTR32(m[i - 15], 18) ^ (m[i - 15] >> 3);
+    uint32_t s1 = LLUV_ROTR32(m[i - 2], 17) ^ LLUV_ROTR32(m[i - 2], 19) ^ (m[i - 2] >> 10);
+    m[i] = m[i - 16] + s0 + m[i - 7] + s1;
+  }
+
+  a = ctx->state[0]; b = ctx->state[1]; c = ctx->state[2]; d = ctx->state[3];
+  e = ctx->state[4]; f = ctx->state[5]; g = ctx->state[6]; h = ctx->state[7];
+
+  for(i = 0; i < 64; ++i){
+    t1 = h + (LLUV_ROTR32(e, 6) ^ LLUV_ROTR32(e, 11) ^ LLUV_ROTR32(e, 25)) +
+         ((e & f) ^ (~e & g)) + lluv_sha256_k[i] + m[i];
+    t2 = (LLUV_ROTR32(a, 2) ^ LLUV_ROTR32(a, 13) ^ LLUV_ROTR32(a, 22)) +
+         ((a & b) ^ (a & c) ^ (b & c));
+    h = g; g = f; f = e; e = d + t1;
+    d = c; c = b; b = a; a = t1 + t2;
+  }
+
+  ctx->state[0] += a; ctx->state[1] += b; ctx->state[2] += c; ctx->state[3] += d;
+  ctx->state[4] += e; ctx->state[5] += f; ctx->state[6] += g; ctx->state[7] += h;
+}
+
+static void lluv_sha256_init(lluv_sha256_t *ctx){
+  ctx->datalen  = 0;
+  ctx->bitlen   = 0;
+  ctx->state[0] = 0x6a09e667; ctx->state[1] = 0xbb67ae85;
+  ctx->state[2] = 0x3c6ef372; ctx->state[3] = 0xa54ff53a;
+  ctx->state[4] = 0x510e527f; ctx->state[5] = 0x9b05688c;
+  ctx->state[6] = 0x1f83d9ab; ctx->state[7] = 0x5be0cd19;
+}
+
+static void lluv_sha256_update(lluv_sha256_t *ctx, const unsigned char *data, size_t len){
+  ctx->bitlen += (uint64_t)len * 8;
+
+  while(len){
+    size_t n;
+
+    if((ctx->datalen == 0) && (len >= 64)){
+      lluv_sha256_transform(ctx, data);
+      data += 64; len -= 64;
+      continue;
+    }
+
+    n = 64 - ctx->datalen;
+    if(n > len) n = len;
+    memcpy(ctx->data + ctx->datalen, data, n);
+    ctx->datalen += n; data += n; len -= n;
+
+    if(ctx->datalen == 64){
+      lluv_sha256_transform(ctx, ctx->data);
+      ctx->datalen = 0;
+    }
+  }
+}
+
+static void lluv_sha256_final(lluv_sha256_t *ctx, unsigned char *hash){
+  int i;
+
+  ctx->data[ctx->datalen++] = 0x80;
+  if(ctx->datalen > 56){
+    memset(ctx->data + ctx->datalen, 0, 64 - ctx->datalen);
+    lluv_sha256_transform(ctx, ctx->data);
+    ctx->datalen = 0;
+  }
+  memset(ctx->data + ctx->datalen, 0, 56 - ctx->datalen);
+  lluv_put_be64(ctx->data + 56, ctx->bitlen);
+  lluv_sha256_transform(ctx, ctx->data);
+
+  for(i = 0; i < 8; ++i) lluv_put_be32(hash + i * 4, ctx->state[i]);
+}
+
+static int lluv_kernel_sha256(lluv_work_data_t *data){
+  lluv_sha256_t ctx;
+  size_t i;
+  int err;
+
+  lluv_sha256_init(&ctx);
+  for(i = 0; i < data->nbufs; ++i)
+    lluv_sha256_update(&ctx, (const unsigned char*)data->bufs[i].base, data->bufs[i].len);
+
+  if((err = lluv_kernel_result(data, 32))) return err;
+  lluv_sha256_final(&ctx, (unsigned char*)data->result);
+  return 0;
+}
+
+//}
+
+//{ XXH64
+
+#define LLUV_XXH_P1 UINT64_C(11400714785074694791)
+#define LLUV_XXH_P2 UINT64_C(14029467366897019727)
+#define LLUV_XXH_P3 UINT64_C( 1609587929392839161)
+#define LLUV_XXH_P4 UINT64_C( 9650029242287828579)
+#define LLUV_XXH_P5 UINT64_C( 2870177450012600261)
+
+#define LLUV_ROTL64(x, n) (((x) << (n)) | ((x) >> (64 - (n))))
+
+typedef struct lluv_xxh64_tag{
+  uint64_t      total;
+  uint64_t      v[4];
+  unsigned char mem[32];
+  size_t        memsize;
+  uint64_t      seed;
+}lluv_xxh64_t;
+
+static uint64_t lluv_read_le64(const unsigned char *p){
+  return  (uint64_t)p[0]        | ((uint64_t)p[1] <<  8) | ((uint64_t)p[2] << 16) |
+         ((uint64_t)p[3] << 24) | ((uint64_t)p[4] << 32) | ((uint64_t)p[5] << 40) |
+         ((uint64_t)p[6] << 48) | ((uint64_t)p[7] << 56);
+}
+
+static uint32_t lluv_read_le32(const unsigned char *p){
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t lluv_xxh64_round(uint64_t acc, uint64_t input){
+  acc += input * LLUV_XXH_P2;
+  acc  = LLUV_ROTL64(acc, 31);
+  return acc * LLUV_XXH_P1;
+}
+
+static uint64_t lluv_xxh64_merge(uint64_t acc, uint64_t val){
+  acc ^= lluv_xxh64_round(0, val);
+  return acc * LLUV_XXH_P1 + LLUV_XXH_P4;
+}
+
+static void lluv_xxh64_init(lluv_xxh64_t *ctx, uint64_t seed){
+  ctx->total   = 0;
+  ctx->memsize = 0;
+  ctx->seed    = seed;
+  ctx->v[0]    = seed + LLUV_XXH_P1 + LLUV_XXH_P2;
+  ctx->v[1]    = seed + LLUV_XXH_P2;
+  ctx->v[2]    = seed;
+  ctx->v[3]    = seed - LLUV_XXH_P1;
+}
+
+static void lluv_xxh64_stripe(lluv_xxh64_t *ctx, const unsigned char *p){
+  ctx->v[0] = lluv_xxh64_round(ctx->v[0], lluv_read_le64(p     ));
+  ctx->v[1] = lluv_xxh64_round(ctx->v[1], lluv_read_le64(p +  8));
+  ctx->v[2] = lluv_xxh64_round(ctx->v[2], lluv_read_le64(p + 16));
+  ctx->v[3] = lluv_xxh64_round(ctx->v[3], lluv_read_le64(p + 24));
+}
+
+static void lluv_xxh64_update(lluv_xxh64_t *ctx, const unsigned char *p, size_t len){
+  ctx->total += len;
+
+  if(ctx->memsize){
+    size_t n = 32 - ctx->memsize;
+    if(n > len) n = len;
+    memcpy(ctx->mem + ctx->memsize, p, n);
+    ctx->memsize += n; p += n; len -= n;
+    if(ctx->memsize < 32) return;
+    lluv_xxh64_stripe(ctx, ctx->mem);
+    ctx->memsize = 0;
+  }
+
+  while(len >= 32){
+    lluv_xxh64_stripe(ctx, p);
+    p += 32; len -= 32;
+  }
+
+  if(len){
+    memcpy(ctx->mem, p, len);
+    ctx->memsize = len;
+  }
+}
+
+static uint64_t lluv_xxh64_digest(const lluv_xxh64_t *ctx){
+  const unsigned char *p = ctx->mem, *end = ctx->mem + ctx->memsize;
+  uint64_t h;
+
+  if(ctx->total >= 32){
+    h = LLUV_ROTL64(ctx->v[0], 1) + LLUV_ROTL64(ctx->v[1], 7) +
+        LLUV_ROTL64(ctx->v[2], 12) + LLUV_ROTL64(ctx->v[3], 18);
+    h = lluv_xxh64_merge(h, ctx->v[0]);
+    h = lluv_xxh64_merge(h, ctx->v[1]);
+    h = lluv_xxh64_merge(h, ctx->v[2]);
+    h = lluv_xxh64_merge(h, ctx->v[3]);
+  }
+  else h = ctx->seed + LLUV_XXH_P5;
+
+  h += ctx->total;
+
+  while(p + 8 <= end){
+    h ^= lluv_xxh64_round(0, lluv_read_le64(p));
+    h  = LLUV_ROTL64(h, 27) * LLUV_XXH_P1 + LLUV_XXH_P4;
+    p += 8;
+  }
+
+  if(p + 4 <= end){
+    h ^= (uint64_t)lluv_read_le32(p) * LLUV_XXH_P1;
+    h  = LLUV_ROTL64(h, 23) * LLUV_XXH_P2 + LLUV_XXH_P3;
+    p += 4;
+  }
+
+  while(p < end){
+    h ^= (*p) * LLUV_XXH_P5;
+    h  = LLUV_ROTL64(h, 11) * LLUV_XXH_P1;
+    ++p;
+  }
+
+  h ^= h >> 33; h *= LLUV_XXH_P2;
+  h ^= h >> 29; h *= LLUV_XXH_P3;
+  h ^= h >> 32;
+
+  return h;
+}
+
+static int lluv_kernel_xxh64(lluv_work_data_t *data){
+  lluv_xxh64_t ctx;
+  size_t i;
+  int err;
+
+  lluv_xxh64_init(&ctx, data->has_param ? (uint64_t)data->param : 0);
+  for(i = 0; i < data->nbufs; ++i)
+    lluv_xxh64_update(&ctx, (const unsigned char*)data->bufs[i].base, data->bufs[i].len);
+
+  if((err = lluv_kernel_result(data, 8))) return err;
+  lluv_put_be64((unsigned char*)data->result, lluv_xxh64_digest(&ctx));
+  return 0;
+}
+
+//}
+
+//{ CRC32C (Castagnoli)
+
+static uint32_t lluv_crc32c_table[256];
+static uv_once_t lluv_crc32c_once = UV_ONCE_INIT;
+
+static void lluv_crc32c_init(void){
+  uint32_t i, j;
+  for(i = 0; i < 256; ++i){
+    uint32_t c = i;
+    for(j = 0; j < 8; ++j) c = (c & 1) ? (c >> 1) ^ 0x82F63B78 : (c >> 1);
+    lluv_crc32c_table[i] = c;
+  }
+}
+
+static int lluv_kernel_crc32c(lluv_work_data_t *data){
+  uint32_t crc = data->has_param ? ~(uint32_t)data->param : 0xFFFFFFFF;
+  size_t i, j;
+  int err;
+
+  uv_once(&lluv_crc32c_once, lluv_crc32c_init);
+
+  for(i = 0; i < data->nbufs; ++i){
+    const unsigned char *p = (const unsigned char*)data->bufs[i].base;
+    for(j = 0; j < data->bufs[i].len; ++j)
+      crc = lluv_crc32c_table[(crc ^ p[j]) & 0xFF] ^ (crc >> 8);
+  }
+
+  if((err = lluv_kernel_result(data, 4))) return err;
+  lluv_put_be32((unsigned char*)data->result, ~crc);
+  return 0;
+}
+
+//}
+
+//{ Base64
+
+static const char lluv_base64_alphabet[] =
+  "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static int lluv_kernel_base64_encode(lluv_work_data_t *data){
+  size_t total = lluv_kernel_total(data), i, j;
+  unsigned char q[3]; size_t nq = 0;
+  char *out;
+  int err;
+
+  if((err = lluv_kernel_result(data, ((total + 2) / 3) * 4))) return err;
+  out = data->result;
+
+  for(i = 0; i < data->nbufs; ++i){
+    const unsigned char *p = (const unsigned char*)data->bufs[i].base;
+    for(j = 0; j < data->bufs[i].len; ++j){
+      q[nq++] = p[j];
+      if(nq == 3){
+        *out++ = lluv_base64_alphabet[q[0] >> 2];
+        *out++ = lluv_base64_alphabet[((q[0] & 0x03) << 4) | (q[1] >> 4)];
+        *out++ = lluv_base64_alphabet[((q[1] & 0x0F) << 2) | (q[2] >> 6)];
+        *out++ = lluv_base64_alphabet[q[2] & 0x3F];
+        nq = 0;
+      }
+    }
+  }
+
+  if(nq){
+    if(nq == 1) q[1] = 0;
+    *out++ = lluv_base64_alphabet[q[0] >> 2];
+    *out++ = lluv_base64_alphabet[((q[0] & 0x03) << 4) | (q[1] >> 4)];
+    *out++ = (nq == 2) ? lluv_base64_alphabet[(q[1] & 0x0F) << 2] : '=';
+    *out++ = '=';
+  }
+
+  return 0;
+}
+
+static int lluv_base64_value(unsigned char c){
+  if(c >= 'A' && c <= 'Z') return c - 'A';
+  if(c >= 'a' && c <= 'z') return c - 'a' + 26;
+  if(c >= '0' && c <= '9') return c - '0' + 52;
+  if(c == '+') return 62;
+  if(c == '/') return 63;
+  return -1;
+}
+
+/* whitespaces are ignored */
+static int lluv_kernel_base64_decode(lluv_work_data_t *data){
+  size_t total = lluv_kernel_total(data), i, j;
+  uint32_t acc = 0; int nacc = 0, pad = 0;
+  char *out;
+  int err;
+
+  if((err = lluv_kernel_result(data, (total / 4) * 3 + 3))) return err;
+  out = data->result;
+
+  for(i = 0; i < data->nbufs; ++i){
+    const unsigned char *p = (const unsigned char*)data->bufs[i].base;
+    for(j = 0; j < data->bufs[i].len; ++j){
+      int v;
+
+      if(p[j] == ' ' || p[j] == '\t' || p[j] == '\r' || p[j] == '\n') continue;
+
+      if(p[j] == '='){ ++pad; continue; }
+
+      v = lluv_base64_value(p[j]);
+      if(v < 0 || pad) goto invalid;
+
+      acc = (acc << 6) | (uint32_t)v;
+      if(++nacc == 4){
+        *out++ = (char)(acc >> 16);
+        *out++ = (char)(acc >> 8);
+        *out++ = (char)(acc);
+        acc = 0; nacc = 0;
+      }
+    }
+  }
+
+  if(pad > 2) goto invalid;
+
+  switch(nacc){
+    case 0: if(pad) goto invalid; break;
+    case 1: goto invalid;
+    case 2: *out++ = (char)(acc >> 4); break;
+    case 3: *out++ = (char)(acc >> 10); *out++ = (char)(acc >> 2); break;
+  }
+
+  data->result_len = out - data->result;
+  return 0;
+
+invalid:
+  free(data->result);
+  data->result = NULL;
+  data->result_len = 0;
+  return UV_EINVAL;
+}
+
+//}
+
+//{ zlib
+
+#ifdef LLUV_USE_ZLIB
+
+static int lluv_kernel_zlib_error(z_stream *z, int ret, lluv_work_data_t *data, int deflate){
+  if(deflate) deflateEnd(z); else inflateEnd(z);
+  free(data->result);
+  data->result = NULL;
+  data->result_len = 0;
+  return (ret == Z_MEM_ERROR) ? UV_ENOMEM : UV_EINVAL;
+}
+
+static int lluv_kernel_deflate(lluv_work_data_t *data){
+  int level = data->has_param ? (int)data->param : Z_DEFAULT_COMPRESSION;
+  z_stream z;
+  size_t i;
+  int ret;
+
+  memset(&z, 0, sizeof(z));
+  ret = deflateInit(&z, level);
+  if(ret != Z_OK) return (ret == Z_MEM_ERROR) ? UV_ENOMEM : UV_EINVAL;
+
+  ret = lluv_kernel_result(data, deflateBound(&z, (uLong)lluv_kernel_total(data)));
+  if(ret){
+    deflateEnd(&z);
+    return ret;
+  }
+
+  z.next_out  = (Bytef*)data->result;
+  z.avail_out = (uInt)data->result_len;
+
+  for(i = 0; i < data->nbufs; ++i){
+    z.next_in  = (Bytef*)data->bufs[i].base;
+    z.avail_in = (uInt)data->bufs[i].len;
+    ret = deflate(&z, Z_NO_FLUSH);
+    if(ret != Z_OK) return lluv_kernel_zlib_error(&z, ret, data, 1);
+  }
+
+  ret = deflate(&z, Z_FINISH);
+  if(ret != Z_STREAM_END) return lluv_kernel_zlib_error(&z, ret, data, 1);
+
+  data->result_len = z.total_out;
+  deflateEnd(&z);
+  return 0;
+}
+
+static int lluv_kernel_inflate(lluv_work_data_t *data){
+  size_t i, capacity = lluv_kernel_total(data) * 4 + 64;
+  z_stream z;
+  int ret = Z_OK;
+
+  memset(&z, 0, sizeof(z));
+  ret = inflateInit(&z);
+  if(ret != Z_OK) return (ret == Z_MEM_ERROR) ? UV_ENOMEM : UV_EINVAL;
+
+  if(lluv_kernel_result(data, capacity)){
+    inflateEnd(&z);
+    return UV_ENOMEM;
+  }
+
+  for(i = 0; (i < data->nbufs) && (ret != Z_STREAM_END); ++i){
+    z.next_in  = (Bytef*)data->bufs[i].base;
+    z.avail_in = (uInt)data->bufs[i].len;
+
+    /* output buffer can be full while inflate still has pending data */
+    do{
+      if(z.total_out == capacity){
+        char *tmp = (char*)realloc(data->result, capacity * 2);
+        if(!tmp) return lluv_kernel_zlib_error(&z, Z_MEM_ERROR, data, 0);
+        data->result = tmp;
+        capacity *= 2;
+      }
+
+      z.next_out  = (Bytef*)data->result + z.total_out;
+      z.avail_out = (uInt)(capacity - z.total_out);
+
+      ret = inflate(&z, Z_NO_FLUSH);
+      if(ret == Z_STREAM_END) break;
+      if(ret != Z_OK && ret != Z_BUF_ERROR) return lluv_kernel_zlib_error(&z, ret, data, 0);
+    }while(z.avail_in || (z.avail_out == 0));
+  }
+
+  if(ret != Z_STREAM_END) return lluv_kernel_zlib_error(&z, Z_DATA_ERROR, data, 0);
+
+  data->result_len = z.total_out;
+  inflateEnd(&z);
+  return 0;
+}
+
+#endif
+
+//}
+
+static const struct{
+  const char         *name;
+  lluv_work_kernel_t  kernel;
+} lluv_work_builtins[] = {
+  { "sha256",        lluv_kernel_sha256        },
+  { "xxh64",         lluv_kernel_xxh64         },
+  { "crc32c",        lluv_kernel_crc32c        },
+  { "base64_encode", lluv_kernel_base64_encode },
+  { "base64_decode", lluv_kernel_base64_decode },
+#ifdef LLUV_USE_ZLIB
+  { "deflate",       lluv_kernel_deflate       },
+  { "inflate",       lluv_kernel_inflate       },
+#endif
+
+  { NULL, NULL }
+};
+
+LLUV_INTERNAL lluv_work_kernel_t lluv_work_builtin(const char *name){
+  int i;
+  for(i = 0; lluv_work_builtins[i].name; ++i){
+    if(strcmp(lluv_work_builtins[i].name, name) == 0)
+      return lluv_work_builtins[i].kernel;
+  }
+  return NULL;
+}
@@ -13,84 +13,104 @@
 #include "lluv_list.h"
 #include <assert.h>
 
+/* Ring buffer of Lua values.
+ * Values stored in preallocated array part of Lua table so in steady
+ * state push/pop does not allocate memory. Slot `i` of ring has key `i+1`.
+ */
+
+#define LLUV_LIST_SLOT(lst, i) ((int)(((lst)->head + (i)) % (lst)->cap) + 1)
+
+static void lluv_list_grow(lua_State *L, lluv_list_t *lst, size_t n){
+  size_t i, cap = lst->cap;
+  int t;
+
+  while(cap < n) cap *= 2;
+
+  luaL_checkstack(L, 3, "too many arguments");
+
+  lua_rawgeti(L, LLUV_LUA_REGISTRY, lst->t);
+  t = lua_gettop(L);
+  lua_createtable(L, (int)cap, 0);
+
+  for(i = 0; i < lst->size; ++i){
+    lua_rawgeti(L, t, LLUV_LIST_SLOT(lst, i));
+    lua_rawseti(L, -2, (int)i + 1);
+  }
+
+  lua_rawseti(L, LLUV_LUA_REGISTRY, lst->t);
+  lua_pop(L, 1);
+
+  lst->head = 0;
+  lst->cap  = cap;
+}
+
 LLUV_INTERNAL void lluv_list_init(lua_State *L, lluv_list_t *lst){
-  lst->first = 0;
-  lst->last = -1;
-  lua_newtable(L);
+  lst->head = 0;
+  lst->size = 0;
+  lst->cap  = LLUV_LIST_INIT_SIZE;
+  lua_createtable(L, LLUV_LIST_INIT_SIZE, 0);
   lst->t = luaL_ref(L, LLUV_LUA_REGISTRY);
 }
 
 LLUV_INTERNAL void lluv_list_close(lua_State *L, lluv_list_t *lst){
-  lst->first = 0;
-  lst->last = -1;
+  lst->head = 0;
+  lst->size = 0;
   luaL_unref(L, LLUV_LUA_REGISTRY, lst->t);
   lst->t = LUA_NOREF;
 }
 
-static void lluv_list_push_(lua_State *L, lluv_list_t *lst, lua_Integer i){
-  int top = lua_gettop(L);
+LLUV_INTERNAL void lluv_list_push_back(lua_State *L, lluv_list_t *lst, int n){
+  int i, t, top = lua_gettop(L);
 
-  assert(!lua_isnoneornil(L, -1));
+  assert(n > 0);
+  assert(top >= n);
+
+  if(lst->size + n > lst->cap) lluv_list_grow(L, lst, lst->size + n);
 
   luaL_checkstack(L, 1, "too many arguments");
 
   lua_rawgeti(L, LLUV_LUA_REGISTRY, lst->t);
-  lua_insert(L, -2);
+  lua_insert(L, -1 - n);
+  t = top - n + 1;
 
-  lua_rawseti(L, -2, i);
+  for(i = n - 1; i >= 0; --i){
+    lua_rawseti(L, t, LLUV_LIST_SLOT(lst, lst->size + i));
+  }
   lua_pop(L, 1);
 
-  assert(top == (1 + lua_gettop(L)));
+  lst->size += n;
+
+  assert(top == (n + lua_gettop(L)));
 }
 
-static int lluv_list_pop_(lua_State *L, lluv_list_t *lst, lua_Integer i){
-  if(lst->first > lst->last) return 0;
+LLUV_INTERNAL int lluv_list_pop_front(lua_State *L, lluv_list_t *lst, int n){
+  int i, t;
 
-  assert((lst->first == i)||(lst->last == i));
+  if(lst->size < (size_t)n) return 0;
 
-  luaL_checkstack(L, 3, "too many arguments");
+  luaL_checkstack(L, n + 2, "too many arguments");
 
   lua_rawgeti(L, LLUV_LUA_REGISTRY, lst->t);
-  lua_rawgeti(L, -1, i);
-
-  assert(!lua_isnoneornil(L, -1));
-
-  lua_pushnil(L);
-  lua_rawseti(L, -3, i);
-
-  lua_remove(L, -2);
-  return 1;
-}
-
-LLUV_INTERNAL void lluv_list_push_front(lua_State *L, lluv_list_t *lst){
-  lua_Integer i = lst->first - 1;
-  lluv_list_push_(L, lst, i);
-  lst->first = i;
-}
+  t = lua_gettop(L);
 
-LLUV_INTERNAL void lluv_list_push_back(lua_State *L, lluv_list_t *lst){
-  lua_Integer i = lst->last + 1;
-  lluv_list_push_(L, lst, i);
-  lst->last = i;
-}
+  for(i = 0; i < n; ++i){
+    int slot = LLUV_LIST_SLOT(lst, i);
+    lua_rawgeti(L, t, slot);
+    lua_pushnil(L);
+    lua_rawseti(L, t, slot);
+  }
+  lua_remove(L, t);
 
-LLUV_INTERNAL int lluv_list_pop_front(lua_State *L, lluv_list_t *lst){
-  int i = lluv_list_pop_(L, lst, lst->first);
-  lst->first += i;
-  return i;
-}
+  lst->size -= n;
+  lst->head  = lst->size ? ((lst->head + n) % lst->cap) : 0;
 
-LLUV_INTERNAL int lluv_list_pop_back(lua_State *L, lluv_list_t *lst){
-  int i = lluv_list_pop_(L, lst, lst->last);
-  lst->last -= i;
-  return i;
+  return n;
 }
 
 LLUV_INTERNAL size_t lluv_list_size(lua_State *L, lluv_list_t *lst){
-  return (size_t)(lst->last - lst->first + 1);
+  return lst->size;
 }
 
 LLUV_INTERNAL int lluv_list_empty(lua_State *L, lluv_list_t *lst){
-  return (lst->first > lst->last)?1:0;
+  return (lst->size == 0)?1:0;
 }
-
@@ -11,23 +11,27 @@
 #ifndef _LLUV_LIST_H_
 #define _LLUV_LIST_H_
 
+/* initial number of slots */
+#ifndef LLUV_LIST_INIT_SIZE
+#  define LLUV_LIST_INIT_SIZE 64
+#endif
+
 typedef struct lluv_list_tag{
-  lua_Integer first;
-  lua_Integer last;
-  int            t;
+  size_t head;
+  size_t size;
+  size_t cap;
+  int    t;
 } lluv_list_t;
 
 LLUV_INTERNAL void lluv_list_init(lua_State *L, lluv_list_t *lst);
 
 LLUV_INTERNAL void lluv_list_close(lua_State *L, lluv_list_t *lst);
 
-LLUV_INTERNAL void lluv_list_push_back(lua_State *L, lluv_list_t *lst);
-
-LLUV_INTERNAL void lluv_list_push_front(lua_State *L, lluv_list_t *lst);
-
-LLUV_INTERNAL int lluv_list_pop_back(lua_State *L, lluv_list_t *lst);
+/* move `n` values from top of stack to end of list */
+LLUV_INTERNAL void lluv_list_push_back(lua_State *L, lluv_list_t *lst, int n);
 
-LLUV_INTERNAL int lluv_list_pop_front(lua_State *L, lluv_list_t *lst);
+/* push `n` values from front of list to stack */
+LLUV_INTERNAL int lluv_list_pop_front(lua_State *L, lluv_list_t *lst, int n);
 
 LLUV_INTERNAL size_t lluv_list_size(lua_State *L, lluv_list_t *lst);
 
@@ -9,16 +9,25 @@
 ******************************************************************************/
 
 #include "lluv_loop.h"
+#include "lluv_worker.h"
 #include "lluv_error.h"
 #include "lluv_utils.h"
 #include "lluv_handle.h"
 #include "lluv_list.h"
+#include "lluv_req.h"
+#include "lluv_stream.h"
+#include "lluv_udp.h"
 #include <assert.h>
 
 #ifndef LLUV_DEFER_DEPTH
 #  define LLUV_DEFER_DEPTH 10
 #endif
 
+/* default max number of deferred calls per iteration for budget policy */
+#ifndef LLUV_DEFER_BUDGET
+#  define LLUV_DEFER_BUDGET 1000
+#endif
+
 #define LLUV_LOOP_NAME LLUV_PREFIX" Loop"
 static const char *LLUV_LOOP = LLUV_LOOP_NAME;
 
@@ -29,8 +38,11 @@ LLUV_INTERNAL lluv_loop_t* lluv_push_default_loop(lua_State *L){
   if(lua_isnil(L, -1)){
     lua_pop(L, 1);
 #ifdef LLUV_USE_UV_DEFAULT_LOOP
-    lluv_loop_create(L, uv_default_loop(), LLUV_FLAG_DEFAULT_LOOP);
-#else
+    /* uv_default_loop is not thread safe so worker threads use own loop */
+    if(!lluv_is_worker_state(L))
+      lluv_loop_create(L, uv_default_loop(), LLUV_FLAG_DEFAULT_LOOP);
+    else
+#endif
     {
       uv_loop_t *loop = lluv_alloc_t(L, uv_loop_t);
       int err = uv_loop_init(loop);
@@ -40,7 +52,6 @@ LLUV_INTERNAL lluv_loop_t* lluv_push_default_loop(lua_State *L){
       }
       lluv_loop_create(L, loop, 0);
     }
-#endif
     lua_pushvalue(L, -1);
     lua_rawsetp(L, LLUV_LUA_REGISTRY, LLUV_DEFAULT_LOOP_TAG);
   }
@@ -70,8 +81,26 @@ LLUV_INTERNAL int lluv_loop_create(lua_State *L, uv_loop_t *h, lluv_flags_t flag
   loop->handle->data = loop;
   loop->flags        = flags | LLUV_FLAG_OPEN;
   loop->level        = 0;
-  loop->buffer_size  = LLUV_BUFFER_SIZE;
+  lluv_bufpool_init(&loop->pool);
+  lluv_addrcache_init(&loop->addrs);
+  lluv_req_pool_init(loop);
   lluv_list_init(L, &loop->defer);
+  loop->ndefer       = 0;
+  loop->defer_policy  = LLUV_DEFER_CALLBACK;
+  loop->defer_count   = 0;
+  loop->defer_time    = 0;
+  loop->defer_drained = 0;
+  loop->defer_carried = 0;
+  loop->defer_nold    = 0;
+  loop->idle          = NULL;
+  loop->prepare      = NULL;
+  loop->check        = NULL;
+  loop->hooks        = 0;
+  loop->corked       = NULL;
+  loop->batched      = NULL;
+  loop->stats        = NULL;
+  loop->watchdog     = NULL;
+  loop->owners       = NULL;
 
   lua_pushvalue(L, -1);
   lua_rawsetp(L, LLUV_LUA_REGISTRY, h);
@@ -112,47 +141,334 @@ LLUV_INTERNAL void lluv_loop_pushself(lua_State *L, lluv_loop_t *loop){
   assert(loop == lua_touserdata(L, -1));
 }
 
-static int lluv_defer_call(lua_State *L){
-  int i, n = lua_tointeger(L, lua_upvalueindex(1));
-  luaL_checkstack(L, n, "too many arguments");
-
-  assert(lua_isfunction(L, lua_upvalueindex(2)));
-  assert(!lua_isnone(L, lua_upvalueindex(n + 1)));
-
-  for(i = 2; i <= n+1; ++i)lua_pushvalue(L, lua_upvalueindex(i));
-
-  lua_call(L, n - 1, 0);
-  return 0;
-}
+static void lluv_loop_on_idle(uv_idle_t *arg);
 
+/* Each deferred call stored in loop ring as `nargs, function, args...`
+ * so no closure created for each call.
+ */
 LLUV_INTERNAL void lluv_loop_defer_call(lua_State *L, lluv_loop_t *loop, int nargs){
   assert(lua_isfunction(L, -1-nargs));
 
   luaL_checkstack(L, 1, "too many arguments");
-  lua_pushinteger(L, nargs+1);
+  lua_pushinteger(L, nargs);
   lua_insert(L, -2-nargs);
 
-  lua_pushcclosure(L, lluv_defer_call, nargs + 2);
-  lluv_list_push_back(L, &loop->defer);
+  lluv_list_push_back(L, &loop->defer, nargs + 2);
+  loop->ndefer += 1;
+
+  /* do not block in poll while there pending calls */
+  if(loop->idle && (loop->defer_policy != LLUV_DEFER_CALLBACK) && !uv_is_active((uv_handle_t*)loop->idle)){
+    uv_idle_start(loop->idle, lluv_loop_on_idle);
+  }
 }
 
-LLUV_INTERNAL int lluv_loop_defer_proceed(lua_State *L, lluv_loop_t *loop){
+/* Proceed deferred calls.
+ * `rounds` limits number of passes over calls scheduled by deferred calls
+ * itself (0 - no limit). `limit` and `deadline` is budget (0 - no limit).
+ */
+static int lluv_loop_defer_drain(lua_State *L, lluv_loop_t *loop, int rounds, size_t limit, uint64_t deadline){
   int top = lua_gettop(L);
+  size_t count = 0;
   int i;
-  for(i = 0; i < LLUV_DEFER_DEPTH; ++i){
-    size_t s = lluv_list_size(L, &loop->defer);
-    for(; s != 0; --s){
-      int err = lluv_list_pop_front(L, &loop->defer);
+  for(i = 0; (rounds == 0) || (i < rounds); ++i){
+    size_t s = loop->ndefer;
+    if(s == 0) break;
+    for(; (s != 0) && (loop->ndefer != 0); --s){
+      int n, err = lluv_list_pop_front(L, &loop->defer, 1);
       assert(err == 1);
-      assert((top+1) == lua_gettop(L));
-      err = lluv_lua_call(L, 0, 0);
+      n = (int)lua_tointeger(L, -1);
+      lua_pop(L, 1);
+
+      err = lluv_list_pop_front(L, &loop->defer, n + 1);
+      assert(err == n + 1);
+      loop->ndefer -= 1;
+      loop->defer_drained += 1;
+      if(loop->defer_nold) loop->defer_nold -= 1;
+
+      assert((top + n + 1) == lua_gettop(L));
+      err = lluv_loop_call(L, loop, n, UV_UNKNOWN_HANDLE, LLUV_CB_DEFER);
       assert(top == lua_gettop(L));
       if(err) return err; 
+
+      if(limit && (++count >= limit)) return 0;
+      if(deadline && (uv_hrtime() >= deadline)) return 0;
+    }
+  }
+  return 0;
+}
+
+static int lluv_loop_watchdog_report(lua_State *L, lluv_loop_t *loop, int htype, int kind, uint64_t elapsed, int interrupted){
+  lluv_watchdog_t *w = loop->watchdog;
+
+  lua_rawgeti(L, LLUV_LUA_REGISTRY, w->handler);
+  lua_pushvalue(L, -2);
+  lua_pushstring(L, lluv_stats_kind_name(htype, kind));
+  lua_pushnumber(L, (lua_Number)elapsed / 1000000);
+  lluv_watchdog_push_traceback(L, w);
+  lua_pushboolean(L, interrupted);
+
+  return lluv_lua_call(L, 5, 0);
+}
+
+/* Watchdog reports handle so keep copy of first argument
+ * under callback while it runs.
+ */
+static int lluv_loop_call_watched(lua_State *L, lluv_loop_t *loop, int narg, int htype, int kind){
+  lluv_watchdog_t *w = loop->watchdog;
+  uint64_t start, elapsed;
+  int err;
+
+  if((htype != UV_UNKNOWN_HANDLE) && (narg > 0)) lua_pushvalue(L, -narg);
+  else lua_pushnil(L);
+  lua_insert(L, -(narg + 2));
+
+  lluv_watchdog_arm(L, w);
+  start = w->start;
+  err = lluv_lua_call(L, narg, 0);
+  elapsed = uv_hrtime() - start;
+
+  /* callback can replace or disable watchdog (then it already disarmed) */
+  if(loop->watchdog && loop->watchdog->active){
+    int interrupted;
+    w = loop->watchdog;
+    interrupted = w->interrupted;
+    lluv_watchdog_disarm(L, w);
+    /* interrupted callback reported too but its error is kept */
+    if((interrupted || (!err && (elapsed >= w->threshold))) && (w->handler != LUA_NOREF)){
+      if(!err){
+        err = lluv_loop_watchdog_report(L, loop, htype, kind, elapsed, interrupted);
+      }
+      else{
+        lua_pushvalue(L, LLUV_ERROR_MARK_INDEX);
+        lua_insert(L, -2);
+        if(lluv_loop_watchdog_report(L, loop, htype, kind, elapsed, interrupted)){
+          lua_pushvalue(L, -2);
+          lua_replace(L, LLUV_ERROR_MARK_INDEX);
+        }
+        lua_remove(L, -2);
+      }
+    }
+    else{
+      lluv_watchdog_push_traceback(L, w);
+      lua_pop(L, 1);
+    }
+  }
+
+  lua_pop(L, 1);
+
+  if(loop->stats) lluv_stats_record(loop->stats, htype, kind, elapsed);
+
+  return err;
+}
+
+LLUV_INTERNAL int lluv_loop_call(lua_State *L, lluv_loop_t *loop, int narg, int htype, int kind){
+  uint64_t start;
+  int err;
+
+  if(loop->watchdog && !loop->watchdog->active){
+    return lluv_loop_call_watched(L, loop, narg, htype, kind);
+  }
+
+  if(!loop->stats) return lluv_lua_call(L, narg, 0);
+
+  start = uv_hrtime();
+  err = lluv_lua_call(L, narg, 0);
+
+  /* profiler can be disabled by callback itself */
+  if(loop->stats) lluv_stats_record(loop->stats, htype, kind, uv_hrtime() - start);
+
+  return err;
+}
+
+LLUV_INTERNAL int lluv_loop_defer_proceed(lua_State *L, lluv_loop_t *loop){
+  if(loop->defer_policy != LLUV_DEFER_CALLBACK) return 0;
+  return lluv_loop_defer_drain(L, loop, LLUV_DEFER_DEPTH, 0, 0);
+}
+
+//{ Internal hooks
+
+static void lluv_loop_on_idle(uv_idle_t *arg){
+  UNUSED_ARG(arg);
+}
+
+static int lluv_loop_defer_on_check(lua_State *L, lluv_loop_t *loop){
+  int err;
+
+  if(loop->defer_policy == LLUV_DEFER_ITERATION){
+    err = lluv_loop_defer_drain(L, loop, LLUV_DEFER_DEPTH, 0, 0);
+  }
+  else{
+    uint64_t deadline = loop->defer_time ? (uv_hrtime() + loop->defer_time) : 0;
+    err = lluv_loop_defer_drain(L, loop, 0, loop->defer_count, deadline);
+  }
+
+  if(err) return err;
+
+  /* count each call only first time it carried to next iteration */
+  if(loop->ndefer){
+    loop->defer_carried += loop->ndefer - loop->defer_nold;
+    loop->defer_nold = loop->ndefer;
+  }
+  else if(loop->idle){
+    uv_idle_stop(loop->idle);
+  }
+
+  return 0;
+}
+
+static void lluv_loop_on_hook(lluv_loop_t *loop, int check){
+  lua_State *L = loop->L;
+
+  LLUV_CHECK_LOOP_CB_INVARIANT(L);
+
+  if(!check && loop->stats && FLAG_IS_SET(loop->hooks, LLUV_LOOP_HOOK_STATS)){
+    lluv_stats_on_iteration(loop->stats, loop->handle);
+  }
+
+  if(FLAG_IS_SET(loop->hooks, LLUV_LOOP_HOOK_FLUSH)){
+    lluv_stream_flush_corked(L, loop);
+  }
+
+  if(check && FLAG_IS_SET(loop->hooks, LLUV_LOOP_HOOK_BATCH)){
+    lluv_udp_flush_batches(L, loop);
+  }
+
+  if(check && FLAG_IS_SET(loop->hooks, LLUV_LOOP_HOOK_DEFER)){
+    if(lluv_loop_defer_on_check(L, loop)){
+      LLUV_CHECK_LOOP_CB_INVARIANT(L);
+      return;
+    }
+  }
+
+  LLUV_CHECK_LOOP_CB_INVARIANT(L);
+}
+
+static void lluv_loop_on_prepare(uv_prepare_t *arg){
+  lluv_loop_on_hook(lluv_loop_byptr(arg->loop), 0);
+}
+
+static void lluv_loop_on_check(uv_check_t *arg){
+  lluv_loop_on_hook(lluv_loop_byptr(arg->loop), 1);
+}
+
+static void lluv_loop_on_hook_close(uv_handle_t *arg){
+  lluv_loop_t *loop = lluv_loop_byptr(arg->loop);
+  lluv_free(loop->L, arg);
+}
+
+LLUV_INTERNAL int lluv_loop_hook_start(lua_State *L, lluv_loop_t *loop, lluv_flags_t hook){
+  if(!loop->prepare){
+    uv_prepare_t *prepare = lluv_alloc_t(L, uv_prepare_t);
+    uv_check_t   *check   = lluv_alloc_t(L, uv_check_t);
+
+    if(!(prepare && check)){
+      if(prepare) lluv_free_t(L, uv_prepare_t, prepare);
+      if(check)   lluv_free_t(L, uv_check_t, check);
+      return UV_ENOMEM;
     }
+
+    uv_prepare_init(loop->handle, prepare);
+    uv_check_init(loop->handle, check);
+    prepare->data = NULL;
+    check->data   = NULL;
+    uv_unref((uv_handle_t*)prepare);
+    uv_unref((uv_handle_t*)check);
+
+    loop->prepare = prepare;
+    loop->check   = check;
+  }
+
+  if(!loop->hooks){
+    uv_prepare_start(loop->prepare, lluv_loop_on_prepare);
+    uv_check_start(loop->check, lluv_loop_on_check);
   }
+
+  FLAG_SET(loop->hooks, hook);
+
   return 0;
 }
 
+LLUV_INTERNAL void lluv_loop_hook_stop(lluv_loop_t *loop, lluv_flags_t hook){
+  FLAG_UNSET(loop->hooks, hook);
+
+  if(!loop->hooks && loop->prepare){
+    uv_prepare_stop(loop->prepare);
+    uv_check_stop(loop->check);
+  }
+}
+
+LLUV_INTERNAL void lluv_loop_owner_add(lluv_loop_t *loop, lluv_loop_owner_t *owner){
+  owner->next  = loop->owners;
+  loop->owners = owner;
+}
+
+LLUV_INTERNAL void lluv_loop_owner_remove(lluv_loop_t *loop, lluv_loop_owner_t *owner){
+  lluv_loop_owner_t **p = &loop->owners;
+
+  for(; *p; p = &(*p)->next){
+    if(*p == owner){
+      *p = owner->next;
+      owner->next = NULL;
+      return;
+    }
+  }
+}
+
+static void lluv_loop_owners_close(lua_State *L, lluv_loop_t *loop){
+  while(loop->owners){
+    lluv_loop_owner_t *owner = loop->owners;
+    loop->owners = owner->next;
+    owner->next  = NULL;
+    owner->close(L, owner);
+  }
+}
+
+static void lluv_loop_on_walk_count(uv_handle_t* handle, void* arg){
+  if(!lluv_loop_is_internal(handle)) *(uint32_t*)arg += 1;
+}
+
+/* Hooks and handles of owners have to be closed before uv_loop_close
+ * so close them unconditionally. It is safe to run loop only if there
+ * no other handles so no Lua callbacks can be called. Otherwise
+ * internal handles released on next loop run.
+ */
+static void lluv_loop_internals_close(lua_State *L, lluv_loop_t *loop){
+  lluv_loop_owner_t *owner;
+  uint32_t count = 0;
+  int alive;
+
+  if(!(loop->prepare || loop->owners)) return;
+
+  if(loop->idle) uv_idle_stop(loop->idle);
+
+  /* owners do not keep loop alive any more */
+  for(owner = loop->owners; owner; owner = owner->next){
+    uv_unref(owner->handle);
+  }
+
+  uv_walk(loop->handle, lluv_loop_on_walk_count, &count);
+  alive = count || uv_loop_alive(loop->handle);
+
+  lluv_loop_owners_close(L, loop);
+
+  if(loop->prepare){
+    uv_close((uv_handle_t*)loop->prepare, lluv_loop_on_hook_close);
+    uv_close((uv_handle_t*)loop->check,   lluv_loop_on_hook_close);
+    if(loop->idle) uv_close((uv_handle_t*)loop->idle, lluv_loop_on_hook_close);
+    loop->prepare = NULL;
+    loop->check   = NULL;
+    loop->idle    = NULL;
+    loop->hooks   = 0;
+    loop->defer_policy = LLUV_DEFER_CALLBACK;
+  }
+
+  if(alive) return;
+
+  uv_run(loop->handle, UV_RUN_NOWAIT);
+}
+
+//}
+
 static int lluv_loop_new_impl(lua_State *L, lluv_flags_t flags){
   uv_loop_t *loop = lluv_alloc_t(L, uv_loop_t);
   int err = uv_loop_init(loop);
@@ -177,6 +493,8 @@ static void lluv_loop_on_walk_close(uv_handle_t* handle, void* arg){
   lluv_close_walk_ctx_t *ctx = (lluv_close_walk_ctx_t *)arg;
   lua_State *L = ctx->L;
 
+  if(lluv_loop_is_internal(handle)) return;
+
    /* in any case we should call uv_run for this handle */
   ctx->count += 1;
 
@@ -261,6 +579,19 @@ static int lluv_loop_close_all_handles(lua_State *L){
   return lua_gettop(L) - 1;
 }
 
+static void lluv_loop_watchdog_free(lua_State *L, lluv_loop_t *loop){
+  lluv_watchdog_t *w = loop->watchdog;
+
+  if(!w) return;
+
+  /* called from callback */
+  if(w->active) lluv_watchdog_disarm(L, w);
+
+  luaL_unref(L, LLUV_LUA_REGISTRY, w->handler);
+  lluv_free(L, w);
+  loop->watchdog = NULL;
+}
+
 static int lluv_loop_close_impl(lua_State *L, int ignore_error, int close_handle){
   lluv_loop_t* loop = lluv_check_loop(L, 1, 0);
   int err;
@@ -278,6 +609,8 @@ static int lluv_loop_close_impl(lua_State *L, int ignore_error, int close_handle
     }
   }
 
+  lluv_loop_internals_close(L, loop);
+
   err = uv_loop_close(loop->handle);
   if(!ignore_error){
     if(err < 0){
@@ -302,6 +635,14 @@ static int lluv_loop_close_impl(lua_State *L, int ignore_error, int close_handle
 
   loop->handle = NULL;
   lluv_list_close(L, &loop->defer);
+  loop->ndefer = 0;
+  loop->defer_nold = 0;
+  lluv_bufpool_close(L, &loop->pool);
+  lluv_addrcache_close(L, &loop->addrs);
+  lluv_req_pool_close(L, loop);
+  lluv_free(L, loop->stats);
+  loop->stats = NULL;
+  lluv_loop_watchdog_free(L, loop);
   return 0;
 }
 
@@ -339,9 +680,11 @@ static int lluv_loop_run_impl(lua_State *L){
 
   loop->level += 1;
   loop->L = L;
-  err = lluv_loop_defer_proceed(L, loop);
+  err = lluv_loop_defer_drain(L, loop, LLUV_DEFER_DEPTH, 0, 0);
   if(!err) err = uv_run(loop->handle, mode);
-  if(!err) err = lluv_loop_defer_proceed(L, loop);
+  if(!err) err = lluv_loop_defer_drain(L, loop, LLUV_DEFER_DEPTH, 0, 0);
+  if(!loop->ndefer && loop->idle) uv_idle_stop(loop->idle);
+  if(loop->corked) lluv_stream_flush_corked(L, loop);
   loop->L = prev_state;
   loop->level -= 1;
 
@@ -465,9 +808,222 @@ static int lluv_loop_defer(lua_State *L){
   return 0;
 }
 
+static const lluv_uv_const_t lluv_defer_policies[] = {
+  { LLUV_DEFER_CALLBACK,  "callback"  },
+  { LLUV_DEFER_ITERATION, "iteration" },
+  { LLUV_DEFER_BUDGET,    "budget"    },
+
+  { 0, NULL }
+};
+
+// defer_policy([loop,] 'callback')
+// defer_policy([loop,] 'iteration')
+// defer_policy([loop,] 'budget' [, {count = 100, time = 5}])
+static int lluv_loop_defer_policy(lua_State *L){
+  lluv_loop_t* loop; int n, err;
+  size_t count = 0; uint64_t time = 0;
+  ssize_t policy;
+
+  if(!lutil_isudatap(L, 1, LLUV_LOOP)){
+    loop = lluv_default_loop(L);
+    n = 1;
+  }
+  else{
+    loop = lluv_check_loop(L, 1, LLUV_FLAG_OPEN);
+    n = 2;
+  }
+
+  policy = lluv_opt_named_const(L, n, LLUV_DEFER_CALLBACK, lluv_defer_policies);
+  luaL_argcheck(L, (policy >= LLUV_DEFER_CALLBACK) && (policy <= LLUV_DEFER_BUDGET), n, "invalid policy");
+
+  if(policy == LLUV_DEFER_BUDGET){
+    if(!lua_isnoneornil(L, n + 1)){
+      luaL_checktype(L, n + 1, LUA_TTABLE);
+      lua_getfield(L, n + 1, "count");
+      count = (size_t)luaL_optinteger(L, -1, 0);
+      lua_getfield(L, n + 1, "time");
+      time  = (uint64_t)(luaL_optnumber(L, -1, 0) * 1000000);
+      lua_pop(L, 2);
+    }
+    if(!(count || time)) count = LLUV_DEFER_BUDGET;
+  }
+
+  if(policy == LLUV_DEFER_CALLBACK){
+    lluv_loop_hook_stop(loop, LLUV_LOOP_HOOK_DEFER);
+    if(loop->idle) uv_idle_stop(loop->idle);
+  }
+  else{
+    err = lluv_loop_hook_start(L, loop, LLUV_LOOP_HOOK_DEFER);
+    if(err < 0){
+      return lluv_fail(L, loop->flags, LLUV_ERR_UV, err, NULL);
+    }
+
+    if(!loop->idle){
+      uv_idle_t *idle = lluv_alloc_t(L, uv_idle_t);
+      if(!idle){
+        lluv_loop_hook_stop(loop, LLUV_LOOP_HOOK_DEFER);
+        return lluv_fail(L, loop->flags, LLUV_ERR_UV, UV_ENOMEM, NULL);
+      }
+      uv_idle_init(loop->handle, idle);
+      idle->data = NULL;
+      loop->idle = idle;
+    }
+
+    if(loop->ndefer) uv_idle_start(loop->idle, lluv_loop_on_idle);
+  }
+
+  loop->defer_policy = (unsigned char)policy;
+  loop->defer_count  = count;
+  loop->defer_time   = time;
+
+  lluv_loop_pushself(L, loop);
+  return 1;
+}
+
+static int lluv_loop_defer_stats(lua_State *L){
+  lluv_loop_t* loop = lluv_opt_loop_ex(L, 1, LLUV_FLAG_OPEN);
+
+  lua_newtable(L);
+  lua_pushstring(L, lluv_defer_policies[loop->defer_policy].name);
+  lua_setfield(L, -2, "policy");
+  lutil_pushint64(L, (int64_t)loop->ndefer);        lua_setfield(L, -2, "pending");
+  lutil_pushint64(L, (int64_t)loop->defer_drained); lua_setfield(L, -2, "drained");
+  lutil_pushint64(L, (int64_t)loop->defer_carried); lua_setfield(L, -2, "carried");
+
+  if(loop->defer_policy == LLUV_DEFER_BUDGET){
+    lutil_pushint64(L, (int64_t)loop->defer_count);  lua_setfield(L, -2, "count");
+    lua_pushnumber(L, (lua_Number)loop->defer_time / 1000000);
+    lua_setfield(L, -2, "time");
+  }
+
+  return 1;
+}
+
+static int lluv_loop_buffer_stats(lua_State *L){
+  lluv_loop_t* loop = lluv_opt_loop_ex(L, 1, LLUV_FLAG_OPEN);
+  lluv_bufpool_push_stats(L, &loop->pool);
+  return 1;
+}
+
+static int lluv_loop_addr_stats(lua_State *L){
+  lluv_loop_t* loop = lluv_opt_loop_ex(L, 1, LLUV_FLAG_OPEN);
+  lluv_addrcache_push_stats(L, &loop->addrs);
+  return 1;
+}
+
+// profile([loop,] enable) => previous state
+static int lluv_loop_profile(lua_State *L){
+  lluv_loop_t* loop; int n, err;
+
+  if(!lutil_isudatap(L, 1, LLUV_LOOP)){
+    loop = lluv_default_loop(L);
+    n = 1;
+  }
+  else{
+    loop = lluv_check_loop(L, 1, LLUV_FLAG_OPEN);
+    n = 2;
+  }
+
+  lua_pushboolean(L, loop->stats != NULL);
+  if(lua_isnone(L, n)) return 1;
+
+  if(!lua_toboolean(L, n)){
+    lluv_loop_hook_stop(loop, LLUV_LOOP_HOOK_STATS);
+    lluv_free(L, loop->stats);
+    loop->stats = NULL;
+    return 1;
+  }
+
+  if(loop->stats) return 1;
+
+  loop->stats = lluv_alloc_t(L, lluv_loop_stats_t);
+  if(!loop->stats){
+    return lluv_fail(L, loop->flags, LLUV_ERR_UV, UV_ENOMEM, NULL);
+  }
+
+  err = lluv_loop_hook_start(L, loop, LLUV_LOOP_HOOK_STATS);
+  if(err < 0){
+    lluv_free(L, loop->stats);
+    loop->stats = NULL;
+    return lluv_fail(L, loop->flags, LLUV_ERR_UV, err, NULL);
+  }
+
+  lluv_stats_reset(loop->stats, loop->handle);
+
+  return 1;
+}
+
+static int lluv_loop_stats(lua_State *L){
+  lluv_loop_t* loop = lluv_opt_loop_ex(L, 1, LLUV_FLAG_OPEN);
+  if(!loop->stats) return 0;
+  lluv_stats_push(L, loop->stats, loop->handle);
+  return 1;
+}
+
+static int lluv_loop_reset_stats(lua_State *L){
+  lluv_loop_t* loop = lluv_opt_loop_ex(L, 1, LLUV_FLAG_OPEN);
+  if(loop->stats) lluv_stats_reset(loop->stats, loop->handle);
+  return 0;
+}
+
+// set_slow_callback_threshold([loop,] ms, handler [, limit])
+// set_slow_callback_threshold([loop,] nil)
+static int lluv_loop_set_slow_callback_threshold(lua_State *L){
+  lluv_loop_t* loop; lluv_watchdog_t *w; int n;
+  lua_Number threshold, limit;
+
+  if(!lutil_isudatap(L, 1, LLUV_LOOP)){
+    loop = lluv_default_loop(L);
+    n = 1;
+  }
+  else{
+    loop = lluv_check_loop(L, 1, LLUV_FLAG_OPEN);
+    n = 2;
+  }
+
+  threshold = luaL_optnumber(L, n, 0);
+  luaL_argcheck(L, threshold >= 0, n, "invalid threshold");
+
+  lluv_loop_watchdog_free(L, loop);
+
+  if(threshold == 0){
+    lluv_loop_pushself(L, loop);
+    return 1;
+  }
+
+  if(!lua_isnoneornil(L, n + 1)) lluv_check_callable(L, n + 1);
+  limit = luaL_optnumber(L, n + 2, 0);
+  luaL_argcheck(L, (limit == 0) || (limit >= threshold), n + 2, "limit less than threshold");
+
+  w = lluv_alloc_t(L, lluv_watchdog_t);
+  if(!w) return lluv_fail(L, loop->flags, LLUV_ERR_UV, UV_ENOMEM, NULL);
+
+  w->threshold = (uint64_t)(threshold * 1000000);
+  w->limit     = (uint64_t)(limit * 1000000);
+  w->handler   = LUA_NOREF;
+  w->start     = 0;
+  w->active    = 0;
+  w->armed     = 0;
+  w->captured  = 0;
+  w->interrupted = 0;
+  w->L         = NULL;
+
+  if(!lua_isnoneornil(L, n + 1)){
+    lua_pushvalue(L, n + 1);
+    w->handler = luaL_ref(L, LLUV_LUA_REGISTRY);
+  }
+
+  loop->watchdog = w;
+
+  lluv_loop_pushself(L, loop);
+  return 1;
+}
+
 static void lluv_loop_on_walk(uv_handle_t* handle, void* arg){
   lua_State *L = (lua_State*)arg;
 
+  if(lluv_loop_is_internal(handle)) return;
+
   lua_settop(L, 2); lua_pushvalue(L, -1);
   lluv_handle_pushself(L, lluv_handle_byptr(handle));
   lua_call(L, 1, 0);
@@ -479,6 +1035,8 @@ static void lluv_loop_on_collect(uv_handle_t* handle, void* arg){
   assert(lua_gettop(L) == 2);
   assert(lua_istable(L, 2));
 
+  if(lluv_loop_is_internal(handle)) return;
+
   lluv_handle_pushself(L, lluv_handle_byptr(handle));
   lua_rawseti(L, 2, lua_rawlen(L, 2) + 1);
 
@@ -517,9 +1075,17 @@ static const struct luaL_Reg lluv_loop_methods[] = {
   { "now",          lluv_loop_now          },
   { "handles",      lluv_loop_handles      },
   { "defer",        lluv_loop_defer        },
+  { "defer_policy", lluv_loop_defer_policy },
+  { "defer_stats",  lluv_loop_defer_stats  },
   { "fileno",       lluv_loop_fileno       },
   { "poll_timeout", lluv_loop_poll_timeout },
   { "update_time",  lluv_loop_update_time  },
+  { "buffer_stats", lluv_loop_buffer_stats },
+  { "addr_stats",   lluv_loop_addr_stats   },
+  { "profile",      lluv_loop_profile      },
+  { "stats",        lluv_loop_stats        },
+  { "reset_stats",  lluv_loop_reset_stats  },
+  { "set_slow_callback_threshold", lluv_loop_set_slow_callback_threshold },
   
   { "close_all_handles", lluv_loop_close_all_handles },
 
@@ -544,8 +1110,16 @@ static const struct luaL_Reg lluv_loop_functions[] = {
   {"now",          lluv_loop_now           },
   {"default_loop", lluv_push_default_loop_l},
   {"update_time",  lluv_loop_update_time   },
+  {"buffer_stats", lluv_loop_buffer_stats  },
+  {"addr_stats",   lluv_loop_addr_stats    },
+  {"profile",      lluv_loop_profile       },
+  {"stats",        lluv_loop_stats         },
+  {"reset_stats",  lluv_loop_reset_stats   },
+  {"set_slow_callback_threshold", lluv_loop_set_slow_callback_threshold },
 
   {"defer",        lluv_loop_defer         },
+  {"defer_policy", lluv_loop_defer_policy  },
+  {"defer_stats",  lluv_loop_defer_stats   },
 
   {NULL,NULL}
 };
@@ -14,22 +14,69 @@
 #include "lluv.h"
 #include "lluv_utils.h"
 #include "lluv_list.h"
+#include "lluv_bufpool.h"
+#include "lluv_addrcache.h"
+#include "lluv_stats.h"
 
 // number of values that push loop.run
 #define LLUV_CALLBACK_TOP_SIZE 0
 
-#define LLUV_BUFFER_SIZE 65536
+/* Object which owns internal handle (e.g. worker pool).
+ * Loop calls `close` before uv_loop_close so owner can release
+ * its handle. Owner have to remove itself when closed by user.
+ */
+typedef struct lluv_loop_owner_tag lluv_loop_owner_t;
+
+struct lluv_loop_owner_tag{
+  lluv_loop_owner_t *next;
+  uv_handle_t       *handle; /* may keep loop alive */
+  void (*close)(lua_State *L, lluv_loop_owner_t *owner);
+};
 
 typedef struct lluv_loop_tag{
-  uv_loop_t   *handle;/* read only */
-  lluv_flags_t flags; /* read only */
-  lua_State   *L;
-  lluv_list_t  defer;
-  int8_t       level;
-  size_t       buffer_size;
-  char         buffer[LLUV_BUFFER_SIZE];
+  uv_loop_t     *handle;/* read only */
+  lluv_flags_t   flags; /* read only */
+  lua_State     *L;
+  lluv_list_t    defer; /* ring of deferred calls */
+  size_t         ndefer;/* number of deferred calls */
+  unsigned char  defer_policy;
+  size_t         defer_count;   /* budget: max calls per iteration */
+  uint64_t       defer_time;    /* budget: max time per iteration (ns) */
+  size_t         defer_drained; /* statistic */
+  size_t         defer_carried;
+  size_t         defer_nold;    /* calls at queue head already counted as carried */
+  uv_idle_t     *idle;          /* keep polling while deferred calls pending */
+  int8_t         level;
+  lluv_bufpool_t pool;  /* read buffers */
+  lluv_addrcache_t addrs; /* host names of received datagrams */
+  lluv_req_t    *reqs[UV_REQ_TYPE_MAX];  /* free requests */
+  unsigned int   nreqs[UV_REQ_TYPE_MAX];
+  uv_prepare_t  *prepare; /* internal hooks (see lluv_loop_hook_start) */
+  uv_check_t    *check;
+  lluv_flags_t   hooks;   /* set of active hook users */
+  lluv_handle_t *corked;  /* streams with pending corked writes */
+  lluv_handle_t *batched; /* udp handles with partial receive batch */
+  lluv_loop_stats_t *stats; /* profiler (NULL if disabled) */
+  lluv_watchdog_t   *watchdog; /* slow callback detector (NULL if disabled) */
+  lluv_loop_owner_t *owners;   /* objects with internal handles */
 }lluv_loop_t;
 
+/* Internal hooks run on prepare and check phases of each loop iteration.
+ * Hook handles are unreferenced and has `data == NULL` so they are
+ * invisible for `loop:handles()` and `loop:close_all_handles()`.
+ */
+#define LLUV_LOOP_HOOK_FLUSH LLUV_FLAG_0 /* flush corked streams */
+#define LLUV_LOOP_HOOK_DEFER LLUV_FLAG_1 /* drain deferred calls on check phase */
+#define LLUV_LOOP_HOOK_STATS LLUV_FLAG_2 /* measure loop lag */
+#define LLUV_LOOP_HOOK_BATCH LLUV_FLAG_3 /* deliver partial udp batches */
+
+/* When deferred calls proceed */
+#define LLUV_DEFER_CALLBACK  0 /* after each callback */
+#define LLUV_DEFER_ITERATION 1 /* once per loop iteration */
+#define LLUV_DEFER_BUDGET    2 /* once per loop iteration with count/time limit */
+
+#define lluv_loop_is_internal(h) ((h)->data == NULL)
+
 LLUV_INTERNAL void lluv_loop_initlib(lua_State *L, int nup);
 
 LLUV_INTERNAL int lluv_loop_create(lua_State *L, uv_loop_t *loop, lluv_flags_t flags);
@@ -56,22 +103,41 @@ LLUV_INTERNAL void lluv_loop_defer_call(lua_State *L, lluv_loop_t *loop, int nar
 
 LLUV_INTERNAL int lluv_loop_defer_proceed(lua_State *L, lluv_loop_t *loop);
 
+/* same as lluv_lua_call but accounts callback in loop profiler.
+ * `htype` is type of handle (UV_UNKNOWN_HANDLE for requests)
+ * and `kind` is one of LLUV_CB_XXX.
+ */
+LLUV_INTERNAL int lluv_loop_call(lua_State *L, lluv_loop_t *loop, int narg, int htype, int kind);
+
+LLUV_INTERNAL int lluv_loop_hook_start(lua_State *L, lluv_loop_t *loop, lluv_flags_t hook);
+
+LLUV_INTERNAL void lluv_loop_hook_stop(lluv_loop_t *loop, lluv_flags_t hook);
+
+LLUV_INTERNAL void lluv_loop_owner_add(lluv_loop_t *loop, lluv_loop_owner_t *owner);
+
+LLUV_INTERNAL void lluv_loop_owner_remove(lluv_loop_t *loop, lluv_loop_owner_t *owner);
+
 #define LLUV_CHECK_LOOP_CB_INVARIANT(L) \
   assert("Some one use invalid callback handler" && (lua_gettop(L) == LLUV_CALLBACK_TOP_SIZE)); \
   assert("Invalid number of upvalues" && (lua_isnone(L, LLUV_NONE_MARK_INDEX)));                \
   assert("Invalid LLUV registry" && (lua_type(L, LLUV_LUA_REGISTRY) == LUA_TTABLE));            \
   assert("Invalid loop" && lluv_check_loop(L, LLUV_LOOP_INDEX, 0));
 
-#define LLUV_HANDLE_CALL_CB(L, H, A)                                            \
+#define LLUV_HANDLE_CALL_CB_EX(L, H, A, K)                                      \
   {                                                                             \
-    int err = lluv_lua_call((L), (A), 0);                                       \
-    if(!err)lluv_loop_defer_proceed((L), lluv_loop_by_handle(&(H)->handle));    \
+    lluv_loop_t *cb_loop = lluv_loop_by_handle(&(H)->handle);                   \
+    int err = lluv_loop_call((L), cb_loop, (A), (H)->handle.type, (K));         \
+    if(!err)lluv_loop_defer_proceed((L), cb_loop);                              \
   }                                                                             \
 
-#define LLUV_LOOP_CALL_CB(L, LOOP, A)                                           \
+#define LLUV_HANDLE_CALL_CB(L, H, A) LLUV_HANDLE_CALL_CB_EX(L, H, A, LLUV_CB_EVENT)
+
+#define LLUV_LOOP_CALL_CB_EX(L, LOOP, A, T, K)                                  \
   {                                                                             \
-    int err = lluv_lua_call((L), (A), 0);                                       \
+    int err = lluv_loop_call((L), (LOOP), (A), (T), (K));                       \
     if(!err)lluv_loop_defer_proceed((L), LOOP);                                 \
   }                                                                             \
 
+#define LLUV_LOOP_CALL_CB(L, LOOP, A, K) LLUV_LOOP_CALL_CB_EX(L, LOOP, A, UV_UNKNOWN_HANDLE, K)
+
 #endif
@@ -10,17 +10,43 @@
 
 #include "lluv.h"
 #include "lluv_req.h"
+#include "lluv_loop.h"
 #include <assert.h>
 
 
+static lluv_req_t* lluv_req_pool_get(lluv_loop_t *loop, uv_req_type type){
+  lluv_req_t *req = loop->reqs[type];
+  if(req){
+    loop->reqs[type]   = req->next;
+    loop->nreqs[type] -= 1;
+    req->next = NULL;
+  }
+  return req;
+}
+
 LLUV_INTERNAL lluv_req_t* lluv_req_new(lua_State *L, uv_req_type type, lluv_handle_t *h){
-  size_t extra_size = uv_req_size(type) - sizeof(uv_req_t);
-  lluv_req_t *req = (lluv_req_t*)lluv_alloc(L, sizeof(lluv_req_t) + extra_size);
+  lluv_req_t *req = NULL;
+
+  if(h) req = lluv_req_pool_get(lluv_loop_by_handle(&h->handle), type);
+
+  if(!req){
+    size_t extra_size = uv_req_size(type) - sizeof(uv_req_t);
+    req = (lluv_req_t*)lluv_alloc(L, sizeof(lluv_req_t) + extra_size);
+    req->type = type;
+    req->next = NULL;
+    req->arg  = LUA_NOREF;
+
+    if(h){ /* reserve slot to pin payload */
+      lua_pushboolean(L, 0);
+      req->arg = luaL_ref(L, LLUV_LUA_REGISTRY);
+    }
+  }
+
+  assert(req->type == type);
 
   req->req.data = req;
   req->handle   = h;
   req->cb       = luaL_ref(L, LLUV_LUA_REGISTRY);
-  req->arg      = LUA_NOREF;
   req->ctx      = LUA_NOREF;
 
   if(h) lluv_handle_lock(L, h, LLUV_LOCK_REQ);
@@ -29,12 +55,31 @@ LLUV_INTERNAL lluv_req_t* lluv_req_new(lua_State *L, uv_req_type type, lluv_hand
 }
 
 LLUV_INTERNAL void lluv_req_free(lua_State *L, lluv_req_t *req){
+  lluv_loop_t *loop = NULL;
+
   luaL_unref(L, LLUV_LUA_REGISTRY, req->cb);
-  luaL_unref(L, LLUV_LUA_REGISTRY, req->arg);
   luaL_unref(L, LLUV_LUA_REGISTRY, req->ctx);
+  req->cb  = LUA_NOREF;
+  req->ctx = LUA_NOREF;
+
   if(req->handle){
+    loop = lluv_loop_by_handle(&req->handle->handle);
     lluv_handle_unlock(L, req->handle, LLUV_LOCK_REQ);
+    req->handle = NULL;
   }
+
+  if(loop && (loop->nreqs[req->type] < LLUV_REQ_POOL_SIZE)){
+    /* unpin payload. Slot never contains nil so luaL_ref can not reuse it*/
+    lua_pushboolean(L, 0);
+    lua_rawseti(L, LLUV_LUA_REGISTRY, req->arg);
+
+    req->next = loop->reqs[req->type];
+    loop->reqs[req->type]   = req;
+    loop->nreqs[req->type] += 1;
+    return;
+  }
+
+  luaL_unref(L, LLUV_LUA_REGISTRY, req->arg);
   lluv_free(L, req);
 }
 
@@ -46,6 +91,16 @@ LLUV_INTERNAL lluv_req_t* lluv_req_byptr(uv_req_t *r){
 }
 
 LLUV_INTERNAL void lluv_req_ref(lua_State *L, lluv_req_t *req){
+  if(req->handle){
+    assert(req->arg != LUA_NOREF);
+    if(lua_isnil(L, -1)){
+      lua_pop(L, 1);
+      lua_pushboolean(L, 0);
+    }
+    lua_rawseti(L, LLUV_LUA_REGISTRY, req->arg);
+    return;
+  }
+
   luaL_unref(L, LLUV_LUA_REGISTRY, req->arg);
   req->arg = luaL_ref(L, LLUV_LUA_REGISTRY);
 }
@@ -62,4 +117,25 @@ LLUV_INTERNAL int lluv_req_has_cb(lua_State *L, lluv_req_t *req){
   lua_pop(L, 1);
 
   return res;
-}
\ No newline at end of file
+}
+
+LLUV_INTERNAL void lluv_req_pool_init(lluv_loop_t *loop){
+  int i;
+  for(i = 0; i < UV_REQ_TYPE_MAX; ++i){
+    loop->reqs[i]  = NULL;
+    loop->nreqs[i] = 0;
+  }
+}
+
+LLUV_INTERNAL void lluv_req_pool_close(lua_State *L, lluv_loop_t *loop){
+  int i;
+  for(i = 0; i < UV_REQ_TYPE_MAX; ++i){
+    while(loop->reqs[i]){
+      lluv_req_t *req = loop->reqs[i];
+      loop->reqs[i] = req->next;
+      luaL_unref(L, LLUV_LUA_REGISTRY, req->arg);
+      lluv_free(L, req);
+    }
+    loop->nreqs[i] = 0;
+  }
+}
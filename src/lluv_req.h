@@ -14,12 +14,22 @@
 #include "lluv.h"
 #include "lluv_handle.h"
 
+/* requests associated with handle are recycled by loop.
+ * Such request owns registry slot `arg` for whole life
+ * so pin payload does not need luaL_ref/luaL_unref.
+ */
+#ifndef LLUV_REQ_POOL_SIZE
+#  define LLUV_REQ_POOL_SIZE 64
+#endif
+
 typedef struct lluv_req_tag{
-  lluv_handle_t *handle;
-  int           cb;
-  int           arg;
-  int           ctx;
-  uv_req_t      req;
+  lluv_handle_t       *handle;
+  int                  cb;
+  int                  arg;
+  int                  ctx;
+  uv_req_type          type;
+  struct lluv_req_tag *next; /* loop free list */
+  uv_req_t             req;
 } lluv_req_t;
 
 #define LLUV_R(H, T) ((uv_##T##_t*)&H->req)
@@ -36,4 +46,8 @@ LLUV_INTERNAL lluv_req_t* lluv_req_byptr(uv_req_t *r);
 
 LLUV_INTERNAL int lluv_req_has_cb(lua_State *L, lluv_req_t *req);
 
+LLUV_INTERNAL void lluv_req_pool_init(lluv_loop_t *loop);
+
+LLUV_INTERNAL void lluv_req_pool_close(lua_State *L, lluv_loop_t *loop);
+
 #endif
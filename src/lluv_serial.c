@@ -0,0 +1,242 @@
+/******************************************************************************
+* Author: Alexey Melnichuk <alexeymelnichuck@gmail.com>
+*
+* Copyright (C) 2014-2019 Alexey Melnichuk <alexeymelnichuck@gmail.com>
+*
+* Licensed according to the included 'LICENSE' document
+*
+* This file is part of lua-lluv library.
+******************************************************************************/
+
+#include "lluv.h"
+#include "lluv_utils.h"
+#include "lluv_serial.h"
+#include "lluv_fbuf.h"
+#include <string.h>
+#include <stdlib.h>
+
+#define LLUV_SERIAL_NIL     'n'
+#define LLUV_SERIAL_TRUE    't'
+#define LLUV_SERIAL_FALSE   'f'
+#define LLUV_SERIAL_INTEGER 'i'
+#define LLUV_SERIAL_NUMBER  'd'
+#define LLUV_SERIAL_STRING  's'
+#define LLUV_SERIAL_POINTER 'p'
+#define LLUV_SERIAL_BUFFER  'b'
+#define LLUV_SERIAL_TABLE   'T'
+#define LLUV_SERIAL_END     'e'
+
+LLUV_INTERNAL void lluv_sbuf_init(lluv_sbuf_t *buf){
+  buf->data     = NULL;
+  buf->size     = 0;
+  buf->capacity = 0;
+}
+
+LLUV_INTERNAL void lluv_sbuf_free(lluv_sbuf_t *buf){
+  lluv_free(NULL, buf->data);
+  lluv_sbuf_init(buf);
+}
+
+LLUV_INTERNAL int lluv_sbuf_reserve(lluv_sbuf_t *buf, size_t size){
+  if(buf->size + size > buf->capacity){
+    size_t capacity = buf->capacity ? buf->capacity : 64;
+    char *tmp;
+    while(capacity < buf->size + size) capacity *= 2;
+    tmp = (char*)realloc(buf->data, capacity);
+    if(!tmp) return UV_ENOMEM;
+    buf->data     = tmp;
+    buf->capacity = capacity;
+  }
+
+  buf->size += size;
+  return 0;
+}
+
+static int lluv_sbuf_write(lluv_sbuf_t *buf, const void *data, size_t size){
+  int err = lluv_sbuf_reserve(buf, size);
+  if(err) return err;
+  memcpy(buf->data + buf->size - size, data, size);
+  return 0;
+}
+
+static int lluv_sbuf_write_tag(lluv_sbuf_t *buf, char tag){
+  return lluv_sbuf_write(buf, &tag, 1);
+}
+
+static int lluv_serialize_value(lua_State *L, int idx, lluv_sbuf_t *buf, int depth){
+  int err;
+
+  switch(lua_type(L, idx)){
+    case LUA_TNIL:
+      return lluv_sbuf_write_tag(buf, LLUV_SERIAL_NIL);
+
+    case LUA_TBOOLEAN:
+      return lluv_sbuf_write_tag(buf, lua_toboolean(L, idx) ? LLUV_SERIAL_TRUE : LLUV_SERIAL_FALSE);
+
+    case LUA_TNUMBER:{
+#if LUA_VERSION_NUM >= 503
+      if(lua_isinteger(L, idx)){
+        lua_Integer v = lua_tointeger(L, idx);
+        if((err = lluv_sbuf_write_tag(buf, LLUV_SERIAL_INTEGER))) return err;
+        return lluv_sbuf_write(buf, &v, sizeof(v));
+      }
+#endif
+      {
+        lua_Number v = lua_tonumber(L, idx);
+        if((err = lluv_sbuf_write_tag(buf, LLUV_SERIAL_NUMBER))) return err;
+        return lluv_sbuf_write(buf, &v, sizeof(v));
+      }
+    }
+
+    case LUA_TSTRING:{
+      size_t len; const char *str = lua_tolstring(L, idx, &len);
+      if((err = lluv_sbuf_write_tag(buf, LLUV_SERIAL_STRING))) return err;
+      if((err = lluv_sbuf_write(buf, &len, sizeof(len)))) return err;
+      return lluv_sbuf_write(buf, str, len);
+    }
+
+    case LUA_TLIGHTUSERDATA:{
+      void *p = lua_touserdata(L, idx);
+      if((err = lluv_sbuf_write_tag(buf, LLUV_SERIAL_POINTER))) return err;
+      return lluv_sbuf_write(buf, &p, sizeof(p));
+    }
+
+    case LUA_TUSERDATA:{
+      lluv_fixed_buffer_t *buffer = lluv_opt_fbuf(L, idx);
+      if(!buffer) return UV_EINVAL;
+      if((err = lluv_sbuf_write_tag(buf, LLUV_SERIAL_BUFFER))) return err;
+      if((err = lluv_sbuf_write(buf, &buffer->capacity, sizeof(buffer->capacity)))) return err;
+      return lluv_sbuf_write(buf, buffer->data, buffer->capacity);
+    }
+
+    case LUA_TTABLE:{
+      if(depth >= LLUV_SERIAL_MAX_DEPTH) return UV_EINVAL;
+      if(!lua_checkstack(L, 3)) return UV_ENOMEM;
+
+      idx = lua_absindex(L, idx);
+      if((err = lluv_sbuf_write_tag(buf, LLUV_SERIAL_TABLE))) return err;
+
+      lua_pushnil(L);
+      while(lua_next(L, idx)){
+        err = lluv_serialize_value(L, -2, buf, depth + 1);
+        if(!err) err = lluv_serialize_value(L, -1, buf, depth + 1);
+        if(err){
+          lua_pop(L, 2);
+          return err;
+        }
+        lua_pop(L, 1);
+      }
+
+      return lluv_sbuf_write_tag(buf, LLUV_SERIAL_END);
+    }
+  }
+
+  return UV_EINVAL;
+}
+
+LLUV_INTERNAL int lluv_serialize(lua_State *L, int first, int last, lluv_sbuf_t *buf){
+  int i;
+
+  for(i = first; i <= last; ++i){
+    int err = lluv_serialize_value(L, i, buf, 0);
+    if(err) return err;
+  }
+
+  return 0;
+}
+
+typedef struct lluv_sreader_tag{
+  const char *data;
+  size_t      size;
+}lluv_sreader_t;
+
+static int lluv_sreader_read(lluv_sreader_t *r, void *dst, size_t size){
+  if(r->size < size) return -1;
+  memcpy(dst, r->data, size);
+  r->data += size;
+  r->size -= size;
+  return 0;
+}
+
+/* returns 1 if value pushed, 0 for end of table and -1 for invalid data */
+static int lluv_deserialize_value(lua_State *L, lluv_sreader_t *r, int depth){
+  char tag;
+
+  if(!lua_checkstack(L, 3)) return -1;
+  if(lluv_sreader_read(r, &tag, 1)) return -1;
+
+  switch(tag){
+    case LLUV_SERIAL_NIL:   lua_pushnil(L);        return 1;
+    case LLUV_SERIAL_TRUE:  lua_pushboolean(L, 1); return 1;
+    case LLUV_SERIAL_FALSE: lua_pushboolean(L, 0); return 1;
+    case LLUV_SERIAL_END:   return 0;
+
+#if LUA_VERSION_NUM >= 503
+    case LLUV_SERIAL_INTEGER:{
+      lua_Integer v;
+      if(lluv_sreader_read(r, &v, sizeof(v))) return -1;
+      lua_pushinteger(L, v);
+      return 1;
+    }
+#endif
+
+    case LLUV_SERIAL_NUMBER:{
+      lua_Number v;
+      if(lluv_sreader_read(r, &v, sizeof(v))) return -1;
+      lua_pushnumber(L, v);
+      return 1;
+    }
+
+    case LLUV_SERIAL_STRING:
+    case LLUV_SERIAL_BUFFER:{
+      size_t len;
+      if(lluv_sreader_read(r, &len, sizeof(len))) return -1;
+      if(r->size < len) return -1;
+      if(tag == LLUV_SERIAL_BUFFER) lluv_push_fbuf_copy(L, r->data, len);
+      else lua_pushlstring(L, r->data, len);
+      r->data += len;
+      r->size -= len;
+      return 1;
+    }
+
+    case LLUV_SERIAL_POINTER:{
+      void *p;
+      if(lluv_sreader_read(r, &p, sizeof(p))) return -1;
+      lua_pushlightuserdata(L, p);
+      return 1;
+    }
+
+    case LLUV_SERIAL_TABLE:{
+      if(depth >= LLUV_SERIAL_MAX_DEPTH) return -1;
+      lua_newtable(L);
+      while(1){
+        int ret = lluv_deserialize_value(L, r, depth + 1);
+        if(ret == 0) return 1;
+        if(ret < 0) return -1;
+        if(lluv_deserialize_value(L, r, depth + 1) != 1) return -1;
+        if(lua_isnil(L, -2)) return -1;
+        lua_rawset(L, -3);
+      }
+    }
+  }
+
+  return -1;
+}
+
+LLUV_INTERNAL int lluv_deserialize(lua_State *L, const char *data, size_t size){
+  lluv_sreader_t r;
+  int top = lua_gettop(L), n = 0;
+
+  r.data = data;
+  r.size = size;
+
+  while(r.size){
+    if(lluv_deserialize_value(L, &r, 0) != 1){
+      lua_settop(L, top);
+      return -1;
+    }
+    ++n;
+  }
+
+  return n;
+}
@@ -0,0 +1,51 @@
+/******************************************************************************
+* Author: Alexey Melnichuk <alexeymelnichuck@gmail.com>
+*
+* Copyright (C) 2014-2019 Alexey Melnichuk <alexeymelnichuck@gmail.com>
+*
+* Licensed according to the included 'LICENSE' document
+*
+* This file is part of lua-lluv library.
+******************************************************************************/
+
+#ifndef _LLUV_SERIAL_H_
+#define _LLUV_SERIAL_H_
+
+#include "lluv.h"
+#include "lluv_utils.h"
+
+/* Serialization of Lua values to pass them between Lua states.
+** Supported types are nil, boolean, number, string, lightuserdata,
+** fixed buffers and tables of this types (without cycles).
+** Lightuserdata is copied as is so it is valid only inside process.
+** Fixed buffer is copied to new buffer (or to string if library is
+** not loaded in destination state).
+*/
+
+/* max nesting level of tables */
+#ifndef LLUV_SERIAL_MAX_DEPTH
+#  define LLUV_SERIAL_MAX_DEPTH 64
+#endif
+
+typedef struct lluv_sbuf_tag{
+  char   *data;   /* heap memory, does not depend on any Lua state */
+  size_t  size;
+  size_t  capacity;
+}lluv_sbuf_t;
+
+LLUV_INTERNAL void lluv_sbuf_init(lluv_sbuf_t *buf);
+
+LLUV_INTERNAL void lluv_sbuf_free(lluv_sbuf_t *buf);
+
+/* append `size` uninitialized bytes (e.g. space for header) */
+LLUV_INTERNAL int lluv_sbuf_reserve(lluv_sbuf_t *buf, size_t size);
+
+/* serialize values from `first` to `last` stack index.
+** Returns 0 or error code (UV_EINVAL for unsupported value, UV_ENOMEM).
+*/
+LLUV_INTERNAL int lluv_serialize(lua_State *L, int first, int last, lluv_sbuf_t *buf);
+
+/* push all values to stack. Returns number of values or -1 for invalid data. */
+LLUV_INTERNAL int lluv_deserialize(lua_State *L, const char *data, size_t size);
+
+#endif
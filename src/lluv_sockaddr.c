@@ -0,0 +1,138 @@
+/******************************************************************************
+* Author: Alexey Melnichuk <alexeymelnichuck@gmail.com>
+*
+* Copyright (C) 2014-2019 Alexey Melnichuk <alexeymelnichuck@gmail.com>
+*
+* Licensed according to the included 'LICENSE' document
+*
+* This file is part of lua-lluv library.
+******************************************************************************/
+
+#include "lluv.h"
+#include "lluv_utils.h"
+#include "lluv_error.h"
+#include "lluv_addrcache.h"
+#include "lluv_sockaddr.h"
+#include <string.h>
+
+#define LLUV_SOCKADDR_NAME LLUV_PREFIX" sockaddr"
+static const char *LLUV_SOCKADDR = LLUV_SOCKADDR_NAME;
+
+LLUV_INTERNAL const struct sockaddr_storage *lluv_check_sockaddr(lua_State *L, int i){
+  struct sockaddr_storage *sa = (struct sockaddr_storage *)lutil_checkudatap (L, i, LLUV_SOCKADDR);
+  luaL_argcheck (L, sa != NULL, i, LLUV_SOCKADDR_NAME" expected");
+  return sa;
+}
+
+LLUV_INTERNAL const struct sockaddr_storage *lluv_opt_sockaddr(lua_State *L, int i){
+  if(!lutil_isudatap(L, i, LLUV_SOCKADDR)) return NULL;
+  return (const struct sockaddr_storage *)lua_touserdata(L, i);
+}
+
+// sockaddr(host, port)
+// sockaddr(key)
+LLUV_IMPL_SAFE(lluv_sockaddr_new){
+  struct sockaddr_storage sa, *res;
+  int err;
+
+  if(lua_type(L, 2) == LUA_TNONE){
+    err = lluv_to_peer_key(L, 1, &sa);
+    if(err < 0){
+      luaL_checkstring(L, 1);
+      return lluv_fail(L, safe_flag, LLUV_ERR_UV, err, "invalid peer key");
+    }
+  }
+  else{
+    err = lluv_check_addr(L, 1, &sa);
+    if(err < 0){
+      lua_settop(L, 2);
+      lua_pushliteral(L, ":"); lua_insert(L, -2); lua_concat(L, 3);
+      return lluv_fail(L, safe_flag, LLUV_ERR_UV, err, lua_tostring(L, -1));
+    }
+  }
+
+  res = lutil_newudatap(L, struct sockaddr_storage, LLUV_SOCKADDR);
+  memcpy(res, &sa, sizeof(sa));
+
+  return 1;
+}
+
+static int lluv_sockaddr_name(lua_State *L){
+  const struct sockaddr_storage *sa = lluv_check_sockaddr(L, 1);
+  return lluv_push_addr(L, sa);
+}
+
+static int lluv_sockaddr_key(lua_State *L){
+  const struct sockaddr_storage *sa = lluv_check_sockaddr(L, 1);
+  return lluv_push_peer_key(L, (const struct sockaddr*)sa);
+}
+
+static int lluv_sockaddr_family(lua_State *L){
+  const struct sockaddr_storage *sa = lluv_check_sockaddr(L, 1);
+  if(((const struct sockaddr*)sa)->sa_family == AF_INET6)
+    lua_pushliteral(L, "inet6");
+  else
+    lua_pushliteral(L, "inet");
+  return 1;
+}
+
+static int lluv_sockaddr_to_s(lua_State *L){
+  const struct sockaddr_storage *sa = lluv_check_sockaddr(L, 1);
+  int n = lluv_push_addr(L, sa);
+
+  if(n == 0){
+    lua_pushfstring(L, LLUV_SOCKADDR_NAME" (%p)", sa);
+    return 1;
+  }
+
+  if(n > 2) lua_pop(L, n - 2);
+
+  if(((const struct sockaddr*)sa)->sa_family == AF_INET6)
+    lua_pushfstring(L, LLUV_SOCKADDR_NAME" ([%s]:%d)", lua_tostring(L, -2), (int)lua_tointeger(L, -1));
+  else
+    lua_pushfstring(L, LLUV_SOCKADDR_NAME" (%s:%d)", lua_tostring(L, -2), (int)lua_tointeger(L, -1));
+
+  return 1;
+}
+
+static int lluv_sockaddr_eq(lua_State *L){
+  const struct sockaddr_storage *lhs = lluv_check_sockaddr(L, 1);
+  const struct sockaddr_storage *rhs = lluv_opt_sockaddr(L, 2);
+  lua_pushboolean(L, rhs && (memcmp(lhs, rhs, sizeof(*lhs)) == 0));
+  return 1;
+}
+
+static const struct luaL_Reg lluv_sockaddr_methods[] = {
+  { "__tostring",  lluv_sockaddr_to_s   },
+  { "__eq",        lluv_sockaddr_eq     },
+  { "name",        lluv_sockaddr_name   },
+  { "key",         lluv_sockaddr_key    },
+  { "family",      lluv_sockaddr_family },
+
+  {NULL,NULL}
+};
+
+#define LLUV_FUNCTIONS(F)                 \
+  {"sockaddr", lluv_sockaddr_new_##F},    \
+
+static const struct luaL_Reg lluv_functions[][2] = {
+  {
+    LLUV_FUNCTIONS(unsafe)
+
+    {NULL,NULL}
+  },
+  {
+    LLUV_FUNCTIONS(safe)
+
+    {NULL,NULL}
+  },
+};
+
+LLUV_INTERNAL void lluv_sockaddr_initlib(lua_State *L, int nup, int safe){
+  lutil_pushnvalues(L, nup);
+  if(!lutil_createmetap(L, LLUV_SOCKADDR, lluv_sockaddr_methods, nup))
+    lua_pop(L, nup);
+  lua_pop(L, 1);
+
+  luaL_setfuncs(L, lluv_functions[safe], nup);
+}
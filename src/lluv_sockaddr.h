@@ -0,0 +1,25 @@
+/******************************************************************************
+* Author: Alexey Melnichuk <alexeymelnichuck@gmail.com>
+*
+* Copyright (C) 2014-2019 Alexey Melnichuk <alexeymelnichuck@gmail.com>
+*
+* Licensed according to the included 'LICENSE' document
+*
+* This file is part of lua-lluv library.
+******************************************************************************/
+
+#ifndef _LLUV_SOCKADDR_H_
+#define _LLUV_SOCKADDR_H_
+
+#include "lluv.h"
+#include "lluv_utils.h"
+
+/* Immutable pre-resolved socket address */
+
+LLUV_INTERNAL void lluv_sockaddr_initlib(lua_State *L, int nup, int safe);
+
+LLUV_INTERNAL const struct sockaddr_storage *lluv_check_sockaddr(lua_State *L, int i);
+
+LLUV_INTERNAL const struct sockaddr_storage *lluv_opt_sockaddr(lua_State *L, int i);
+
+#endif
@@ -0,0 +1,273 @@
+/******************************************************************************
+* Author: Alexey Melnichuk <alexeymelnichuck@gmail.com>
+*
+* Copyright (C) 2014-2019 Alexey Melnichuk <alexeymelnichuck@gmail.com>
+*
+* Licensed according to the included 'LICENSE' document
+*
+* This file is part of lua-lluv library.
+******************************************************************************/
+
+#include "lluv.h"
+#include "lluv_utils.h"
+#include "lluv_stats.h"
+#include <string.h>
+
+#if LLUV_UV_VER_GE(1,39,0)
+#  define LLUV_STATS_IDLE_TIME 1
+#endif
+
+static const char *lluv_stats_kind_names[LLUV_CB_KIND_MAX] = {
+  "event", "timer", "read", "write", "connection", "connect", "shutdown",
+  "fs", "dns", "work", "message", "close", "defer"
+};
+
+static uint64_t lluv_stats_idle_time(uv_loop_t *loop){
+#ifdef LLUV_STATS_IDLE_TIME
+  return uv_metrics_idle_time(loop);
+#else
+  (void)loop;
+  return 0;
+#endif
+}
+
+LLUV_INTERNAL void lluv_stats_reset(lluv_loop_stats_t *stats, uv_loop_t *loop){
+  memset(stats, 0, sizeof(*stats));
+
+#ifdef LLUV_STATS_IDLE_TIME
+  /* can not be disabled but costs only two clock reads per poll */
+  uv_loop_configure(loop, UV_METRICS_IDLE_TIME);
+#endif
+
+  stats->started   = uv_hrtime();
+  stats->idle_base = lluv_stats_idle_time(loop);
+}
+
+/* bucket 0 - less than 1us, bucket N - [2^(N-1), 2^N) us */
+static int lluv_stats_bucket(uint64_t elapsed){
+  uint64_t us = elapsed / 1000;
+  int i = 0;
+
+  while(us && (i < LLUV_STATS_BUCKETS - 1)){
+    us >>= 1;
+    ++i;
+  }
+
+  return i;
+}
+
+static void lluv_cb_stats_add(lluv_cb_stats_t *s, uint64_t elapsed){
+  s->count += 1;
+  s->total += elapsed;
+  if(elapsed > s->max) s->max = elapsed;
+  s->hist[lluv_stats_bucket(elapsed)] += 1;
+}
+
+static int lluv_stats_resolve_kind(int htype, int kind){
+  if(kind == LLUV_CB_EVENT){
+    if(htype == UV_TIMER) return LLUV_CB_TIMER;
+    if(htype == UV_ASYNC) return LLUV_CB_MESSAGE;
+  }
+  return kind;
+}
+
+LLUV_INTERNAL const char *lluv_stats_kind_name(int htype, int kind){
+  return lluv_stats_kind_names[lluv_stats_resolve_kind(htype, kind)];
+}
+
+LLUV_INTERNAL void lluv_stats_record(lluv_loop_stats_t *stats, int htype, int kind, uint64_t elapsed){
+  if((htype < 0) || (htype >= UV_HANDLE_TYPE_MAX)) htype = UV_UNKNOWN_HANDLE;
+
+  kind = lluv_stats_resolve_kind(htype, kind);
+
+  lluv_cb_stats_add(&stats->types[htype], elapsed);
+  lluv_cb_stats_add(&stats->kinds[kind], elapsed);
+}
+
+LLUV_INTERNAL void lluv_stats_on_iteration(lluv_loop_stats_t *stats, uv_loop_t *loop){
+  uint64_t now  = uv_hrtime();
+  uint64_t idle = lluv_stats_idle_time(loop);
+
+  /* time between iterations excluding time spent waiting in poll */
+  if(stats->last_iter){
+    uint64_t elapsed = now - stats->last_iter, waited = idle - stats->last_idle;
+    lluv_cb_stats_add(&stats->lag, (elapsed > waited) ? (elapsed - waited) : 0);
+  }
+
+  stats->last_iter = now;
+  stats->last_idle = idle;
+}
+
+LLUV_INTERNAL int lluv_stats_req_kind(uv_req_type type){
+  switch(type){
+    case UV_WRITE:
+    case UV_UDP_SEND:       return LLUV_CB_WRITE;
+    case UV_CONNECT:        return LLUV_CB_CONNECT;
+    case UV_SHUTDOWN:       return LLUV_CB_SHUTDOWN;
+    case UV_FS:             return LLUV_CB_FS;
+    case UV_GETADDRINFO:
+    case UV_GETNAMEINFO:    return LLUV_CB_DNS;
+    case UV_WORK:           return LLUV_CB_WORK;
+    default:                return LLUV_CB_EVENT;
+  }
+}
+
+static void lluv_cb_stats_push(lua_State *L, const lluv_cb_stats_t *s){
+  int i, n;
+
+  lua_newtable(L);
+  lutil_pushint64(L, (int64_t)s->count);           lua_setfield(L, -2, "count");
+  lua_pushnumber(L, (lua_Number)s->total / 1000000); lua_setfield(L, -2, "total");
+  lua_pushnumber(L, (lua_Number)s->max   / 1000000); lua_setfield(L, -2, "max");
+
+  for(n = LLUV_STATS_BUCKETS; n > 0; --n){
+    if(s->hist[n - 1]) break;
+  }
+
+  lua_createtable(L, n, 0);
+  for(i = 0; i < n; ++i){
+    lutil_pushint64(L, (int64_t)s->hist[i]);
+    lua_rawseti(L, -2, i + 1);
+  }
+  lua_setfield(L, -2, "hist");
+}
+
+LLUV_INTERNAL void lluv_stats_push(lua_State *L, lluv_loop_stats_t *stats, uv_loop_t *loop){
+  int i;
+
+  lua_newtable(L);
+
+  lua_pushnumber(L, (lua_Number)(uv_hrtime() - stats->started) / 1000000);
+  lua_setfield(L, -2, "uptime");
+
+#ifdef LLUV_STATS_IDLE_TIME
+  lua_pushnumber(L, (lua_Number)(lluv_stats_idle_time(loop) - stats->idle_base) / 1000000);
+  lua_setfield(L, -2, "idle");
+#else
+  (void)loop;
+#endif
+
+  lluv_cb_stats_push(L, &stats->lag);
+  lua_setfield(L, -2, "lag");
+
+  lua_newtable(L);
+  for(i = 0; i < UV_HANDLE_TYPE_MAX; ++i){
+    const char *name;
+    if(!stats->types[i].count) continue;
+#if LLUV_UV_VER_GE(1,19,0)
+    name = (i == UV_UNKNOWN_HANDLE) ? "request" : uv_handle_type_name((uv_handle_type)i);
+#else
+    name = (i == UV_UNKNOWN_HANDLE) ? "request" : NULL;
+#endif
+    if(name) lua_pushstring(L, name); else lua_pushinteger(L, i);
+    lluv_cb_stats_push(L, &stats->types[i]);
+    lua_rawset(L, -3);
+  }
+  lua_setfield(L, -2, "types");
+
+  lua_newtable(L);
+  for(i = 0; i < LLUV_CB_KIND_MAX; ++i){
+    if(!stats->kinds[i].count) continue;
+    lluv_cb_stats_push(L, &stats->kinds[i]);
+    lua_setfield(L, -2, lluv_stats_kind_names[i]);
+  }
+  lua_setfield(L, -2, "kinds");
+}
+
+//{ Watchdog
+
+/* keys in LUA_REGISTRYINDEX. Hook runs inside Lua function so
+** lluv registry (upvalue) is not available there.
+*/
+static const char *LLUV_WATCHDOG_TAG       = LLUV_PREFIX" Watchdog";
+static const char *LLUV_WATCHDOG_TRACEBACK = LLUV_PREFIX" Watchdog traceback";
+
+/* called from hook so traceback starts with running (slow) function */
+static void lluv_watchdog_traceback(lua_State *L){
+#if LUA_VERSION_NUM >= 502
+  luaL_traceback(L, L, "slow callback", 0);
+#else
+  lua_getglobal(L, "debug");
+  if(lua_istable(L, -1)){
+    lua_getfield(L, -1, "traceback");
+    lua_remove(L, -2);
+    if(lua_isfunction(L, -1)){
+      lua_pushliteral(L, "slow callback");
+      lua_pushinteger(L, 1);
+      if(lua_pcall(L, 2, 1, 0) == 0) return;
+    }
+  }
+  lua_pop(L, 1);
+  lua_pushnil(L);
+#endif
+}
+
+static void lluv_watchdog_hook(lua_State *L, lua_Debug *ar){
+  lluv_watchdog_t *w;
+  uint64_t elapsed;
+
+  (void)ar;
+
+  lua_rawgetp(L, LUA_REGISTRYINDEX, LLUV_WATCHDOG_TAG);
+  w = (lluv_watchdog_t*)lua_touserdata(L, -1);
+  lua_pop(L, 1);
+
+  if(!w) return;
+
+  elapsed = uv_hrtime() - w->start;
+
+  if(!w->captured && (elapsed >= w->threshold)){
+    w->captured = 1;
+    lluv_watchdog_traceback(L);
+    lua_rawsetp(L, LUA_REGISTRYINDEX, LLUV_WATCHDOG_TRACEBACK);
+  }
+
+  if(w->limit && (elapsed >= w->limit)){
+    /* keep hook until callback returns so pcall can not swallow it */
+    w->interrupted = 1;
+    luaL_error(L, "callback interrupted by watchdog after %d ms", (int)(elapsed / 1000000));
+  }
+}
+
+LLUV_INTERNAL void lluv_watchdog_arm(lua_State *L, lluv_watchdog_t *w){
+  w->start    = uv_hrtime();
+  w->active   = 1;
+  w->captured = 0;
+  w->armed    = 0;
+  w->interrupted = 0;
+
+  if(lua_gethook(L) != NULL) return;
+
+  lua_pushlightuserdata(L, w);
+  lua_rawsetp(L, LUA_REGISTRYINDEX, LLUV_WATCHDOG_TAG);
+  lua_sethook(L, lluv_watchdog_hook, LUA_MASKCOUNT, LLUV_WATCHDOG_HOOK_COUNT);
+  w->armed = 1;
+  w->L     = L;
+}
+
+/* callback can disable watchdog from other thread (coroutine)
+** so remove hook from thread where it was installed.
+*/
+LLUV_INTERNAL void lluv_watchdog_disarm(lua_State *L, lluv_watchdog_t *w){
+  if(w->armed){
+    if(lua_gethook(w->L) == lluv_watchdog_hook) lua_sethook(w->L, NULL, 0, 0);
+    lua_pushnil(L);
+    lua_rawsetp(L, LUA_REGISTRYINDEX, LLUV_WATCHDOG_TAG);
+    w->armed = 0;
+  }
+  w->active = 0;
+}
+
+LLUV_INTERNAL void lluv_watchdog_push_traceback(lua_State *L, lluv_watchdog_t *w){
+  if(!w->captured){
+    lua_pushnil(L);
+    return;
+  }
+
+  lua_rawgetp(L, LUA_REGISTRYINDEX, LLUV_WATCHDOG_TRACEBACK);
+  lua_pushnil(L);
+  lua_rawsetp(L, LUA_REGISTRYINDEX, LLUV_WATCHDOG_TRACEBACK);
+  w->captured = 0;
+}
+
+//}
@@ -0,0 +1,105 @@
+/******************************************************************************
+* Author: Alexey Melnichuk <alexeymelnichuck@gmail.com>
+*
+* Copyright (C) 2014-2019 Alexey Melnichuk <alexeymelnichuck@gmail.com>
+*
+* Licensed according to the included 'LICENSE' document
+*
+* This file is part of lua-lluv library.
+******************************************************************************/
+
+#ifndef _LLUV_STATS_H_
+#define _LLUV_STATS_H_
+
+#include "lluv.h"
+#include "lluv_utils.h"
+
+/* Optional loop profiler.
+** Counts Lua callbacks per handle type and per callback kind
+** and measures loop lag on each iteration.
+*/
+
+/* callback kinds */
+#define LLUV_CB_EVENT       0  /* start callback of handle (idle, signal, poll...) */
+#define LLUV_CB_TIMER       1
+#define LLUV_CB_READ        2
+#define LLUV_CB_WRITE       3
+#define LLUV_CB_CONNECTION  4
+#define LLUV_CB_CONNECT     5
+#define LLUV_CB_SHUTDOWN    6
+#define LLUV_CB_FS          7
+#define LLUV_CB_DNS         8
+#define LLUV_CB_WORK        9
+#define LLUV_CB_MESSAGE     10 /* async handles and workers */
+#define LLUV_CB_CLOSE       11
+#define LLUV_CB_DEFER       12
+#define LLUV_CB_KIND_MAX    13
+
+/* number of log2 buckets of microseconds */
+#ifndef LLUV_STATS_BUCKETS
+#  define LLUV_STATS_BUCKETS 32
+#endif
+
+typedef struct lluv_cb_stats_tag{
+  uint64_t count;
+  uint64_t total;  /* ns */
+  uint64_t max;    /* ns */
+  uint64_t hist[LLUV_STATS_BUCKETS];
+}lluv_cb_stats_t;
+
+typedef struct lluv_loop_stats_tag{
+  lluv_cb_stats_t types[UV_HANDLE_TYPE_MAX]; /* UV_UNKNOWN_HANDLE for requests */
+  lluv_cb_stats_t kinds[LLUV_CB_KIND_MAX];
+  lluv_cb_stats_t lag;       /* busy time of each loop iteration */
+  uint64_t        started;   /* hrtime of reset */
+  uint64_t        idle_base; /* idle time at reset */
+  uint64_t        last_iter; /* hrtime of previous iteration */
+  uint64_t        last_idle;
+}lluv_loop_stats_t;
+
+LLUV_INTERNAL void lluv_stats_reset(lluv_loop_stats_t *stats, uv_loop_t *loop);
+
+LLUV_INTERNAL void lluv_stats_record(lluv_loop_stats_t *stats, int htype, int kind, uint64_t elapsed);
+
+/* call once per loop iteration */
+LLUV_INTERNAL void lluv_stats_on_iteration(lluv_loop_stats_t *stats, uv_loop_t *loop);
+
+LLUV_INTERNAL void lluv_stats_push(lua_State *L, lluv_loop_stats_t *stats, uv_loop_t *loop);
+
+LLUV_INTERNAL int lluv_stats_req_kind(uv_req_type type);
+
+LLUV_INTERNAL const char *lluv_stats_kind_name(int htype, int kind);
+
+/* Slow callback watchdog.
+** While callback runs count hook checks elapsed time and captures
+** traceback when callback exceeds threshold. Hook is not installed
+** if Lua state already has other hook (e.g. debugger).
+** After limit hook stays installed and raises error on each call
+** so callback can not swallow interruption with pcall.
+*/
+
+/* number of VM instructions between hook calls */
+#ifndef LLUV_WATCHDOG_HOOK_COUNT
+#  define LLUV_WATCHDOG_HOOK_COUNT 1000
+#endif
+
+typedef struct lluv_watchdog_tag{
+  uint64_t threshold; /* ns */
+  uint64_t limit;     /* ns, interrupt callback with error (0 - never) */
+  int      handler;   /* reference in lluv registry */
+  uint64_t start;     /* hrtime of current callback */
+  int      active;    /* callback is running */
+  int      armed;     /* hook installed */
+  int      captured;  /* traceback captured */
+  int      interrupted; /* callback interrupted after limit */
+  lua_State *L;       /* thread with installed hook */
+}lluv_watchdog_t;
+
+LLUV_INTERNAL void lluv_watchdog_arm(lua_State *L, lluv_watchdog_t *w);
+
+LLUV_INTERNAL void lluv_watchdog_disarm(lua_State *L, lluv_watchdog_t *w);
+
+/* push captured traceback or nil */
+LLUV_INTERNAL void lluv_watchdog_push_traceback(lua_State *L, lluv_watchdog_t *w);
+
+#endif
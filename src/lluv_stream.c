@@ -16,7 +16,9 @@
 #include "lluv_loop.h"
 #include "lluv_error.h"
 #include "lluv_req.h"
+#include "lluv_fbuf.h"
 #include <assert.h>
+#include <string.h>
 
 #define LLUV_STREAM_NAME LLUV_PREFIX" Stream"
 static const char *LLUV_STREAM = LLUV_STREAM_NAME;
@@ -40,6 +42,143 @@ LLUV_INTERNAL lluv_handle_t* lluv_check_stream(lua_State *L, int idx, lluv_flags
   return handle;
 }
 
+//{ Stream extension
+
+#define LLUV_STREAM_CORK_NONE   0
+#define LLUV_STREAM_CORK_MANUAL 1
+#define LLUV_STREAM_CORK_AUTO   2
+
+/* corked data flushed immediately when its size exceed this value */
+#ifndef LLUV_STREAM_CORK_HIGH
+#  define LLUV_STREAM_CORK_HIGH 65536
+#endif
+
+typedef struct lluv_stream_ext_tag{
+  lluv_handle_ext_t base;
+
+  /* start_read_into */
+  int                  rbuf;  /* reference to fixed buffer */
+  lluv_fixed_buffer_t *rfbuf;
+  char                *rbase;
+  size_t               rsize;
+  size_t               rpos;
+  int                  ring;
+  size_t               rhead;  /* ring: first not consumed byte */
+  size_t               rused;  /* ring: number of not consumed bytes */
+  size_t               rwrap;  /* ring: end of data before wrap (0 - not wrapped) */
+
+  /* start_read_framed */
+  int                  fmode;      /* LLUV_FRAME_XXX */
+  int                  fmulti;     /* deliver all frames with one callback */
+  int                  freading;
+  size_t               fmax;       /* max frame size */
+  int                  fdelim_ref;
+  const char          *fdelim;
+  size_t               fdelim_len;
+  char                *fbase;
+  size_t               fcap;
+  size_t               fbegin;     /* first not parsed byte */
+  size_t               fend;       /* end of data */
+  size_t               fscan;      /* position to continue delimiter search */
+
+  /* on_drain */
+  int                  drain_cb;
+  size_t               drain_low; /* low watermark */
+  int                  drain_armed;
+  int                  drain_err; /* write error already reported */
+
+  /* cork */
+  int                  cork;        /* LLUV_STREAM_CORK_XXX */
+  int                  cork_ref;    /* table with pending payload */
+  int                  cork_nref;
+  uv_buf_t            *cork_bufs;
+  size_t               cork_n;
+  size_t               cork_cap;
+  size_t               cork_size;   /* pending bytes */
+  int                  cork_queued; /* stream is in loop->corked list */
+  lluv_handle_t       *cork_next;
+}lluv_stream_ext_t;
+
+static void lluv_stream_cork_unlink(lua_State *L, lluv_handle_t *handle, lluv_stream_ext_t *ext);
+
+static void lluv_stream_ext_free(lua_State *L, lluv_handle_t *handle, lluv_handle_ext_t *arg){
+  lluv_stream_ext_t *ext = (lluv_stream_ext_t*)arg;
+
+  if(ext->rfbuf) lluv_fbuf_unpin(ext->rfbuf);
+  luaL_unref(L, LLUV_LUA_REGISTRY, ext->rbuf);
+  luaL_unref(L, LLUV_LUA_REGISTRY, ext->fdelim_ref);
+  lluv_free(L, ext->fbase);
+  luaL_unref(L, LLUV_LUA_REGISTRY, ext->drain_cb);
+  if(ext->cork_queued) lluv_stream_cork_unlink(L, handle, ext);
+  luaL_unref(L, LLUV_LUA_REGISTRY, ext->cork_ref);
+  lluv_free(L, ext->cork_bufs);
+  lluv_free_t(L, lluv_stream_ext_t, ext);
+}
+
+/* pending corked data has to be passed to libuv before close */
+static void lluv_stream_ext_close(lua_State *L, lluv_handle_t *handle, lluv_handle_ext_t *arg){
+  UNUSED_ARG(arg);
+  lluv_stream_cork_sync(L, handle);
+}
+
+static lluv_stream_ext_t *lluv_stream_ext(lua_State *L, lluv_handle_t *handle){
+  lluv_stream_ext_t *ext = (lluv_stream_ext_t*)handle->ext;
+  if(ext) return ext;
+
+  ext = lluv_alloc_t(L, lluv_stream_ext_t);
+  if(!ext) return NULL;
+
+  ext->base.free  = lluv_stream_ext_free;
+  ext->base.close = lluv_stream_ext_close;
+  ext->rbuf      = LUA_NOREF;
+  ext->rfbuf     = NULL;
+  ext->rbase     = NULL;
+  ext->rsize     = 0;
+  ext->rpos      = 0;
+  ext->ring      = 0;
+  ext->rhead     = 0;
+  ext->rused     = 0;
+  ext->rwrap     = 0;
+  ext->fmode       = 0;
+  ext->fmulti      = 0;
+  ext->freading    = 0;
+  ext->fmax        = 0;
+  ext->fdelim_ref  = LUA_NOREF;
+  ext->fdelim      = NULL;
+  ext->fdelim_len  = 0;
+  ext->fbase       = NULL;
+  ext->fcap        = 0;
+  ext->fbegin      = 0;
+  ext->fend        = 0;
+  ext->fscan       = 0;
+  ext->drain_cb    = LUA_NOREF;
+  ext->drain_low   = 0;
+  ext->drain_armed = 0;
+  ext->drain_err   = 0;
+  ext->cork        = LLUV_STREAM_CORK_NONE;
+  ext->cork_ref    = LUA_NOREF;
+  ext->cork_nref   = 0;
+  ext->cork_bufs   = NULL;
+  ext->cork_n      = 0;
+  ext->cork_cap    = 0;
+  ext->cork_size   = 0;
+  ext->cork_queued = 0;
+  ext->cork_next   = NULL;
+
+  handle->ext = &ext->base;
+  return ext;
+}
+
+static size_t lluv_stream_write_queue_size(lluv_handle_t *handle){
+#if LLUV_UV_VER_GE(1,19,0)
+  return uv_stream_get_write_queue_size(LLUV_H(handle, uv_stream_t));
+#else
+  return LLUV_H(handle, uv_stream_t)->write_queue_size;
+#endif
+}
+
+//}
+
 LLUV_INTERNAL void lluv_on_stream_req_cb(uv_req_t* arg, int status){
   lluv_req_t    *req    = lluv_req_byptr(arg);
   lluv_handle_t *handle = req->handle;
@@ -69,7 +208,7 @@ LLUV_INTERNAL void lluv_on_stream_req_cb(uv_req_t* arg, int status){
   lluv_push_status(L, status);
   lua_insert(L, -2);
 
-  LLUV_HANDLE_CALL_CB(L, handle, 3);
+  LLUV_HANDLE_CALL_CB_EX(L, handle, 3, lluv_stats_req_kind(arg->type));
 
   LLUV_CHECK_LOOP_CB_INVARIANT(L);
 }
@@ -93,6 +232,11 @@ static int lluv_stream_shutdown(lua_State *L){
   else
     lluv_check_args_with_cb(L, 2);
 
+  err = lluv_stream_cork_sync(L, handle);
+  if(err < 0){
+    return lluv_fail(L, handle->flags, LLUV_ERR_UV, err, NULL);
+  }
+
   req = lluv_req_new(L, UV_SHUTDOWN, handle);
 
   err = uv_shutdown(LLUV_R(req, shutdown), LLUV_H(handle, uv_stream_t), lluv_on_stream_shutdown_cb);
@@ -118,7 +262,7 @@ static void lluv_on_stream_connection_cb(uv_stream_t* arg, int status){
   lluv_handle_pushself(L, handle);
   lluv_push_status(L, status);
 
-  LLUV_HANDLE_CALL_CB(L, handle, 2);
+  LLUV_HANDLE_CALL_CB_EX(L, handle, 2, LLUV_CB_CONNECTION);
 
   LLUV_CHECK_LOOP_CB_INVARIANT(L);
 }
@@ -283,21 +427,87 @@ static void lluv_on_stream_read_cb(uv_stream_t* arg, ssize_t nread, const uv_buf
     lluv_handle_unlock(L, handle, LLUV_LOCK_READ);
   }
 
-  LLUV_HANDLE_CALL_CB(L, handle, 3);
+  LLUV_HANDLE_CALL_CB_EX(L, handle, 3, LLUV_CB_READ);
 
   LLUV_CHECK_LOOP_CB_INVARIANT(L);
 }
 
+static void lluv_stream_release_read_buffer(lua_State *L, lluv_handle_t *handle){
+  lluv_stream_ext_t *ext = (lluv_stream_ext_t*)handle->ext;
+
+  if(ext && (ext->rbuf != LUA_NOREF)){
+    lluv_fbuf_unpin(ext->rfbuf);
+    luaL_unref(L, LLUV_LUA_REGISTRY, ext->rbuf);
+    ext->rbuf  = LUA_NOREF;
+    ext->rfbuf = NULL;
+    ext->rbase = NULL;
+    ext->rsize = ext->rpos = 0;
+    ext->rhead = ext->rused = ext->rwrap = 0;
+  }
+}
+
+static void lluv_stream_release_framer(lua_State *L, lluv_handle_t *handle){
+  lluv_stream_ext_t *ext = (lluv_stream_ext_t*)handle->ext;
+
+  if(ext && ext->fmode){
+    luaL_unref(L, LLUV_LUA_REGISTRY, ext->fdelim_ref);
+    lluv_free(L, ext->fbase);
+    ext->fmode      = 0;
+    ext->freading   = 0;
+    ext->fdelim_ref = LUA_NOREF;
+    ext->fdelim     = NULL;
+    ext->fdelim_len = 0;
+    ext->fbase      = NULL;
+    ext->fcap = ext->fbegin = ext->fend = ext->fscan = 0;
+  }
+}
+
+/* state after uv_read_stop */
+static void lluv_stream_read_stopped(lua_State *L, lluv_handle_t *handle){
+  if(LLUV_READ_CB(handle) != LUA_NOREF){
+    lluv_handle_unlock(L, handle, LLUV_LOCK_READ);
+    luaL_unref(L, LLUV_LUA_REGISTRY, LLUV_READ_CB(handle));
+    LLUV_READ_CB(handle) = LUA_NOREF;
+  }
+
+  lluv_stream_release_read_buffer(L, handle);
+
+  /* keep not delivered data for next start_read_framed */
+  if(handle->ext) ((lluv_stream_ext_t*)handle->ext)->freading = 0;
+}
+
+/* pass error of read start to new callback which is on top of stack */
+static int lluv_stream_read_start_error(lua_State *L, lluv_handle_t *handle, int err){
+  lua_pushvalue(L, 1);
+  lluv_error_create(L, LLUV_ERR_UV, err, NULL);
+  lluv_loop_defer_call(L, lluv_loop_by_handle(&handle->handle), 2);
+  lua_settop(L, 1);
+  return 1;
+}
+
 static int lluv_stream_start_read(lua_State *L){
   lluv_handle_t *handle = lluv_check_stream(L, 1, LLUV_FLAG_OPEN);
   int err;
 
   lluv_check_args_with_cb(L, 2);
-  LLUV_READ_CB(handle) = luaL_ref(L, LLUV_LUA_REGISTRY);
+
+  /* libuv does not replace callbacks of active read (UV_EALREADY) */
+  uv_read_stop(LLUV_H(handle, uv_stream_t));
 
   err = uv_read_start(LLUV_H(handle, uv_stream_t), lluv_alloc_buffer_cb, lluv_on_stream_read_cb);
-  if(err >= 0) lluv_handle_lock(L, handle, LLUV_LOCK_READ);
-  return lluv_return(L, handle, LLUV_READ_CB(handle), err);
+  if(err < 0){
+    lluv_stream_read_stopped(L, handle);
+    return lluv_stream_read_start_error(L, handle, err);
+  }
+
+  luaL_unref(L, LLUV_LUA_REGISTRY, LLUV_READ_CB(handle));
+  LLUV_READ_CB(handle) = luaL_ref(L, LLUV_LUA_REGISTRY);
+  lluv_stream_release_read_buffer(L, handle);
+  lluv_stream_release_framer(L, handle);
+  lluv_handle_lock(L, handle, LLUV_LOCK_READ);
+
+  lua_settop(L, 1);
+  return 1;
 }
 
 static int lluv_stream_stop_read(lua_State *L){
@@ -311,10 +521,512 @@ static int lluv_stream_stop_read(lua_State *L){
     return lluv_fail(L, handle->flags, LLUV_ERR_UV, err, NULL);
   }
 
-  if(LLUV_READ_CB(handle) != LUA_NOREF){
-    lluv_handle_unlock(L, handle, LLUV_LOCK_READ);
+  lluv_stream_read_stopped(L, handle);
+
+  lua_settop(L, 1);
+  return 1;
+}
+
+/* in ring mode read wraps to the buffer begin 
+ * if free space at the end is less than this value
+ * (but not more than quarter of buffer)
+ */
+#ifndef LLUV_READ_INTO_MIN_TAIL
+#  define LLUV_READ_INTO_MIN_TAIL 4096
+#endif
+
+/* Ring keeps data until it released by `consume`.
+ * Not wrapped: data is [rhead, rpos).
+ * Wrapped:     data is [rhead, rwrap) + [0, rpos).
+ * Read gets only free space so if ring is full libuv
+ * reports UV_ENOBUFS and reading stops.
+ */
+static void lluv_alloc_read_into_cb(uv_handle_t* h, size_t suggested_size, uv_buf_t *buf){
+  lluv_handle_t     *handle = lluv_handle_byptr(h);
+  lluv_stream_ext_t *ext    = (lluv_stream_ext_t*)handle->ext;
+  size_t min_tail = ext->rsize / 4;
+
+  UNUSED_ARG(suggested_size);
+
+  if(min_tail > LLUV_READ_INTO_MIN_TAIL) min_tail = LLUV_READ_INTO_MIN_TAIL;
+
+  if((!ext->ring) || (ext->rused == 0)){
+    ext->rpos = ext->rhead = ext->rwrap = 0;
+  }
+  else if(ext->rwrap){
+    *buf = lluv_buf_init(ext->rbase + ext->rpos, ext->rhead - ext->rpos);
+    return;
+  }
+  else if(((ext->rsize - ext->rpos) <= min_tail) && (ext->rhead > ext->rsize - ext->rpos)){
+    ext->rwrap = ext->rpos;
+    ext->rpos  = 0;
+    *buf = lluv_buf_init(ext->rbase, ext->rhead);
+    return;
+  }
+
+  *buf = lluv_buf_init(ext->rbase + ext->rpos, ext->rsize - ext->rpos);
+}
+
+static void lluv_stream_ring_consume(lluv_stream_ext_t *ext, size_t n){
+  ext->rused -= n;
+
+  while(n){
+    size_t end = ext->rwrap ? ext->rwrap : ext->rpos;
+    size_t len = end - ext->rhead;
+
+    if(len > n) len = n;
+    ext->rhead += len;
+    n          -= len;
+
+    if(ext->rwrap && (ext->rhead == ext->rwrap)){
+      ext->rhead = 0;
+      ext->rwrap = 0;
+    }
+  }
+}
+
+static void lluv_on_stream_read_into_cb(uv_stream_t* arg, ssize_t nread, const uv_buf_t* buf){
+  lluv_handle_t     *handle = lluv_handle_byptr((uv_handle_t*)arg);
+  lluv_stream_ext_t *ext    = (lluv_stream_ext_t*)handle->ext;
+  lua_State *L = LLUV_HCALLBACK_L(handle);
+
+  LLUV_CHECK_LOOP_CB_INVARIANT(L);
+
+  if(!IS_(handle, OPEN)) return;
+
+  /* EAGAIN. Buffer untouched so there nothing to report */
+  if(nread == 0) return;
+
+  lua_rawgeti(L, LLUV_LUA_REGISTRY, LLUV_READ_CB(handle));
+  assert(!lua_isnil(L, -1));
+
+  lluv_handle_pushself(L, handle);
+
+  if(nread > 0){
+    size_t offset = buf->base - ext->rbase;
+    ext->rpos = offset + nread;
+    if(ext->ring) ext->rused += nread;
+
+    lua_pushnil(L);
+    lutil_pushint64(L, offset);
+    lutil_pushint64(L, nread);
+  }
+  else{
+    uv_read_stop(arg);
+
     luaL_unref(L, LLUV_LUA_REGISTRY, LLUV_READ_CB(handle));
     LLUV_READ_CB(handle) = LUA_NOREF;
+    lluv_stream_release_read_buffer(L, handle);
+
+    lluv_error_create(L, LLUV_ERR_UV, (uv_errno_t)nread, NULL);
+    lua_pushnil(L);
+    lua_pushnil(L);
+
+    lluv_handle_unlock(L, handle, LLUV_LOCK_READ);
+  }
+
+  LLUV_HANDLE_CALL_CB_EX(L, handle, 4, LLUV_CB_READ);
+
+  LLUV_CHECK_LOOP_CB_INVARIANT(L);
+}
+
+static int lluv_stream_start_read_into(lua_State *L){
+  static const lluv_uv_const_t MODES[] = {
+    { 0, "fixed" },
+    { 1, "ring"  },
+
+    { 0, NULL }
+  };
+
+  lluv_handle_t       *handle = lluv_check_stream(L, 1, LLUV_FLAG_OPEN);
+  lluv_fixed_buffer_t *buffer = lluv_check_fbuf(L, 2);
+  lluv_stream_ext_t   *ext;
+  int ring = 0, err;
+
+  if(lua_gettop(L) > 3){
+    ring = (int)lluv_opt_named_const(L, 3, 0, MODES);
+    lluv_check_args_with_cb(L, 4);
+  }
+  else{
+    lluv_check_args_with_cb(L, 3);
+  }
+
+  luaL_argcheck(L, buffer->capacity > 0, 2, LLUV_PREFIX" empty buffer");
+
+  ext = lluv_stream_ext(L, handle);
+  if(!ext){
+    return lluv_fail(L, handle->flags, LLUV_ERR_UV, UV_ENOMEM, NULL);
+  }
+
+  luaL_unref(L, LLUV_LUA_REGISTRY, LLUV_READ_CB(handle));
+  LLUV_READ_CB(handle) = luaL_ref(L, LLUV_LUA_REGISTRY);
+
+  lluv_stream_release_read_buffer(L, handle);
+  lluv_stream_release_framer(L, handle);
+  lua_pushvalue(L, 2);
+  ext->rbuf  = luaL_ref(L, LLUV_LUA_REGISTRY);
+  ext->rfbuf = buffer;
+  ext->rbase = buffer->data;
+  ext->rsize = buffer->capacity;
+  ext->rpos  = 0;
+  ext->ring  = ring;
+  lluv_fbuf_pin(buffer);
+
+  err = uv_read_start(LLUV_H(handle, uv_stream_t), lluv_alloc_read_into_cb, lluv_on_stream_read_into_cb);
+  if(err >= 0) lluv_handle_lock(L, handle, LLUV_LOCK_READ);
+  else lluv_stream_release_read_buffer(L, handle);
+
+  return lluv_return(L, handle, LLUV_READ_CB(handle), err);
+}
+
+// consume(n) releases `n` bytes of ring buffer
+static int lluv_stream_consume(lua_State *L){
+  lluv_handle_t     *handle = lluv_check_stream(L, 1, LLUV_FLAG_OPEN);
+  lluv_stream_ext_t *ext    = (lluv_stream_ext_t*)handle->ext;
+  lua_Integer        n      = luaL_checkinteger(L, 2);
+
+  luaL_argcheck(L, ext && (ext->rbuf != LUA_NOREF) && ext->ring, 1, LLUV_PREFIX" stream does not read into ring buffer");
+  luaL_argcheck(L, (n >= 0) && ((size_t)n <= ext->rused), 2, LLUV_PREFIX" out of range");
+
+  lluv_stream_ring_consume(ext, (size_t)n);
+
+  lua_settop(L, 1);
+  return 1;
+}
+
+#define LLUV_FRAME_LINE      1
+#define LLUV_FRAME_DELIMITER 2
+#define LLUV_FRAME_U16BE     3
+#define LLUV_FRAME_U32LE     4
+
+/* default max frame size */
+#ifndef LLUV_FRAME_MAX
+#  define LLUV_FRAME_MAX 1048576
+#endif
+
+static int lluv_stream_framed_active(lluv_handle_t *handle, lluv_stream_ext_t *ext){
+  return IS_(handle, OPEN) && (handle->ext == &ext->base) && ext->freading &&
+    !uv_is_closing(LLUV_H(handle, uv_handle_t));
+}
+
+static void lluv_alloc_read_framed_cb(uv_handle_t* h, size_t suggested_size, uv_buf_t *buf){
+  lluv_handle_t     *handle = lluv_handle_byptr(h);
+  lluv_stream_ext_t *ext    = (lluv_stream_ext_t*)handle->ext;
+
+  if(ext->fbegin == ext->fend){
+    ext->fbegin = ext->fend = ext->fscan = 0;
+  }
+
+  if((ext->fcap - ext->fend < LLUV_READ_INTO_MIN_TAIL) && ext->fbegin){
+    size_t n = ext->fend - ext->fbegin;
+    memmove(ext->fbase, ext->fbase + ext->fbegin, n);
+    ext->fscan -= ext->fbegin;
+    ext->fend   = n;
+    ext->fbegin = 0;
+  }
+
+  if(ext->fcap - ext->fend < LLUV_READ_INTO_MIN_TAIL){
+    size_t cap = ext->fcap ? ext->fcap * 2 : suggested_size;
+    char *base;
+
+    while(cap - ext->fend < LLUV_READ_INTO_MIN_TAIL) cap *= 2;
+
+    base = (char*)lluv_alloc(handle->L, cap);
+    if(!base){ /* read callback gets UV_ENOBUFS */
+      *buf = lluv_buf_init(NULL, 0);
+      return;
+    }
+
+    if(ext->fend) memcpy(base, ext->fbase, ext->fend);
+    lluv_free(handle->L, ext->fbase);
+    ext->fbase = base;
+    ext->fcap  = cap;
+  }
+
+  *buf = lluv_buf_init(ext->fbase + ext->fend, ext->fcap - ext->fend);
+}
+
+static int lluv_stream_frame_next_delim(lluv_stream_ext_t *ext, const char **frame, size_t *len){
+  const char *begin = ext->fbase + ext->fbegin;
+  const char *end   = ext->fbase + ext->fend;
+  const char *p     = ext->fbase + ((ext->fscan > ext->fbegin) ? ext->fscan : ext->fbegin);
+  size_t dlen = ext->fdelim_len, size = ext->fend - ext->fbegin;
+
+  while((size_t)(end - p) >= dlen){
+    p = memchr(p, ext->fdelim[0], (end - p) - dlen + 1);
+    if(!p) break;
+
+    if(0 == memcmp(p, ext->fdelim, dlen)){
+      size_t flen = p - begin;
+      if(flen > ext->fmax) return UV_E2BIG;
+
+      ext->fbegin = ext->fscan = (p + dlen) - ext->fbase;
+
+      if((ext->fmode == LLUV_FRAME_LINE) && flen && (begin[flen - 1] == '\r')) --flen;
+
+      *frame = begin; *len = flen;
+      return 1;
+    }
+    ++p;
+  }
+
+  /* tail may contain begin of delimiter */
+  if(size >= dlen){
+    ext->fscan = ext->fend - dlen + 1;
+    if(size - dlen + 1 > ext->fmax) return UV_E2BIG;
+  }
+
+  return 0;
+}
+
+/* Returns 1 if there complete frame, 0 if need more data or error code */
+static int lluv_stream_frame_next(lluv_stream_ext_t *ext, const char **frame, size_t *len){
+  const unsigned char *data = (const unsigned char*)ext->fbase + ext->fbegin;
+  size_t size = ext->fend - ext->fbegin;
+  size_t hlen, flen;
+
+  switch(ext->fmode){
+    case LLUV_FRAME_U16BE:
+      hlen = 2;
+      if(size < hlen) return 0;
+      flen = ((size_t)data[0] << 8) | (size_t)data[1];
+      break;
+
+    case LLUV_FRAME_U32LE:
+      hlen = 4;
+      if(size < hlen) return 0;
+      flen = (size_t)data[0] | ((size_t)data[1] << 8) | ((size_t)data[2] << 16) | ((size_t)data[3] << 24);
+      break;
+
+    default:
+      return lluv_stream_frame_next_delim(ext, frame, len);
+  }
+
+  if(flen > ext->fmax) return UV_E2BIG;
+
+  if(size - hlen < flen) return 0;
+
+  *frame = (const char*)data + hlen; *len = flen;
+  ext->fbegin += hlen + flen;
+
+  return 1;
+}
+
+/* deferred call already runs in protected mode */
+static int lluv_stream_framed_call(lua_State *L, lluv_handle_t *handle, int deferred){
+  if(deferred){
+    lua_call(L, 3, 0);
+    return 0;
+  }
+
+  {
+    lluv_loop_t *loop = lluv_loop_by_handle(&handle->handle);
+    if(lluv_loop_call(L, loop, 3, handle->handle.type, LLUV_CB_READ)) return 1;
+    lluv_loop_defer_proceed(L, loop);
+  }
+  return 0;
+}
+
+static void lluv_stream_framed_error(lua_State *L, lluv_handle_t *handle, lluv_stream_ext_t *ext, int err, int deferred){
+  uv_read_stop(LLUV_H(handle, uv_stream_t));
+
+  lua_rawgeti(L, LLUV_LUA_REGISTRY, LLUV_READ_CB(handle));
+  luaL_unref(L, LLUV_LUA_REGISTRY, LLUV_READ_CB(handle));
+  LLUV_READ_CB(handle) = LUA_NOREF;
+
+  lluv_handle_pushself(L, handle);
+  lluv_error_create(L, LLUV_ERR_UV, (uv_errno_t)err, NULL);
+
+  /* not parsed data */
+  if(ext->fend > ext->fbegin)
+    lua_pushlstring(L, ext->fbase + ext->fbegin, ext->fend - ext->fbegin);
+  else
+    lua_pushnil(L);
+
+  lluv_stream_release_framer(L, handle);
+  lluv_handle_unlock(L, handle, LLUV_LOCK_READ);
+
+  lluv_stream_framed_call(L, handle, deferred);
+}
+
+static void lluv_stream_framed_dispatch(lua_State *L, lluv_handle_t *handle, lluv_stream_ext_t *ext, int deferred){
+  const char *frame; size_t len;
+  int ret, n = 0, self;
+
+  lluv_handle_pushself(L, handle);
+  self = lua_gettop(L);
+
+  while((ret = lluv_stream_frame_next(ext, &frame, &len)) > 0){
+    if(!(ext->fmulti && n)){
+      lua_rawgeti(L, LLUV_LUA_REGISTRY, LLUV_READ_CB(handle));
+      lua_pushvalue(L, self);
+      lua_pushnil(L);
+      if(ext->fmulti) lua_newtable(L);
+    }
+
+    if(ext->fmulti){
+      lua_pushlstring(L, frame, len);
+      lua_rawseti(L, -2, ++n);
+      continue;
+    }
+
+    lua_pushlstring(L, frame, len);
+
+    if(lluv_stream_framed_call(L, handle, deferred) || !lluv_stream_framed_active(handle, ext)){
+      lua_settop(L, self - 1);
+      return;
+    }
+  }
+
+  if(n){
+    if(lluv_stream_framed_call(L, handle, deferred) || !lluv_stream_framed_active(handle, ext)){
+      lua_settop(L, self - 1);
+      return;
+    }
+  }
+
+  if(ret < 0) lluv_stream_framed_error(L, handle, ext, ret, deferred);
+
+  lua_settop(L, self - 1);
+}
+
+static void lluv_on_stream_read_framed_cb(uv_stream_t* arg, ssize_t nread, const uv_buf_t* buf){
+  lluv_handle_t     *handle = lluv_handle_byptr((uv_handle_t*)arg);
+  lluv_stream_ext_t *ext    = (lluv_stream_ext_t*)handle->ext;
+  lua_State *L = LLUV_HCALLBACK_L(handle);
+
+  UNUSED_ARG(buf);
+
+  LLUV_CHECK_LOOP_CB_INVARIANT(L);
+
+  if(!IS_(handle, OPEN)) return;
+
+  if(nread == 0) return;
+
+  if(nread < 0){
+    lluv_stream_framed_error(L, handle, ext, (int)nread, 0);
+  }
+  else{
+    assert(buf->base == ext->fbase + ext->fend);
+    ext->fend += nread;
+    lluv_stream_framed_dispatch(L, handle, ext, 0);
+  }
+
+  LLUV_CHECK_LOOP_CB_INVARIANT(L);
+}
+
+/* deliver frames which was received before stop_read */
+static int lluv_stream_framed_resume(lua_State *L){
+  lluv_handle_t     *handle = lluv_check_stream(L, 1, 0);
+  lluv_stream_ext_t *ext    = (lluv_stream_ext_t*)handle->ext;
+
+  if(ext && lluv_stream_framed_active(handle, ext)){
+    lluv_stream_framed_dispatch(L, handle, ext, 1);
+  }
+
+  return 0;
+}
+
+static int lluv_stream_start_read_framed(lua_State *L){
+  static const lluv_uv_const_t MODES[] = {
+    { LLUV_FRAME_LINE,      "line"      },
+    { LLUV_FRAME_DELIMITER, "delimiter" },
+    { LLUV_FRAME_U16BE,     "u16be"     },
+    { LLUV_FRAME_U32LE,     "u32le"     },
+
+    { 0, NULL }
+  };
+
+  lluv_handle_t     *handle = lluv_check_stream(L, 1, LLUV_FLAG_OPEN);
+  lluv_stream_ext_t *ext;
+  int mode, multi = 0, cb, err;
+  int64_t max = LLUV_FRAME_MAX;
+
+  lluv_check_args_with_cb(L, 3);
+  cb = lua_gettop(L);
+
+  if(lua_istable(L, 2)){
+    lua_getfield(L, 2, "mode");
+    mode = (int)lluv_opt_named_const(L, -1, LLUV_FRAME_LINE, MODES);
+    lua_pop(L, 1);
+
+    lua_getfield(L, 2, "max");
+    if(!lua_isnil(L, -1)) max = lutil_checkint64(L, -1);
+    lua_pop(L, 1);
+
+    lua_getfield(L, 2, "multi");
+    multi = lua_toboolean(L, -1);
+    lua_pop(L, 1);
+
+    lua_getfield(L, 2, "delimiter");
+  }
+  else{
+    mode = (int)lluv_opt_named_const(L, 2, LLUV_FRAME_LINE, MODES);
+    lua_pushnil(L);
+  }
+                                                   /* self, opt, cb, delimiter */
+  luaL_argcheck(L, (mode >= LLUV_FRAME_LINE) && (mode <= LLUV_FRAME_U32LE), 2, LLUV_PREFIX" invalid frame mode");
+  luaL_argcheck(L, max > 0, 2, LLUV_PREFIX" invalid max frame size");
+
+  if(mode == LLUV_FRAME_LINE){
+    lua_pop(L, 1);
+    lua_pushliteral(L, "\n");
+  }
+  else if(mode == LLUV_FRAME_DELIMITER){
+    luaL_argcheck(L, (lua_type(L, -1) == LUA_TSTRING) && lua_rawlen(L, -1), 2, LLUV_PREFIX" delimiter expected");
+  }
+
+  ext = lluv_stream_ext(L, handle);
+  if(!ext){
+    return lluv_fail(L, handle->flags, LLUV_ERR_UV, UV_ENOMEM, NULL);
+  }
+
+  /* If framed read is active (e.g. mode switched from read callback)
+  ** only framer and callback are replaced. Otherwise libuv callbacks of
+  ** active read have to be replaced and libuv does not allow it without
+  ** stop (UV_EALREADY).
+  */
+  if(!(ext->freading && (LLUV_READ_CB(handle) != LUA_NOREF))){
+    uv_read_stop(LLUV_H(handle, uv_stream_t));
+
+    err = uv_read_start(LLUV_H(handle, uv_stream_t), lluv_alloc_read_framed_cb, lluv_on_stream_read_framed_cb);
+    if(err < 0){
+      lluv_stream_read_stopped(L, handle);
+      lua_settop(L, cb);
+      return lluv_stream_read_start_error(L, handle, err);
+    }
+  }
+
+  lluv_stream_release_read_buffer(L, handle);
+
+  /* data received before stop_read is preserved */
+  luaL_unref(L, LLUV_LUA_REGISTRY, ext->fdelim_ref);
+  ext->fdelim_ref = LUA_NOREF;
+  ext->fdelim     = NULL;
+  ext->fdelim_len = 0;
+  if(!lua_isnil(L, -1)){
+    ext->fdelim     = lua_tolstring(L, -1, &ext->fdelim_len);
+    ext->fdelim_ref = luaL_ref(L, LLUV_LUA_REGISTRY);
+  }
+  else lua_pop(L, 1);
+
+  ext->fmode    = mode;
+  ext->fmulti   = multi;
+  ext->fmax     = (size_t)max;
+  ext->fscan    = ext->fbegin;
+
+  luaL_unref(L, LLUV_LUA_REGISTRY, LLUV_READ_CB(handle));
+  LLUV_READ_CB(handle) = luaL_ref(L, LLUV_LUA_REGISTRY);
+
+  lluv_handle_lock(L, handle, LLUV_LOCK_READ);
+  ext->freading = 1;
+
+  if(ext->fend > ext->fbegin){
+    lua_pushvalue(L, LLUV_LUA_REGISTRY);
+    lua_pushvalue(L, LLUV_LUA_HANDLES);
+    lua_pushcclosure(L, lluv_stream_framed_resume, 2);
+    lua_pushvalue(L, 1);
+    lluv_loop_defer_call(L, lluv_loop_by_handle(&handle->handle), 1);
   }
 
   lua_settop(L, 1);
@@ -325,20 +1037,143 @@ static int lluv_stream_stop_read(lua_State *L){
 
 //{ Write
 
+static size_t lluv_stream_bufs_count(lua_State *L, int idx){
+  if(lua_type(L, idx) == LUA_TTABLE) return lua_rawlen(L, idx);
+  return 1;
+}
+
+static uv_buf_t lluv_stream_check_buf(lua_State *L, int idx, int allow_fbuf){
+  size_t len; const char *str;
+
+  if(allow_fbuf){
+    lluv_fixed_buffer_t *buffer = lluv_opt_fbuf(L, idx);
+    if(buffer) return lluv_buf_init(buffer->data, buffer->capacity);
+  }
+
+  str = luaL_checklstring(L, idx, &len);
+  return lluv_buf_init((char*)str, len);
+}
+
+/* string or array of strings. Fixed buffers allowed only for sync calls
+ * because there no way to pin them for async request.
+ */
+static void lluv_stream_check_bufs(lua_State *L, int idx, uv_buf_t *buf, size_t n, int allow_fbuf){
+  size_t i;
+
+  if(lua_type(L, idx) != LUA_TTABLE){
+    buf[0] = lluv_stream_check_buf(L, idx, allow_fbuf);
+    return;
+  }
+
+  for(i = 0; i < n; ++i){
+    lua_rawgeti(L, idx, i + 1);
+    buf[i] = lluv_stream_check_buf(L, -1, allow_fbuf);
+    lua_pop(L, 1);
+  }
+}
+
+/* skip `written` bytes. Returns index of first buffer with unsent data */
+static size_t lluv_stream_bufs_skip(uv_buf_t *buf, size_t n, size_t written){
+  size_t i;
+
+  for(i = 0; i < n; ++i){
+    if(written < buf[i].len){
+      buf[i].base += written;
+      buf[i].len  -= written;
+      break;
+    }
+    written -= buf[i].len;
+  }
+
+  return i;
+}
+
 static int lluv_stream_try_write(lua_State *L){
   lluv_handle_t *handle = lluv_check_stream(L, 1, LLUV_FLAG_OPEN);
-  size_t len; const char *str = luaL_checklstring(L, 2, &len);
-  int err; uv_buf_t buf = lluv_buf_init((char*)str, len);
+  size_t i, written, n = lluv_stream_bufs_count(L, 2);
+  uv_buf_t *buf; int err;
+
+  luaL_argcheck(L, n > 0, 2, "Empty array not supported");
 
   lluv_check_none(L, 3);
 
-  err = uv_try_write(LLUV_H(handle, uv_stream_t), &buf, 1);
+  buf = (uv_buf_t*)lluv_alloca(sizeof(uv_buf_t) * n);
+  if(!buf){
+    return lluv_fail(L, handle->flags, LLUV_ERR_UV, UV_ENOMEM, NULL);
+  }
+
+  lluv_stream_check_bufs(L, 2, buf, n, 1);
+
+  err = lluv_stream_cork_sync(L, handle);
+  if(err < 0){
+    return lluv_fail(L, handle->flags, LLUV_ERR_UV, err, NULL);
+  }
+
+  err = uv_try_write(LLUV_H(handle, uv_stream_t), buf, n);
   if(err < 0){
     return lluv_fail(L, handle->flags, LLUV_ERR_UV, err, NULL);
   }
 
   lua_pushinteger(L, err);
-  return 1;
+
+  if(lua_type(L, 2) != LUA_TTABLE) return 1;
+
+  /* position of remainder. index of element and number of sent bytes in it */
+  written = (size_t)err;
+  for(i = 0; i < n; ++i){
+    if(written < buf[i].len) break;
+    written -= buf[i].len;
+  }
+
+  if(i == n) return 1;
+
+  lua_pushinteger(L, i + 1);
+  lutil_pushint64(L, written);
+  return 3;
+}
+
+/* call after write request done to arm drain event*/
+static void lluv_stream_drain_arm(lluv_handle_t *handle){
+  lluv_stream_ext_t *ext = (lluv_stream_ext_t*)handle->ext;
+
+  if(ext && (ext->drain_cb != LUA_NOREF)){
+    if(lluv_stream_write_queue_size(handle) > ext->drain_low)
+      ext->drain_armed = 1;
+  }
+}
+
+/* call after write request done to proceed drain event */
+static void lluv_stream_drain_check(lua_State *L, lluv_handle_t *handle){
+  lluv_stream_ext_t *ext = (lluv_stream_ext_t*)handle->ext;
+
+  if(!(ext && ext->drain_armed)) return;
+
+  if(lluv_stream_write_queue_size(handle) > ext->drain_low) return;
+
+  ext->drain_armed = 0;
+
+  lua_rawgeti(L, LLUV_LUA_REGISTRY, ext->drain_cb);
+  lluv_handle_pushself(L, handle);
+
+  LLUV_HANDLE_CALL_CB_EX(L, handle, 1, LLUV_CB_WRITE);
+}
+
+/* report first error of write without callback to drain callback */
+static void lluv_stream_drain_error(lua_State *L, lluv_handle_t *handle, int status){
+  lluv_stream_ext_t *ext = (lluv_stream_ext_t*)handle->ext;
+
+  if(!(ext && (ext->drain_cb != LUA_NOREF))) return;
+
+  if(ext->drain_err) return;
+
+  ext->drain_err   = 1;
+  ext->drain_armed = 0;
+
+  lua_rawgeti(L, LLUV_LUA_REGISTRY, ext->drain_cb);
+  lluv_handle_pushself(L, handle);
+  lluv_error_create(L, LLUV_ERR_UV, (uv_errno_t)status, NULL);
+
+  LLUV_HANDLE_CALL_CB_EX(L, handle, 2, LLUV_CB_WRITE);
 }
 
 static void lluv_on_stream_write_cb(uv_write_t* arg, int status){
@@ -362,79 +1197,371 @@ static void lluv_on_stream_write_cb(uv_write_t* arg, int status){
 
   if(lua_isnil(L, -3)){
     lua_pop(L, 3);
+  }
+  else{
+    lluv_push_status(L, status);
+    lua_insert(L, -2);
 
-    LLUV_CHECK_LOOP_CB_INVARIANT(L);
-    return;
+    LLUV_HANDLE_CALL_CB_EX(L, handle, 3, LLUV_CB_WRITE);
   }
 
-  lluv_push_status(L, status);
-  lua_insert(L, -2);
+  if(IS_(handle, OPEN)) lluv_stream_drain_check(L, handle);
+
+  LLUV_CHECK_LOOP_CB_INVARIANT(L);
+}
+
+/* write without callback. Completion only release payload */
+static void lluv_on_stream_write_nocb_cb(uv_write_t* arg, int status){
+  lluv_req_t    *req    = lluv_req_byptr((uv_req_t*)arg);
+  lluv_handle_t *handle = req->handle;
+  lua_State     *L      = LLUV_HCALLBACK_L(handle);
+
+  LLUV_CHECK_LOOP_CB_INVARIANT(L);
 
-  LLUV_HANDLE_CALL_CB(L, handle, 3);
+  if(IS_(handle, OPEN) && handle->ext){
+    lluv_handle_pushself(L, handle);
+    lluv_req_free(L, req);
+    if(status < 0) lluv_stream_drain_error(L, handle, status);
+    if(IS_(handle, OPEN)) lluv_stream_drain_check(L, handle);
+    lua_pop(L, 1);
+  }
+  else{
+    lluv_req_free(L, req);
+  }
 
   LLUV_CHECK_LOOP_CB_INVARIANT(L);
 }
 
+//{ Cork
+
+/* Corked stream collects callback-less writes and sends them as one
+ * uv_write request. In `auto` mode stream added to loop->corked list
+ * and flushed by loop hook in prepare/check phase of same iteration.
+ */
+
+static int lluv_stream_cork_append(lua_State *L, lluv_stream_ext_t *ext, int idx, const uv_buf_t *buf, size_t n){
+  size_t i;
+
+  if(ext->cork_n + n > ext->cork_cap){
+    size_t cap = ext->cork_cap ? ext->cork_cap : 16;
+    uv_buf_t *bufs;
+
+    while(cap < ext->cork_n + n) cap *= 2;
+
+    bufs = (uv_buf_t*)lluv_alloc(L, sizeof(uv_buf_t) * cap);
+    if(!bufs) return UV_ENOMEM;
+
+    if(ext->cork_n) memcpy(bufs, ext->cork_bufs, sizeof(uv_buf_t) * ext->cork_n);
+    lluv_free(L, ext->cork_bufs);
+    ext->cork_bufs = bufs;
+    ext->cork_cap  = cap;
+  }
+
+  if(ext->cork_ref == LUA_NOREF){
+    lua_newtable(L);
+    ext->cork_ref = luaL_ref(L, LLUV_LUA_REGISTRY);
+  }
+
+  lua_rawgeti(L, LLUV_LUA_REGISTRY, ext->cork_ref);
+  lua_pushvalue(L, idx);
+  lua_rawseti(L, -2, ++ext->cork_nref);
+  lua_pop(L, 1);
+
+  for(i = 0; i < n; ++i){
+    ext->cork_bufs[ext->cork_n++] = buf[i];
+    ext->cork_size += buf[i].len;
+  }
+
+  return 0;
+}
+
+/* push table with pending payload and reset pending state.
+ * Buffers stay valid in `cork_bufs` until next append.
+ */
+static size_t lluv_stream_cork_detach(lua_State *L, lluv_stream_ext_t *ext){
+  size_t n = ext->cork_n;
+
+  lua_rawgeti(L, LLUV_LUA_REGISTRY, ext->cork_ref);
+  luaL_unref(L, LLUV_LUA_REGISTRY, ext->cork_ref);
+  ext->cork_ref  = LUA_NOREF;
+  ext->cork_nref = 0;
+  ext->cork_n    = 0;
+  ext->cork_size = 0;
+
+  return n;
+}
+
+static int lluv_stream_cork_flush(lua_State *L, lluv_handle_t *handle, lluv_stream_ext_t *ext){
+  lluv_req_t *req; size_t n; int err;
+
+  if(!ext->cork_n) return 0;
+
+  lua_pushnil(L);
+  req = lluv_req_new(L, UV_WRITE, handle);
+  n = lluv_stream_cork_detach(L, ext);
+  lluv_req_ref(L, req);
+
+  err = uv_write(LLUV_R(req, write), LLUV_H(handle, uv_stream_t), ext->cork_bufs, n, lluv_on_stream_write_nocb_cb);
+  if(err < 0){
+    lluv_req_free(L, req);
+    return err;
+  }
+
+  lluv_stream_drain_arm(handle);
+  return 0;
+}
+
+/* send pending data before any other write or shutdown */
+LLUV_INTERNAL int lluv_stream_cork_sync(lua_State *L, lluv_handle_t *handle){
+  lluv_stream_ext_t *ext = (lluv_stream_ext_t*)handle->ext;
+  if(!(ext && ext->cork_n)) return 0;
+  return lluv_stream_cork_flush(L, handle, ext);
+}
+
+static int lluv_stream_cork_enqueue(lua_State *L, lluv_handle_t *handle, lluv_stream_ext_t *ext){
+  lluv_loop_t *loop = lluv_loop_by_handle(&handle->handle);
+  int err = lluv_loop_hook_start(L, loop, LLUV_LOOP_HOOK_FLUSH);
+  if(err < 0) return err;
+
+  ext->cork_next   = loop->corked;
+  ext->cork_queued = 1;
+  loop->corked     = handle;
+
+  lluv_handle_lock(L, handle, LLUV_LOCK_CORK);
+  return 0;
+}
+
+/* `handle->ext` may be already detached so use `ext` */
+static void lluv_stream_cork_unlink(lua_State *L, lluv_handle_t *handle, lluv_stream_ext_t *ext){
+  lluv_loop_t *loop = lluv_loop_by_handle(&handle->handle);
+  lluv_handle_t **p = &loop->corked;
+
+  while(*p != handle){
+    assert(*p);
+    p = &((lluv_stream_ext_t*)(*p)->ext)->cork_next;
+  }
+
+  *p = ext->cork_next;
+  ext->cork_next   = NULL;
+  ext->cork_queued = 0;
+
+  if(!loop->corked) lluv_loop_hook_stop(loop, LLUV_LOOP_HOOK_FLUSH);
+
+  lluv_handle_unlock(L, handle, LLUV_LOCK_CORK);
+}
+
+LLUV_INTERNAL void lluv_stream_flush_corked(lua_State *L, lluv_loop_t *loop){
+  while(loop->corked){
+    lluv_handle_t     *handle = loop->corked;
+    lluv_stream_ext_t *ext    = (lluv_stream_ext_t*)handle->ext;
+
+    loop->corked     = ext->cork_next;
+    ext->cork_next   = NULL;
+    ext->cork_queued = 0;
+
+    /* there no one to report error to.
+     * Failed stream also fails on next read or write.
+     */
+    if(!uv_is_closing(LLUV_H(handle, uv_handle_t))){
+      lluv_stream_cork_flush(L, handle, ext);
+    }
+
+    lluv_handle_unlock(L, handle, LLUV_LOCK_CORK);
+  }
+
+  lluv_loop_hook_stop(loop, LLUV_LOOP_HOOK_FLUSH);
+}
+
+static int lluv_stream_cork_write(lua_State *L, lluv_handle_t *handle, lluv_stream_ext_t *ext, uv_buf_t *buf, size_t n){
+  int err = lluv_stream_cork_append(L, ext, 2, buf, n);
+
+  if(err >= 0){
+    if(ext->cork_size >= LLUV_STREAM_CORK_HIGH){
+      err = lluv_stream_cork_flush(L, handle, ext);
+    }
+    else if((ext->cork == LLUV_STREAM_CORK_AUTO) && !ext->cork_queued){
+      err = lluv_stream_cork_enqueue(L, handle, ext);
+    }
+  }
+
+  if(err < 0){
+    return lluv_fail(L, handle->flags, LLUV_ERR_UV, err, NULL);
+  }
+
+  lua_settop(L, 1);
+  return 1;
+}
+
+static int lluv_stream_cork(lua_State *L){
+  static const lluv_uv_const_t FLAGS[] = {
+    { LLUV_STREAM_CORK_MANUAL, "manual" },
+    { LLUV_STREAM_CORK_AUTO,   "auto"   },
+
+    { 0, NULL }
+  };
+
+  lluv_handle_t *handle = lluv_check_stream(L, 1, LLUV_FLAG_OPEN);
+  int mode = (int)lluv_opt_named_const(L, 2, LLUV_STREAM_CORK_MANUAL, FLAGS);
+  lluv_stream_ext_t *ext;
+
+  luaL_argcheck(L, (mode == LLUV_STREAM_CORK_MANUAL) || (mode == LLUV_STREAM_CORK_AUTO), 2,
+    LLUV_PREFIX" invalid cork mode");
+
+  ext = lluv_stream_ext(L, handle);
+  if(!ext){
+    return lluv_fail(L, handle->flags, LLUV_ERR_UV, UV_ENOMEM, NULL);
+  }
+
+  ext->cork = mode;
+
+  if(mode == LLUV_STREAM_CORK_AUTO){
+    if(ext->cork_n && !ext->cork_queued){
+      int err = lluv_stream_cork_enqueue(L, handle, ext);
+      if(err < 0){
+        return lluv_fail(L, handle->flags, LLUV_ERR_UV, err, NULL);
+      }
+    }
+  }
+  else if(ext->cork_queued){
+    lluv_stream_cork_unlink(L, handle, ext);
+  }
+
+  lua_settop(L, 1);
+  return 1;
+}
+
+static int lluv_stream_uncork(lua_State *L){
+  lluv_handle_t *handle = lluv_check_stream(L, 1, LLUV_FLAG_OPEN);
+  lluv_stream_ext_t *ext = (lluv_stream_ext_t*)handle->ext;
+  int err;
+
+  lua_settop(L, 1);
+
+  if(!(ext && ext->cork)) return 1;
+
+  ext->cork = LLUV_STREAM_CORK_NONE;
+  if(ext->cork_queued) lluv_stream_cork_unlink(L, handle, ext);
+
+  err = lluv_stream_cork_flush(L, handle, ext);
+  if(err < 0){
+    return lluv_fail(L, handle->flags, LLUV_ERR_UV, err, NULL);
+  }
+
+  return 1;
+}
+
+//}
+
 static int lluv_stream_write_(lua_State *L, lluv_handle_t *handle, uv_buf_t *buf, size_t n){
+  lluv_stream_ext_t *ext = (lluv_stream_ext_t*)handle->ext;
   int err; lluv_req_t *req;
+  uv_write_cb cb = lluv_on_stream_write_cb;
+
+  /* check arguments before pending corked data detached */
+  if(lua_gettop(L) == 4) lluv_check_callable(L, 3);
+  else if(lua_gettop(L) != 2) lluv_check_args_with_cb(L, 3);
+
+  if(ext && ext->cork){
+    if(lua_gettop(L) == 2){
+      return lluv_stream_cork_write(L, handle, ext, buf, n);
+    }
+
+    if(ext->cork_n){ /* send pending data with this request to preserve order */
+      err = lluv_stream_cork_append(L, ext, 2, buf, n);
+      if(err < 0){
+        return lluv_fail(L, handle->flags, LLUV_ERR_UV, err, NULL);
+      }
+
+      n = lluv_stream_cork_detach(L, ext);
+      lua_replace(L, 2);
+      buf = ext->cork_bufs;
+    }
+  }
 
   if(lua_gettop(L) == 4){
-    int ctx;
-    lluv_check_callable(L, -2);
-    ctx = luaL_ref(L, LLUV_LUA_REGISTRY);
+    int ctx = luaL_ref(L, LLUV_LUA_REGISTRY);
     req = lluv_req_new(L, UV_WRITE, handle);
     lluv_req_ref(L, req); /* string/table */
     req->ctx = ctx;
   }
   else{
-    if(lua_gettop(L) == 2)
+    if(lua_gettop(L) == 2){
       lua_settop(L, 3);
-    else
-      lluv_check_args_with_cb(L, 3);
+      cb = lluv_on_stream_write_nocb_cb;
+    }
 
     req = lluv_req_new(L, UV_WRITE, handle);
     lluv_req_ref(L, req); /* string/table */
   }
 
-  err = uv_write(LLUV_R(req, write), LLUV_H(handle, uv_stream_t), buf, n, lluv_on_stream_write_cb);
+  err = uv_write(LLUV_R(req, write), LLUV_H(handle, uv_stream_t), buf, n, cb);
+  if(err >= 0) lluv_stream_drain_arm(handle);
 
   return lluv_return_req(L, handle, req, err);
 }
 
-static int lluv_stream_write_t(lua_State *L, lluv_handle_t  *handle){
-  int i, n = lua_rawlen(L, 2);
+static int lluv_stream_write(lua_State *L){
+  lluv_handle_t *handle = lluv_check_stream(L, 1, LLUV_FLAG_OPEN);
+  size_t n = lluv_stream_bufs_count(L, 2);
   uv_buf_t *buf;
-  
-  assert(lua_type(L, 2) == LUA_TTABLE);
 
   luaL_argcheck(L, n > 0, 2, "Empty array not supported");
-  
+
   buf = (uv_buf_t*)lluv_alloca(sizeof(uv_buf_t) * n);
   if(!buf){
-    return lluv_fail(L, handle->flags, LLUV_ERR_UV, ENOMEM, NULL); 
+    return lluv_fail(L, handle->flags, LLUV_ERR_UV, UV_ENOMEM, NULL);
   }
 
-  for(i = 0; i < n; ++i){
-    size_t len; const char *str;
-    lua_rawgeti(L, 2, i + 1);
-    str = luaL_checklstring(L, -1, &len);
-    buf[i] = lluv_buf_init((char*)str, len);
-    lua_pop(L, 1);
-  }
+  lluv_stream_check_bufs(L, 2, buf, n, 0);
 
   return lluv_stream_write_(L, handle, buf, n);
 }
 
-static int lluv_stream_write(lua_State *L){
-  lluv_handle_t  *handle = lluv_check_stream(L, 1, LLUV_FLAG_OPEN);
-  if(lua_type(L, 2) == LUA_TTABLE){
-    return lluv_stream_write_t(L, handle);
+/* try write data immediately and queue only unsent tail */
+static int lluv_stream_write_fast(lua_State *L){
+  lluv_handle_t *handle = lluv_check_stream(L, 1, LLUV_FLAG_OPEN);
+  lluv_stream_ext_t *ext = (lluv_stream_ext_t*)handle->ext;
+  size_t i, n = lluv_stream_bufs_count(L, 2);
+  uv_buf_t *buf; int err;
+
+  luaL_argcheck(L, n > 0, 2, "Empty array not supported");
+
+  if(lua_gettop(L) > 2) lluv_check_callable(L, 3);
+  lluv_check_none(L, 5);
+
+  buf = (uv_buf_t*)lluv_alloca(sizeof(uv_buf_t) * n);
+  if(!buf){
+    return lluv_fail(L, handle->flags, LLUV_ERR_UV, UV_ENOMEM, NULL);
   }
-  else{
-    size_t len; const char *str = luaL_checklstring(L, 2, &len);
-    uv_buf_t buf = lluv_buf_init((char*)str, len);
-    return lluv_stream_write_(L, handle, &buf, 1);
+
+  lluv_stream_check_bufs(L, 2, buf, n, 0);
+
+  if(ext && ext->cork){
+    return lluv_stream_write_(L, handle, buf, n);
+  }
+
+  /* on any error (e.g. EAGAIN) just queue all data.
+   * uv_write reports real error if any.
+   */
+  err = uv_try_write(LLUV_H(handle, uv_stream_t), buf, n);
+  if(err < 0) err = 0;
+
+  i = lluv_stream_bufs_skip(buf, n, (size_t)err);
+  if(i < n){
+    return lluv_stream_write_(L, handle, &buf[i], n - i);
   }
+
+  if(lua_gettop(L) > 2){ /* all data sent so just call callback */
+    lua_settop(L, 4);
+    lua_pushvalue(L, 3);
+    lua_pushvalue(L, 1);
+    lua_pushnil(L);
+    lua_pushvalue(L, 4);
+    lluv_loop_defer_call(L, lluv_loop_by_handle(&handle->handle), 3);
+  }
+
+  lua_settop(L, 1);
+  return 1;
 }
 
 static int lluv_stream_write2(lua_State *L){
@@ -456,16 +1583,61 @@ static int lluv_stream_write2(lua_State *L){
   else
     lluv_check_args_with_cb(L, 4);
 
+  err = lluv_stream_cork_sync(L, handle);
+  if(err < 0){
+    return lluv_fail(L, handle->flags, LLUV_ERR_UV, err, NULL);
+  }
+
   req = lluv_req_new(L, UV_WRITE, handle);
   lluv_req_ref(L, req); /* string */
 
   err = uv_write2(LLUV_R(req, write), LLUV_H(handle, uv_stream_t), &buf, 1, LLUV_H(src, uv_stream_t), lluv_on_stream_write_cb);
+  if(err >= 0) lluv_stream_drain_arm(handle);
 
   return lluv_return_req(L, handle, req, err);
 }
 
 //}
 
+static int lluv_stream_on_drain(lua_State *L){
+  lluv_handle_t *handle = lluv_check_stream(L, 1, LLUV_FLAG_OPEN);
+  int64_t low = luaL_opt(L, lutil_checkint64, 3, 0);
+  lluv_stream_ext_t *ext;
+
+  luaL_argcheck(L, low >= 0, 3, LLUV_PREFIX" invalid watermark");
+
+  lua_settop(L, 2);
+
+  if(lua_isnil(L, 2)){
+    ext = (lluv_stream_ext_t*)handle->ext;
+    if(ext){
+      luaL_unref(L, LLUV_LUA_REGISTRY, ext->drain_cb);
+      ext->drain_cb    = LUA_NOREF;
+      ext->drain_armed = 0;
+    }
+    lua_settop(L, 1);
+    return 1;
+  }
+
+  lluv_check_callable(L, 2);
+
+  ext = lluv_stream_ext(L, handle);
+  if(!ext){
+    return lluv_fail(L, handle->flags, LLUV_ERR_UV, UV_ENOMEM, NULL);
+  }
+
+  luaL_unref(L, LLUV_LUA_REGISTRY, ext->drain_cb);
+  ext->drain_cb  = luaL_ref(L, LLUV_LUA_REGISTRY);
+  ext->drain_low = (size_t)low;
+  ext->drain_err = 0;
+
+  /* there may be already pending data */
+  ext->drain_armed = (lluv_stream_write_queue_size(handle) > ext->drain_low) ? 1 : 0;
+
+  lua_settop(L, 1);
+  return 1;
+}
+
 static int lluv_stream_is_readable(lua_State *L){
   lluv_handle_t *handle = lluv_check_stream(L, 1, LLUV_FLAG_OPEN);
   lua_settop(L, 1);
@@ -497,17 +1669,10 @@ static int lluv_stream_set_blocking(lua_State *L){
 
 static int lluv_stream_get_write_queue_size(lua_State *L){
   lluv_handle_t *handle = lluv_check_stream(L, 1, LLUV_FLAG_OPEN);
-  size_t queue_size;
 
   lua_settop(L, 1);
 
-#if LLUV_UV_VER_GE(1,19,0)
-  queue_size = uv_stream_get_write_queue_size(LLUV_H(handle, uv_stream_t));
-#else
-  queue_size = LLUV_H(handle, uv_stream_t)->write_queue_size;
-#endif
-
-  lutil_pushint64(L, queue_size);
+  lutil_pushint64(L, lluv_stream_write_queue_size(handle));
 
   return 1;
 }
@@ -520,9 +1685,16 @@ static const struct luaL_Reg lluv_stream_methods[] = {
   { "accept",               lluv_stream_accept                },
   { "start_read",           lluv_stream_start_read            },
   { "stop_read",            lluv_stream_stop_read             },
+  { "consume",              lluv_stream_consume               },
+  { "start_read_into",      lluv_stream_start_read_into       },
+  { "start_read_framed",    lluv_stream_start_read_framed     },
   { "try_write",            lluv_stream_try_write             },
   { "write",                lluv_stream_write                 },
   { "write2",               lluv_stream_write2                },
+  { "write_fast",           lluv_stream_write_fast            },
+  { "on_drain",             lluv_stream_on_drain              },
+  { "cork",                 lluv_stream_cork                  },
+  { "uncork",               lluv_stream_uncork                },
   { "readable",             lluv_stream_is_readable           },
   { "writable",             lluv_stream_is_writable           },
   { "set_blocking",         lluv_stream_set_blocking          },
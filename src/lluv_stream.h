@@ -23,4 +23,9 @@ LLUV_INTERNAL void lluv_on_stream_connect_cb(uv_connect_t* arg, int status);
 
 LLUV_INTERNAL void lluv_on_stream_req_cb(uv_req_t* arg, int status);
 
+LLUV_INTERNAL void lluv_stream_flush_corked(lua_State *L, lluv_loop_t *loop);
+
+/* pass pending corked data to libuv */
+LLUV_INTERNAL int lluv_stream_cork_sync(lua_State *L, lluv_handle_t *handle);
+
 #endif
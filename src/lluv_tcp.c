@@ -15,6 +15,7 @@
 #include "lluv_loop.h"
 #include "lluv_error.h"
 #include "lluv_req.h"
+#include "lluv_sockaddr.h"
 #include <assert.h>
 
 #define LLUV_TCP_NAME LLUV_PREFIX" tcp"
@@ -58,10 +59,13 @@ static lluv_handle_t* lluv_check_tcp(lua_State *L, int idx, lluv_flags_t flags){
   return handle;
 }
 
+// connect(host, port, cb)
+// connect(sockaddr, cb)
 static int lluv_tcp_connect(lua_State *L){
   lluv_handle_t  *handle = lluv_check_tcp(L, 1, LLUV_FLAG_OPEN);
+  const struct sockaddr_storage *psa = lluv_opt_sockaddr(L, 2);
   struct sockaddr_storage sa; lluv_req_t *req;
-  int err = lluv_check_addr(L, 2, &sa);
+  int err = psa ? 0 : lluv_check_addr(L, 2, &sa);
 
   if(err < 0){
     lua_settop(L, 3);
@@ -69,11 +73,11 @@ static int lluv_tcp_connect(lua_State *L){
     return lluv_fail(L, handle->flags, LLUV_ERR_UV, err, lua_tostring(L, -1));
   }
 
-  lluv_check_args_with_cb(L, 4);
+  lluv_check_args_with_cb(L, psa ? 3 : 4);
 
   req = lluv_req_new(L, UV_CONNECT, handle);
 
-  err = uv_tcp_connect(LLUV_R(req, connect), LLUV_H(handle, uv_tcp_t), (struct sockaddr *)&sa, lluv_on_stream_connect_cb);
+  err = uv_tcp_connect(LLUV_R(req, connect), LLUV_H(handle, uv_tcp_t), (const struct sockaddr *)(psa ? psa : &sa), lluv_on_stream_connect_cb);
 
   return lluv_return_req(L, handle, req, err);
 }
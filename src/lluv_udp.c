@@ -15,7 +15,10 @@
 #include "lluv_error.h"
 #include "lluv_req.h"
 #include "lluv_stream.h"
+#include "lluv_fbuf.h"
+#include "lluv_sockaddr.h"
 #include <assert.h>
+#include <string.h>
 
 #define LLUV_UDP_NAME LLUV_PREFIX" udp"
 static const char *LLUV_UDP = LLUV_UDP_NAME;
@@ -30,7 +33,18 @@ LLUV_IMPL_SAFE(lluv_udp_create){
   int err;
 
 #if LLUV_UV_VER_GE(1,7,0)
-  unsigned int flags = lluv_opt_af_flags(L, loop ? 2 : 1, AF_UNSPEC);
+  static const lluv_uv_const_t FLAGS[] = {
+    {AF_UNSPEC,       "unspec"   },
+    {AF_INET,         "inet"     },
+    {AF_INET6,        "inet6"    },
+#if LLUV_UV_VER_GE(1,40,0)
+    {UV_UDP_RECVMMSG, "recvmmsg" },
+#endif
+
+    {0, NULL}
+  };
+
+  unsigned int flags = lluv_opt_flags_ui_2(L, loop ? 2 : 1, AF_UNSPEC, FLAGS);
 #endif
 
   if(!loop) loop = lluv_default_loop(L);
@@ -50,6 +64,147 @@ LLUV_IMPL_SAFE(lluv_udp_create){
   return 1;
 }
 
+//{ UDP extension
+
+/* max size of single datagram */
+#define LLUV_UDP_DGRAM_MAXSIZE 65536
+
+/* max number of messages for one recvmmsg call (same as libuv uses) */
+#ifndef LLUV_UDP_MMSG_MAX
+#  define LLUV_UDP_MMSG_MAX 20
+#endif
+
+typedef struct lluv_udp_ext_tag{
+  lluv_handle_ext_t base;
+
+  /* start_recv_batch */
+  int                  batch;   /* reference to table with current batch */
+  int                  nbatch;  /* number of datagrams in batch */
+  int                  max;     /* max number of datagrams in batch */
+  int                  rbuf;    /* reference to fixed buffer */
+  lluv_fixed_buffer_t *rfbuf;
+  size_t               rpos;
+  char                *mbase;   /* receive buffer */
+  size_t               msize;
+  int                  batch_queued; /* handle is in loop->batched list */
+  lluv_handle_t       *batch_next;
+
+  int                  peer_key; /* pass peer key instead of host name */
+}lluv_udp_ext_t;
+
+/* `handle->ext` may be already detached so use `ext` */
+static void lluv_udp_batch_unlink(lluv_handle_t *handle, lluv_udp_ext_t *ext){
+  lluv_loop_t *loop = lluv_loop_by_handle(&handle->handle);
+  lluv_handle_t **p = &loop->batched;
+
+  if(!ext->batch_queued) return;
+
+  while(*p != handle){
+    assert(*p);
+    p = &((lluv_udp_ext_t*)(*p)->ext)->batch_next;
+  }
+
+  *p = ext->batch_next;
+  ext->batch_next   = NULL;
+  ext->batch_queued = 0;
+
+  if(!loop->batched) lluv_loop_hook_stop(loop, LLUV_LOOP_HOOK_BATCH);
+}
+
+/* Receive memory is not released here because libuv may still iterate
+ * over datagrams from recvmmsg buffer if receiving restarted from callback.
+ */
+static void lluv_udp_release_batch(lua_State *L, lluv_handle_t *handle, lluv_udp_ext_t *ext){
+  lluv_udp_batch_unlink(handle, ext);
+
+  luaL_unref(L, LLUV_LUA_REGISTRY, ext->batch);
+  luaL_unref(L, LLUV_LUA_REGISTRY, ext->rbuf);
+  if(ext->rfbuf) lluv_fbuf_unpin(ext->rfbuf);
+
+  ext->batch  = LUA_NOREF;
+  ext->nbatch = 0;
+  ext->max    = 0;
+  ext->rbuf   = LUA_NOREF;
+  ext->rfbuf  = NULL;
+  ext->rpos   = 0;
+}
+
+static void lluv_udp_ext_free(lua_State *L, lluv_handle_t *handle, lluv_handle_ext_t *arg){
+  lluv_udp_ext_t *ext = (lluv_udp_ext_t*)arg;
+
+  lluv_udp_release_batch(L, handle, ext);
+  lluv_free(L, ext->mbase);
+  lluv_free_t(L, lluv_udp_ext_t, ext);
+}
+
+static int lluv_udp_own_buffer(lluv_handle_t *handle, const char *base){
+  lluv_udp_ext_t *ext = (lluv_udp_ext_t*)handle->ext;
+  return ext && ext->mbase && (base >= ext->mbase) && (base < ext->mbase + ext->msize);
+}
+
+/* release buffer allocated by lluv_alloc_buffer_cb.
+ * Chunks of recvmmsg buffer released with last UV_UDP_MMSG_FREE callback.
+ */
+static void lluv_udp_free_buffer(lluv_handle_t *handle, const uv_buf_t *buf, unsigned flags){
+#if LLUV_UV_VER_GE(1,40,0)
+  if(flags & UV_UDP_MMSG_CHUNK) return;
+#else
+  UNUSED_ARG(flags);
+#endif
+
+  if(lluv_udp_own_buffer(handle, buf->base)) return;
+
+  lluv_free_buffer(&handle->handle, buf);
+}
+
+static lluv_udp_ext_t *lluv_udp_ext(lua_State *L, lluv_handle_t *handle){
+  lluv_udp_ext_t *ext = (lluv_udp_ext_t*)handle->ext;
+  if(ext) return ext;
+
+  ext = lluv_alloc_t(L, lluv_udp_ext_t);
+  if(!ext) return NULL;
+
+  ext->base.free  = lluv_udp_ext_free;
+  ext->base.close = NULL;
+  ext->batch      = LUA_NOREF;
+  ext->nbatch     = 0;
+  ext->max        = 0;
+  ext->rbuf       = LUA_NOREF;
+  ext->rfbuf      = NULL;
+  ext->rpos       = 0;
+  ext->mbase      = NULL;
+  ext->msize      = 0;
+  ext->batch_queued = 0;
+  ext->batch_next   = NULL;
+  ext->peer_key   = 0;
+
+  handle->ext = &ext->base;
+  return ext;
+}
+
+/* push sender address for recv callbacks.
+ * Host names are taken from loop cache so fixed set of peers
+ * does not need formatting for each datagram.
+ */
+static int lluv_udp_push_peer(lua_State *L, lluv_handle_t *handle, const struct sockaddr *addr){
+  lluv_udp_ext_t *ext = (lluv_udp_ext_t*)handle->ext;
+
+  if(!addr) return 0;
+
+  if(ext && ext->peer_key){
+    if(!lluv_push_peer_key(L, addr)) return 0;
+    lua_pushinteger(L, ntohs((addr->sa_family == AF_INET6) ?
+      ((const struct sockaddr_in6*)addr)->sin6_port :
+      ((const struct sockaddr_in *)addr)->sin_port
+    ));
+    return 2;
+  }
+
+  return lluv_addrcache_push_addr(L, &lluv_loop_by_handle(&handle->handle)->addrs, addr);
+}
+
+//}
+
 static lluv_handle_t* lluv_check_udp(lua_State *L, int idx, lluv_flags_t flags){
   lluv_handle_t *handle = lluv_check_handle(L, idx, flags);
   luaL_argcheck (L, LLUV_H(handle, uv_handle_t)->type == UV_UDP, idx, LLUV_UDP_NAME" expected");
@@ -225,6 +380,18 @@ static int lluv_udp_getpeername(lua_State *L) {
 
 //{ Send
 
+/* send(peer, data, ...) where peer is sockaddr object
+ * or peer key from recv callback
+ */
+static int lluv_udp_is_peer(lua_State *L, struct sockaddr_storage *sa){
+  const struct sockaddr_storage *addr = lluv_opt_sockaddr(L, 2);
+  if(addr){
+    memcpy(sa, addr, sizeof(*sa));
+    return 1;
+  }
+  return (lua_type(L, 3) != LUA_TNUMBER) && (lluv_to_peer_key(L, 2, sa) == 0);
+}
+
 static int lluv_udp_try_send(lua_State *L){
   lluv_handle_t *handle = lluv_check_udp(L, 1, LLUV_FLAG_OPEN);
   int top = lua_gettop(L);
@@ -233,9 +400,10 @@ static int lluv_udp_try_send(lua_State *L){
     (top == 2) ? 1 :
 #endif
     0;
-  struct sockaddr_storage sa; int err = is_connected ? 0 : lluv_check_addr(L, 2, &sa);
+  struct sockaddr_storage sa; int is_peer = is_connected ? 0 : lluv_udp_is_peer(L, &sa);
+  int err = (is_connected || is_peer) ? 0 : lluv_check_addr(L, 2, &sa);
   struct sockaddr_storage *psa = is_connected ? 0 : &sa;
-  int data_index = is_connected ? 2 : 4;
+  int data_index = is_connected ? 2 : (is_peer ? 3 : 4);
 
   if (err < 0) {
     lua_settop(L, 3);
@@ -344,6 +512,9 @@ static int lluv_udp_send_t(lua_State *L, lluv_handle_t  *handle, struct sockaddr
 //   send(addr, port, data)
 //   send(addr, port, data, cb)
 //   send(addr, port, data, cb, ctx)
+//   send(peer, data)
+//   send(peer, data, cb)
+//   send(peer, data, cb, ctx)
 static int lluv_udp_send(lua_State *L){
   lluv_handle_t  *handle = lluv_check_udp(L, 1, LLUV_FLAG_OPEN);
   int top = lua_gettop(L);
@@ -352,9 +523,10 @@ static int lluv_udp_send(lua_State *L){
     ((top == 2) || lua_isfunction(L, 3)) ? 1 :
 #endif
     0;
-  struct sockaddr_storage sa; int err = is_connected ? 0 : lluv_check_addr(L, 2, &sa);
+  struct sockaddr_storage sa; int is_peer = is_connected ? 0 : lluv_udp_is_peer(L, &sa);
+  int err = (is_connected || is_peer) ? 0 : lluv_check_addr(L, 2, &sa);
   struct sockaddr_storage *psa = is_connected ? 0 : &sa;
-  int data_index = is_connected ? 2 : 4;
+  int data_index = is_connected ? 2 : (is_peer ? 3 : 4);
 
   if(err < 0){
     int top = lua_gettop(L);
@@ -386,6 +558,299 @@ static int lluv_udp_send(lua_State *L){
   }
 }
 
+/* Batch send.
+ * Messages sent with uv_udp_try_send while socket accept them
+ * and rest queued with uv_udp_send. All queued sends belong to single
+ * batch request so callback called once when last datagram sent.
+ */
+
+typedef struct lluv_udp_send_item_tag{
+  uv_udp_send_t req;
+  unsigned int  idx;
+}lluv_udp_send_item_t;
+
+typedef struct lluv_udp_send_batch_tag{
+  lluv_handle_t        *handle;
+  int                   cb;
+  int                   ctx;
+  int                   arg;     /* messages */
+  int                   errors;  /* message index -> error */
+  unsigned int          pending;
+  lluv_udp_send_item_t  items[1];
+}lluv_udp_send_batch_t;
+
+static void lluv_udp_send_batch_error(lua_State *L, int *errors, unsigned int idx, int err){
+  if(*errors == LUA_NOREF){
+    lua_newtable(L);
+    *errors = luaL_ref(L, LLUV_LUA_REGISTRY);
+  }
+
+  lua_rawgeti(L, LLUV_LUA_REGISTRY, *errors);
+  lluv_error_create(L, LLUV_ERR_UV, (uv_errno_t)err, NULL);
+  lua_rawseti(L, -2, idx + 1);
+  lua_pop(L, 1);
+}
+
+static void lluv_udp_send_batch_free(lua_State *L, lluv_udp_send_batch_t *batch){
+  luaL_unref(L, LLUV_LUA_REGISTRY, batch->cb);
+  luaL_unref(L, LLUV_LUA_REGISTRY, batch->ctx);
+  luaL_unref(L, LLUV_LUA_REGISTRY, batch->arg);
+  luaL_unref(L, LLUV_LUA_REGISTRY, batch->errors);
+  lluv_handle_unlock(L, batch->handle, LLUV_LOCK_REQ);
+  lluv_free(L, batch);
+}
+
+static void lluv_on_udp_send_batch_cb(uv_udp_send_t* arg, int status){
+  lluv_udp_send_item_t  *item   = (lluv_udp_send_item_t*)arg;
+  lluv_udp_send_batch_t *batch  = (lluv_udp_send_batch_t*)arg->data;
+  lluv_handle_t         *handle = batch->handle;
+  lua_State *L = LLUV_HCALLBACK_L(handle);
+
+  LLUV_CHECK_LOOP_CB_INVARIANT(L);
+
+  if((status < 0) && IS_(handle, OPEN)){
+    lluv_udp_send_batch_error(L, &batch->errors, item->idx, status);
+  }
+
+  if(--batch->pending > 0) return;
+
+  if((!IS_(handle, OPEN)) || (batch->cb == LUA_NOREF)){
+    lluv_udp_send_batch_free(L, batch);
+
+    LLUV_CHECK_LOOP_CB_INVARIANT(L);
+    return;
+  }
+
+  lua_rawgeti(L, LLUV_LUA_REGISTRY, batch->cb);
+  lluv_handle_pushself(L, handle);
+  lua_rawgeti(L, LLUV_LUA_REGISTRY, batch->errors);
+  lua_rawgeti(L, LLUV_LUA_REGISTRY, batch->ctx);
+  lluv_udp_send_batch_free(L, batch);
+
+  LLUV_HANDLE_CALL_CB_EX(L, handle, 3, LLUV_CB_WRITE);
+
+  LLUV_CHECK_LOOP_CB_INVARIANT(L);
+}
+
+/* number of buffers in message {peer, data} or {host, port, data} */
+static unsigned int lluv_udp_msg_nbufs(lua_State *L, int i){
+  unsigned int n = 1;
+
+  lua_rawgeti(L, 2, i);
+  luaL_argcheck(L, lua_istable(L, -1), 2, "array of messages expected");
+
+  lua_rawgeti(L, -1, (lua_rawlen(L, -1) > 2) ? 3 : 2);
+  if(lua_istable(L, -1)){
+    n = (unsigned int)lua_rawlen(L, -1);
+    luaL_argcheck(L, n > 0, 2, "Empty array not supported");
+  }
+  else{
+    luaL_argcheck(L, lua_isstring(L, -1), 2, "String or array expected");
+  }
+
+  lua_pop(L, 2);
+  return n;
+}
+
+/* Parse message to address and buffers.
+ * Returns error code for invalid address.
+ */
+static int lluv_udp_msg_parse(lua_State *L, int i, struct sockaddr_storage *sa, uv_buf_t *bufs){
+  int top = lua_gettop(L), entry = top + 1, data, err;
+  size_t len; const char *str;
+
+  lua_rawgeti(L, 2, i);
+
+  if(lua_rawlen(L, entry) > 2){
+    const char *host;
+    lua_rawgeti(L, entry, 1);
+    lua_rawgeti(L, entry, 2);
+    host = lua_tostring(L, -2);
+    err = (host && lua_isnumber(L, -1)) ? lluv_to_addr(L, host, (int)lua_tointeger(L, -1), sa) : UV_EINVAL;
+    data = 3;
+  }
+  else{
+    const struct sockaddr_storage *addr;
+    lua_rawgeti(L, entry, 1);
+    addr = lluv_opt_sockaddr(L, -1);
+    if(addr){
+      memcpy(sa, addr, sizeof(*sa));
+      err = 0;
+    }
+    else{
+      err = lluv_to_peer_key(L, -1, sa);
+    }
+    data = 2;
+  }
+
+  lua_settop(L, entry);
+  lua_rawgeti(L, entry, data);
+
+  if(lua_istable(L, -1)){
+    unsigned int j, n = (unsigned int)lua_rawlen(L, -1);
+    for(j = 0; j < n; ++j){
+      lua_rawgeti(L, -1, j + 1);
+      str = lua_tolstring(L, -1, &len);
+      luaL_argcheck(L, str != NULL, 2, "String expected");
+      bufs[j] = lluv_buf_init((char*)str, len);
+      lua_pop(L, 1);
+    }
+  }
+  else{
+    str = lua_tolstring(L, -1, &len);
+    bufs[0] = lluv_buf_init((char*)str, len);
+  }
+
+  /* strings still referenced by messages table */
+  lua_settop(L, top);
+
+  return err;
+}
+
+// send_batch(messages)
+// send_batch(messages, cb)
+// send_batch(messages, cb, ctx)
+static int lluv_udp_send_batch(lua_State *L){
+  lluv_handle_t *handle = lluv_check_udp(L, 1, LLUV_FLAG_OPEN);
+  uv_udp_t      *udp    = LLUV_H(handle, uv_udp_t);
+  lluv_udp_send_batch_t *batch = NULL;
+  unsigned int i, j, n, total, queued, queue_count;
+  struct sockaddr_storage *addrs;
+  struct sockaddr **paddrs;
+  uv_buf_t *bufs, **pbufs;
+  unsigned int *nbufs;
+  int *status, errors = LUA_NOREF;
+
+  luaL_checktype(L, 2, LUA_TTABLE);
+  if(!lua_isnoneornil(L, 3)) lluv_check_callable(L, 3);
+  lua_settop(L, 4);
+
+  n = (unsigned int)lua_rawlen(L, 2);
+
+  for(total = 0, i = 1; i <= n; ++i){
+    total += lluv_udp_msg_nbufs(L, i);
+  }
+
+  /* temporary arrays. Memory released by GC even if parse raise error */
+  addrs  = (struct sockaddr_storage*)lua_newuserdata(L,
+    n * (sizeof(struct sockaddr_storage) + sizeof(struct sockaddr*) + sizeof(uv_buf_t*) + sizeof(unsigned int) + sizeof(int)) +
+    total * sizeof(uv_buf_t) + 1
+  );
+  bufs   = (uv_buf_t*)&addrs[n];
+  paddrs = (struct sockaddr**)&bufs[total];
+  pbufs  = (uv_buf_t**)&paddrs[n];
+  nbufs  = (unsigned int*)&pbufs[n];
+  status = (int*)&nbufs[n];
+
+  for(i = 0, j = 0; i < n; ++i){
+    nbufs[i]  = lluv_udp_msg_nbufs(L, i + 1);
+    pbufs[i]  = &bufs[j];
+    paddrs[i] = (struct sockaddr*)&addrs[i];
+    status[i] = lluv_udp_msg_parse(L, i + 1, &addrs[i], pbufs[i]);
+    j += nbufs[i];
+  }
+
+#if LLUV_UV_VER_GE(1,19,0)
+  queue_count = (unsigned int)uv_udp_get_send_queue_count(udp);
+#else
+  queue_count = (unsigned int)udp->send_queue_count;
+#endif
+
+  /* status: 0 - not sent, 1 - sent, <0 - error */
+  i = 0;
+  if(queue_count == 0) while(i < n){
+    int err;
+
+    if(status[i] < 0){ ++i; continue; }
+
+#if LLUV_UV_VER_GE(1,50,0)
+    for(j = i; (j < n) && (status[j] == 0); ++j);
+
+    err = uv_udp_try_send2(udp, j - i, &pbufs[i], &nbufs[i], &paddrs[i], 0);
+    if(err > 0){
+      for(j = i + err; i < j; ++i) status[i] = 1;
+      continue;
+    }
+#else
+    err = uv_udp_try_send(udp, pbufs[i], nbufs[i], paddrs[i]);
+    if(err >= 0){
+      status[i++] = 1;
+      continue;
+    }
+#endif
+
+    if((err == 0) || (err == UV_EAGAIN)) break;
+
+    status[i++] = err;
+  }
+
+  for(queued = 0, j = i; j < n; ++j){
+    if(status[j] == 0) ++queued;
+  }
+
+  if(queued){
+    batch = (lluv_udp_send_batch_t*)lluv_alloc(L, sizeof(lluv_udp_send_batch_t) + (queued - 1) * sizeof(lluv_udp_send_item_t));
+    if(batch){
+      batch->handle  = handle;
+      batch->pending = 0;
+
+      for(j = i; j < n; ++j){
+        lluv_udp_send_item_t *item = &batch->items[batch->pending];
+        int err;
+
+        if(status[j] != 0) continue;
+
+        item->req.data = batch;
+        item->idx      = j;
+        err = uv_udp_send(&item->req, udp, pbufs[j], nbufs[j], paddrs[j], lluv_on_udp_send_batch_cb);
+        if(err < 0) status[j] = err;
+        else batch->pending += 1;
+      }
+
+      if(!batch->pending){
+        lluv_free(L, batch);
+        batch = NULL;
+      }
+    }
+    else{
+      for(j = i; j < n; ++j) if(status[j] == 0) status[j] = UV_ENOMEM;
+    }
+  }
+
+  for(i = 0; i < n; ++i){
+    if(status[i] < 0) lluv_udp_send_batch_error(L, &errors, i, status[i]);
+  }
+
+  if(batch){
+    lua_pushvalue(L, 2);
+    batch->arg    = luaL_ref(L, LLUV_LUA_REGISTRY);
+    batch->errors = errors;
+    lua_pushvalue(L, 4);
+    batch->ctx    = luaL_ref(L, LLUV_LUA_REGISTRY);
+    batch->cb     = LUA_NOREF;
+    if(!lua_isnil(L, 3)){
+      lua_pushvalue(L, 3);
+      batch->cb   = luaL_ref(L, LLUV_LUA_REGISTRY);
+    }
+
+    lluv_handle_lock(L, handle, LLUV_LOCK_REQ);
+  }
+  else{
+    /* all messages done so just call callback */
+    if(!lua_isnil(L, 3)){
+      lua_pushvalue(L, 3);
+      lua_pushvalue(L, 1);
+      lua_rawgeti(L, LLUV_LUA_REGISTRY, errors);
+      lua_pushvalue(L, 4);
+      lluv_loop_defer_call(L, lluv_loop_by_handle(&handle->handle), 3);
+    }
+    luaL_unref(L, LLUV_LUA_REGISTRY, errors);
+  }
+
+  lua_settop(L, 1);
+  return 1;
+}
+
 //}
 
 //{ Recv
@@ -402,7 +867,7 @@ static void lluv_on_udp_recv_cb(uv_udp_t *arg, ssize_t nread, const uv_buf_t* bu
     ** nread == 0 and addr == NULL when there is 
     ** nothing to read
     */
-    lluv_free_buffer((uv_handle_t*)arg, buf);
+    lluv_udp_free_buffer(handle, buf, flags);
     return;
   }
 
@@ -415,10 +880,10 @@ static void lluv_on_udp_recv_cb(uv_udp_t *arg, ssize_t nread, const uv_buf_t* bu
     assert(addr);
     lua_pushnil(L);
     lua_pushlstring(L, buf->base, nread);
-    lluv_free_buffer((uv_handle_t*)arg, buf);
+    lluv_udp_free_buffer(handle, buf, flags);
   }
   else{
-    lluv_free_buffer((uv_handle_t*)arg, buf);
+    lluv_udp_free_buffer(handle, buf, flags);
 
     /* The callee is responsible for stopping closing the stream 
      *  when an error happens by calling uv_read_stop() or uv_close().
@@ -436,7 +901,7 @@ static void lluv_on_udp_recv_cb(uv_udp_t *arg, ssize_t nread, const uv_buf_t* bu
   }
   lua_pushinteger(L, flags);
 
-  LLUV_HANDLE_CALL_CB(L, handle, 4 + lluv_push_addr(L, (const struct sockaddr_storage*)addr));
+  LLUV_HANDLE_CALL_CB_EX(L, handle, 4 + lluv_udp_push_peer(L, handle, addr), LLUV_CB_READ);
 
   LLUV_CHECK_LOOP_CB_INVARIANT(L);
 }
@@ -448,6 +913,12 @@ static int lluv_udp_start_recv(lua_State *L){
   lluv_check_args_with_cb(L, 2);
   LLUV_READ_CB(handle) = luaL_ref(L, LLUV_LUA_REGISTRY);
 
+  if(handle->ext && ((lluv_udp_ext_t*)handle->ext)->max){
+    /* switch from batch mode */
+    uv_udp_recv_stop(LLUV_H(handle, uv_udp_t));
+    lluv_udp_release_batch(L, handle, (lluv_udp_ext_t*)handle->ext);
+  }
+
   err = uv_udp_recv_start(LLUV_H(handle, uv_udp_t), lluv_alloc_buffer_cb, lluv_on_udp_recv_cb);
 
   if(err >= 0) lluv_handle_lock(L, handle, LLUV_LOCK_READ);
@@ -472,10 +943,255 @@ static int lluv_udp_stop_recv(lua_State *L){
     lluv_handle_unlock(L, handle, LLUV_LOCK_READ);
   }
 
+  /* not delivered datagrams are dropped */
+  if(handle->ext) lluv_udp_release_batch(L, handle, (lluv_udp_ext_t*)handle->ext);
+
   lua_settop(L, 1);
   return 1;
 }
 
+/* Batch receive.
+ * Datagrams accumulated and delivered when there no more data in socket,
+ * when batch is full or when fixed buffer has no space for next datagram.
+ * libuv limits number of reads per poll so it may stop before socket
+ * drained. Partial batch is delivered by loop check hook in this case.
+ * With `recvmmsg` flag libuv reads several datagrams with one syscall.
+ */
+
+static void lluv_alloc_udp_batch_cb(uv_handle_t* h, size_t suggested_size, uv_buf_t *buf){
+  lluv_handle_t  *handle = lluv_handle_byptr(h);
+  lluv_udp_ext_t *ext    = (lluv_udp_ext_t*)handle->ext;
+
+  UNUSED_ARG(suggested_size);
+
+  /* libuv does not call alloc until previous buffer is released
+   * so we can reuse same memory for each read
+   */
+  *buf = lluv_buf_init(ext->mbase, ext->msize);
+}
+
+static int lluv_udp_batch_is_active(lluv_handle_t *handle, lluv_udp_ext_t *ext){
+  return IS_(handle, OPEN) && (handle->ext == &ext->base) && ext->max &&
+    (LLUV_READ_CB(handle) != LUA_NOREF);
+}
+
+static void lluv_udp_batch_deliver(lua_State *L, lluv_handle_t *handle, lluv_udp_ext_t *ext){
+  lua_rawgeti(L, LLUV_LUA_REGISTRY, LLUV_READ_CB(handle));
+  lluv_handle_pushself(L, handle);
+  lua_pushnil(L);
+  lua_rawgeti(L, LLUV_LUA_REGISTRY, ext->batch);
+  lua_pushinteger(L, ext->nbatch);
+
+  luaL_unref(L, LLUV_LUA_REGISTRY, ext->batch);
+  ext->batch  = LUA_NOREF;
+  ext->nbatch = 0;
+  ext->rpos   = 0;
+
+  LLUV_HANDLE_CALL_CB_EX(L, handle, 4, LLUV_CB_READ);
+}
+
+static void lluv_udp_batch_push(lua_State *L, lluv_handle_t *handle, lluv_udp_ext_t *ext, const char *data, size_t len, const struct sockaddr *addr, unsigned flags){
+  int i, n;
+
+  if(ext->batch == LUA_NOREF){
+    lua_createtable(L, ext->max * (ext->rfbuf ? 5 : 4), 0);
+    ext->batch = luaL_ref(L, LLUV_LUA_REGISTRY);
+  }
+
+  lua_rawgeti(L, LLUV_LUA_REGISTRY, ext->batch);
+  i = ext->nbatch * (ext->rfbuf ? 5 : 4);
+
+  if(ext->rfbuf){
+    if(len > ext->rfbuf->capacity){
+      len = ext->rfbuf->capacity;
+      flags |= UV_UDP_PARTIAL;
+    }
+    memcpy(ext->rfbuf->data + ext->rpos, data, len);
+    lutil_pushint64(L, ext->rpos); lua_rawseti(L, -2, ++i);
+    lutil_pushint64(L, len);       lua_rawseti(L, -2, ++i);
+    ext->rpos += len;
+  }
+  else{
+    lua_pushlstring(L, data, len); lua_rawseti(L, -2, ++i);
+  }
+
+  n = lluv_udp_push_peer(L, handle, addr);
+  if(n > 2) lua_pop(L, n - 2);
+  else if(n == 0){ lua_pushnil(L); lua_pushnil(L); }
+  lua_rawseti(L, -3, i + 2);
+  lua_rawseti(L, -2, i + 1);
+  i += 2;
+
+#if LLUV_UV_VER_GE(1,40,0)
+  flags &= ~(unsigned)UV_UDP_MMSG_CHUNK;
+#endif
+  lua_pushinteger(L, flags); lua_rawseti(L, -2, ++i);
+
+  lua_pop(L, 1);
+
+  ext->nbatch += 1;
+}
+
+/* deliver partial batch at the end of loop iteration */
+static void lluv_udp_batch_enqueue(lua_State *L, lluv_handle_t *handle, lluv_udp_ext_t *ext){
+  lluv_loop_t *loop = lluv_loop_by_handle(&handle->handle);
+
+  if(ext->batch_queued) return;
+
+  /* without hook batch still delivered when socket drained */
+  if(lluv_loop_hook_start(L, loop, LLUV_LOOP_HOOK_BATCH) < 0) return;
+
+  ext->batch_next   = loop->batched;
+  ext->batch_queued = 1;
+  loop->batched     = handle;
+}
+
+LLUV_INTERNAL void lluv_udp_flush_batches(lua_State *L, lluv_loop_t *loop){
+  while(loop->batched){
+    lluv_handle_t  *handle = loop->batched;
+    lluv_udp_ext_t *ext    = (lluv_udp_ext_t*)handle->ext;
+
+    loop->batched     = ext->batch_next;
+    ext->batch_next   = NULL;
+    ext->batch_queued = 0;
+
+    if(ext->nbatch && lluv_udp_batch_is_active(handle, ext)){
+      lluv_udp_batch_deliver(L, handle, ext);
+    }
+  }
+
+  lluv_loop_hook_stop(loop, LLUV_LOOP_HOOK_BATCH);
+}
+
+static void lluv_on_udp_recv_batch_cb(uv_udp_t *arg, ssize_t nread, const uv_buf_t* buf, const struct sockaddr* addr, unsigned flags){
+  lluv_handle_t  *handle = lluv_handle_byptr((uv_handle_t*)arg);
+  lluv_udp_ext_t *ext    = (lluv_udp_ext_t*)handle->ext;
+  lua_State *L = LLUV_HCALLBACK_L(handle);
+
+  LLUV_CHECK_LOOP_CB_INVARIANT(L);
+
+  /* receiving was switched from `start_recv` inside callback */
+  if(!lluv_udp_own_buffer(handle, buf->base)) lluv_udp_free_buffer(handle, buf, flags);
+
+  if(!lluv_udp_batch_is_active(handle, ext)) return;
+
+  if(nread >= 0){
+    if(addr == NULL){
+#if LLUV_UV_VER_GE(1,40,0)
+      /* recvmmsg done with buffer but there may be more data */
+      if(flags & UV_UDP_MMSG_FREE) return;
+#endif
+      /* there nothing to read */
+      if(ext->nbatch) lluv_udp_batch_deliver(L, handle, ext);
+      LLUV_CHECK_LOOP_CB_INVARIANT(L);
+      return;
+    }
+
+    if(ext->rfbuf && ext->nbatch && (ext->rpos + nread > ext->rfbuf->capacity)){
+      lluv_udp_batch_deliver(L, handle, ext);
+      if(!lluv_udp_batch_is_active(handle, ext)){
+        LLUV_CHECK_LOOP_CB_INVARIANT(L);
+        return;
+      }
+    }
+
+    lluv_udp_batch_push(L, handle, ext, buf->base, (size_t)nread, addr, flags);
+
+    if(ext->nbatch >= ext->max) lluv_udp_batch_deliver(L, handle, ext);
+    else lluv_udp_batch_enqueue(L, handle, ext);
+
+    LLUV_CHECK_LOOP_CB_INVARIANT(L);
+    return;
+  }
+
+  /* deliver data received before error */
+  if(ext->nbatch){
+    lluv_udp_batch_deliver(L, handle, ext);
+    if(!lluv_udp_batch_is_active(handle, ext)){
+      LLUV_CHECK_LOOP_CB_INVARIANT(L);
+      return;
+    }
+  }
+
+  uv_udp_recv_stop(arg);
+
+  lua_rawgeti(L, LLUV_LUA_REGISTRY, LLUV_READ_CB(handle));
+  luaL_unref(L, LLUV_LUA_REGISTRY, LLUV_READ_CB(handle));
+  LLUV_READ_CB(handle) = LUA_NOREF;
+
+  lluv_handle_pushself(L, handle);
+  lluv_error_create(L, LLUV_ERR_UV, (uv_errno_t)nread, NULL);
+
+  lluv_udp_release_batch(L, handle, ext);
+  lluv_handle_unlock(L, handle, LLUV_LOCK_READ);
+
+  LLUV_HANDLE_CALL_CB_EX(L, handle, 2, LLUV_CB_READ);
+
+  LLUV_CHECK_LOOP_CB_INVARIANT(L);
+}
+
+static int lluv_udp_start_recv_batch(lua_State *L){
+  lluv_handle_t       *handle = lluv_check_udp(L, 1, LLUV_FLAG_OPEN);
+  int64_t              max    = lutil_checkint64(L, 2);
+  lluv_fixed_buffer_t *buffer = NULL;
+  lluv_udp_ext_t      *ext;
+  size_t nmsg = 1;
+  int err;
+
+  luaL_argcheck(L, max > 0, 2, LLUV_PREFIX" invalid batch size");
+
+  if(lua_gettop(L) > 3){
+    buffer = lluv_check_fbuf(L, 3);
+    luaL_argcheck(L, buffer->capacity > 0, 3, LLUV_PREFIX" empty buffer");
+    lluv_check_args_with_cb(L, 4);
+  }
+  else{
+    lluv_check_args_with_cb(L, 3);
+  }
+
+  ext = lluv_udp_ext(L, handle);
+  if(!ext){
+    return lluv_fail(L, handle->flags, LLUV_ERR_UV, UV_ENOMEM, NULL);
+  }
+
+  /* restart receiving with new settings */
+  if(LLUV_READ_CB(handle) != LUA_NOREF){
+    uv_udp_recv_stop(LLUV_H(handle, uv_udp_t));
+  }
+  lluv_udp_release_batch(L, handle, ext);
+
+#if LLUV_UV_VER_GE(1,40,0)
+  /* buffer allocated once for all datagrams libuv can read with one call */
+  if(uv_udp_using_recvmmsg(LLUV_H(handle, uv_udp_t))){
+    nmsg = LLUV_UDP_MMSG_MAX;
+  }
+#endif
+
+  if(!ext->mbase){
+    ext->mbase = (char*)lluv_alloc(L, nmsg * LLUV_UDP_DGRAM_MAXSIZE);
+    if(!ext->mbase){
+      return lluv_fail(L, handle->flags, LLUV_ERR_UV, UV_ENOMEM, NULL);
+    }
+    ext->msize = nmsg * LLUV_UDP_DGRAM_MAXSIZE;
+  }
+  ext->max   = (max > INT_MAX / 5) ? INT_MAX / 5 : (int)max;
+
+  luaL_unref(L, LLUV_LUA_REGISTRY, LLUV_READ_CB(handle));
+  LLUV_READ_CB(handle) = luaL_ref(L, LLUV_LUA_REGISTRY);
+
+  if(buffer){
+    ext->rbuf  = luaL_ref(L, LLUV_LUA_REGISTRY);
+    ext->rfbuf = buffer;
+    lluv_fbuf_pin(buffer);
+  }
+
+  err = uv_udp_recv_start(LLUV_H(handle, uv_udp_t), lluv_alloc_udp_batch_cb, lluv_on_udp_recv_batch_cb);
+  if(err >= 0) lluv_handle_lock(L, handle, LLUV_LOCK_READ);
+  else lluv_udp_release_batch(L, handle, ext);
+
+  return lluv_return(L, handle, LLUV_READ_CB(handle), err);
+}
+
 //}
 
 static int lluv_udp_getsockname(lua_State *L){
@@ -577,6 +1293,22 @@ static int lluv_udp_set_ttl(lua_State *L){
   return 1;
 }
 
+/* recv callbacks get peer key instead of host name */
+static int lluv_udp_set_peer_keys(lua_State *L){
+  lluv_handle_t  *handle = lluv_check_udp(L, 1, LLUV_FLAG_OPEN);
+  int enable = lua_toboolean(L, 2);
+  lluv_udp_ext_t *ext = lluv_udp_ext(L, handle);
+
+  if(!ext){
+    return lluv_fail(L, handle->flags, LLUV_ERR_UV, UV_ENOMEM, NULL);
+  }
+
+  ext->peer_key = enable;
+
+  lua_settop(L, 1);
+  return 1;
+}
+
 static int lluv_udp_get_send_queue_size(lua_State *L){
   lluv_handle_t *handle = lluv_check_udp(L, 1, LLUV_FLAG_OPEN);
   size_t queue_size;
@@ -610,15 +1342,18 @@ static const struct luaL_Reg lluv_udp_methods[] = {
   { "bind",                     lluv_udp_bind                    },
   { "try_send",                 lluv_udp_try_send                },
   { "send",                     lluv_udp_send                    },
+  { "send_batch",               lluv_udp_send_batch              },
   { "getsockname",              lluv_udp_getsockname             },
   { "start_recv",               lluv_udp_start_recv              },
   { "stop_recv",                lluv_udp_stop_recv               },
+  { "start_recv_batch",         lluv_udp_start_recv_batch        },
   { "set_membership",           lluv_udp_set_membership          },
   { "set_multicast_loop",       lluv_udp_set_multicast_loop      },
   { "set_multicast_ttl",        lluv_udp_set_multicast_ttl       },
   { "set_multicast_interface",  lluv_udp_set_multicast_interface },
   { "set_broadcast",            lluv_udp_set_broadcast           },
   { "set_ttl",                  lluv_udp_set_ttl                 },
+  { "set_peer_keys",            lluv_udp_set_peer_keys           },
   { "get_send_queue_size",      lluv_udp_get_send_queue_size     },
   { "get_send_queue_count",     lluv_udp_get_send_queue_count    },
 #if LLUV_UV_VER_GE(1,27,0)
@@ -633,6 +1368,9 @@ static const lluv_uv_const_t lluv_udp_constants[] = {
   { UV_UDP_IPV6ONLY,   "UDP_IPV6ONLY"   },
   { UV_UDP_PARTIAL,    "UDP_PARTIAL"    },
   { UV_UDP_REUSEADDR,  "UDP_REUSEADDR"  },
+#if LLUV_UV_VER_GE(1,40,0)
+  { UV_UDP_RECVMMSG,   "UDP_RECVMMSG"   },
+#endif
   { UV_LEAVE_GROUP ,   "LEAVE_GROUP"    },
   { UV_JOIN_GROUP,     "JOIN_GROUP"     },
 
@@ -15,4 +15,6 @@ LLUV_INTERNAL void lluv_udp_initlib(lua_State *L, int nup, int safe);
 
 LLUV_INTERNAL int lluv_udp_index(lua_State *L);
 
+LLUV_INTERNAL void lluv_udp_flush_batches(lua_State *L, lluv_loop_t *loop);
+
 #endif
@@ -124,17 +124,10 @@ LLUV_INTERNAL void lluv_push_status(lua_State *L, int status){
 }
 
 LLUV_INTERNAL void lluv_alloc_buffer_cb(uv_handle_t* h, size_t suggested_size, uv_buf_t *buf){
-//  *buf = lluv_buf_init(malloc(suggested_size), suggested_size);
   lluv_handle_t *handle = lluv_handle_byptr(h);
   lluv_loop_t     *loop = lluv_loop_by_handle(h);
 
-  if(!IS_(loop, BUFFER_BUSY)){
-    SET_(loop, BUFFER_BUSY);
-    buf->base = loop->buffer; buf->len = loop->buffer_size;
-  }
-  else{
-    *buf = lluv_buf_init(lluv_alloc(handle->L, suggested_size), suggested_size);
-  }
+  *buf = lluv_bufpool_alloc(handle->L, &loop->pool, suggested_size);
 }
 
 LLUV_INTERNAL void lluv_free_buffer(uv_handle_t* h, const uv_buf_t *buf){
@@ -142,13 +135,7 @@ LLUV_INTERNAL void lluv_free_buffer(uv_handle_t* h, const uv_buf_t *buf){
     lluv_handle_t *handle = lluv_handle_byptr(h);
     lluv_loop_t     *loop = lluv_loop_by_handle(h);
 
-    if(buf->base == loop->buffer){
-      assert(IS_(loop, BUFFER_BUSY));
-      UNSET_(loop, BUFFER_BUSY);
-    }
-    else{
-      lluv_free(handle->L, &buf->base[0]);
-    }
+    lluv_bufpool_free(handle->L, &loop->pool, buf->base);
   }
 }
 
@@ -167,7 +167,6 @@ typedef unsigned char lluv_flag_t;
 #define LLUV_FLAG_STREAM       LLUV_FLAG_2
 #define LLUV_FLAG_DEFAULT_LOOP LLUV_FLAG_2
 #define LLUV_FLAG_RAISE_ERROR  LLUV_FLAG_3
-#define LLUV_FLAG_BUFFER_BUSY  LLUV_FLAG_4
 
 #define INHERITE_FLAGS(O) (O->flags & (LLUV_FLAG_RAISE_ERROR))
 
@@ -0,0 +1,651 @@
+/******************************************************************************
+* Author: Alexey Melnichuk <alexeymelnichuck@gmail.com>
+*
+* Copyright (C) 2014-2019 Alexey Melnichuk <alexeymelnichuck@gmail.com>
+*
+* Licensed according to the included 'LICENSE' document
+*
+* This file is part of lua-lluv library.
+******************************************************************************/
+
+#include "lluv.h"
+#include "lluv_utils.h"
+#include "lluv_error.h"
+#include "lluv_loop.h"
+#include "lluv_serial.h"
+#include "lluv_worker.h"
+#include "lluv_vmpool.h"
+#include <lualib.h>
+#include <assert.h>
+#include <string.h>
+
+/* Pool is shared between owner state and jobs on thread pool.
+** Owner holds it via userdata in lluv registry and each queued job
+** increments `busy` counter. Pool memory released by last of them.
+** Arguments and results are serialized so job never touches owner state.
+*/
+
+#define LLUV_VMPOOL_NAME LLUV_PREFIX" Lua VM pool"
+static const char *LLUV_VMPOOL = LLUV_VMPOOL_NAME;
+
+/* keys in LUA_REGISTRYINDEX of pooled state */
+static const char *LLUV_VMPOOL_CHUNKS  = LLUV_PREFIX" Lua VM chunks";
+static const char *LLUV_VMPOOL_MODULES = LLUV_PREFIX" Lua VM modules";
+
+#define LLUV_VMPOOL_CHUNK  0
+#define LLUV_VMPOOL_MODULE 1
+
+typedef struct lluv_vm_tag lluv_vm_t;
+
+struct lluv_vm_tag{
+  lluv_vm_t *next;
+  lua_State *L;
+  int        ncached;   /* number of cached chunks */
+};
+
+typedef struct lluv_vmpool_tag{
+  uv_mutex_t  mutex;
+  lluv_vm_t  *idle;
+  int         nidle;
+  int         max_idle;
+  int         busy;     /* number of queued jobs */
+  int         closed;
+  size_t      created;  /* total number of created states */
+  size_t      jobs;     /* total number of executed jobs */
+  char       *path;
+  char       *cpath;
+  lluv_sbuf_t preload;  /* serialized names of modules to require */
+}lluv_vmpool_t;
+
+typedef struct lluv_queue_lua_req_tag{
+  uv_work_t      req;
+  lluv_vmpool_t *pool;
+  int            status;
+  int            cb;
+  int            kind;
+  lluv_sbuf_t    data;  /* arguments, then results or error message */
+  size_t         code_len;
+  char           code[1];
+}lluv_queue_lua_req_t;
+
+//{ Pool
+
+static void lluv_vmpool_free(lluv_vmpool_t *pool){
+  uv_mutex_destroy(&pool->mutex);
+  lluv_sbuf_free(&pool->preload);
+  lluv_free(NULL, pool->path);
+  lluv_free(NULL, pool->cpath);
+  lluv_free(NULL, pool);
+}
+
+static void lluv_vm_error(lua_State *L, lluv_sbuf_t *buf){
+  size_t len; const char *msg = lua_tolstring(L, -1, &len);
+
+  if(!msg) msg = "unknown error", len = strlen(msg);
+
+  buf->size = 0;
+  if(lluv_sbuf_reserve(buf, len + 1) == 0){
+    memcpy(buf->data, msg, len);
+    buf->data[len] = '\0';
+  }
+}
+
+static int lluv_vm_boot(lua_State *L){
+  lluv_vmpool_t *pool = (lluv_vmpool_t*)lua_touserdata(L, 1);
+  int i, n;
+
+  lluv_worker_prepare_state(L, pool->path, pool->cpath);
+
+  lua_newtable(L);
+  lua_rawsetp(L, LUA_REGISTRYINDEX, LLUV_VMPOOL_CHUNKS);
+
+  lua_newtable(L);
+  lua_rawsetp(L, LUA_REGISTRYINDEX, LLUV_VMPOOL_MODULES);
+
+  n = lluv_deserialize(L, pool->preload.data, pool->preload.size);
+  if(n < 0) return luaL_error(L, "invalid preload list");
+
+  for(i = 2; i < 2 + n; ++i){
+    lua_getglobal(L, "require");
+    lua_pushvalue(L, i);
+    lua_call(L, 1, 0);
+  }
+
+  return 0;
+}
+
+/* can be called from any thread */
+static lluv_vm_t *lluv_vm_new(lluv_vmpool_t *pool, lluv_sbuf_t *err){
+  lluv_vm_t *vm = lluv_alloc_t(NULL, lluv_vm_t);
+  lua_State *L;
+
+  L = vm ? luaL_newstate() : NULL;
+  if(!L){
+    /* no memory even for error message */
+    err->size = 0;
+    lluv_free(NULL, vm);
+    return NULL;
+  }
+
+  luaL_openlibs(L);
+
+  lua_pushcfunction(L, lluv_vm_boot);
+  lua_pushlightuserdata(L, pool);
+  if(lua_pcall(L, 1, 0, 0)){
+    lluv_vm_error(L, err);
+    lua_close(L);
+    lluv_free(NULL, vm);
+    return NULL;
+  }
+
+  vm->next    = NULL;
+  vm->L       = L;
+  vm->ncached = 0;
+
+  uv_mutex_lock(&pool->mutex);
+  pool->created += 1;
+  uv_mutex_unlock(&pool->mutex);
+
+  return vm;
+}
+
+static void lluv_vm_close(lluv_vm_t *vm){
+  lua_close(vm->L);
+  lluv_free(NULL, vm);
+}
+
+static lluv_vm_t *lluv_vmpool_acquire(lluv_vmpool_t *pool, lluv_sbuf_t *err){
+  lluv_vm_t *vm;
+
+  uv_mutex_lock(&pool->mutex);
+  vm = pool->idle;
+  if(vm){
+    pool->idle   = vm->next;
+    pool->nidle -= 1;
+  }
+  uv_mutex_unlock(&pool->mutex);
+
+  return vm ? vm : lluv_vm_new(pool, err);
+}
+
+/* return state to pool and release job reference */
+static void lluv_vmpool_release(lluv_vmpool_t *pool, lluv_vm_t *vm){
+  int last;
+
+  uv_mutex_lock(&pool->mutex);
+  if(vm){
+    pool->jobs += 1;
+    if(!pool->closed && pool->nidle < pool->max_idle){
+      vm->next    = pool->idle;
+      pool->idle  = vm;
+      pool->nidle += 1;
+      vm = NULL;
+    }
+  }
+  pool->busy -= 1;
+  last = pool->closed && (pool->busy == 0);
+  uv_mutex_unlock(&pool->mutex);
+
+  if(vm) lluv_vm_close(vm);
+  if(last) lluv_vmpool_free(pool);
+}
+
+/* release owner reference */
+static void lluv_vmpool_close(lluv_vmpool_t *pool){
+  lluv_vm_t *vm;
+  int last;
+
+  uv_mutex_lock(&pool->mutex);
+  pool->closed = 1;
+  vm           = pool->idle;
+  pool->idle   = NULL;
+  pool->nidle  = 0;
+  last         = (pool->busy == 0);
+  uv_mutex_unlock(&pool->mutex);
+
+  while(vm){
+    lluv_vm_t *next = vm->next;
+    lluv_vm_close(vm);
+    vm = next;
+  }
+
+  if(last) lluv_vmpool_free(pool);
+}
+
+static int lluv_vmpool__gc(lua_State *L){
+  lluv_vmpool_t **ud = (lluv_vmpool_t **)lutil_checkudatap (L, 1, LLUV_VMPOOL);
+
+  if(*ud){
+    lluv_vmpool_close(*ud);
+    *ud = NULL;
+  }
+
+  return 0;
+}
+
+static lluv_vmpool_t *lluv_vmpool_new(lua_State *L){
+  lluv_vmpool_t *pool = lluv_alloc_t(L, lluv_vmpool_t);
+  lluv_vmpool_t **ud;
+
+  if(!pool) return NULL;
+
+  if(uv_mutex_init(&pool->mutex) < 0){
+    lluv_free(L, pool);
+    return NULL;
+  }
+
+  pool->idle     = NULL;
+  pool->nidle    = 0;
+  pool->max_idle = LLUV_VMPOOL_MAX_IDLE;
+  pool->busy     = 0;
+  pool->closed   = 0;
+  pool->created  = 0;
+  pool->jobs     = 0;
+  pool->path     = lluv_worker_package_field(L, "path");
+  pool->cpath    = lluv_worker_package_field(L, "cpath");
+  lluv_sbuf_init(&pool->preload);
+
+  /* replace current pool. Running jobs keep old one alive */
+  lua_rawgetp(L, LLUV_LUA_REGISTRY, LLUV_VMPOOL);
+  if(lua_isuserdata(L, -1)){
+    lua_pushcfunction(L, lluv_vmpool__gc);
+    lua_insert(L, -2);
+    lua_call(L, 1, 0);
+  }
+  else lua_pop(L, 1);
+
+  ud = (lluv_vmpool_t **)lutil_newudatap(L, lluv_vmpool_t*, LLUV_VMPOOL);
+  *ud = pool;
+  lua_rawsetp(L, LLUV_LUA_REGISTRY, LLUV_VMPOOL);
+
+  return pool;
+}
+
+static lluv_vmpool_t *lluv_vmpool_get(lua_State *L){
+  lluv_vmpool_t **ud;
+
+  lua_rawgetp(L, LLUV_LUA_REGISTRY, LLUV_VMPOOL);
+  ud = (lluv_vmpool_t **)lua_touserdata(L, -1);
+  lua_pop(L, 1);
+
+  if(ud && *ud) return *ud;
+
+  return lluv_vmpool_new(L);
+}
+
+//}
+
+//{ Job
+
+static void lluv_vm_require(lua_State *L, const char *name, size_t len){
+  const char *sep = (const char*)memchr(name, ':', len);
+
+  lua_getglobal(L, "require");
+  lua_pushlstring(L, name, sep ? (size_t)(sep - name) : len);
+  lua_call(L, 1, 1);
+
+  if(sep){
+    if(!lua_istable(L, -1)) luaL_error(L, "module for `%s` is not a table", name);
+    lua_getfield(L, -1, sep + 1);
+    lua_remove(L, -2);
+  }
+
+  if(!lua_isfunction(L, -1)) luaL_error(L, "`%s` is not a function", name);
+}
+
+/* push function for job and cache it */
+static void lluv_vm_push_function(lua_State *L, lluv_vm_t *vm, lluv_queue_lua_req_t *req){
+  const char *tag = (req->kind == LLUV_VMPOOL_CHUNK) ? LLUV_VMPOOL_CHUNKS : LLUV_VMPOOL_MODULES;
+  int cache, key;
+
+  lua_rawgetp(L, LUA_REGISTRYINDEX, tag);
+  cache = lua_gettop(L);
+  lua_pushlstring(L, req->code, req->code_len);
+  key = cache + 1;
+
+  lua_pushvalue(L, key);
+  lua_rawget(L, cache);
+  if(!lua_isfunction(L, -1)){
+    lua_pop(L, 1);
+
+    if(req->kind == LLUV_VMPOOL_MODULE){
+      lluv_vm_require(L, req->code, req->code_len);
+    }
+    else{
+      if(luaL_loadbuffer(L, req->code, req->code_len, "=queue_lua")) lua_error(L);
+
+      /* do not let cache grow indefinitely for generated chunks */
+      if(++vm->ncached > LLUV_VMPOOL_CACHE_MAX){
+        lua_newtable(L);
+        lua_pushvalue(L, -1);
+        lua_rawsetp(L, LUA_REGISTRYINDEX, tag);
+        lua_replace(L, cache);
+        vm->ncached = 1;
+      }
+    }
+
+    lua_pushvalue(L, key);
+    lua_pushvalue(L, -2);
+    lua_rawset(L, cache);
+  }
+
+  lua_replace(L, cache);
+  lua_settop(L, cache);
+}
+
+static int lluv_vm_run(lua_State *L){
+  lluv_vm_t *vm = (lluv_vm_t*)lua_touserdata(L, 1);
+  lluv_queue_lua_req_t *req = (lluv_queue_lua_req_t*)lua_touserdata(L, 2);
+  int base = lua_gettop(L), n;
+
+  lluv_vm_push_function(L, vm, req);
+
+  n = lluv_deserialize(L, req->data.data, req->data.size);
+  if(n < 0) return luaL_error(L, "invalid arguments");
+
+  lua_call(L, n, LUA_MULTRET);
+
+  req->data.size = 0;
+  if(lluv_serialize(L, base + 1, lua_gettop(L), &req->data))
+    return luaL_error(L, "unsupported result value");
+
+  return 0;
+}
+
+static void lluv_queue_lua_on_work(uv_work_t *arg){
+  lluv_queue_lua_req_t *req = (lluv_queue_lua_req_t*)arg;
+  lluv_vm_t *vm = lluv_vmpool_acquire(req->pool, &req->data);
+  lua_State *L;
+
+  if(!vm){
+    req->status = UV_ECANCELED;
+    lluv_vmpool_release(req->pool, NULL);
+    return;
+  }
+
+  L = vm->L;
+  lua_pushcfunction(L, lluv_vm_run);
+  lua_pushlightuserdata(L, vm);
+  lua_pushlightuserdata(L, req);
+  if(lua_pcall(L, 2, 0, 0)){
+    lluv_vm_error(L, &req->data);
+    req->status = UV_ECANCELED;
+  }
+  lua_settop(L, 0);
+
+  lluv_vmpool_release(req->pool, vm);
+}
+
+static void lluv_queue_lua_free(lua_State *L, lluv_queue_lua_req_t *req){
+  luaL_unref(L, LLUV_LUA_REGISTRY, req->cb);
+  lluv_sbuf_free(&req->data);
+  lluv_free(L, req);
+}
+
+static void lluv_queue_lua_on_after(uv_work_t *arg, int status){
+  lluv_queue_lua_req_t *req = (lluv_queue_lua_req_t*)arg;
+  lluv_loop_t *loop = lluv_loop_byptr(arg->loop);
+  lua_State *L = loop->L;
+  int argc = 1;
+
+  LLUV_CHECK_LOOP_CB_INVARIANT(L);
+
+  /* job was canceled before start */
+  if(status < 0) lluv_vmpool_release(req->pool, NULL);
+  else status = req->status;
+
+  lua_rawgeti(L, LLUV_LUA_REGISTRY, req->cb);
+
+  if(status < 0){
+    lluv_error_create(L, LLUV_ERR_UV, (uv_errno_t)status,
+      (req->status < 0 && req->data.size) ? req->data.data : NULL
+    );
+  }
+  else{
+    int n;
+    lua_pushnil(L);
+    n = lluv_deserialize(L, req->data.data, req->data.size);
+    if(n < 0){
+      lua_pop(L, 1);
+      lluv_error_create(L, LLUV_ERR_UV, UV_EINVAL, NULL);
+    }
+    else argc += n;
+  }
+
+  lluv_queue_lua_free(L, req);
+
+  LLUV_LOOP_CALL_CB(L, loop, argc, LLUV_CB_WORK);
+
+  LLUV_CHECK_LOOP_CB_INVARIANT(L);
+}
+
+/* module function spec is `name` or `name:function` */
+static int lluv_queue_lua_is_module(const char *code, size_t len){
+  size_t i; int sep = 0;
+
+  if(len == 0) return 0;
+
+  for(i = 0; i < len; ++i){
+    unsigned char c = (unsigned char)code[i];
+    if(c == ':'){
+      if(sep || i == 0 || i == len - 1) return 0;
+      sep = 1;
+      continue;
+    }
+    if(c == '.' && !sep) continue;
+    if(c == '_' || (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'))
+      continue;
+    return 0;
+  }
+
+  return 1;
+}
+
+/* push bytecode of Lua function without upvalues */
+static void lluv_queue_lua_dump(lua_State *L, int idx){
+  const char *name; int i;
+
+  luaL_argcheck(L, !lua_iscfunction(L, idx), idx, "Lua function expected");
+
+  for(i = 1; (name = lua_getupvalue(L, idx, i)) != NULL; ++i){
+    lua_pop(L, 1);
+    /* first upvalue of loaded chunk is set to globals */
+    if((i != 1) || (strcmp(name, "_ENV") != 0))
+      luaL_argerror(L, idx, "function with upvalues can not be moved to other state");
+  }
+
+  lua_getglobal(L, "string");
+  lua_getfield(L, -1, "dump");
+  lua_remove(L, -2);
+  lua_pushvalue(L, idx);
+  lua_call(L, 1, 1);
+}
+
+// queue_lua([loop,] chunk|module|function, args, cb)
+LLUV_IMPL_SAFE(lluv_queue_lua){
+  lluv_loop_t *loop = lluv_opt_loop(L, 1, LLUV_FLAG_OPEN);
+  int first = loop ? 2 : 1, args = first + 1;
+  lluv_queue_lua_req_t *req;
+  lluv_vmpool_t *pool;
+  const char *code; size_t len;
+  int kind = LLUV_VMPOOL_CHUNK, err;
+
+  if(!loop) loop = lluv_default_loop(L);
+
+  lluv_check_args_with_cb(L, first + 2);
+  if(!lua_isnil(L, args)) luaL_checktype(L, args, LUA_TTABLE);
+
+  if(lua_isfunction(L, first)){
+    lluv_queue_lua_dump(L, first);
+    lua_replace(L, first);
+    code = lua_tolstring(L, first, &len);
+  }
+  else{
+    code = luaL_checklstring(L, first, &len);
+    if(lluv_queue_lua_is_module(code, len)) kind = LLUV_VMPOOL_MODULE;
+  }
+
+  pool = lluv_vmpool_get(L);
+  if(!pool) return lluv_fail(L, safe_flag | loop->flags, LLUV_ERR_UV, UV_ENOMEM, NULL);
+
+  req = (lluv_queue_lua_req_t*)lluv_alloc(L, sizeof(lluv_queue_lua_req_t) + len);
+  if(!req) return lluv_fail(L, safe_flag | loop->flags, LLUV_ERR_UV, UV_ENOMEM, NULL);
+
+  req->pool     = pool;
+  req->status   = 0;
+  req->cb       = LUA_NOREF;
+  req->kind     = kind;
+  req->code_len = len;
+  memcpy(req->code, code, len);
+  req->code[len] = '\0';
+  lluv_sbuf_init(&req->data);
+
+  if(!lua_isnil(L, args)){
+    int i, n = (int)lua_rawlen(L, args);
+
+    luaL_checkstack(L, n, "too many arguments");
+    for(i = 1; i <= n; ++i) lua_rawgeti(L, args, i);
+    err = lluv_serialize(L, lua_gettop(L) - n + 1, lua_gettop(L), &req->data);
+    lua_pop(L, n);
+
+    if(err){
+      lluv_queue_lua_free(L, req);
+      return lluv_fail(L, safe_flag | loop->flags, LLUV_ERR_UV, err, NULL);
+    }
+  }
+
+  lua_pushvalue(L, first + 2);
+  req->cb = luaL_ref(L, LLUV_LUA_REGISTRY);
+
+  uv_mutex_lock(&pool->mutex);
+  pool->busy += 1;
+  uv_mutex_unlock(&pool->mutex);
+
+  err = uv_queue_work(loop->handle, &req->req, lluv_queue_lua_on_work, lluv_queue_lua_on_after);
+  if(err < 0){
+    lluv_vmpool_release(pool, NULL);
+    lluv_queue_lua_free(L, req);
+    return lluv_fail(L, safe_flag | loop->flags, LLUV_ERR_UV, err, NULL);
+  }
+
+  lua_pushboolean(L, 1);
+  return 1;
+}
+
+//}
+
+static void lluv_vmpool_push_stats(lua_State *L, lluv_vmpool_t *pool){
+  uv_mutex_lock(&pool->mutex);
+  lua_newtable(L);
+  lutil_pushint64(L, pool->nidle);    lua_setfield(L, -2, "idle");
+  lutil_pushint64(L, pool->busy);     lua_setfield(L, -2, "busy");
+  lutil_pushint64(L, pool->max_idle); lua_setfield(L, -2, "max_idle");
+  lutil_pushint64(L, pool->created);  lua_setfield(L, -2, "created");
+  lutil_pushint64(L, pool->jobs);     lua_setfield(L, -2, "jobs");
+  uv_mutex_unlock(&pool->mutex);
+}
+
+// lua_pool() => stats
+// lua_pool{max_idle=N, warm=N, preload={...}}
+LLUV_IMPL_SAFE(lluv_lua_pool){
+  lluv_vmpool_t *pool;
+  int i, n, warm = 0, max_idle = LLUV_VMPOOL_MAX_IDLE, err = 0;
+
+  if(lua_isnoneornil(L, 1)){
+    pool = lluv_vmpool_get(L);
+    if(!pool) return lluv_fail(L, safe_flag, LLUV_ERR_UV, UV_ENOMEM, NULL);
+    lluv_vmpool_push_stats(L, pool);
+    return 1;
+  }
+
+  luaL_checktype(L, 1, LUA_TTABLE);
+  lua_settop(L, 1);
+
+  lua_getfield(L, 1, "max_idle");
+  max_idle = (int)luaL_optinteger(L, -1, max_idle);
+  luaL_argcheck(L, max_idle >= 0, 1, "invalid max_idle value");
+
+  lua_getfield(L, 1, "warm");
+  warm = (int)luaL_optinteger(L, -1, warm);
+  luaL_argcheck(L, warm >= 0 && warm <= max_idle, 1, "invalid warm value");
+
+  lua_getfield(L, 1, "preload");
+  if(!lua_isnil(L, -1)){
+    luaL_argcheck(L, lua_istable(L, -1), 1, "preload must be an array of module names");
+    n = (int)lua_rawlen(L, -1);
+    for(i = 1; i <= n; ++i){
+      lua_rawgeti(L, 4, i);
+      luaL_argcheck(L, lua_type(L, -1) == LUA_TSTRING, 1, "preload must be an array of module names");
+      lua_pop(L, 1);
+    }
+  }
+  else n = 0;
+
+  pool = lluv_vmpool_new(L);
+  if(!pool) return lluv_fail(L, safe_flag, LLUV_ERR_UV, UV_ENOMEM, NULL);
+
+  pool->max_idle = max_idle;
+
+  if(n){
+    luaL_checkstack(L, n, "too many modules");
+    for(i = 1; i <= n; ++i) lua_rawgeti(L, 4, i);
+    err = lluv_serialize(L, 5, 4 + n, &pool->preload);
+    lua_settop(L, 4);
+    if(err) return lluv_fail(L, safe_flag, LLUV_ERR_UV, err, NULL);
+  }
+
+  for(i = 0; i < warm; ++i){
+    lluv_sbuf_t msg; lluv_vm_t *vm;
+
+    lluv_sbuf_init(&msg);
+    vm = lluv_vm_new(pool, &msg);
+    if(!vm){
+      lua_pushstring(L, msg.size ? msg.data : "");
+      lluv_sbuf_free(&msg);
+      return lluv_fail(L, safe_flag, LLUV_ERR_UV, UV_ECANCELED, lua_tostring(L, -1));
+    }
+
+    uv_mutex_lock(&pool->mutex);
+    vm->next     = pool->idle;
+    pool->idle   = vm;
+    pool->nidle += 1;
+    uv_mutex_unlock(&pool->mutex);
+  }
+
+  lluv_vmpool_push_stats(L, pool);
+  return 1;
+}
+
+static const struct luaL_Reg lluv_vmpool_methods[] = {
+  { "__gc",        lluv_vmpool__gc             },
+
+  {NULL,NULL}
+};
+
+#define LLUV_FUNCTIONS(F)                    \
+  {"queue_lua",   lluv_queue_lua_##F},       \
+  {"lua_pool",    lluv_lua_pool_##F},        \
+
+static const struct luaL_Reg lluv_functions[][3] = {
+  {
+    LLUV_FUNCTIONS(unsafe)
+
+    {NULL,NULL}
+  },
+  {
+    LLUV_FUNCTIONS(safe)
+
+    {NULL,NULL}
+  },
+};
+
+LLUV_INTERNAL void lluv_vmpool_initlib(lua_State *L, int nup, int safe){
+  assert((safe == 0) || (safe == 1));
+
+  lutil_pushnvalues(L, nup);
+  if(!lutil_createmetap(L, LLUV_VMPOOL, lluv_vmpool_methods, nup))
+    lua_pop(L, nup);
+  lua_pop(L, 1);
+
+  luaL_setfuncs(L, lluv_functions[safe], nup);
+}
@@ -0,0 +1,34 @@
+/******************************************************************************
+* Author: Alexey Melnichuk <alexeymelnichuck@gmail.com>
+*
+* Copyright (C) 2014-2019 Alexey Melnichuk <alexeymelnichuck@gmail.com>
+*
+* Licensed according to the included 'LICENSE' document
+*
+* This file is part of lua-lluv library.
+******************************************************************************/
+
+#ifndef _LLUV_VMPOOL_H_
+#define _LLUV_VMPOOL_H_
+
+#include "lluv.h"
+#include "lluv_utils.h"
+
+/* Pool of Lua states which execute Lua functions on libuv thread pool.
+** States are created on demand (or in advance by `lua_pool{warm=N}`)
+** and reused by next jobs together with compiled chunks.
+*/
+
+/* max number of idle states kept by default */
+#ifndef LLUV_VMPOOL_MAX_IDLE
+#  define LLUV_VMPOOL_MAX_IDLE 4
+#endif
+
+/* max number of compiled chunks cached by each state */
+#ifndef LLUV_VMPOOL_CACHE_MAX
+#  define LLUV_VMPOOL_CACHE_MAX 64
+#endif
+
+LLUV_INTERNAL void lluv_vmpool_initlib(lua_State *L, int nup, int safe);
+
+#endif
@@ -0,0 +1,259 @@
+/******************************************************************************
+* Author: Alexey Melnichuk <alexeymelnichuck@gmail.com>
+*
+* Copyright (C) 2014-2019 Alexey Melnichuk <alexeymelnichuck@gmail.com>
+*
+* Licensed according to the included 'LICENSE' document
+*
+* This file is part of lua-lluv library.
+******************************************************************************/
+
+#include "lluv.h"
+#include "lluv_utils.h"
+#include "lluv_error.h"
+#include "lluv_loop.h"
+#include "lluv_fbuf.h"
+#include "lluv_work.h"
+#include <assert.h>
+#include <stdlib.h>
+
+/* key in lluv registry for table with user kernels */
+static const char *LLUV_WORK_KERNELS = LLUV_PREFIX" Work kernels";
+
+typedef struct lluv_work_req_tag{
+  uv_work_t             req;
+  lluv_work_kernel_t    kernel;
+  lluv_work_data_t      data;
+  int                   status;
+  int                   cb;
+  int                   args;   /* keeps strings and buffers alive */
+  lluv_fixed_buffer_t **fbufs;  /* pinned buffers (NULL for strings) */
+  uv_buf_t              bufs[1];
+}lluv_work_req_t;
+
+static void *lluv_work_kernel_to_ptr(lluv_work_kernel_t kernel){
+  union{ lluv_work_kernel_t kernel; void *ptr; } u;
+  u.kernel = kernel;
+  return u.ptr;
+}
+
+static lluv_work_kernel_t lluv_work_ptr_to_kernel(void *ptr){
+  union{ lluv_work_kernel_t kernel; void *ptr; } u;
+  u.ptr = ptr;
+  return u.kernel;
+}
+
+static lluv_work_kernel_t lluv_work_find(lua_State *L, int idx){
+  lluv_work_kernel_t kernel;
+
+  if(lua_islightuserdata(L, idx))
+    return lluv_work_ptr_to_kernel(lua_touserdata(L, idx));
+
+  kernel = lluv_work_builtin(luaL_checkstring(L, idx));
+  if(kernel) return kernel;
+
+  lua_rawgetp(L, LLUV_LUA_REGISTRY, LLUV_WORK_KERNELS);
+  if(lua_istable(L, -1)){
+    lua_pushvalue(L, idx);
+    lua_rawget(L, -2);
+    if(lua_islightuserdata(L, -1))
+      kernel = lluv_work_ptr_to_kernel(lua_touserdata(L, -1));
+    lua_pop(L, 1);
+  }
+  lua_pop(L, 1);
+
+  return kernel;
+}
+
+static void lluv_work_check_item(lua_State *L, int idx, int arg){
+  if(lua_type(L, idx) == LUA_TSTRING) return;
+  if(lluv_opt_fbuf(L, idx)) return;
+  luaL_argerror(L, arg, "string or "LLUV_PREFIX" fixed buffer expected");
+}
+
+static void lluv_work_release(lua_State *L, lluv_work_req_t *req){
+  size_t i;
+
+  for(i = 0; i < req->data.nbufs; ++i){
+    if(req->fbufs[i]) lluv_fbuf_unpin(req->fbufs[i]);
+  }
+
+  luaL_unref(L, LLUV_LUA_REGISTRY, req->args);
+  luaL_unref(L, LLUV_LUA_REGISTRY, req->cb);
+  free(req->data.result);
+  lluv_free(L, req);
+}
+
+static void lluv_work_on_work(uv_work_t *arg){
+  lluv_work_req_t *req = (lluv_work_req_t*)arg;
+  req->status = req->kernel(&req->data);
+}
+
+static void lluv_work_on_after(uv_work_t *arg, int status){
+  lluv_work_req_t *req = (lluv_work_req_t*)arg;
+  lluv_loop_t *loop = lluv_loop_byptr(arg->loop);
+  lua_State *L = loop->L;
+  int argc = 1;
+
+  LLUV_CHECK_LOOP_CB_INVARIANT(L);
+
+  if(status >= 0) status = req->status;
+
+  lua_rawgeti(L, LLUV_LUA_REGISTRY, req->cb);
+
+  if(status < 0){
+    lluv_error_create(L, LLUV_ERR_UV, (uv_errno_t)status, NULL);
+  }
+  else{
+    lua_pushnil(L);
+    lua_pushlstring(L, req->data.result ? req->data.result : "", req->data.result_len);
+    argc = 2;
+  }
+
+  lluv_work_release(L, req);
+
+  LLUV_LOOP_CALL_CB(L, loop, argc, LLUV_CB_WORK);
+
+  LLUV_CHECK_LOOP_CB_INVARIANT(L);
+}
+
+// queue_work([loop,] kernel, data, cb)
+// data is string, fbuf or array of them with optional `param` field
+LLUV_IMPL_SAFE(lluv_queue_work){
+  lluv_loop_t *loop = lluv_opt_loop(L, 1, LLUV_FLAG_OPEN);
+  int first = loop ? 2 : 1, args = first + 1;
+  lluv_work_kernel_t kernel;
+  lluv_work_req_t *req;
+  int64_t param = 0;
+  int i, n, has_param = 0, err;
+
+  if(!loop) loop = lluv_default_loop(L);
+
+  kernel = lluv_work_find(L, first);
+  luaL_argcheck(L, kernel != NULL, first, "unknown kernel");
+  lluv_check_args_with_cb(L, first + 2);
+
+  /* copy arguments to private table so caller can not release them */
+  if(lua_istable(L, args)){
+    n = (int)lua_rawlen(L, args);
+    lua_createtable(L, n, 0);
+    for(i = 1; i <= n; ++i){
+      lua_rawgeti(L, args, i);
+      lluv_work_check_item(L, -1, args);
+      lua_rawseti(L, -2, i);
+    }
+
+    lua_getfield(L, args, "param");
+    if(!lua_isnil(L, -1)){
+      param     = lutil_checkint64(L, -1);
+      has_param = 1;
+    }
+    lua_pop(L, 1);
+  }
+  else{
+    n = 1;
+    lluv_work_check_item(L, args, args);
+    lua_createtable(L, 1, 0);
+    lua_pushvalue(L, args);
+    lua_rawseti(L, -2, 1);
+  }
+
+  req = (lluv_work_req_t*)lluv_alloc(L, sizeof(lluv_work_req_t) +
+    sizeof(uv_buf_t) * (n ? n - 1 : 0) + sizeof(lluv_fixed_buffer_t*) * n
+  );
+  if(!req) return lluv_fail(L, safe_flag | loop->flags, LLUV_ERR_UV, UV_ENOMEM, NULL);
+
+  req->kernel          = kernel;
+  req->status          = 0;
+  req->fbufs           = (lluv_fixed_buffer_t**)&req->bufs[n ? n : 1];
+  req->data.bufs       = req->bufs;
+  req->data.nbufs      = n;
+  req->data.has_param  = has_param;
+  req->data.param      = param;
+  req->data.result     = NULL;
+  req->data.result_len = 0;
+
+  for(i = 0; i < n; ++i){
+    lluv_fixed_buffer_t *buffer;
+
+    lua_rawgeti(L, -1, i + 1);
+    buffer = lluv_opt_fbuf(L, -1);
+    if(buffer){
+      lluv_fbuf_pin(buffer);
+      req->bufs[i]  = lluv_buf_init(buffer->data, buffer->capacity);
+      req->fbufs[i] = buffer;
+    }
+    else{
+      size_t len; const char *str = lua_tolstring(L, -1, &len);
+      req->bufs[i]  = lluv_buf_init((char*)str, len);
+      req->fbufs[i] = NULL;
+    }
+    lua_pop(L, 1);
+  }
+
+  req->args = luaL_ref(L, LLUV_LUA_REGISTRY);
+  lua_pushvalue(L, first + 2);
+  req->cb   = luaL_ref(L, LLUV_LUA_REGISTRY);
+
+  err = uv_queue_work(loop->handle, &req->req, lluv_work_on_work, lluv_work_on_after);
+  if(err < 0){
+    lluv_work_release(L, req);
+    return lluv_fail(L, safe_flag | loop->flags, LLUV_ERR_UV, err, NULL);
+  }
+
+  lua_pushboolean(L, 1);
+  return 1;
+}
+
+// work_kernel(name) => ptr
+// work_kernel(name, ptr)
+static int lluv_work_kernel(lua_State *L){
+  luaL_checkstring(L, 1);
+
+  if(lua_gettop(L) == 1){
+    lluv_work_kernel_t kernel = lluv_work_find(L, 1);
+    if(!kernel) return 0;
+    lua_pushlightuserdata(L, lluv_work_kernel_to_ptr(kernel));
+    return 1;
+  }
+
+  luaL_argcheck(L, lluv_work_builtin(lua_tostring(L, 1)) == NULL, 1, "can not replace builtin kernel");
+  if(!lua_isnil(L, 2)) luaL_checktype(L, 2, LUA_TLIGHTUSERDATA);
+
+  lua_rawgetp(L, LLUV_LUA_REGISTRY, LLUV_WORK_KERNELS);
+  if(!lua_istable(L, -1)){
+    lua_pop(L, 1);
+    lua_newtable(L);
+    lua_pushvalue(L, -1);
+    lua_rawsetp(L, LLUV_LUA_REGISTRY, LLUV_WORK_KERNELS);
+  }
+
+  lua_pushvalue(L, 1);
+  lua_pushvalue(L, 2);
+  lua_rawset(L, -3);
+
+  return 0;
+}
+
+#define LLUV_FUNCTIONS(F)                    \
+  {"queue_work",  lluv_queue_work_##F},      \
+  {"work_kernel", lluv_work_kernel},         \
+
+static const struct luaL_Reg lluv_functions[][3] = {
+  {
+    LLUV_FUNCTIONS(unsafe)
+
+    {NULL,NULL}
+  },
+  {
+    LLUV_FUNCTIONS(safe)
+
+    {NULL,NULL}
+  },
+};
+
+LLUV_INTERNAL void lluv_work_initlib(lua_State *L, int nup, int safe){
+  assert((safe == 0) || (safe == 1));
+
+  luaL_setfuncs(L, lluv_functions[safe], nup);
+}
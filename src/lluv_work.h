@@ -0,0 +1,40 @@
+/******************************************************************************
+* Author: Alexey Melnichuk <alexeymelnichuck@gmail.com>
+*
+* Copyright (C) 2014-2019 Alexey Melnichuk <alexeymelnichuck@gmail.com>
+*
+* Licensed according to the included 'LICENSE' document
+*
+* This file is part of lua-lluv library.
+******************************************************************************/
+
+#ifndef _LLUV_WORK_H_
+#define _LLUV_WORK_H_
+
+#include "lluv.h"
+#include "lluv_utils.h"
+
+/* Native kernel runs on libuv threadpool so it must not use Lua API.
+** Input buffers are read only and stay valid until kernel returns.
+** Kernel allocates result with malloc and returns 0 or libuv error code.
+**
+** Other modules can pass kernel to `uv.queue_work` as lightuserdata
+** or register it by name with `uv.work_kernel(name, ptr)`.
+*/
+typedef struct lluv_work_data_tag{
+  const uv_buf_t *bufs;
+  size_t          nbufs;
+  int             has_param;
+  int64_t         param;      /* e.g. compression level or hash seed */
+  char           *result;
+  size_t          result_len;
+}lluv_work_data_t;
+
+typedef int (*lluv_work_kernel_t)(lluv_work_data_t *data);
+
+LLUV_INTERNAL void lluv_work_initlib(lua_State *L, int nup, int safe);
+
+/* returns NULL if there no builtin kernel with this name */
+LLUV_INTERNAL lluv_work_kernel_t lluv_work_builtin(const char *name);
+
+#endif
@@ -0,0 +1,1054 @@
+/******************************************************************************
+* Author: Alexey Melnichuk <alexeymelnichuck@gmail.com>
+*
+* Copyright (C) 2014-2019 Alexey Melnichuk <alexeymelnichuck@gmail.com>
+*
+* Licensed according to the included 'LICENSE' document
+*
+* This file is part of lua-lluv library.
+******************************************************************************/
+
+#include "lluv.h"
+#include "lluv_utils.h"
+#include "lluv_error.h"
+#include "lluv_loop.h"
+#include "lluv_serial.h"
+#include "lluv_worker.h"
+#include <lualib.h>
+#include <assert.h>
+#include <string.h>
+
+/* Each worker is a thread with its own Lua state and its own default loop.
+** Parent and workers exchange serialized values via message queues.
+** Each queue is protected by mutex and wakes consumer loop with uv_async_t.
+** Async handles are internal (data == NULL) so loop walkers ignore them.
+*/
+
+#define LLUV_WORKER_POOL_NAME LLUV_PREFIX" Worker pool"
+static const char *LLUV_WORKER_POOL = LLUV_WORKER_POOL_NAME;
+
+#define LLUV_WORKER_PORT_NAME LLUV_PREFIX" Worker port"
+static const char *LLUV_WORKER_PORT = LLUV_WORKER_PORT_NAME;
+
+/* key in LUA_REGISTRYINDEX of worker state */
+static const char *LLUV_WORKER_TAG = LLUV_PREFIX" Worker";
+
+/* key in lluv registry of worker state */
+static const char *LLUV_WORKER_PORT_TAG = LLUV_PREFIX" Worker port instance";
+
+#ifndef LLUV_WORKER_MAX
+#  define LLUV_WORKER_MAX 1024
+#endif
+
+LLUV_EXPORT_API int luaopen_lluv(lua_State *L);
+LLUV_EXPORT_API int luaopen_lluv_safe(lua_State *L);
+LLUV_EXPORT_API int luaopen_lluv_unsafe(lua_State *L);
+
+//{ Message queue
+
+#define LLUV_MSG_DATA  0
+#define LLUV_MSG_CLOSE 1 /* parent -> worker */
+#define LLUV_MSG_ERROR 2 /* worker -> parent, data is error message */
+#define LLUV_MSG_EXIT  3 /* worker -> parent, last message from thread */
+
+typedef struct lluv_msg_tag lluv_msg_t;
+
+struct lluv_msg_tag{
+  lluv_msg_t *next;
+  int         type;
+  int         id;   /* worker id */
+  size_t      size;
+  char       *data;
+};
+
+typedef struct lluv_mqueue_tag{
+  uv_mutex_t  mutex;
+  lluv_msg_t *first;
+  lluv_msg_t *last;
+  uv_async_t *async; /* consumer or NULL if there no consumer yet */
+}lluv_mqueue_t;
+
+static lluv_msg_t *lluv_msg_new(int type, int id, char *data, size_t size){
+  lluv_msg_t *msg = lluv_alloc_t(NULL, lluv_msg_t);
+  if(!msg) return NULL;
+
+  msg->next = NULL;
+  msg->type = type;
+  msg->id   = id;
+  msg->data = data;
+  msg->size = size;
+
+  return msg;
+}
+
+static void lluv_msg_free(lluv_msg_t *msg){
+  lluv_free(NULL, msg->data);
+  lluv_free_t(NULL, lluv_msg_t, msg);
+}
+
+static void lluv_msg_free_all(lluv_msg_t *msg){
+  while(msg){
+    lluv_msg_t *next = msg->next;
+    lluv_msg_free(msg);
+    msg = next;
+  }
+}
+
+static int lluv_mqueue_init(lluv_mqueue_t *q){
+  q->first = q->last = NULL;
+  q->async = NULL;
+  return uv_mutex_init(&q->mutex);
+}
+
+static void lluv_mqueue_close(lluv_mqueue_t *q){
+  lluv_msg_free_all(q->first);
+  q->first = q->last = NULL;
+  uv_mutex_destroy(&q->mutex);
+}
+
+static void lluv_mqueue_push(lluv_mqueue_t *q, lluv_msg_t *msg){
+  uv_mutex_lock(&q->mutex);
+  if(q->last) q->last->next = msg;
+  else q->first = msg;
+  q->last = msg;
+  if(q->async) uv_async_send(q->async);
+  uv_mutex_unlock(&q->mutex);
+}
+
+static lluv_msg_t *lluv_mqueue_take(lluv_mqueue_t *q){
+  lluv_msg_t *msg;
+  uv_mutex_lock(&q->mutex);
+  msg = q->first;
+  q->first = q->last = NULL;
+  uv_mutex_unlock(&q->mutex);
+  return msg;
+}
+
+/* return list of not processed messages to the head of queue */
+static void lluv_mqueue_unshift(lluv_mqueue_t *q, lluv_msg_t *msg, int wakeup){
+  lluv_msg_t *last = msg;
+
+  if(!msg) return;
+  while(last->next) last = last->next;
+
+  uv_mutex_lock(&q->mutex);
+  last->next = q->first;
+  q->first = msg;
+  if(!q->last) q->last = last;
+  if(wakeup && q->async) uv_async_send(q->async);
+  uv_mutex_unlock(&q->mutex);
+}
+
+static void lluv_mqueue_attach(lluv_mqueue_t *q, uv_async_t *async){
+  uv_mutex_lock(&q->mutex);
+  q->async = async;
+  if(async && q->first) uv_async_send(async);
+  uv_mutex_unlock(&q->mutex);
+}
+
+/* serialize values and allocate message */
+static int lluv_msg_pack(lua_State *L, int first, int type, int id, lluv_msg_t **pmsg){
+  lluv_sbuf_t buf;
+  int err;
+
+  lluv_sbuf_init(&buf);
+  err = lluv_serialize(L, first, lua_gettop(L), &buf);
+  if(err < 0){
+    lluv_sbuf_free(&buf);
+    return err;
+  }
+
+  *pmsg = lluv_msg_new(type, id, buf.data, buf.size);
+  if(!*pmsg){
+    lluv_sbuf_free(&buf);
+    return UV_ENOMEM;
+  }
+
+  return 0;
+}
+
+static lluv_msg_t *lluv_msg_copy(const lluv_msg_t *src, int id){
+  char *data = NULL;
+  lluv_msg_t *msg;
+
+  if(src->size){
+    data = (char*)lluv_alloc(NULL, src->size);
+    if(!data) return NULL;
+    memcpy(data, src->data, src->size);
+  }
+
+  msg = lluv_msg_new(src->type, id, data, src->size);
+  if(!msg) lluv_free(NULL, data);
+
+  return msg;
+}
+
+static char *lluv_strdup(const char *str){
+  size_t len; char *res;
+  if(!str) return NULL;
+  len = strlen(str) + 1;
+  res = (char*)lluv_alloc(NULL, len);
+  if(res) memcpy(res, str, len);
+  return res;
+}
+
+//}
+
+//{ Pool structures
+
+typedef struct lluv_worker_pool_tag lluv_worker_pool_t;
+
+typedef struct lluv_worker_tag{
+  lluv_worker_pool_t *pool;
+  int                 id;
+  int                 started;
+  uv_thread_t         thread;
+  lluv_mqueue_t       inbox;  /* parent -> worker */
+  lluv_msg_t         *close_msg; /* preallocated so stop can not fail */
+}lluv_worker_t;
+
+struct lluv_worker_pool_tag{
+  uv_async_t     async;    /* must be first field. wakes parent loop */
+  lluv_loop_owner_t owner; /* released by loop close */
+  lluv_mqueue_t  inbox;    /* workers -> parent */
+  lluv_loop_t   *loop;
+  lluv_flags_t   flags;
+  int            closing;
+  int            self;     /* reference to userdata while pool is open */
+  int            loop_ref; /* keep loop alive while pool is open */
+  int            cb;
+  int            close_cb;
+  int            n;
+  int            alive;    /* number of running threads */
+  int            next;     /* round robin for post */
+  char          *module;
+  char          *path;
+  char          *cpath;
+  lluv_worker_t  workers[1];
+};
+
+typedef struct lluv_worker_port_tag{
+  lluv_worker_t *worker;
+  uv_async_t    *async;
+  int            cb;
+}lluv_worker_port_t;
+
+typedef struct lluv_worker_async_tag{
+  uv_async_t          handle; /* must be first field */
+  lluv_worker_port_t *port;
+}lluv_worker_async_t;
+
+static void lluv_worker_post(lluv_worker_t *worker, int type, const char *str){
+  char *data = lluv_strdup(str);
+  lluv_msg_t *msg = lluv_msg_new(type, worker->id, data, data ? strlen(data) : 0);
+
+  if(!msg){
+    lluv_free(NULL, data);
+    if(type != LLUV_MSG_EXIT) return;
+    /* parent have to know that thread is done */
+    while(!(msg = lluv_msg_new(type, worker->id, NULL, 0)));
+  }
+
+  lluv_mqueue_push(&worker->pool->inbox, msg);
+}
+
+//}
+
+//{ Worker thread
+
+static const char *lluv_worker_boot_chunk =
+  "local module = ...\n"
+  "local uv     = require \"lluv\"\n"
+  "local port   = uv.worker_port()\n"
+  "local main   = require(module)\n"
+  "if type(main) == 'function' then main(port, port:id()) end\n"
+  "uv.run()\n"
+;
+
+static const char *lluv_worker_shutdown_chunk =
+  "local uv = require \"lluv\"\n"
+  "uv.worker_port():close()\n"
+  "uv.run(\"nowait\")\n"
+  "uv.default_loop():close(true)\n"
+;
+
+static void lluv_worker_preload(lua_State *L, const char *name, lua_CFunction fn){
+  lua_pushcfunction(L, fn);
+  lua_setfield(L, -2, name);
+}
+
+LLUV_INTERNAL void lluv_worker_prepare_state(lua_State *L, const char *path, const char *cpath){
+  lua_getglobal(L, "package");
+  if(lua_istable(L, -1)){
+    if(path){
+      lua_pushstring(L, path);
+      lua_setfield(L, -2, "path");
+    }
+    if(cpath){
+      lua_pushstring(L, cpath);
+      lua_setfield(L, -2, "cpath");
+    }
+
+    /* library can be linked statically so do not search it again */
+    lua_getfield(L, -1, "preload");
+    if(lua_istable(L, -1)){
+      lluv_worker_preload(L, "lluv",        luaopen_lluv);
+      lluv_worker_preload(L, "lluv.safe",   luaopen_lluv_safe);
+      lluv_worker_preload(L, "lluv.unsafe", luaopen_lluv_unsafe);
+    }
+    lua_pop(L, 1);
+  }
+  lua_pop(L, 1);
+}
+
+static int lluv_worker_boot(lua_State *L){
+  lluv_worker_t *worker = (lluv_worker_t*)lua_touserdata(L, 1);
+  lluv_worker_pool_t *pool = worker->pool;
+
+  lua_pushlightuserdata(L, worker);
+  lua_rawsetp(L, LUA_REGISTRYINDEX, LLUV_WORKER_TAG);
+
+  lluv_worker_prepare_state(L, pool->path, pool->cpath);
+
+  if(luaL_loadbuffer(L, lluv_worker_boot_chunk, strlen(lluv_worker_boot_chunk), "=lluv.worker"))
+    return lua_error(L);
+
+  lua_pushstring(L, pool->module);
+  lua_call(L, 1, 0);
+
+  return 0;
+}
+
+static int lluv_worker_shutdown(lua_State *L){
+  if(luaL_loadbuffer(L, lluv_worker_shutdown_chunk, strlen(lluv_worker_shutdown_chunk), "=lluv.worker"))
+    return lua_error(L);
+  lua_call(L, 0, 0);
+  return 0;
+}
+
+static void lluv_worker_main(void *arg){
+  lluv_worker_t *worker = (lluv_worker_t*)arg;
+  lua_State *L = luaL_newstate();
+
+  if(!L){
+    lluv_worker_post(worker, LLUV_MSG_ERROR, "can not create Lua state");
+    lluv_worker_post(worker, LLUV_MSG_EXIT, NULL);
+    return;
+  }
+
+  luaL_openlibs(L);
+
+  lua_pushcfunction(L, lluv_worker_boot);
+  lua_pushlightuserdata(L, worker);
+  if(lua_pcall(L, 1, 0, 0)){
+    const char *msg = lua_tostring(L, -1);
+    lluv_worker_post(worker, LLUV_MSG_ERROR, msg ? msg : "(error object is not a string)");
+    lua_pop(L, 1);
+  }
+
+  lua_pushcfunction(L, lluv_worker_shutdown);
+  if(lua_pcall(L, 0, 0, 0)) lua_pop(L, 1);
+
+  lua_close(L);
+
+  lluv_worker_post(worker, LLUV_MSG_EXIT, NULL);
+}
+
+LLUV_INTERNAL int lluv_is_worker_state(lua_State *L){
+  int res;
+  lua_rawgetp(L, LUA_REGISTRYINDEX, LLUV_WORKER_TAG);
+  res = lua_islightuserdata(L, -1);
+  lua_pop(L, 1);
+  return res;
+}
+
+//}
+
+//{ Worker port
+
+static lluv_worker_port_t *lluv_check_worker_port(lua_State *L, int idx, int open){
+  lluv_worker_port_t *port = (lluv_worker_port_t *)lutil_checkudatap (L, idx, LLUV_WORKER_PORT);
+  luaL_argcheck (L, port != NULL, idx, LLUV_WORKER_PORT_NAME" expected");
+  luaL_argcheck (L, !open || port->async, idx, LLUV_WORKER_PORT_NAME" closed");
+  return port;
+}
+
+static void lluv_worker_port_on_close(uv_handle_t *h){
+  lluv_free_t(NULL, lluv_worker_async_t, h);
+}
+
+static void lluv_worker_port_close_impl(lua_State *L, lluv_worker_port_t *port){
+  if(!port->async) return;
+
+  lluv_mqueue_attach(&port->worker->inbox, NULL);
+  uv_close((uv_handle_t*)port->async, lluv_worker_port_on_close);
+  port->async = NULL;
+
+  luaL_unref(L, LLUV_LUA_REGISTRY, port->cb);
+  port->cb = LUA_NOREF;
+}
+
+static void lluv_worker_port_on_async(uv_async_t *arg){
+  lluv_worker_port_t *port = ((lluv_worker_async_t*)arg)->port;
+  lluv_loop_t *loop = lluv_loop_byptr(arg->loop);
+  lua_State *L = loop->L;
+  lluv_msg_t *msg, *keep = NULL, **tail = &keep;
+
+  LLUV_CHECK_LOOP_CB_INVARIANT(L);
+
+  msg = lluv_mqueue_take(&port->worker->inbox);
+  while(msg){
+    lluv_msg_t *next = msg->next;
+    int n, err = 0;
+
+    if(msg->type == LLUV_MSG_CLOSE){
+      lluv_msg_free(msg);
+      lluv_msg_free_all(next);
+      lluv_msg_free_all(keep);
+
+      if(port->cb != LUA_NOREF){
+        lua_rawgeti(L, LLUV_LUA_REGISTRY, port->cb);
+        lua_rawgetp(L, LLUV_LUA_REGISTRY, LLUV_WORKER_PORT_TAG);
+        lluv_error_create(L, LLUV_ERR_UV, UV_EOF, NULL);
+        err = lluv_loop_call(L, loop, 2, UV_ASYNC, LLUV_CB_MESSAGE);
+      }
+
+      lluv_worker_port_close_impl(L, port);
+      uv_stop(loop->handle);
+
+      if(!err) lluv_loop_defer_proceed(L, loop);
+      LLUV_CHECK_LOOP_CB_INVARIANT(L);
+      return;
+    }
+
+    if(port->cb == LUA_NOREF){
+      /* wait until user set callback */
+      msg->next = NULL;
+      *tail = msg; tail = &msg->next;
+      msg = next;
+      continue;
+    }
+
+    lua_rawgeti(L, LLUV_LUA_REGISTRY, port->cb);
+    lua_rawgetp(L, LLUV_LUA_REGISTRY, LLUV_WORKER_PORT_TAG);
+    lua_pushnil(L);
+    n = lluv_deserialize(L, msg->data, msg->size);
+    lluv_msg_free(msg);
+    msg = next;
+
+    if(n < 0){
+      lua_pop(L, 3);
+      continue;
+    }
+
+    err = lluv_loop_call(L, loop, n + 2, UV_ASYNC, LLUV_CB_MESSAGE);
+    if(!err) lluv_loop_defer_proceed(L, loop);
+
+    if(!port->async){ /* closed from callback */
+      lluv_msg_free_all(msg);
+      lluv_msg_free_all(keep);
+      keep = NULL;
+      break;
+    }
+
+    if(err){
+      *tail = msg;
+      lluv_mqueue_unshift(&port->worker->inbox, keep, 1);
+      LLUV_CHECK_LOOP_CB_INVARIANT(L);
+      return;
+    }
+  }
+
+  lluv_mqueue_unshift(&port->worker->inbox, keep, 0);
+
+  LLUV_CHECK_LOOP_CB_INVARIANT(L);
+}
+
+static int lluv_worker_port_new(lua_State *L){
+  lluv_worker_t *worker;
+  lluv_worker_port_t *port;
+  lluv_worker_async_t *async;
+  lluv_loop_t *loop;
+  int err;
+
+  lua_rawgetp(L, LLUV_LUA_REGISTRY, LLUV_WORKER_PORT_TAG);
+  if(!lua_isnil(L, -1)) return 1;
+  lua_pop(L, 1);
+
+  lua_rawgetp(L, LUA_REGISTRYINDEX, LLUV_WORKER_TAG);
+  worker = (lluv_worker_t*)lua_touserdata(L, -1);
+  lua_pop(L, 1);
+  if(!worker) return 0;
+
+  loop = lluv_default_loop(L);
+
+  async = lluv_alloc_t(L, lluv_worker_async_t);
+  if(!async) return lluv_fail(L, LLUV_FLAG_RAISE_ERROR, LLUV_ERR_UV, UV_ENOMEM, NULL);
+
+  err = uv_async_init(loop->handle, &async->handle, lluv_worker_port_on_async);
+  if(err < 0){
+    lluv_free_t(L, lluv_worker_async_t, async);
+    return lluv_fail(L, LLUV_FLAG_RAISE_ERROR, LLUV_ERR_UV, err, NULL);
+  }
+  async->handle.data = NULL;
+
+  port = lutil_newudatap(L, lluv_worker_port_t, LLUV_WORKER_PORT);
+  port->worker = worker;
+  port->async  = &async->handle;
+  port->cb     = LUA_NOREF;
+  async->port  = port;
+
+  lua_pushvalue(L, -1);
+  lua_rawsetp(L, LLUV_LUA_REGISTRY, LLUV_WORKER_PORT_TAG);
+
+  lluv_mqueue_attach(&worker->inbox, port->async);
+
+  return 1;
+}
+
+static int lluv_worker_port_send(lua_State *L){
+  lluv_worker_port_t *port = lluv_check_worker_port(L, 1, 1);
+  lluv_msg_t *msg;
+  int err = lluv_msg_pack(L, 2, LLUV_MSG_DATA, port->worker->id, &msg);
+
+  if(err < 0)
+    return lluv_fail(L, LLUV_FLAG_RAISE_ERROR, LLUV_ERR_UV, err, "can not serialize value");
+
+  lluv_mqueue_push(&port->worker->pool->inbox, msg);
+
+  lua_settop(L, 1);
+  return 1;
+}
+
+static int lluv_worker_port_on_message(lua_State *L){
+  lluv_worker_port_t *port = lluv_check_worker_port(L, 1, 1);
+
+  luaL_unref(L, LLUV_LUA_REGISTRY, port->cb);
+  port->cb = LUA_NOREF;
+
+  if(!lua_isnoneornil(L, 2)){
+    lluv_check_callable(L, 2);
+    lua_settop(L, 2);
+    port->cb = luaL_ref(L, LLUV_LUA_REGISTRY);
+
+    /* deliver messages received before callback was set */
+    uv_async_send(port->async);
+  }
+
+  lua_settop(L, 1);
+  return 1;
+}
+
+static int lluv_worker_port_id(lua_State *L){
+  lluv_worker_port_t *port = lluv_check_worker_port(L, 1, 0);
+  lua_pushinteger(L, port->worker->id);
+  return 1;
+}
+
+static int lluv_worker_port_close(lua_State *L){
+  lluv_worker_port_t *port = lluv_check_worker_port(L, 1, 0);
+  lluv_worker_port_close_impl(L, port);
+  return 0;
+}
+
+static int lluv_worker_port_to_s(lua_State *L){
+  lluv_worker_port_t *port = lluv_check_worker_port(L, 1, 0);
+  lua_pushfstring(L, LLUV_WORKER_PORT_NAME" (%p)", port);
+  return 1;
+}
+
+static const struct luaL_Reg lluv_worker_port_methods[] = {
+  { "__tostring",  lluv_worker_port_to_s       },
+  { "__gc",        lluv_worker_port_close      },
+  { "send",        lluv_worker_port_send       },
+  { "on_message",  lluv_worker_port_on_message },
+  { "id",          lluv_worker_port_id         },
+  { "close",       lluv_worker_port_close      },
+
+  {NULL,NULL}
+};
+
+//}
+
+//{ Worker pool
+
+static lluv_worker_pool_t *lluv_check_worker_pool(lua_State *L, int idx){
+  lluv_worker_pool_t **pool = (lluv_worker_pool_t **)lutil_checkudatap (L, idx, LLUV_WORKER_POOL);
+  luaL_argcheck (L, pool != NULL, idx, LLUV_WORKER_POOL_NAME" expected");
+  luaL_argcheck (L, *pool != NULL, idx, LLUV_WORKER_POOL_NAME" closed");
+  return *pool;
+}
+
+static void lluv_worker_pool_on_close(uv_handle_t *h){
+  lluv_worker_pool_t *pool = (lluv_worker_pool_t*)h;
+
+  lluv_free(NULL, pool->module);
+  lluv_free(NULL, pool->path);
+  lluv_free(NULL, pool->cpath);
+  lluv_free(NULL, pool);
+}
+
+#define LLUV_WORKER_POOL_BY_OWNER(O) ((lluv_worker_pool_t*)((char*)(O) - offsetof(lluv_worker_pool_t, owner)))
+
+static void lluv_worker_pool_stop_all(lluv_worker_pool_t *pool){
+  int i;
+
+  for(i = 0; i < pool->n; ++i){
+    lluv_worker_t *worker = &pool->workers[i];
+    if(worker->started && worker->close_msg){
+      lluv_mqueue_push(&worker->inbox, worker->close_msg);
+      worker->close_msg = NULL;
+    }
+  }
+}
+
+/* all threads have to be stopped (or going to stop) */
+static void lluv_worker_pool_join_all(lluv_worker_pool_t *pool){
+  int i;
+
+  for(i = 0; i < pool->n; ++i){
+    lluv_worker_t *worker = &pool->workers[i];
+    if(worker->started){
+      uv_thread_join(&worker->thread);
+      worker->started = 0;
+    }
+    if(worker->close_msg){
+      lluv_msg_free(worker->close_msg);
+      worker->close_msg = NULL;
+    }
+    lluv_mqueue_close(&worker->inbox);
+  }
+  pool->alive = 0;
+
+  lluv_mqueue_close(&pool->inbox);
+}
+
+/* release all resources. push close callback if any */
+static int lluv_worker_pool_release(lua_State *L, lluv_worker_pool_t *pool, int gc){
+  int has_cb = (pool->close_cb != LUA_NOREF);
+
+  lluv_worker_pool_join_all(pool);
+
+  lluv_loop_owner_remove(pool->loop, &pool->owner);
+
+  lua_rawgeti(L, LLUV_LUA_REGISTRY, pool->self);
+  if(lua_isuserdata(L, -1)) *(lluv_worker_pool_t **)lua_touserdata(L, -1) = NULL;
+
+  if(has_cb && !gc){
+    lua_rawgeti(L, LLUV_LUA_REGISTRY, pool->close_cb);
+    lua_insert(L, -2);
+  }
+  else lua_pop(L, 1);
+
+  luaL_unref(L, LLUV_LUA_REGISTRY, pool->self);
+  luaL_unref(L, LLUV_LUA_REGISTRY, pool->loop_ref);
+  luaL_unref(L, LLUV_LUA_REGISTRY, pool->cb);
+  luaL_unref(L, LLUV_LUA_REGISTRY, pool->close_cb);
+  pool->self = pool->loop_ref = pool->cb = pool->close_cb = LUA_NOREF;
+
+  if(IS_(pool->loop, OPEN))
+    uv_close((uv_handle_t*)&pool->async, lluv_worker_pool_on_close);
+  else
+    lluv_worker_pool_on_close((uv_handle_t*)&pool->async);
+
+  return has_cb && !gc;
+}
+
+static void lluv_worker_pool_on_async(uv_async_t *arg){
+  lluv_worker_pool_t *pool = (lluv_worker_pool_t*)arg;
+  lluv_loop_t *loop = pool->loop;
+  lua_State *L = loop->L;
+  lluv_msg_t *msg, *keep = NULL, **tail = &keep;
+
+  LLUV_CHECK_LOOP_CB_INVARIANT(L);
+
+  msg = lluv_mqueue_take(&pool->inbox);
+  while(msg){
+    lluv_msg_t *next = msg->next;
+    int n, err;
+
+    if(msg->type == LLUV_MSG_EXIT){
+      pool->alive -= 1;
+      lluv_msg_free(msg);
+      msg = next;
+      continue;
+    }
+
+    if(pool->cb == LUA_NOREF){
+      /* wait until user set callback */
+      msg->next = NULL;
+      *tail = msg; tail = &msg->next;
+      msg = next;
+      continue;
+    }
+
+    lua_rawgeti(L, LLUV_LUA_REGISTRY, pool->cb);
+    lua_rawgeti(L, LLUV_LUA_REGISTRY, pool->self);
+
+    if(msg->type == LLUV_MSG_ERROR){
+      lluv_error_create(L, LLUV_ERR_UV, UV_ECANCELED, msg->data);
+      lua_pushinteger(L, msg->id);
+      n = 0;
+    }
+    else{
+      lua_pushnil(L);
+      lua_pushinteger(L, msg->id);
+      n = lluv_deserialize(L, msg->data, msg->size);
+    }
+    lluv_msg_free(msg);
+    msg = next;
+
+    if(n < 0){
+      lua_pop(L, 4);
+      continue;
+    }
+
+    err = lluv_loop_call(L, loop, n + 3, UV_ASYNC, LLUV_CB_MESSAGE);
+    if(!err) lluv_loop_defer_proceed(L, loop);
+
+    if(err){
+      *tail = msg;
+      lluv_mqueue_unshift(&pool->inbox, keep, 1);
+      if(pool->closing && (pool->alive == 0)) uv_async_send(&pool->async);
+      LLUV_CHECK_LOOP_CB_INVARIANT(L);
+      return;
+    }
+  }
+
+  lluv_mqueue_unshift(&pool->inbox, keep, 0);
+
+  if(pool->closing && (pool->alive == 0)){
+    if(lluv_worker_pool_release(L, pool, 0)){
+      LLUV_LOOP_CALL_CB(L, loop, 1, LLUV_CB_CLOSE);
+    }
+  }
+
+  LLUV_CHECK_LOOP_CB_INVARIANT(L);
+}
+
+/* loop closed while pool is open. blocking shutdown */
+static void lluv_worker_pool_on_loop_close(lua_State *L, lluv_loop_owner_t *owner){
+  lluv_worker_pool_t *pool = LLUV_WORKER_POOL_BY_OWNER(owner);
+
+  if(!pool->closing){
+    pool->closing = 1;
+    lluv_worker_pool_stop_all(pool);
+  }
+  lluv_worker_pool_release(L, pool, 1);
+}
+
+LLUV_INTERNAL char *lluv_worker_package_field(lua_State *L, const char *name){
+  char *res = NULL;
+
+  lua_getglobal(L, "package");
+  if(lua_istable(L, -1)){
+    lua_getfield(L, -1, name);
+    if(lua_type(L, -1) == LUA_TSTRING) res = lluv_strdup(lua_tostring(L, -1));
+    lua_pop(L, 1);
+  }
+  lua_pop(L, 1);
+
+  return res;
+}
+
+static int lluv_worker_default_size(void){
+  uv_cpu_info_t *info; int count;
+  if(uv_cpu_info(&info, &count) < 0) return 1;
+  uv_free_cpu_info(info, count);
+  return count > 0 ? count : 1;
+}
+
+// worker_pool([loop,] {n = 4, module = 'worker'})
+LLUV_IMPL_SAFE(lluv_worker_pool_new){
+  lluv_loop_t *loop = lluv_opt_loop(L, 1, LLUV_FLAG_OPEN);
+  int idx = loop ? 2 : 1;
+  lluv_worker_pool_t *pool, **ud;
+  const char *module;
+  int i, n, err;
+
+  luaL_checktype(L, idx, LUA_TTABLE);
+
+  lua_getfield(L, idx, "module");
+  if(lua_type(L, -1) != LUA_TSTRING) luaL_argerror(L, idx, "module name expected");
+  module = lua_tostring(L, -1);
+  lua_getfield(L, idx, "n");
+  n = (int)luaL_optinteger(L, -1, 0);
+  lua_pop(L, 1);
+  if(n <= 0) n = lluv_worker_default_size();
+  luaL_argcheck(L, n <= LLUV_WORKER_MAX, idx, "too many workers");
+
+  if(!loop) loop = lluv_default_loop(L);
+
+  pool = (lluv_worker_pool_t*)lluv_alloc(L, sizeof(lluv_worker_pool_t) + sizeof(lluv_worker_t) * (n - 1));
+  if(!pool) return lluv_fail(L, safe_flag | loop->flags, LLUV_ERR_UV, UV_ENOMEM, NULL);
+
+  memset(pool, 0, sizeof(lluv_worker_pool_t) + sizeof(lluv_worker_t) * (n - 1));
+  pool->loop     = loop;
+  pool->flags    = safe_flag | INHERITE_FLAGS(loop);
+  pool->n        = n;
+  pool->self     = pool->loop_ref = pool->cb = pool->close_cb = LUA_NOREF;
+  pool->module   = lluv_strdup(module);
+  pool->path     = lluv_worker_package_field(L, "path");
+  pool->cpath    = lluv_worker_package_field(L, "cpath");
+
+  err = lluv_mqueue_init(&pool->inbox);
+  if(err < 0){
+    lluv_worker_pool_on_close((uv_handle_t*)&pool->async);
+    return lluv_fail(L, safe_flag | loop->flags, LLUV_ERR_UV, err, NULL);
+  }
+
+  err = uv_async_init(loop->handle, &pool->async, lluv_worker_pool_on_async);
+  if(err < 0){
+    lluv_mqueue_close(&pool->inbox);
+    lluv_worker_pool_on_close((uv_handle_t*)&pool->async);
+    return lluv_fail(L, safe_flag | loop->flags, LLUV_ERR_UV, err, NULL);
+  }
+  pool->async.data = NULL;
+  lluv_mqueue_attach(&pool->inbox, &pool->async);
+
+  pool->owner.handle = (uv_handle_t*)&pool->async;
+  pool->owner.close  = lluv_worker_pool_on_loop_close;
+  lluv_loop_owner_add(loop, &pool->owner);
+
+  ud = lutil_newudatap(L, lluv_worker_pool_t*, LLUV_WORKER_POOL);
+  *ud = pool;
+
+  lua_pushvalue(L, -1);
+  pool->self = luaL_ref(L, LLUV_LUA_REGISTRY);
+
+  lluv_loop_pushself(L, loop);
+  pool->loop_ref = luaL_ref(L, LLUV_LUA_REGISTRY);
+
+  for(i = 0; i < n; ++i){
+    lluv_worker_t *worker = &pool->workers[i];
+    worker->pool = pool;
+    worker->id   = i + 1;
+    worker->close_msg = lluv_msg_new(LLUV_MSG_CLOSE, worker->id, NULL, 0);
+    if(!worker->close_msg){
+      err = UV_ENOMEM;
+      break;
+    }
+
+    err = lluv_mqueue_init(&worker->inbox);
+    if(err < 0){
+      lluv_msg_free(worker->close_msg);
+      break;
+    }
+
+    err = uv_thread_create(&worker->thread, lluv_worker_main, worker);
+    if(err < 0){
+      lluv_msg_free(worker->close_msg);
+      lluv_mqueue_close(&worker->inbox);
+      break;
+    }
+    worker->started = 1;
+    pool->alive += 1;
+  }
+
+  if(err < 0){
+    pool->n = i;
+    pool->closing = 1;
+    lluv_worker_pool_stop_all(pool);
+    lluv_worker_pool_release(L, pool, 1);
+    return lluv_fail(L, safe_flag | loop->flags, LLUV_ERR_UV, err, NULL);
+  }
+
+  return 1;
+}
+
+static int lluv_worker_pool_send_msg(lua_State *L, lluv_worker_pool_t *pool, lluv_worker_t *worker, int first){
+  lluv_msg_t *msg;
+  int err = lluv_msg_pack(L, first, LLUV_MSG_DATA, worker->id, &msg);
+
+  if(err < 0) return err;
+
+  lluv_mqueue_push(&worker->inbox, msg);
+  return 0;
+}
+
+// send(id, ...)
+static int lluv_worker_pool_send(lua_State *L){
+  lluv_worker_pool_t *pool = lluv_check_worker_pool(L, 1);
+  int id = (int)luaL_checkinteger(L, 2);
+  int err;
+
+  luaL_argcheck(L, (id > 0) && (id <= pool->n), 2, "invalid worker id");
+
+  if(pool->closing)
+    return lluv_fail(L, pool->flags, LLUV_ERR_UV, UV_ECANCELED, NULL);
+
+  err = lluv_worker_pool_send_msg(L, pool, &pool->workers[id - 1], 3);
+  if(err < 0)
+    return lluv_fail(L, pool->flags, LLUV_ERR_UV, err, "can not serialize value");
+
+  lua_settop(L, 1);
+  return 1;
+}
+
+// post(...) - send message to next worker
+static int lluv_worker_pool_post(lua_State *L){
+  lluv_worker_pool_t *pool = lluv_check_worker_pool(L, 1);
+  lluv_worker_t *worker;
+  int err;
+
+  if(pool->closing || (pool->n == 0))
+    return lluv_fail(L, pool->flags, LLUV_ERR_UV, UV_ECANCELED, NULL);
+
+  worker = &pool->workers[pool->next];
+
+  err = lluv_worker_pool_send_msg(L, pool, worker, 2);
+  if(err < 0)
+    return lluv_fail(L, pool->flags, LLUV_ERR_UV, err, "can not serialize value");
+
+  pool->next = (pool->next + 1) % pool->n;
+
+  lua_pushinteger(L, worker->id);
+  return 1;
+}
+
+// broadcast(...)
+static int lluv_worker_pool_broadcast(lua_State *L){
+  lluv_worker_pool_t *pool = lluv_check_worker_pool(L, 1);
+  lluv_msg_t *msg;
+  int i, err;
+
+  if(pool->closing)
+    return lluv_fail(L, pool->flags, LLUV_ERR_UV, UV_ECANCELED, NULL);
+
+  /* serialize only once */
+  err = lluv_msg_pack(L, 2, LLUV_MSG_DATA, 0, &msg);
+  if(err < 0)
+    return lluv_fail(L, pool->flags, LLUV_ERR_UV, err, "can not serialize value");
+
+  for(i = 0; i < pool->n; ++i){
+    lluv_msg_t *copy = lluv_msg_copy(msg, pool->workers[i].id);
+    if(!copy){
+      lluv_msg_free(msg);
+      return lluv_fail(L, pool->flags, LLUV_ERR_UV, UV_ENOMEM, NULL);
+    }
+    lluv_mqueue_push(&pool->workers[i].inbox, copy);
+  }
+  lluv_msg_free(msg);
+
+  lua_settop(L, 1);
+  return 1;
+}
+
+static int lluv_worker_pool_on_message(lua_State *L){
+  lluv_worker_pool_t *pool = lluv_check_worker_pool(L, 1);
+
+  luaL_unref(L, LLUV_LUA_REGISTRY, pool->cb);
+  pool->cb = LUA_NOREF;
+
+  if(!lua_isnoneornil(L, 2)){
+    lluv_check_callable(L, 2);
+    lua_settop(L, 2);
+    pool->cb = luaL_ref(L, LLUV_LUA_REGISTRY);
+
+    /* deliver messages received before callback was set */
+    uv_async_send(&pool->async);
+  }
+
+  lua_settop(L, 1);
+  return 1;
+}
+
+static int lluv_worker_pool_size(lua_State *L){
+  lluv_worker_pool_t *pool = lluv_check_worker_pool(L, 1);
+  lua_pushinteger(L, pool->n);
+  return 1;
+}
+
+// close([cb])
+static int lluv_worker_pool_close(lua_State *L){
+  lluv_worker_pool_t **ud = (lluv_worker_pool_t **)lutil_checkudatap (L, 1, LLUV_WORKER_POOL);
+  lluv_worker_pool_t *pool;
+
+  luaL_argcheck (L, ud != NULL, 1, LLUV_WORKER_POOL_NAME" expected");
+  pool = *ud;
+
+  if(!pool || pool->closing) return 0;
+
+  if(!lua_isnoneornil(L, 2)){
+    lluv_check_callable(L, 2);
+    lua_settop(L, 2);
+    pool->close_cb = luaL_ref(L, LLUV_LUA_REGISTRY);
+  }
+
+  pool->closing = 1;
+  lluv_worker_pool_stop_all(pool);
+
+  /* all workers already done */
+  if(pool->alive == 0) uv_async_send(&pool->async);
+
+  return 0;
+}
+
+static int lluv_worker_pool__gc(lua_State *L){
+  lluv_worker_pool_t **ud = (lluv_worker_pool_t **)lutil_checkudatap (L, 1, LLUV_WORKER_POOL);
+  lluv_worker_pool_t *pool = ud ? *ud : NULL;
+
+  if(!pool) return 0;
+
+  /* blocking shutdown */
+  if(!pool->closing){
+    pool->closing = 1;
+    lluv_worker_pool_stop_all(pool);
+  }
+  lluv_worker_pool_release(L, pool, 1);
+
+  return 0;
+}
+
+static int lluv_worker_pool_to_s(lua_State *L){
+  lluv_worker_pool_t **ud = (lluv_worker_pool_t **)lutil_checkudatap (L, 1, LLUV_WORKER_POOL);
+  luaL_argcheck (L, ud != NULL, 1, LLUV_WORKER_POOL_NAME" expected");
+  lua_pushfstring(L, LLUV_WORKER_POOL_NAME" (%p)", ud);
+  return 1;
+}
+
+static const struct luaL_Reg lluv_worker_pool_methods[] = {
+  { "__tostring",  lluv_worker_pool_to_s       },
+  { "__gc",        lluv_worker_pool__gc        },
+  { "send",        lluv_worker_pool_send       },
+  { "post",        lluv_worker_pool_post       },
+  { "broadcast",   lluv_worker_pool_broadcast  },
+  { "on_message",  lluv_worker_pool_on_message },
+  { "size",        lluv_worker_pool_size       },
+  { "close",       lluv_worker_pool_close      },
+
+  {NULL,NULL}
+};
+
+//}
+
+#define LLUV_FUNCTIONS(F)                        \
+  {"worker_pool", lluv_worker_pool_new_##F},     \
+  {"worker_port", lluv_worker_port_new},         \
+
+static const struct luaL_Reg lluv_functions[][3] = {
+  {
+    LLUV_FUNCTIONS(unsafe)
+
+    {NULL,NULL}
+  },
+  {
+    LLUV_FUNCTIONS(safe)
+
+    {NULL,NULL}
+  },
+};
+
+LLUV_INTERNAL void lluv_worker_initlib(lua_State *L, int nup, int safe){
+  lutil_pushnvalues(L, nup);
+  if(!lutil_createmetap(L, LLUV_WORKER_POOL, lluv_worker_pool_methods, nup))
+    lua_pop(L, nup);
+  lua_pop(L, 1);
+
+  lutil_pushnvalues(L, nup);
+  if(!lutil_createmetap(L, LLUV_WORKER_PORT, lluv_worker_port_methods, nup))
+    lua_pop(L, nup);
+  lua_pop(L, 1);
+
+  luaL_setfuncs(L, lluv_functions[safe], nup);
+}
@@ -0,0 +1,28 @@
+/******************************************************************************
+* Author: Alexey Melnichuk <alexeymelnichuck@gmail.com>
+*
+* Copyright (C) 2014-2019 Alexey Melnichuk <alexeymelnichuck@gmail.com>
+*
+* Licensed according to the included 'LICENSE' document
+*
+* This file is part of lua-lluv library.
+******************************************************************************/
+
+#ifndef _LLUV_WORKER_H_
+#define _LLUV_WORKER_H_
+
+#include "lluv.h"
+#include "lluv_utils.h"
+
+LLUV_INTERNAL void lluv_worker_initlib(lua_State *L, int nup, int safe);
+
+/* returns 1 if Lua state belongs to worker thread */
+LLUV_INTERNAL int lluv_is_worker_state(lua_State *L);
+
+/* set package paths and preload library into new Lua state */
+LLUV_INTERNAL void lluv_worker_prepare_state(lua_State *L, const char *path, const char *cpath);
+
+/* returns copy of string field of `package` table or NULL */
+LLUV_INTERNAL char *lluv_worker_package_field(lua_State *L, const char *name);
+
+#endif
@@ -51,15 +51,20 @@ local TEXT_EOL   = is_windows and "\r\n" or "\n"
 
 local BINARY_EOL = "\n"
 
-local BUFFER_SIZE = 4096
+-- read-ahead window of native reader
+local READ_CHUNK_SIZE = 256 * 1024
+
+local READ_CHUNKS = 2
 
 local File = ut.class() do
 
 function File:__init()
   self._co   = assert(coroutine.running())
-  self._buf  = uv.buffer(BUFFER_SIZE)
   self._wait = false
 
+  -- number of dropped readers which still have active read request
+  self._closing_readers = 0
+
   return self
 end
 
@@ -136,6 +141,9 @@ end
 function File:close()
   local terminated
 
+  -- reader may have active read request
+  self:_reset_reader(true)
+
   self._fd:close(function(file, err, result)
     if terminated then return end
 
@@ -152,45 +160,98 @@ function File:close()
   return ok, err
 end
 
-function File:_read_some(n)
-  local terminated
+-- Sequential reads are served by native reader which prefetches
+-- next chunks while current one is consumed. Reader is dropped
+-- when position changed by seek or write.
+function File:_get_reader()
+  if not self._reader then
+    local reader, err = self._fd:reader(self._pos, {
+      chunk_size = READ_CHUNK_SIZE;
+      chunks     = READ_CHUNKS;
+    })
+    if not reader then return nil, err end
+    self._reader = reader
+  end
+  return self._reader
+end
+
+-- File can not be closed while reader has active read request
+-- so `wait` suspends until all dropped readers are done.
+function File:_reset_reader(wait)
+  local reader = self._reader
+
+  if reader then
+    self._reader = nil
+    self._closing_readers = self._closing_readers + 1
+
+    reader:close(function()
+      self._closing_readers = self._closing_readers - 1
+      if self._closing_readers == 0 and self._on_readers_closed then
+        self._on_readers_closed()
+      end
+    end)
+  end
 
-  n = n or self._buf:size()
+  if not (wait and self._closing_readers > 0) then return end
 
-  assert(n <= self._buf:size())
+  local terminated
 
-  self._fd:read(self._buf, self._pos, 0, n, function(file, err, buffer, size)
+  self._on_readers_closed = function()
     if terminated then return end
+    self:_resume(true)
+  end
 
-    if err then return self:_resume(nil, err) end
+  self:_yield()
+  terminated = true
+  self._on_readers_closed = nil
+end
 
-    if size == 0 then return self:_resume() end
+function File:_wait_reader(reader)
+  local terminated
 
-    self._pos = self._pos + size
-    self:_resume(buffer:to_s(size))
+  reader:wait(function()
+    if terminated then return end
+    self:_resume(true)
   end)
 
   local ok, err = self:_yield()
   terminated = true
 
-  if not ok then return nil, err end
+  return ok, err
+end
 
-  return ok
+-- call reader method until it returns data, EOF or error
+function File:_read_buffered(method, ...)
+  local reader, err = self:_get_reader()
+  if not reader then return nil, err end
+
+  while true do
+    local chunk, err = reader[method](reader, ...)
+
+    if chunk ~= false then
+      self._pos = reader:tell()
+      -- file can grow so next read starts new reader
+      if chunk == nil and err == nil then self:_reset_reader() end
+      return chunk, err
+    end
+
+    local ok, err = self:_wait_reader(reader)
+    if not ok then return nil, err end
+  end
+end
+
+function File:_read_some(n)
+  return self:_read_buffered('read', n)
 end
 
 function File:read_n(n)
-  local chunk_size = self._buf:size()
-  if n <= chunk_size then
-    return self:_read_some(n)
-  end
   local res = {}
   while n > 0 do
-    local chunk, err = self:_read_some(math.min(chunk_size, n))
+    local chunk, err = self:_read_some(n)
     if not chunk then
       if err then return nil, err, table.concat(res) end
       break
     end
-    if #chunk == 0 then break end
     n = n - #chunk
     res[#res + 1] = chunk
   end
@@ -203,27 +264,7 @@ function File:read_all()
 end
 
 function File:read_line(keep)
-  local res = ''
-  while true do
-    local chunk, err = self:_read_some()
-    if not chunk then
-      if err then return nil, err end
-      if #res > 0 then return res end
-      return nil -- EOF
-    end
-    if chunk == '' then return res end
-
-    res = res .. chunk
-    local i = string.find(res, self._eol, nil, true)
-
-    if i then
-      local rest_size = #res - (i - 1 + #self._eol)
-      self._pos = self._pos - rest_size
-
-      if keep then i = i + #self._eol end
-      return string.sub(res, 1, i - 1)
-    end
-  end
+  return self:_read_buffered('read_line', keep, self._eol)
 end
 
 function File:read_pat(pat)
@@ -262,6 +303,8 @@ end
 function File:write_string(str)
   local terminated
 
+  self:_reset_reader()
+
   self._fd:write(str, self._pos, function(file, err, ...)
     if terminated then return end
 
@@ -321,7 +364,11 @@ function File:seek(whence, offset)
     error("invalid option '" .. tostring(whence) .. "'", 2)
   end
 
-  self._pos = math.max(0, pos)
+  pos = math.max(0, pos)
+
+  if pos ~= self._pos then self:_reset_reader() end
+
+  self._pos = pos
 
   return self._pos
 end
@@ -363,6 +410,7 @@ function File:datasync()
 end
 
 function File:truncate(offset)
+  self:_reset_reader()
   return call_fs(self, self._fd.truncate, offset or 0)
 end
 
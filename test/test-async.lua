@@ -0,0 +1,81 @@
+local uv  = require "lluv.unsafe"
+
+local PASS = false
+
+local TIMER = uv.timer():start(10000, function()
+  uv.stop()
+end)
+
+local function test_local(done)
+  local calls, wakeups = {}, 0
+
+  local async = uv.async(function(self, ...)
+    if select('#', ...) == 0 then
+      wakeups = wakeups + 1
+      return
+    end
+    calls[#calls + 1] = {...}
+  end)
+
+  -- sends without payload are coalesced
+  async:send():send()
+
+  uv.timer():start(10, function(self)
+    self:close()
+    assert(wakeups == 1, wakeups)
+    assert(#calls == 0)
+
+    async:send(1, "a"):send(2, {x = 1})
+
+    uv.timer():start(10, function(self)
+      self:close()
+      assert(wakeups == 1, wakeups)
+      assert(#calls == 2, #calls)
+      assert(calls[1][1] == 1 and calls[1][2] == "a")
+      assert(calls[2][1] == 2 and calls[2][2].x == 1)
+      async:close(done)
+    end)
+  end)
+end
+
+local function test_threads(done)
+  local N, W, got, last = 100, 2, 0, {}
+  local pool = uv.worker_pool{n = W, module = "worker_async"}
+
+  local ptr
+
+  local async = uv.async(function(self, id, i)
+    if id == nil then return end
+    assert(i == (last[id] or 0) + 1, "invalid order")
+    last[id] = i
+    got = got + 1
+    if got == N * W then
+      pool:close(function()
+        self:close(function()
+          -- pointer outlives handle but send fails
+          local ok, err = pcall(uv.async_send, ptr, 1)
+          assert(not ok)
+          assert(err:name() == "EPIPE", tostring(err))
+          uv.async_release(ptr)
+          done()
+        end)
+      end)
+    end
+  end)
+
+  ptr = async:ptr()
+  pool:broadcast(ptr, N)
+end
+
+test_local(function()
+  test_threads(function()
+    PASS = true
+    TIMER:close()
+  end)
+end)
+
+uv.run()
+
+if not PASS then os.exit(1) end
+
+print("Done!")
@@ -0,0 +1,87 @@
+local uv   = require "lluv.unsafe"
+
+local PASS = false
+
+local TIMER = uv.timer():start(10000, function()
+  uv.stop()
+end)
+
+local N = 5
+
+local before = uv.buffer_stats()
+assert(before.in_use == 0, before.in_use)
+
+local function Client(host, port)
+  uv.tcp():connect(host, port, function(cli, err)
+    if err then
+      io.stderr:write("Can not connect to server:", tostring(err), "\n")
+      return cli:close()
+    end
+
+    -- send messages one by one so each one read by separate callback
+    local i = 0
+    uv.timer():start(1, 10, function(self)
+      i = i + 1
+      if i > N then
+        self:close()
+        return cli:close()
+      end
+      cli:write("message #" .. i)
+    end)
+  end)
+end
+
+local reads = 0
+
+local function on_read(cli, err, data)
+  if err then
+    if err:name() == 'EOF' then
+      PASS = reads > 0
+      TIMER:close()
+    else
+      io.stderr:write("Can not read data:", tostring(err), "\n")
+    end
+    return cli:close()
+  end
+
+  -- buffer already returned to pool before callback but it was taken for read
+  local stats = uv.buffer_stats()
+  assert(stats.peak >= 1, stats.peak)
+  assert(stats.allocs - before.allocs > reads, stats.allocs)
+  reads = reads + 1
+end
+
+local function on_connection(server, err)
+  if err then
+    io.stderr:write("Can not listen on server:", tostring(err), "\n")
+    return server:close()
+  end
+
+  server:accept():start_read(on_read)
+  server:close()
+end
+
+uv.tcp():bind("127.0.0.1", 0, function(server, err)
+  if err then
+    io.stderr:write("Can not bind on server:", tostring(err), "\n")
+    return server:close()
+  end
+
+  server:listen(on_connection)
+
+  Client(server:getsockname())
+end)
+
+uv.run()
+
+if not PASS then os.exit(1) end
+
+local after = uv.buffer_stats()
+assert(after.in_use == 0, after.in_use)
+assert(after.allocs - before.allocs >= reads, after.allocs)
+-- released blocks are reused by next reads
+assert(after.hits - before.hits >= reads - 1, after.hits)
+assert(after.cached > 0, after.cached)
+assert(after.peak >= 1)
+
+print("Done!")
@@ -0,0 +1,96 @@
+local uv   = require "lluv.unsafe"
+
+local PASS = false
+
+local TIMER = uv.timer():start(10000, function()
+  uv.stop()
+end)
+
+local function Client(host, port)
+  uv.tcp():connect(host, port, function(cli, err)
+    if err then
+      io.stderr:write("Can not connect to server:", tostring(err), "\n")
+      return cli:close()
+    end
+
+    cli:cork("auto")
+
+    for i = 1, 100 do
+      cli:write(string.format("%.3d;", i))
+    end
+
+    -- invalid argument does not drop pending data
+    assert(not pcall(cli.write, cli, "BAD", 1))
+
+    -- write with callback sends pending data first
+    cli:write("END", function(cli, err)
+      assert(not err, tostring(err))
+    end)
+
+    cli:write{"HELLO", ", ", "WORLD", "!!!"}
+
+    -- internal hooks are invisible
+    for _, h in ipairs(uv.handles()) do
+      assert(type(h.close) == "function", "invalid handle in list")
+    end
+
+    cli:close()
+  end)
+end
+
+local result = {}
+
+local function on_read(cli, err, data)
+  if err then
+    if err:name() == 'EOF' then
+      io.stderr:write("Read done.\n")
+      local expected = {}
+      for i = 1, 100 do expected[#expected + 1] = string.format("%.3d;", i) end
+      expected[#expected + 1] = "END"
+      expected[#expected + 1] = "HELLO, WORLD!!!"
+      assert(table.concat(result) == table.concat(expected))
+      PASS = true
+      TIMER:close()
+    else
+      io.stderr:write("Can not read data:", tostring(err), "\n")
+    end
+    return cli:close()
+  end
+
+  result[#result + 1] = data
+end
+
+local function on_connection(server, err)
+  if err then
+    io.stderr:write("Can not listen on server:", tostring(err), "\n")
+    return server:close()
+  end
+
+  server
+    :accept()
+    :start_read(on_read)
+  server:close()
+end
+
+local function on_bind(server, err)
+  if err then
+    io.stderr:write("Can not bind on server:", tostring(err), "\n")
+    return server:close()
+  end
+
+  local host, port = server:getsockname()
+
+  io.stderr:write("Bind on:", host, ":", port, "\n")
+
+  server:listen(on_connection)
+
+  Client(host, port)
+end
+
+uv.tcp():bind("127.0.0.1", 0, on_bind)
+
+uv.run()
+
+if not PASS then os.exit(1) end
+
+print("Done!")
@@ -0,0 +1,64 @@
+local uv  = require "lluv.unsafe"
+
+local PASS = false
+
+local TIMER = uv.timer():start(10000, function()
+  uv.stop()
+end)
+
+local function test_budget()
+  local N, calls = 100, 0
+
+  uv.defer_policy("budget", {count = 10})
+  assert(uv.defer_stats().policy == "budget")
+  assert(uv.defer_stats().count  == 10)
+
+  local drained = uv.defer_stats().drained
+  local carried = uv.defer_stats().carried
+
+  uv.timer():start(1, function(self)
+    self:close()
+    for i = 1, N do uv.defer(function(j)
+      calls = calls + 1
+      assert(calls == j, j)
+      if j == N then
+        local stats = uv.defer_stats()
+        -- each call counted once when first carried
+        assert(stats.carried - carried == N - 10, stats.carried - carried)
+        assert(stats.drained - drained >= N, stats.drained)
+        uv.defer_policy("callback")
+        PASS = true
+        TIMER:close()
+      end
+    end, i) end
+    -- only first 10 calls done in this iteration
+    assert(calls == 0)
+  end)
+end
+
+-- deferred call from first timer proceed only after second timer
+-- because both timers expire in same iteration.
+uv.defer_policy("iteration")
+assert(uv.defer_stats().policy == "iteration")
+
+local called = false
+
+uv.timer():start(10, function(self)
+  self:close()
+  uv.defer(function() called = true end)
+end)
+
+uv.timer():start(10, function(self)
+  self:close()
+  assert(not called)
+  uv.defer(function()
+    assert(called)
+    test_budget()
+  end)
+end)
+
+uv.run()
+
+if not PASS then os.exit(1) end
+
+print("Done!")
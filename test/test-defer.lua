@@ -0,0 +1,53 @@
+local uv  = require "lluv.unsafe"
+
+local PASS = false
+
+local TIMER = uv.timer():start(10000, function()
+  uv.stop()
+end)
+
+local N, calls = 1000, {}
+
+-- every argument stored in its own slot
+local ARGS = false
+uv.defer(function(a, b, c)
+  assert(a == "a", a)
+  assert(b == 2, b)
+  assert(c == true, c)
+  ARGS = true
+end, "a", 2, true)
+
+local function on_defer(i, a, b, c)
+  assert(a == nil, a)
+  assert(b == i * 2, b)
+  assert(c == nil, c)
+  calls[#calls + 1] = i
+end
+
+-- more calls than initial ring size so it have to grow
+for i = 1, N do uv.defer(on_defer, i, nil, i * 2, nil) end
+
+-- calls from deferred function proceed in same order
+uv.defer(function()
+  assert(ARGS)
+  assert(#calls == N, #calls)
+  for i = 1, N do assert(calls[i] == i, calls[i]) end
+
+  local n = 0
+  for i = 1, 10 do uv.defer(function(j)
+    n = n + 1
+    assert(n == j, j)
+  end, i) end
+
+  uv.default_loop():defer(function()
+    assert(n == 10, n)
+    PASS = true
+    TIMER:close()
+  end)
+end)
+
+uv.run()
+
+if not PASS then os.exit(1) end
+
+print("Done!")
@@ -0,0 +1,154 @@
+local RUN = lunit and function()end or function ()
+  local res = lunit.run()
+  if res.errors + res.failed > 0 then
+    os.exit(-1)
+  end
+  return os.exit(0)
+end
+
+local lunit      = require "lunit"
+local TEST_CASE  = assert(lunit.TEST_CASE)
+local skip       = lunit.skip or function() end
+
+local uv   = require "lluv"
+
+local ENABLE = true
+
+local _ENV = TEST_CASE'fixed buffer' if ENABLE then
+
+local it = setmetatable(_ENV or _M, {__call = function(self, describe, fn)
+  self["test " .. describe] = fn
+end})
+
+it("integers", function()
+  local b = uv.buffer(16):fill(0)
+
+  assert_equal(b, b:set_u16be(0, 0x0102))
+  assert_equal("\1\2", b:to_s(0, 2))
+  assert_equal(0x0102, b:get_u16be(0))
+  assert_equal(0x0201, b:get_u16le(0))
+
+  b:set_u32le(2, 0x01020304)
+  assert_equal("\4\3\2\1", b:to_s(2, 4))
+  assert_equal(0x01020304, b:get_u32le(2))
+
+  b:set_i8(6, -1)
+  assert_equal(255, b:get_u8(6))
+  assert_equal(-1,  b:get_i8(6))
+
+  b:set_i16le(7, -2)
+  assert_equal(-2, b:get_i16le(7))
+
+  b:set_i32be(9, -3)
+  assert_equal(-3, b:get_i32be(9))
+
+  assert_error(function() b:get_u32le(13) end)
+  assert_error(function() b:get_u8(16)    end)
+end)
+
+it("floats", function()
+  local b = uv.buffer(8)
+
+  b:set_f64le(0, 1.5)
+  assert_equal(1.5, b:get_f64le(0))
+
+  b:set_f32be(0, -0.25)
+  assert_equal(-0.25, b:get_f32be(0))
+end)
+
+it("find", function()
+  local b = uv.buffer(10):copy(0, "0123\r\n6789")
+
+  assert_equal(4,   b:find("\r\n"))
+  assert_equal(0,   b:find("0"))
+  assert_equal(9,   b:find("9"))
+  assert_equal(nil, b:find("9", 0, 9))
+  assert_equal(nil, b:find("ab"))
+  assert_equal(6,   b:find("6", 5))
+end)
+
+it("copy and fill", function()
+  local b = uv.buffer(6):fill("-")
+  assert_equal("------", b:to_s())
+
+  b:copy(1, "abcd", 1, 2)
+  assert_equal("-bc---", b:to_s())
+
+  local c = uv.buffer(6):fill(0x41)
+  c:copy(0, b, 1, 2)
+  assert_equal("bcAAAA", c:to_s())
+
+  c:fill("z", 4)
+  assert_equal("bcAAzz", c:to_s())
+
+  assert_error(function() c:copy(5, "ab") end)
+end)
+
+it("slice", function()
+  local b = uv.buffer(8):copy(0, "01234567")
+  local s = b:slice(2, 4)
+
+  assert_true(s:is_view())
+  assert_false(b:is_view())
+  assert_equal(4, s:size())
+  assert_equal("2345", s:to_s())
+
+  s:fill("x", 1, 2)
+  assert_equal("012xx567", b:to_s())
+
+  local ss = s:slice(1)
+  assert_equal("xx5", ss:to_s())
+
+  assert_error(function() b:slice(9) end)
+  assert_error(function() s:slice(2, 3) end)
+end)
+
+it("growable", function()
+  local b = uv.buffer(4, true):copy(0, "abcd")
+  assert_true(b:growable())
+  assert_false(uv.buffer(4):growable())
+
+  b:resize(8)
+  assert_equal(8, b:size())
+  assert_equal("abcd", b:to_s(0, 4))
+
+  local s = b:slice(0, 2)
+  assert_error(function() b:resize(16) end)
+  s = nil
+  for i = 1, 5 do collectgarbage('collect') end
+
+  b:resize(2)
+  assert_equal("ab", b:to_s())
+
+  assert_error(function() uv.buffer(4):resize(8) end)
+end)
+
+it("pinned by file request", function()
+  local FILE = "./fbuf.txt"
+  local f = assert(uv.fs_open(FILE, "w+"))
+  assert(f:write("0123456789"))
+
+  local b, done = uv.buffer(4, true), false
+  f:read(b, 0, function(self, err, buf, size)
+    assert_nil(err)
+    assert_equal(4, size)
+    -- request done so buffer can be resized
+    assert_equal(b, b:resize(8))
+    done = true
+  end)
+
+  local ok, err = pcall(b.resize, b, 32)
+  assert_false(ok)
+  assert_equal("EBUSY", err:name())
+
+  assert_equal(0, uv.run())
+  assert_true(done)
+  assert_equal("0123", b:to_s(0, 4))
+
+  f:close()
+  uv.fs_unlink(FILE)
+end)
+
+end
+
+RUN()
@@ -0,0 +1,86 @@
+local uv   = require "lluv.unsafe"
+
+local PASS = false
+
+local TIMER = uv.timer():start(10000, function()
+  uv.stop()
+end)
+
+local FILE = "./appender.log"
+
+-- file may not exist
+pcall(uv.fs_unlink, FILE)
+
+local N, done, batches = 100, 0, 0
+
+local log = assert(uv.fs_appender(FILE, {
+  max_batch_bytes   = 256;
+  flush_interval_ms = 5;
+  sync              = "data";
+  on_batch          = function(self, err, records, bytes)
+    assert(not err, tostring(err))
+    batches = batches + 1
+  end;
+}))
+
+local buf = uv.buffer(4)
+buf:copy(0, "buf\n")
+
+local expected = {}
+for i = 1, N do
+  local data = (i % 10 == 0) and buf or ("record #" .. i .. "\n")
+  expected[#expected + 1] = (type(data) == "string") and data or "buf\n"
+  log:write(data, function(self, err)
+    assert(self == log)
+    assert(not err, tostring(err))
+    done = done + 1
+    assert(done == i, "records done out of order")
+  end)
+end
+
+log:flush(function(self, err)
+  assert(not err, tostring(err))
+  assert(done == N, done)
+
+  local stats = log:stats()
+  assert(stats.records == N, stats.records)
+  assert(stats.syncs < N, stats.syncs)
+  assert(stats.batches == batches, stats.batches)
+  assert(stats.pending == 0, stats.pending)
+
+  log:close(function(self, err)
+    assert(not err, tostring(err))
+
+    local f = assert(uv.fs_open(FILE, "r"))
+    local buf, n = f:read(4096)
+    f:close()
+    assert(buf:to_s(0, n) == table.concat(expected))
+
+    PASS = true
+    TIMER:close()
+  end)
+end)
+
+uv.run()
+
+-- pending records are limited
+do
+  local log = assert(uv.fs_appender(FILE, {max_pending_bytes = 16}))
+  assert(log:write(("x"):rep(10)) == 10)
+  local ok, err = pcall(log.write, log, ("x"):rep(10))
+  assert(not ok)
+  assert(err:name() == 'ENOBUFS', tostring(err))
+  -- one record can exceed limit
+  log:flush(function(self, err)
+    assert(not err, tostring(err))
+    assert(self:write(("x"):rep(32)) == 32)
+    self:close()
+  end)
+  uv.run()
+end
+
+uv.fs_unlink(FILE)
+
+if not PASS then os.exit(1) end
+
+print("Done!")
@@ -0,0 +1,75 @@
+local uv   = require "lluv.unsafe"
+
+local PASS = false
+
+local TIMER = uv.timer():start(10000, function()
+  uv.stop()
+end)
+
+local N = 10
+
+local DIR = assert(uv.fs_mkdtemp("./opendir.XXXXXX"))
+for i = 1, N do
+  assert(uv.fs_open(DIR .. "/file" .. i, "w")):close()
+end
+
+local function cleanup()
+  for i = 1, N do uv.fs_unlink(DIR .. "/file" .. i) end
+  uv.fs_rmdir(DIR)
+end
+
+-- sync
+local dir = assert(uv.fs_opendir(DIR, {entries = 4}))
+local count = 0
+while true do
+  local names, types = assert(dir:read())
+  assert(#names <= 4)
+  if #names == 0 then break end
+  for i = 1, #names do
+    assert(types[i] == "file" or types[i] == "unknown", types[i])
+  end
+  count = count + #names
+end
+dir:close()
+assert(count == N, count)
+
+-- async
+uv.fs_opendir(DIR, {entries = 3}, function(dir, err, path)
+  assert(not err, tostring(err))
+  assert(path == DIR)
+
+  local found, batches = {}, 0
+
+  local function on_read(self, err, names)
+    assert(self == dir)
+    assert(not err, tostring(err))
+
+    if #names == 0 then
+      assert(batches >= 4, batches)
+      for i = 1, N do assert(found["file" .. i], i) end
+      return dir:close(function()
+        PASS = true
+        TIMER:close()
+      end)
+    end
+
+    batches = batches + 1
+    assert(#names <= 3)
+    for _, name in ipairs(names) do found[name] = true end
+    dir:read(on_read)
+  end
+
+  dir:read(on_read)
+
+  -- only one read at a time
+  local ok, err = dir:read(on_read)
+  assert(ok == nil and err:name() == "EBUSY", tostring(err))
+end)
+
+uv.run()
+
+cleanup()
+
+if not PASS then os.exit(1) end
+
+print("Done!")
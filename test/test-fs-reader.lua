@@ -0,0 +1,91 @@
+local uv   = require "lluv.unsafe"
+
+local PASS = false
+
+local unpack = unpack or table.unpack
+
+local TIMER = uv.timer():start(10000, function()
+  uv.stop()
+end)
+
+local FILE = "./reader.txt"
+
+local lines = {}
+for i = 1, 200 do
+  lines[#lines + 1] = string.rep(string.char(65 + i % 26), i % 37) .. "#" .. i
+end
+local DATA = table.concat(lines, "\r\n")
+
+local f = assert(uv.fs_open(FILE, "w+"))
+f:write(DATA)
+
+-- small chunks so lines and eol are split between chunks
+local reader = assert(f:reader(0, {chunk_size = 7, chunks = 3}))
+
+-- file can not be closed while reader prefetches data
+local ok, err = f:close()
+assert(ok == nil, tostring(ok))
+assert(err:no() == uv.EBUSY, tostring(err))
+
+-- read until method returns data or EOF
+local function read(method, done, ...)
+  local args, n = {...}, select('#', ...)
+  local function step()
+    local res, err = reader[method](reader, unpack(args, 1, n))
+    if res == false then
+      return reader:wait(step)
+    end
+    assert(not err, tostring(err))
+    done(res)
+  end
+  step()
+end
+
+local result = {}
+
+local function next_line()
+  read("read_line", function(line)
+    if line then
+      result[#result + 1] = line
+      return next_line()
+    end
+
+    assert(#result == #lines, #result)
+    for i = 1, #lines do assert(result[i] == lines[i], i) end
+    assert(reader:tell() == #DATA)
+
+    reader:close(function(self)
+      assert(self == reader)
+
+      -- read by blocks from the middle of file
+      local pos = #lines[1] + 2
+      reader = f:reader(pos, {chunk_size = 5})
+      local res = {}
+      local function next_block()
+        read("read", function(data)
+          if data then
+            assert(#data <= 4)
+            res[#res + 1] = data
+            return next_block()
+          end
+          assert(table.concat(res) == DATA:sub(pos + 1))
+          reader:close()
+          f:close()
+          PASS = true
+          TIMER:close()
+        end, 4)
+      end
+      next_block()
+    end)
+  end, false, "\r\n")
+end
+
+next_line()
+
+uv.run()
+
+uv.fs_unlink(FILE)
+
+if not PASS then os.exit(1) end
+
+print("Done!")
@@ -0,0 +1,84 @@
+local uv   = require "lluv.unsafe"
+
+local PASS = false
+
+local TIMER = uv.timer():start(10000, function()
+  uv.stop()
+end)
+
+local SRC_FILE = "./sendfile.src.txt"
+local DST_FILE = "./sendfile.dst.txt"
+
+local DATA = {}
+for i = 1, 64 * 1024 do DATA[#DATA + 1] = string.format("%08d", i) end
+DATA = table.concat(DATA) -- 512 KiB
+
+local src = assert(uv.fs_open(SRC_FILE, "w+"))
+assert(src:write(DATA))
+
+-- sync copy to file descriptor
+local dst = assert(uv.fs_open(DST_FILE, "w+"))
+assert(src:sendfile(dst:fd(), 8, 16) == 16)
+assert(src:sendfile(dst:fd(), #DATA - 8) == 8)
+dst:close()
+
+dst = assert(uv.fs_open(DST_FILE, "r"))
+local buf, n = dst:read(64)
+assert(n == 24)
+assert(buf:to_s(0, n) == DATA:sub(9, 24) .. DATA:sub(-8))
+dst:close()
+
+local result = {}
+
+local function on_connection(server, err)
+  assert(not err, tostring(err))
+
+  server:accept():start_read(function(cli, err, data)
+    if err then
+      assert(err:name() == 'EOF', tostring(err))
+      assert(table.concat(result) == DATA:sub(101))
+      PASS = true
+      TIMER:close()
+      return cli:close()
+    end
+    result[#result + 1] = data
+  end)
+  server:close()
+end
+
+uv.tcp():bind("127.0.0.1", 0, function(server, err)
+  assert(not err, tostring(err))
+
+  server:listen(on_connection)
+
+  local host, port = server:getsockname()
+  uv.tcp():connect(host, port, function(cli, err)
+    assert(not err, tostring(err))
+
+    -- corked data sent before file content
+    cli:cork('manual')
+    cli:write(DATA:sub(101, 200))
+
+    src:sendfile(cli, 200, nil, function(file, err, sent)
+      assert(file == src)
+      assert(not err, tostring(err))
+      assert(sent == #DATA - 200, sent)
+      cli:close()
+    end)
+
+    -- file pinned while transfer in progress
+    local ok, err = src:close()
+    assert(ok == nil, tostring(ok))
+    assert(err:no() == uv.EBUSY, tostring(err))
+  end)
+end)
+
+uv.run()
+
+src:close()
+uv.fs_unlink(SRC_FILE)
+uv.fs_unlink(DST_FILE)
+
+if not PASS then os.exit(1) end
+
+print("Done!")
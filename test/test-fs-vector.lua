@@ -0,0 +1,66 @@
+local uv   = require "lluv.unsafe"
+
+local PASS = false
+
+local TIMER = uv.timer():start(10000, function()
+  uv.stop()
+end)
+
+local FILE = "./vector.txt"
+
+local buf = uv.buffer(16)
+buf:copy(0, "0123456789ABCDEF")
+
+local f = assert(uv.fs_open(FILE, "w+"))
+
+-- sync
+local data, n = f:write({"Hello", ", ", buf:slice(10, 6), "!"})
+assert(n == 14, n)
+
+local a, b = uv.buffer(5), uv.buffer(16)
+local bufs, n = f:read({a, b:slice(2, 4)})
+assert(n == 9, n)
+assert(bufs[1] == a)
+assert(a:to_s() == "Hello")
+assert(b:to_s(2, 4) == ", AB")
+
+-- strings are not allowed for read
+assert(not pcall(f.read, f, {"Hello"}))
+assert(not pcall(f.write, f, {}))
+
+-- buffers are pinned while request is active
+local g = uv.buffer(4, true)
+f:read({g, uv.buffer(2)}, 0, function(self, err, bufs, size)
+  assert(not err, tostring(err))
+  assert(g:resize(8) == g)
+end)
+local ok, err = pcall(g.resize, g, 16)
+assert(not ok)
+assert(err:name() == "EBUSY", tostring(err))
+
+-- async
+f:write({"[", buf, "]"}, 14, function(self, err, data, size)
+  assert(self == f)
+  assert(not err, tostring(err))
+  assert(size == 18, size)
+
+  local head, tail = uv.buffer(14), uv.buffer(64)
+  f:read({head, tail}, 0, function(self, err, bufs, size)
+    assert(not err, tostring(err))
+    assert(size == 32, size)
+    assert(head:to_s() == "Hello, ABCDEF!")
+    assert(tail:to_s(0, 18) == "[0123456789ABCDEF]")
+
+    f:close()
+    PASS = true
+    TIMER:close()
+  end)
+end)
+
+uv.run()
+
+uv.fs_unlink(FILE)
+
+if not PASS then os.exit(1) end
+
+print("Done!")
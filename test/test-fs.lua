@@ -40,7 +40,7 @@ local function gc_collect(n)
   for i = 1, n or 5 do collectgarbage('collect') end
 end
 
-local select, ipairs, string, jit = select, ipairs, string, jit
+local select, ipairs, string, table, jit = select, ipairs, string, table, jit
 local _VERSION = _VERSION
 
 local ENABLE = true
@@ -324,6 +324,27 @@ it('lines should works', function()
   end
 end)
 
+it('should read lines across read-ahead chunks', function()
+  local lines = {}
+  for i = 1, 20000 do lines[i] = string.rep('x', i % 100) .. i end
+  local data = table.concat(lines, '\n')
+  mkfile(TEST_FILE, data)
+
+  ut.corun(function()
+    file, err = assert(fs.open(TEST_FILE, 'rb'))
+    for i = 1, #lines do assert_equal(lines[i], file:read('*l')) end
+    assert_nil(file:read('*l'))
+
+    assert_equal(10, file:seek('set', 10))
+    assert_equal(data:sub(11, 20), file:read(10))
+    assert_equal(20, file:seek())
+    assert_equal(data:sub(21), file:read('*a'))
+    assert(file:close())
+  end)
+
+  assert_equal(0, uv.run())
+end)
+
 end
 
 RUN()
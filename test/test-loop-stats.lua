@@ -0,0 +1,71 @@
+local uv  = require "lluv.unsafe"
+
+local PASS = false
+
+local TIMER = uv.timer():start(10000, function()
+  uv.stop()
+end)
+
+local function busy(ms)
+  local deadline = uv.hrtime() + ms * 1000000
+  while uv.hrtime() < deadline do end
+end
+
+assert(uv.profile() == false)
+assert(uv.stats() == nil)
+assert(uv.profile(true) == false)
+assert(uv.profile() == true)
+
+local n = 0
+uv.timer():start(1, 1, function(self)
+  busy(5)
+  n = n + 1
+  if n < 3 then return end
+  self:close()
+
+  uv.defer(function()
+    local s = uv.stats()
+
+    local t = assert(s.kinds.timer, "timer stats expected")
+    assert(t.count == 3, t.count)
+    assert(t.max >= 5 and t.total >= 15, t.max)
+    local hist = 0
+    for _, v in ipairs(t.hist) do hist = hist + v end
+    assert(hist == t.count)
+    assert(#t.hist >= 14) -- 5ms is in [4096, 8192) us bucket
+
+    assert(s.types.timer.count == 3)
+    assert(s.lag.count > 0)
+    assert(s.lag.max >= 5, s.lag.max)
+    assert(s.uptime > 0)
+
+    uv.reset_stats()
+    s = uv.stats()
+    assert(s.kinds.timer == nil)
+    assert(s.lag.count == 0)
+
+    TIMER:close(function()
+      assert(uv.stats().kinds.close == nil) -- counted after callback
+
+      -- started here so fs callback can not run before close one
+      uv.fs_stat(".", function()
+        local s = uv.stats()
+        assert(s.kinds.close.count == 1)
+        assert(s.kinds.fs == nil) -- called after callback
+        uv.defer(function()
+          assert(uv.stats().kinds.fs.count == 1)
+          assert(uv.stats().types.request.count >= 1)
+          assert(uv.profile(false) == true)
+          assert(uv.stats() == nil)
+          PASS = true
+        end)
+      end)
+    end)
+  end)
+end)
+
+uv.run()
+
+if not PASS then os.exit(1) end
+
+print("Done!")
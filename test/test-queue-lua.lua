@@ -0,0 +1,90 @@
+local uv  = require "lluv.unsafe"
+
+local PASS = false
+
+local TIMER = uv.timer():start(10000, function()
+  uv.stop()
+end)
+
+local done, expected = 0, 0
+
+local function finish()
+  done = done + 1
+  if done == expected then
+    PASS = true
+    TIMER:close()
+  end
+end
+
+local function test(fn, args, check)
+  expected = expected + 1
+  uv.queue_lua(fn, args, function(...)
+    check(...)
+    finish()
+  end)
+end
+
+local stats = uv.lua_pool{warm = 2, max_idle = 2, preload = {"string"}}
+assert(stats.idle == 2, stats.idle)
+assert(stats.created == 2, stats.created)
+
+-- source chunk
+test("local a, b = ... return a + b, {a = a, list = {b}}", {1, 2}, function(err, sum, t)
+  assert(not err, tostring(err))
+  assert(sum == 3)
+  assert(t.a == 1 and t.list[1] == 2)
+end)
+
+-- function without upvalues
+test(function(s, n) return s:upper(), n == nil, true end, {"abc"}, function(err, s, no_n, flag)
+  assert(not err, tostring(err))
+  assert(s == "ABC")
+  assert(no_n == true and flag == true)
+end)
+
+-- module function
+test("string:rep", {"ab", 3}, function(err, s)
+  assert(not err, tostring(err))
+  assert(s == "ababab")
+end)
+
+-- fixed buffers are copied in both directions
+local buf = uv.buffer(6)
+buf:copy(0, "foobar")
+test("local s = ... return type(s), s", {buf}, function(err, t, s)
+  assert(not err, tostring(err))
+  assert(t == "string" and s == "foobar")
+end)
+
+test("local b = require 'lluv'.buffer(3) b:copy(0, 'xyz') return b", nil, function(err, b)
+  assert(not err, tostring(err))
+  assert(type(b) == "userdata")
+  assert(b:to_s() == "xyz")
+end)
+
+-- runtime error
+test("error('boom')", nil, function(err, res)
+  assert(err, "error expected")
+  assert(string.find(tostring(err), "boom", 1, true), tostring(err))
+  assert(res == nil)
+end)
+
+-- unsupported result
+test("return print", nil, function(err)
+  assert(err, "error expected")
+end)
+
+local up = 1
+assert(not pcall(uv.queue_lua, function() return up end, nil, function() end))
+assert(not pcall(uv.queue_lua, "return 1", {print}, function() end))
+
+uv.run()
+
+stats = uv.lua_pool()
+assert(stats.busy == 0, stats.busy)
+assert(stats.idle <= 2, stats.idle)
+assert(stats.jobs == expected, stats.jobs)
+
+if not PASS then os.exit(1) end
+
+print("Done!")
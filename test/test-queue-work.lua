@@ -0,0 +1,85 @@
+local uv  = require "lluv.unsafe"
+
+local PASS = false
+
+local TIMER = uv.timer():start(10000, function()
+  uv.stop()
+end)
+
+local function hex(s)
+  return (s:gsub('.', function(ch) return string.format('%.2x', ch:byte()) end))
+end
+
+local tests, done, expected = {}, 0, 0
+
+local function finish()
+  done = done + 1
+  if done == expected then
+    PASS = true
+    TIMER:close()
+  end
+end
+
+local function test(kernel, data, result, decode)
+  tests[#tests + 1] = function()
+    uv.queue_work(kernel, data, function(err, res)
+      assert(not err, tostring(err))
+      if decode then res = decode(res) end
+      assert(res == result, kernel .. ': ' .. tostring(res))
+      finish()
+    end)
+  end
+end
+
+local buf = uv.buffer(6)
+buf:copy(0, "foobar")
+
+test("sha256",        "abc",             "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad", hex)
+test("sha256",        {"a", "b", "c"},   "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad", hex)
+test("xxh64",         {},                "ef46db3751d8e999", hex)
+test("xxh64",         {"ab", "c"},       "44bc2cf5ad770999", hex)
+test("crc32c",        {"1234", "56789"}, "e3069283", hex)
+test("base64_encode", buf,               "Zm9vYmFy")
+test("base64_encode", {buf, "!"},        "Zm9vYmFyIQ==")
+test("base64_decode", "Zm9v\r\nYmE=",    "fooba")
+
+expected = #tests + 2
+if uv.work_kernel("deflate") then expected = expected + 1 end
+
+for _, t in ipairs(tests) do t() end
+
+assert(not pcall(uv.queue_work, "no_such_kernel", "", function() end))
+assert(not pcall(uv.queue_work, "sha256", {1}, function() end))
+
+-- invalid input
+uv.queue_work("base64_decode", "Zm9v!", function(err, res)
+  assert(err, "error expected")
+  assert(res == nil)
+  finish()
+end)
+
+-- kernels can be passed as pointers
+uv.queue_work(uv.work_kernel("sha256"), "", function(err, res)
+  assert(not err, tostring(err))
+  assert(hex(res) == "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855")
+  finish()
+end)
+
+if uv.work_kernel("deflate") then
+  local data = string.rep("hello world ", 1000)
+  uv.queue_work("deflate", {data, param = 9}, function(err, res)
+    assert(not err, tostring(err))
+    assert(#res < #data)
+    uv.queue_work("inflate", res, function(err, res)
+      assert(not err, tostring(err))
+      assert(res == data)
+      finish()
+    end)
+  end)
+end
+
+uv.run()
+
+if not PASS then os.exit(1) end
+
+print("Done!")
@@ -0,0 +1,107 @@
+local uv   = require "lluv.unsafe"
+
+local PASS = false
+
+local TIMER = uv.timer():start(10000, function()
+  uv.stop()
+end)
+
+local function u16be(s)
+  return string.char(math.floor(#s / 256), #s % 256) .. s
+end
+
+local function u32le(s)
+  local n = #s
+  return string.char(n % 256, math.floor(n / 256) % 256, math.floor(n / 65536) % 256, 0) .. s
+end
+
+local function Client(host, port)
+  uv.tcp():connect(host, port, function(cli, err)
+    if err then
+      io.stderr:write("Can not connect to server:", tostring(err), "\n")
+      return cli:close()
+    end
+
+    cli:write("line 1\r\nline")
+    uv.timer():start(50, function(t)
+      t:close()
+      cli:write{" 2\nline 3\n", u16be("HELLO"), u16be(""), u32le("WORLD"), u32le("!!!"),
+        "a||b||c||", "tail"}
+      cli:close()
+    end)
+  end)
+end
+
+local result = {}
+
+local function push(...)
+  local t = {...}
+  for i = 1, select('#', ...) do result[#result + 1] = tostring(t[i]) end
+end
+
+local function on_read_multi(cli, err, frames)
+  if err then
+    assert(err:name() == 'EOF', tostring(err))
+    assert(frames == "tail")
+    push("EOF", frames)
+    assert(table.concat(result, ";") == "line 1;line 2;line 3;HELLO;;WORLD;!!!;a;b;c;EOF;tail",
+      table.concat(result, ";"))
+    PASS = true
+    TIMER:close()
+    return cli:close()
+  end
+
+  assert(type(frames) == 'table')
+  for i = 1, #frames do push(frames[i]) end
+end
+
+local function on_read(cli, err, frame)
+  assert(not err, tostring(err))
+
+  push(frame)
+
+  if frame == "line 3" then
+    cli:stop_read()
+    -- rest of data already in buffer
+    cli:start_read_framed({mode = "u16be"}, on_read)
+  elseif frame == "" then
+    cli:start_read_framed({mode = "u32le", max = 16}, on_read)
+  elseif frame == "!!!" then
+    cli:start_read_framed({mode = "delimiter", delimiter = "||", multi = true}, on_read_multi)
+  end
+end
+
+local function on_connection(server, err)
+  if err then
+    io.stderr:write("Can not listen on server:", tostring(err), "\n")
+    return server:close()
+  end
+
+  server
+    :accept()
+    :start_read_framed("line", on_read)
+  server:close()
+end
+
+local function on_bind(server, err)
+  if err then
+    io.stderr:write("Can not bind on server:", tostring(err), "\n")
+    return server:close()
+  end
+
+  local host, port = server:getsockname()
+
+  io.stderr:write("Bind on:", host, ":", port, "\n")
+
+  server:listen(on_connection)
+
+  Client(host, port)
+end
+
+uv.tcp():bind("127.0.0.1", 0, on_bind)
+
+uv.run()
+
+if not PASS then os.exit(1) end
+
+print("Done!")
@@ -0,0 +1,95 @@
+local uv   = require "lluv.unsafe"
+
+local PASS = false
+
+local TIMER = uv.timer():start(10000, function()
+  uv.stop()
+end)
+
+local MESSAGES = {}
+for i = 1, 12 do MESSAGES[i] = string.rep(string.char(64 + i), 10 + i % 3) end
+
+local function run_server(messages, on_connection)
+  local server = uv.tcp()
+  server:bind("127.0.0.1", 0)
+  server:listen(function(server, err)
+    assert(not err, tostring(err))
+    on_connection(server:accept())
+    server:close()
+  end)
+
+  local host, port = server:getsockname()
+
+  uv.tcp():connect(host, port, function(cli, err)
+    assert(not err, tostring(err))
+
+    local i = 0
+    uv.timer():start(1, 5, function(self)
+      i = i + 1
+      if not messages[i] then
+        self:close()
+        return cli:close()
+      end
+      cli:write(messages[i])
+    end)
+  end)
+end
+
+-- ring wraps and keeps data until consumed
+local ring_done, overrun_done = false, false
+
+run_server(MESSAGES, function(cli)
+  -- larger than min tail (quarter of buffer)
+  local buffer, result = uv.buffer(64), {}
+  local pending, wrapped, last_offset = {}, false, -1
+
+  cli:start_read_into(buffer, "ring", function(cli, err, offset, length)
+    if err then
+      assert(err:name() == 'EOF', tostring(err))
+      for _, c in ipairs(pending) do result[#result + 1] = buffer:to_s(c[1], c[2]) end
+      assert(table.concat(result) == table.concat(MESSAGES))
+      assert(wrapped, "ring does not wrap")
+      ring_done = true
+      return cli:close()
+    end
+
+    assert(offset + length <= buffer:size())
+    if offset < last_offset then wrapped = true end
+    last_offset = offset
+
+    -- keep one chunk not consumed so ring have to skip it
+    pending[#pending + 1] = {offset, length}
+    if #pending > 1 then
+      local c = table.remove(pending, 1)
+      result[#result + 1] = buffer:to_s(c[1], c[2])
+      cli:consume(c[2])
+    end
+  end)
+end)
+
+-- without consume ring overflows
+run_server(MESSAGES, function(cli)
+  local buffer = uv.buffer(32)
+
+  cli:start_read_into(buffer, "ring", function(cli, err, offset, length)
+    if err then
+      assert(err:name() == 'ENOBUFS', tostring(err))
+      overrun_done = true
+      return cli:close()
+    end
+  end)
+end)
+
+uv.timer():start(1, 10, function(self)
+  if ring_done and overrun_done then
+    self:close()
+    PASS = true
+    TIMER:close()
+  end
+end)
+
+uv.run()
+
+if not PASS then os.exit(1) end
+
+print("Done!")
@@ -0,0 +1,77 @@
+local uv   = require "lluv.unsafe"
+
+local PASS = false
+
+local TIMER = uv.timer():start(10000, function()
+  uv.stop()
+end)
+
+-- Write requests return to loop free list and reused by next writes.
+-- Each reused request has to keep its own payload and callback.
+
+local ROUNDS, N = 3, 200
+
+local expected, received = {}, {}
+
+local function Client(host, port)
+  uv.tcp():connect(host, port, function(cli, err)
+    assert(not err, tostring(err))
+
+    local round = 0
+
+    local function next_round()
+      round = round + 1
+      if round > ROUNDS then
+        return cli:shutdown(function(cli, err)
+          assert(not err, tostring(err))
+          cli:close()
+        end)
+      end
+
+      local done = 0
+      for i = 1, N do
+        -- payload referenced only by request
+        local msg = string.format("%d:%d;", round, i)
+        expected[#expected + 1] = msg
+        cli:write(msg, function(self, err, ctx)
+          assert(self == cli)
+          assert(not err, tostring(err))
+          assert(ctx == i, "invalid context for reused request")
+          done = done + 1
+          if done == N then next_round() end
+        end, i)
+      end
+      collectgarbage("collect")
+    end
+
+    next_round()
+  end)
+end
+
+uv.tcp():bind("127.0.0.1", 0, function(server, err)
+  assert(not err, tostring(err))
+
+  server:listen(function(server, err)
+    assert(not err, tostring(err))
+
+    server:accept():start_read(function(cli, err, data)
+      if err then
+        assert(err:name() == 'EOF', tostring(err))
+        assert(table.concat(received) == table.concat(expected))
+        PASS = true
+        TIMER:close()
+        return cli:close()
+      end
+      received[#received + 1] = data
+    end)
+    server:close()
+  end)
+
+  Client(server:getsockname())
+end)
+
+uv.run()
+
+if not PASS then os.exit(1) end
+
+print("Done!")
@@ -0,0 +1,85 @@
+local uv  = require "lluv.unsafe"
+
+local PASS = false
+
+local unpack = unpack or table.unpack
+
+local TIMER = uv.timer():start(10000, function()
+  uv.stop()
+end)
+
+local function busy(ms)
+  local deadline = uv.hrtime() + ms * 1000000
+  while uv.hrtime() < deadline do end
+end
+
+local reports = {}
+
+uv.set_slow_callback_threshold(5, function(handle, kind, elapsed, traceback)
+  reports[#reports + 1] = {handle, kind, elapsed, traceback}
+end)
+
+local slow = uv.timer():start(1, function(self)
+  busy(20)
+  self:close()
+end)
+
+uv.timer():start(2, function(self)
+  self:close()
+
+  uv.defer(function()
+    assert(#reports == 1, #reports)
+
+    local handle, kind, elapsed, traceback = unpack(reports[1])
+    assert(handle == slow)
+    assert(kind == "timer", kind)
+    assert(elapsed >= 20, elapsed)
+    assert(type(traceback) == "string")
+    assert(string.find(traceback, "busy", 1, true), traceback)
+
+    TIMER:close()
+    PASS = true
+  end)
+end)
+
+uv.run()
+
+if not PASS then os.exit(1) end
+
+-- interrupt runaway callback
+uv.set_slow_callback_threshold(5, nil, 50)
+
+uv.timer():start(1, function(self)
+  self:close()
+  while true do end
+end)
+
+local ok, err = pcall(uv.run)
+assert(not ok)
+assert(string.find(tostring(err), "interrupted", 1, true), tostring(err))
+
+-- interruption can not be swallowed by pcall and reported to handler
+reports = {}
+
+uv.set_slow_callback_threshold(5, function(handle, kind, elapsed, traceback, interrupted)
+  reports[#reports + 1] = {handle, kind, elapsed, traceback, interrupted}
+end, 50)
+
+local runaway = uv.timer():start(1, function(self)
+  self:close()
+  while true do
+    pcall(function() while true do end end)
+  end
+end)
+
+ok, err = pcall(uv.run)
+assert(not ok)
+assert(string.find(tostring(err), "interrupted", 1, true), tostring(err))
+assert(#reports == 1, #reports)
+assert(reports[1][1] == runaway)
+assert(reports[1][3] >= 50, reports[1][3])
+assert(reports[1][5] == true)
+
+uv.set_slow_callback_threshold(nil)
+
+print("Done!")
@@ -0,0 +1,79 @@
+local uv  = require "lluv.unsafe"
+
+local PASS = false
+
+local TIMER = uv.timer():start(10000, function()
+  uv.stop()
+end)
+
+local host = "127.0.0.1"
+
+do -- basic
+  local sa = uv.sockaddr(host, 5555)
+  assert(sa:family() == "inet")
+  local h, p = sa:name()
+  assert(h == host, h) assert(p == 5555, p)
+  assert(sa == uv.sockaddr(host, 5555))
+  assert(sa ~= uv.sockaddr(host, 5556))
+  assert(uv.sockaddr(sa:key()) == sa)
+  assert(string.find(tostring(sa), "127.0.0.1:5555", 1, true))
+
+  local sa6 = uv.sockaddr("::1", 5555)
+  assert(sa6:family() == "inet6")
+  assert(string.find(tostring(sa6), "[::1]:5555", 1, true))
+
+  assert(not pcall(uv.sockaddr, "not an address", 1))
+end
+
+local udp_done, tcp_done = false, false
+
+local function done()
+  if not (udp_done and tcp_done) then return end
+  PASS = true
+  TIMER:close()
+end
+
+do -- udp
+  local server = uv.udp():bind(host, 0)
+  local dest = uv.sockaddr(server:getsockname())
+  local N, n = 5, 0
+  local cli = uv.udp()
+
+  server:start_recv(function(self, err, data)
+    assert(not err, tostring(err))
+    n = n + 1
+    assert(data == "msg:" .. n, data)
+    if n == N then
+      udp_done = true
+      self:close()
+      cli:close()
+      done()
+    end
+  end)
+
+  assert(cli:try_send(dest, "msg:1") == #"msg:1")
+  for i = 2, N do cli:send(dest, "msg:" .. i) end
+end
+
+do -- tcp
+  local server = uv.tcp():bind(host, 0)
+  server:listen(function(self, err)
+    assert(not err, tostring(err))
+    local cli = self:accept()
+    cli:close()
+    self:close()
+  end)
+
+  uv.tcp():connect(uv.sockaddr(server:getsockname()), function(self, err)
+    assert(not err, tostring(err))
+    tcp_done = true
+    self:close()
+    done()
+  end)
+end
+
+uv.run()
+
+if not PASS then os.exit(1) end
+
+print("Done!")
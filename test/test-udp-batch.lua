@@ -0,0 +1,106 @@
+local uv  = require "lluv.unsafe"
+
+local PASS = false
+
+local TIMER = uv.timer():start(10000, function()
+  uv.stop()
+end)
+
+local host, N = "127.0.0.1", 50
+
+local received, buffer = {}, uv.buffer(64)
+
+-- `recvmmsg` supported since libuv 1.40
+local ok, server = pcall(uv.udp, "recvmmsg")
+if not ok then server = uv.udp() end
+
+server:bind(host, 0)
+local _, port = server:getsockname()
+
+-- libuv cancels queued datagrams when socket is closed
+-- so sender closed from last send callback
+local function send_all(n)
+  local cli = uv.udp()
+  for i = 1, n - 1 do cli:send(host, port, "msg:" .. i) end
+  cli:send(host, port, "msg:" .. n, function(self, err)
+    assert(not err, tostring(err))
+    self:close()
+  end)
+end
+
+local function done()
+  PASS = true
+  TIMER:close()
+  server:close()
+end
+
+-- libuv stops after 32 reads per poll so last partial batch
+-- is not followed by `nothing to read` callback.
+local function test_partial()
+  local M, MAX, sizes = 32, 20, {}
+  received = {}
+
+  server:stop_recv()
+
+  send_all(M)
+
+  -- wait until all datagrams are in socket buffer
+  uv.timer():start(100, function(self)
+    self:close()
+    server:start_recv_batch(MAX, function(self, err, batch, n)
+      assert(not err, tostring(err))
+      sizes[#sizes + 1] = n
+      for i = 1, n * 4, 4 do received[#received + 1] = batch[i] end
+      if #received == M then
+        for i = 1, M do assert(received[i] == "msg:" .. i, received[i]) end
+        for i = 1, #sizes do assert(sizes[i] <= MAX, sizes[i]) end
+        done()
+      end
+    end)
+  end)
+end
+
+local function check_received()
+  assert(#received == N, #received)
+  for i = 1, N do assert(received[i] == "msg:" .. i, received[i]) end
+end
+
+local function on_recv_fbuf(self, err, batch, n)
+  assert(not err, tostring(err))
+  for i = 1, n * 5, 5 do
+    local offset, length, h, p = batch[i], batch[i + 1], batch[i + 2], batch[i + 3]
+    assert(h == host and type(p) == 'number')
+    received[#received + 1] = buffer:to_s(offset, length)
+  end
+  if #received == N then
+    check_received()
+    test_partial()
+  end
+end
+
+local function on_recv(self, err, batch, n)
+  assert(not err, tostring(err))
+  assert(n > 0 and n <= 8)
+  for i = 1, n * 4, 4 do
+    local data, h, p, flags = batch[i], batch[i + 1], batch[i + 2], batch[i + 3]
+    assert(h == host and type(p) == 'number' and type(flags) == 'number')
+    received[#received + 1] = data
+  end
+
+  if #received == N then
+    check_received()
+    received = {}
+    self:start_recv_batch(16, buffer, on_recv_fbuf)
+    send_all(N)
+  end
+end
+
+server:start_recv_batch(8, on_recv)
+
+send_all(N)
+
+uv.run()
+
+if not PASS then os.exit(1) end
+
+print("Done!")
@@ -0,0 +1,60 @@
+local uv  = require "lluv.unsafe"
+
+local PASS = false
+
+local TIMER = uv.timer():start(10000, function()
+  uv.stop()
+end)
+
+local host, N = "127.0.0.1", 10
+
+local server = uv.udp():bind(host, 0)
+local _, port = server:getsockname()
+
+local client = uv.udp():bind(host, 0)
+local _, client_port = client:getsockname()
+
+local keys, echo = {}, 0
+
+-- server echo datagrams using peer key
+server:set_peer_keys(true)
+server:start_recv(function(self, err, data, flags, key, peer_port)
+  assert(not err, tostring(err))
+  assert(type(key) == "string")
+  assert(peer_port == client_port, peer_port)
+  keys[key] = true
+  self:send(key, data)
+end)
+
+-- client get host names from loop cache
+client:start_recv(function(self, err, data, flags, peer_host, peer_port)
+  assert(not err, tostring(err))
+  assert(peer_host == host, peer_host)
+  assert(peer_port == port, peer_port)
+  assert(data == "msg:" .. (echo + 1), data)
+  echo = echo + 1
+
+  if echo == N then
+    local n = 0 for _ in pairs(keys) do n = n + 1 end
+    assert(n == 1, n)
+
+    local stats = uv.addr_stats()
+    assert(stats.hits >= N - 1, stats.hits)
+    assert(stats.size >= 1, stats.size)
+
+    PASS = true
+    TIMER:close()
+    server:close()
+    client:close()
+  end
+end)
+
+for i = 1, N do
+  client:send(host, port, "msg:" .. i)
+end
+
+uv.run()
+
+if not PASS then os.exit(1) end
+
+print("Done!")
@@ -0,0 +1,65 @@
+local uv  = require "lluv.unsafe"
+
+local PASS = false
+
+local TIMER = uv.timer():start(10000, function()
+  uv.stop()
+end)
+
+local host, N = "127.0.0.1", 60
+
+local server = uv.udp():bind(host, 0)
+local _, port = server:getsockname()
+local dest = uv.sockaddr(host, port)
+
+local messages, expected = {}, {}
+for i = 1, N do
+  local data = "msg:" .. i
+  if i % 3 == 0 then
+    messages[i] = {host, port, data}
+  elseif i % 3 == 1 then
+    messages[i] = {dest, {"msg:", tostring(i)}}
+  else
+    messages[i] = {dest:key(), data}
+  end
+  expected[data] = true
+end
+
+-- invalid address reported as error for this message only
+messages[N + 1] = {"not an address", 1, "bad"}
+
+local received, sent = 0, false
+
+local function done()
+  if not (sent and received == N) then return end
+  PASS = true
+  TIMER:close()
+  server:close()
+end
+
+server:start_recv(function(self, err, data)
+  assert(not err, tostring(err))
+  assert(expected[data], data)
+  expected[data] = nil
+  received = received + 1
+  done()
+end)
+
+local cli = uv.udp()
+
+cli:send_batch(messages, function(self, errors, ctx)
+  assert(self == cli)
+  assert(ctx == "ctx")
+  assert(type(errors) == "table")
+  local n = 0 for i, e in pairs(errors) do n = n + 1; assert(i == N + 1, i) end
+  assert(n == 1, n)
+  sent = true
+  self:close()
+  done()
+end, "ctx")
+
+uv.run()
+
+if not PASS then os.exit(1) end
+
+print("Done!")
@@ -0,0 +1,69 @@
+local uv  = require "lluv.unsafe"
+
+local PASS, FAIL_PASS = false, false
+
+local TIMER = uv.timer():start(10000, function()
+  uv.stop()
+end)
+
+local function test_echo(done)
+  local N, replies = 3, 0
+
+  local pool = uv.worker_pool{n = N, module = "worker_echo"}
+  assert(pool:size() == N)
+
+  assert(not pcall(pool.send, pool, 1, function() end))
+  assert(not pcall(pool.send, pool, N + 1, 1))
+
+  pool:on_message(function(self, err, id, wid, i, str, t)
+    assert(self == pool)
+    assert(not err, tostring(err))
+    assert(id == wid and id == i, id)
+    assert(str == "hello")
+    assert(t.a[1] == 1 and t.a[3] == 3 and t.b == true and t[1.5] == -1)
+    replies = replies + 1
+    if replies == N then
+      self:close(function(self)
+        assert(self == pool)
+        done()
+      end)
+    end
+  end)
+
+  for i = 1, N do
+    pool:send(i, i, "hello", {a = {1, 2, 3}, b = true, [1.5] = -1})
+  end
+end
+
+local function test_error(done)
+  local pool = uv.worker_pool{n = 1, module = "lluv_worker_no_such_module"}
+
+  pool:on_message(function(self, err, id)
+    assert(err, "error expected")
+    assert(id == 1)
+    FAIL_PASS = true
+    self:close(done)
+  end)
+end
+
+test_echo(function()
+  test_error(function()
+    PASS = true
+    TIMER:close()
+  end)
+end)
+
+uv.run()
+
+if not (PASS and FAIL_PASS) then os.exit(1) end
+
+-- closing loop stops workers and releases open pool
+do
+  local loop = uv.loop()
+  local pool = uv.worker_pool(loop, {n = 2, module = "worker_echo"})
+  pool:post("hello")
+  loop:close()
+  assert(not pcall(pool.size, pool))
+end
+
+print("Done!")
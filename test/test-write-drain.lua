@@ -0,0 +1,100 @@
+local uv   = require "lluv.unsafe"
+
+local PASS_DRAIN, PASS_ERROR = false, false
+
+local TIMER = uv.timer():start(10000, function()
+  uv.stop()
+end)
+
+local CHUNK  = ("x"):rep(64 * 1024)
+local CHUNKS = 256
+
+local function done()
+  if PASS_DRAIN and PASS_ERROR then TIMER:close() end
+end
+
+local function server(on_connection, on_bind)
+  uv.tcp():bind("127.0.0.1", 0, function(srv, err)
+    if err then
+      io.stderr:write("Can not bind on server:", tostring(err), "\n")
+      return srv:close()
+    end
+
+    srv:listen(function(srv, err)
+      if err then
+        io.stderr:write("Can not listen on server:", tostring(err), "\n")
+        return srv:close()
+      end
+      on_connection(srv:accept())
+      srv:close()
+    end)
+
+    on_bind(srv:getsockname())
+  end)
+end
+
+-- write without callback and notification when queue drains
+server(function(cli)
+  local total = 0
+  cli:start_read(function(cli, err, data)
+    if err then
+      assert(err:name() == 'EOF', tostring(err))
+      assert(total == #CHUNK * CHUNKS, total)
+      PASS_DRAIN = true
+      done()
+      return cli:close()
+    end
+    total = total + #data
+  end)
+end, function(host, port)
+  uv.tcp():connect(host, port, function(cli, err)
+    assert(not err, tostring(err))
+
+    local drained = 0
+    cli:on_drain(function(self, err)
+      assert(self == cli)
+      assert(err == nil, tostring(err))
+      assert(cli:get_write_queue_size() == 0)
+      drained = drained + 1
+      cli:close()
+    end)
+
+    for i = 1, CHUNKS do cli:write(CHUNK) end
+
+    assert(cli:get_write_queue_size() > 0)
+    assert(drained == 0)
+  end)
+end)
+
+-- error of write without callback reported to drain callback
+server(function(cli)
+  cli:close()
+end, function(host, port)
+  uv.tcp():connect(host, port, function(cli, err)
+    assert(not err, tostring(err))
+
+    local errors = 0
+    cli:on_drain(function(self, err)
+      assert(self == cli)
+      if not err then return end
+      errors = errors + 1
+      assert(errors == 1)
+      PASS_ERROR = true
+      done()
+    end)
+
+    uv.timer():start(0, 10, function(timer)
+      if PASS_ERROR or not cli:writable() then
+        timer:close()
+        return cli:close()
+      end
+      cli:write(CHUNK)
+    end)
+  end)
+end)
+
+uv.run()
+
+if not (PASS_DRAIN and PASS_ERROR) then os.exit(1) end
+
+print("Done!")
@@ -0,0 +1,91 @@
+local uv   = require "lluv.unsafe"
+
+local PASS = false
+
+local TIMER = uv.timer():start(10000, function()
+  uv.stop()
+end)
+
+local BIG = string.rep("x", 4 * 1024 * 1024)
+
+local EXPECTED = "HELLO, WORLD!!!" .. BIG .. "END"
+
+local function Client(host, port)
+  uv.tcp():connect(host, port, function(cli, err)
+    if err then
+      io.stderr:write("Can not connect to server:", tostring(err), "\n")
+      return cli:close()
+    end
+
+    local n, idx, off = cli:try_write{"HELLO", ", ", "WORLD", "!!!"}
+    assert(n == 15, tostring(n))
+    assert(idx == nil and off == nil)
+
+    local called = false
+    -- kernel buffer can not hold whole string so tail should be queued
+    cli:write_fast({BIG}, function(cli, err, ctx)
+      assert(not err, tostring(err))
+      assert(ctx == 'ctx')
+      called = true
+    end, 'ctx')
+
+    cli:write_fast("END", function(cli, err)
+      assert(not err, tostring(err))
+      assert(called)
+      cli:close()
+    end)
+  end)
+end
+
+local result = {}
+
+local function on_read(cli, err, data)
+  if err then
+    if err:name() == 'EOF' then
+      io.stderr:write("Read done.\n")
+      assert(table.concat(result) == EXPECTED)
+      PASS = true
+      TIMER:close()
+    else
+      io.stderr:write("Can not read data:", tostring(err), "\n")
+    end
+    return cli:close()
+  end
+
+  result[#result + 1] = data
+end
+
+local function on_connection(server, err)
+  if err then
+    io.stderr:write("Can not listen on server:", tostring(err), "\n")
+    return server:close()
+  end
+
+  server
+    :accept()
+    :start_read(on_read)
+  server:close()
+end
+
+local function on_bind(server, err)
+  if err then
+    io.stderr:write("Can not bind on server:", tostring(err), "\n")
+    return server:close()
+  end
+
+  local host, port = server:getsockname()
+
+  io.stderr:write("Bind on:", host, ":", port, "\n")
+
+  server:listen(on_connection)
+
+  Client(host, port)
+end
+
+uv.tcp():bind("127.0.0.1", 0, on_bind)
+
+uv.run()
+
+if not PASS then os.exit(1) end
+
+print("Done!")
@@ -0,0 +1,11 @@
+-- Worker module for test-async.lua
+-- Sends `n` payloads to async handle from worker thread.
+
+local uv = require "lluv"
+
+return function(port, id)
+  port:on_message(function(self, err, ptr, n)
+    if err then return end
+    for i = 1, n do uv.async_send(ptr, id, i) end
+  end)
+end
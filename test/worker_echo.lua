@@ -0,0 +1,9 @@
+-- Worker module for test-worker-pool.lua
+-- Sends back all received values prefixed with worker id.
+
+return function(port, id)
+  port:on_message(function(self, err, ...)
+    if err then return end
+    self:send(id, ...)
+  end)
+end